@@ -9,6 +9,7 @@
 #include "lex.h"
 #include "types.h"
 #include "errors.h"
+#include "profile.h"
 
 #define AST_NODES              \
     NODE(Node)                 \
@@ -124,6 +125,10 @@
 AST_NODES
 #undef NODE
 
+// stb_ds hash maps keyed by the id of an interned list of polymorphic solutions.
+// See intern_poly_solutions in polymorph.h.
+#define PolySolutionTable(T) struct { u64 key; T value; } *
+
 typedef struct Package Package;
 
 typedef struct Scope {
@@ -1036,7 +1041,7 @@ struct AstPolyStructType {
 
     Scope *scope;
     bh_arr(AstPolyStructParam) poly_params;
-    Table(AstStructType *) concrete_structs;
+    PolySolutionTable(AstStructType *) concrete_structs;
 
     AstStructType* base_struct;
 };
@@ -1090,7 +1095,7 @@ struct AstPolyUnionType {
 
     Scope *scope;
     bh_arr(AstPolyStructParam) poly_params;
-    Table(AstUnionType *) concrete_unions;
+    PolySolutionTable(AstUnionType *) concrete_unions;
 
     AstUnionType* base_union;
 };
@@ -1134,7 +1139,7 @@ struct AstDistinctType {
 // Top level nodes
 struct AstBinding       { AstTyped_base; AstNode* node; OnyxToken *documentation; };
 struct AstAlias         { AstTyped_base; AstTyped* alias; };
-struct AstInclude       { AstNode_base;  AstTyped* name_node; char* name; b32 recursive: 1; };
+struct AstInclude       { AstNode_base;  AstTyped* name_node; char* name; b32 recursive: 1; b32 prefetched: 1; };
 struct AstInjection     {
     AstTyped_base;
     AstTyped* full_loc;
@@ -1191,11 +1196,6 @@ struct AstOverloadedFunction {
 
     bh_arr(OverloadOption) overloads;
 
-    // CLEANUP: This is unused right now, but should be used to cache
-    // the complete set of overloads that can be used by an overloaded
-    // function.
-    bh_imap            all_overloads;
-
     AstType *expected_return_node;
     Type    *expected_return_type;
 
@@ -1423,7 +1423,7 @@ struct AstFunction {
 
     bh_arr(AstPolySolution) known_slns;
 
-    Table(AstSolidifiedFunction) concrete_funcs;
+    PolySolutionTable(AstSolidifiedFunction) concrete_funcs;
     bh_imap active_queries;
 
     bh_arr(AstNode *) nodes_that_need_entities_after_clone;
@@ -1440,6 +1440,7 @@ struct AstFunction {
     b32 is_foreign         : 1;
     b32 is_foreign_dyncall : 1;
     b32 is_intrinsic       : 1;
+    b32 is_inline          : 1;
 };
 
 struct AstCaptureBlock {
@@ -1675,12 +1676,16 @@ typedef struct Entity {
     u32 micro_attempts;
 
     b32 entered_in_queue : 1;
+    b32 parked : 1;
 
     Package *package;
     Scope *scope;
 
-    // TODO: This is incomplete. Add proper cycle detection and halting.
-    // struct Entity *waiting_on;
+    // NOTE: The entity this entity was blocked on the last time it yielded, if it
+    // is known. A yielding entity with a dependency is parked until the dependency
+    // changes state, instead of being retried over and over.
+    struct Entity *waiting_on;
+    bh_arr(struct Entity *) waiters;
 
     union {
         AstDirectiveError     *error;
@@ -1711,10 +1716,22 @@ typedef struct Entity {
 
 typedef struct EntityHeap {
     bh_arena entity_arena;
+    bh_allocator entity_alloc;
+    AllocatorStats entity_alloc_stats;
     bh_arr(Entity *) entities;
     bh_arr(Entity *) quick_unsorted_entities;
     i32 next_id;
 
+    // NOTE: The entity being processed right now. Dependencies recorded with
+    // entity_wait_on are attached to this entity.
+    Entity *current;
+
+    // NOTE: Entities that are waiting on a dependency, and therefore not in the
+    // heap. This can contain entities that have since been woken up.
+    bh_arr(Entity *) parked_entities;
+    i32 parked_count;
+    b32 parking_disabled;
+
     i32 state_count[Entity_State_Count];
     i32 type_count[Entity_Type_Count];
 
@@ -1731,6 +1748,11 @@ void entity_change_type(EntityHeap* entities, Entity *ent, EntityType new_type);
 void entity_change_state(EntityHeap* entities, Entity *ent, EntityState new_state);
 void entity_heap_add_job(EntityHeap *entities, enum TypeMatch (*func)(void *), void *job_data);
 
+void entity_wait_on(EntityHeap *entities, Entity *dependency);
+b32 entity_heap_park(EntityHeap *entities, Entity *e);
+void entity_heap_wake_waiters(EntityHeap *entities, Entity *dependency);
+i32 entity_heap_unpark_all(EntityHeap *entities);
+
 // If target_arr is null, the entities will be placed directly in the heap.
 void add_entities_for_node(bh_arr(Entity *)* target_arr, AstNode* node, Scope* scope, Package* package);
 
@@ -1813,8 +1835,33 @@ typedef struct CheckerData {
     bh_arr(Type **) expected_return_type_stack;
 } CheckerData;
 
+// The flattened list of options reachable from a set of overloads, and a memo of
+// which option matched a given list of argument types. See get_overload_set.
+typedef struct OverloadSet {
+    u32 generation;
+    bh_arr(AstTyped *) options;
+    Table(AstTyped *) matches;
+} OverloadSet;
+
+// A list of polymorphic solutions that has been interned, so that it can be
+// identified by its id instead of by comparing every solution in it.
+typedef struct PolySolutionTuple {
+    u32 id;
+    bh_arr(AstPolySolution) slns;
+} PolySolutionTuple;
+
 typedef struct ContextCaches {
     bh_imap implicit_cast_to_bool_cache;
+
+    // Maps a bh_arr(OverloadOption) to its OverloadSet. Every set is rebuilt
+    // once overload_generation changes, which happens whenever an option is
+    // added anywhere, because sets include the options of nested groups.
+    bh_imap overload_sets;
+    u32 overload_generation;
+
+    // Interned lists of polymorphic solutions, keyed by their hash.
+    struct { u64 key; PolySolutionTuple *value; } *poly_solution_tuples;
+    u32 next_poly_solution_tuple_id;
 } ContextCaches;
 
 typedef struct DefinedVariable {
@@ -1852,14 +1899,23 @@ struct CompileOptions {
 
     b32 running_perf : 1;
 
+    // 0 disables the passes in wasm_optimize.h.
+    u32 optimization_level : 2;
+
     Runtime runtime;
 
+    // Number of threads used to read and lex source files. 1 disables the worker pool.
+    i32 job_count;
+
     bh_arr(const char *) included_folders;
     bh_arr(const char *) files;
     const char* target_file;
     const char* documentation_file;
     const char* symbol_info_file;
     const char* help_subcommand;
+    const char* cache_dir;
+    const char* profile_file;
+    const char* run_profile_file;
     bh_arr(DefinedVariable) defined_variables;
 
     b32 debug_session;
@@ -1887,6 +1943,10 @@ struct Context {
     // NOTE: This is defined in onyxwasm.h
     struct OnyxWasmModule* wasm_module;
 
+    // NOTE: Set when the output was found in the build cache (see cache.h),
+    // in which case nothing was compiled.
+    bh_buffer cached_output;
+
     // NOTE: All definitions (bindings, injections, aliases) are
     // present in this list when generating CTags.
     bh_arr(AstNode *) tag_locations;
@@ -1910,6 +1970,14 @@ struct Context {
     u64 microseconds_per_state[Entity_State_Count];
     u64 microseconds_per_type[Entity_Type_Count];
 
+    // NOTE: Memory statistics, printed with -V and sampled in the profile.
+    AllocatorStats ast_alloc_stats;
+    u64 ast_nodes_per_kind[Ast_Kind_Count];
+    u64 ast_bytes_per_kind[Ast_Kind_Count];
+    u32 solidified_function_count;
+    u32 solidified_struct_count;
+    u32 solidified_union_count;
+
     u32 cycle_almost_detected : 2;
     b32 cycle_detected : 1;
 
@@ -0,0 +1,39 @@
+#ifndef ONYXCACHE_H
+#define ONYXCACHE_H
+
+#include "bh.h"
+#include "astnodes.h"
+
+// Build cache
+//
+// When a cache directory is given with --cache-dir, the output of a successful
+// compilation is stored there, together with a manifest of everything that the
+// compilation read: the content hash of every loaded source file, every file
+// included with #file_contents, the listing of every folder read by #load_all,
+// and every path that a #load searched without finding a file.
+//
+// The cache entry is chosen by a key built from the compiler version and every
+// option that can change the output. A later compilation with the same key
+// checks the manifest, and if none of the inputs changed, the stored output is
+// used instead of compiling again.
+
+// Computes the cache key. This has to be called before compiling, because
+// compiling can modify the options (e.g. #load_path adds to included_folders).
+void compile_cache_init(CompileOptions *opts);
+
+// Returns 1 and fills `out_code` if the stored output can be used.
+b32 compile_cache_lookup(bh_buffer *out_code);
+
+// Records that #load_all read `folder`. Adding or removing a file in the folder
+// invalidates the cache entry.
+void compile_cache_track_folder(const char *folder);
+
+// Records the paths that were searched before `name` was found (or not found) in
+// the included folders. Creating a file at one of them invalidates the cache entry,
+// because it would shadow the file that was loaded.
+void compile_cache_track_lookup(const char *name, const char *suffix);
+
+// Stores `code` as the output of the compilation that just finished.
+void compile_cache_store(bh_buffer code);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef ONYXFRONTEND_H
+#define ONYXFRONTEND_H
+
+#include "bh.h"
+#include "lex.h"
+#include "astnodes.h"
+
+// Front end worker pool
+//
+// When a file is discovered (i.e. a #load entity enters the entity heap), its
+// path is resolved and it is handed to a pool of worker threads that read and
+// tokenize it. When the main thread gets to the #load, it picks up the already
+// tokenized file instead of doing the work itself.
+//
+// Parsing still happens on the main thread, in the same order as before, because
+// the parser introduces symbols, packages and entities as it goes. This means the
+// generated entities (and the output binary) do not depend on the number of jobs.
+
+void frontend_pool_init(i32 job_count);
+void frontend_pool_free();
+
+void frontend_prefetch_include(AstInclude *include);
+
+// Returns 1 if `filename` was prefetched without error. `out_fc` and `out_tokenizer`
+// are then filled with the contents of the file and the lexed tokens. If this
+// returns 0, the file must be read and lexed on the calling thread.
+b32 frontend_take_prefetched(char *filename, bh_file_contents *out_fc, OnyxTokenizer *out_tokenizer);
+
+// Resident mode
+//
+// Used by `onyx watch`, where the compiler stays alive between compilations.
+// Every file that is read and lexed without error is kept, together with its
+// tokens, until the compiler exits. The next compilation uses the kept copy of
+// every file whose size and modification time did not change, so only modified
+// files are read and lexed again. In this mode, frontend_take_prefetched also
+// loads files that were not prefetched.
+void frontend_resident_enable();
+void frontend_resident_free();
+
+// Returns 1 if none of the files used by the last compilation have different
+// contents on disk. Files that were saved without changes do not count.
+b32 frontend_resident_unchanged();
+
+#endif
@@ -117,6 +117,10 @@ typedef struct OnyxTokenizer {
 
     b32 optional_semicolons : 1;
     b32 insert_semicolon: 1;
+
+    // Set when lexing on a front end worker thread. See frontend.h.
+    b32 defer_errors : 1;
+    b32 encountered_error : 1;
 } OnyxTokenizer;
 
 const char *token_type_name(TokenType tkn_type);
@@ -0,0 +1,78 @@
+#ifndef ONYXPROFILE_H
+#define ONYXPROFILE_H
+
+#include "bh.h"
+
+// Compilation profile
+//
+// With --profile <file>, the compiler records a timeline of the compilation and
+// writes it as a Chrome trace-event JSON file, which can be opened with
+// chrome://tracing, Perfetto or speedscope. The timeline contains:
+//
+//  - every time an entity is processed, with its phase, location and whether it yielded,
+//  - the reading and lexing of every file, on the thread that did it,
+//  - the parsing of every file,
+//  - the code generation of every procedure, with its size in instructions,
+//    including every solidified polymorphic procedure,
+//  - linking and optimizing the module,
+//  - counters for the memory used by the compiler, sampled while entities are processed.
+//
+// Everything is recorded on the main thread. Work done by the front end workers is
+// timed by the workers and recorded once the main thread picks up the result.
+
+void profile_init(const char *filename);
+b32  profile_enabled();
+
+// Writes the profile to the file given to profile_init, and frees it.
+void profile_write_and_free();
+
+// Microseconds since profile_init.
+u64  profile_now();
+
+// Records a span from `start` to `end`. `thread` is 0 for the main thread, and 1 + the
+// index of the worker otherwise. `name` is copied. `args` is copied too, and is either NULL
+// or the body of a JSON object, like "\"size\": 12". Strings in it must be escaped with
+// profile_json_string.
+void profile_span(const char *category, const char *name, u64 start, u64 end, i32 thread, const char *args);
+
+// Records the values of counters at `time`, which are drawn as a graph named `name`.
+// `args` is copied, and is the body of a JSON object of numbers, like "\"bytes\": 12".
+void profile_counter(const char *name, u64 time, const char *args);
+
+// Returns `str` as a quoted and escaped JSON string, allocated from the scratch allocator.
+char *profile_json_string(const char *str, i32 length);
+
+
+// Allocator statistics
+//
+// A counting allocator forwards to `backing`, and counts the allocations made through it.
+// A resize counts as an allocation of the new size. Nothing is subtracted when memory is
+// freed, so this is mostly useful for arenas, which do not free individual allocations.
+//
+// Live bytes are the bytes allocated since the backing allocator was last reset, and the
+// peak is the most that were live at once. When `wraps_around` is set, the backing
+// allocator is a ring like bh_scratch, and it has started over from the beginning
+// whenever it returns memory below the previous allocation.
+typedef struct AllocatorStats {
+    bh_allocator backing;
+    u64 allocation_count;
+    u64 total_bytes;
+    u64 live_bytes;
+    u64 peak_bytes;
+
+    b32 wraps_around;
+    ptr last_allocation;
+} AllocatorStats;
+
+bh_allocator counting_allocator(AllocatorStats *stats, bh_allocator backing);
+
+// Called when the backing allocator is cleared, so nothing allocated through it is live.
+void counting_allocator_reset(AllocatorStats *stats);
+
+// Bytes reserved by an arena, which is every chunk it has allocated so far.
+u64 arena_reserved_bytes(bh_arena *arena);
+
+// The peak resident set size of the process, in bytes, or 0 if it is not known.
+u64 peak_resident_bytes();
+
+#endif
@@ -32,6 +32,7 @@ Scope *get_scope_from_node(AstNode *node);
 Scope *get_scope_from_node_or_create(AstNode *node);
 
 void build_all_overload_options(bh_arr(OverloadOption) overloads, bh_imap* all_overloads);
+OverloadSet *get_overload_set(bh_arr(OverloadOption) overloads);
 
 u32 char_to_base16_value(char x);
 
@@ -0,0 +1,353 @@
+#include "cache.h"
+#include "utils.h"
+#include "errors.h"
+#include "wasm_emit.h"
+
+#if defined(_BH_LINUX) || defined(_BH_DARWIN)
+    #include <sys/stat.h>
+#endif
+
+#ifdef _BH_WINDOWS
+    #include <direct.h>
+    #define DIR_SEPARATOR '\\'
+#else
+    #define DIR_SEPARATOR '/'
+#endif
+
+#define CACHE_MANIFEST_HEADER "onyx-cache 1"
+
+typedef struct CacheFolder {
+    char *path;
+    u64 hash;
+} CacheFolder;
+
+typedef struct CompileCache {
+    b32 enabled;
+    u64 key;
+
+    char *manifest_path;
+    char *output_path;
+
+    bh_arr(CacheFolder) folders;
+
+    // Paths that were searched for a #load and did not exist. If one of them is
+    // created, it would be loaded instead of the file that was found later on.
+    Table(u8) missing;
+} CompileCache;
+
+static CompileCache cache;
+
+// FNV-1a
+static u64 cache_hash(u64 hash, const void *data, u64 length) {
+    const u8 *bytes = data;
+    fori (i, 0, (i64) length) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static u64 cache_hash_string(u64 hash, const char *str) {
+    if (str == NULL) str = "";
+
+    // The terminating zero is included so consecutive strings cannot run together.
+    return cache_hash(hash, str, strlen(str) + 1);
+}
+
+static u64 cache_hash_full_path(u64 hash, const char *path) {
+    // If the path does not exist, it is returned as is.
+    char *full_path = bh_path_get_full_name(path, bh_heap_allocator());
+    hash = cache_hash_string(hash, full_path);
+    if (full_path != path) bh_free(bh_heap_allocator(), full_path);
+    return hash;
+}
+
+static b32 cache_hash_file(const char *path, u64 *out_hash) {
+    if (!bh_file_exists(path)) return 0;
+
+    bh_file_contents contents = bh_file_read_contents(bh_heap_allocator(), path);
+    *out_hash = cache_hash(0xcbf29ce484222325ull, contents.data, contents.length);
+
+    bh_file_contents_free(&contents);
+    bh_free(bh_heap_allocator(), (char *) contents.filename);
+    return 1;
+}
+
+//
+// The order of directory entries is not defined, so the hashes of the entries are
+// combined in a way that does not depend on the order.
+static b32 cache_hash_folder(const char *folder, u64 *out_hash) {
+    bh_dir dir = bh_dir_open((char *) folder);
+    if (dir == NULL) return 0;
+
+    u64 hash = 0;
+    bh_dirent entry;
+    while (bh_dir_read(dir, &entry)) {
+        if (!strcmp(entry.name, ".") || !strcmp(entry.name, "..")) continue;
+
+        u64 entry_hash = cache_hash(0xcbf29ce484222325ull, &entry.type, sizeof(entry.type));
+        entry_hash = cache_hash_string(entry_hash, entry.name);
+        hash += entry_hash;
+    }
+
+    bh_dir_close(dir);
+
+    *out_hash = hash;
+    return 1;
+}
+
+static void cache_create_folder(const char *folder) {
+    #if defined(_BH_LINUX) || defined(_BH_DARWIN)
+    mkdir(folder, 0755);
+    #endif
+
+    #ifdef _BH_WINDOWS
+    _mkdir(folder);
+    #endif
+}
+
+void compile_cache_init(CompileOptions *opts) {
+    bh_arr_each(CacheFolder, cf, cache.folders) bh_free(bh_heap_allocator(), cf->path);
+    if (cache.folders) bh_arr_free(cache.folders);
+    if (cache.manifest_path) bh_free(bh_heap_allocator(), cache.manifest_path);
+    if (cache.output_path) bh_free(bh_heap_allocator(), cache.output_path);
+    if (cache.missing) shfree(cache.missing);
+    memset(&cache, 0, sizeof(cache));
+
+    if (opts->cache_dir == NULL) return;
+
+    // Only building and running produce an output worth caching.
+    if (opts->action != ONYX_COMPILE_ACTION_COMPILE && opts->action != ONYX_COMPILE_ACTION_RUN) return;
+
+    // These produce extra output as a side effect of compiling, which a cached
+    // build would not produce.
+    if (opts->documentation_file || opts->generate_tag_file || opts->generate_symbol_info_file) return;
+    if (opts->print_function_mappings || opts->print_static_if_results) return;
+    if (opts->debug_session) return;
+
+    // This configuration writes a second file next to the output.
+    if (opts->use_multi_threading && !opts->use_post_mvp_features) return;
+
+    u64 key = 0xcbf29ce484222325ull;
+    key = cache_hash_string(key, CACHE_MANIFEST_HEADER);
+    key = cache_hash_string(key, __DATE__ " " __TIME__);
+
+    u32 flags[] = {
+        opts->runtime,
+        opts->use_post_mvp_features,
+        opts->use_multi_threading,
+        opts->generate_foreign_info,
+        opts->generate_type_info,
+        opts->generate_method_info,
+        opts->no_core,
+        opts->no_stale_code,
+        opts->no_file_contents,
+        opts->enable_optional_semicolons,
+        opts->debug_info_enabled,
+        opts->stack_trace_enabled,
+        opts->optimization_level,
+    };
+    key = cache_hash(key, flags, sizeof(flags));
+
+    bh_arr_each(const char *, folder, opts->included_folders) key = cache_hash_full_path(key, *folder);
+    key = cache_hash_string(key, "");
+
+    bh_arr_each(const char *, file, opts->files) key = cache_hash_full_path(key, *file);
+    key = cache_hash_string(key, "");
+
+    bh_arr_each(DefinedVariable, dv, opts->defined_variables) {
+        key = cache_hash_string(key, dv->key);
+        key = cache_hash_string(key, dv->value);
+    }
+
+    cache_create_folder(opts->cache_dir);
+
+    cache.enabled = 1;
+    cache.key = key;
+    char key_text[17];
+    snprintf(key_text, 17, "%016llx", (unsigned long long) key);
+
+    cache.manifest_path = bh_aprintf(bh_heap_allocator(), "%s/%s.manifest", opts->cache_dir, key_text);
+    cache.output_path   = bh_aprintf(bh_heap_allocator(), "%s/%s.wasm", opts->cache_dir, key_text);
+    bh_arr_new(bh_heap_allocator(), cache.folders, 4);
+    sh_new_arena(cache.missing);
+}
+
+static b32 cache_manifest_is_current(bh_file_contents *manifest) {
+    char *line = manifest->data;
+    char *end  = line + manifest->length;
+    b32 header_matched = 0;
+
+    while (line < end) {
+        char *newline = memchr(line, '\n', end - line);
+        if (newline == NULL) return 0;
+        *newline = '\0';
+
+        if (!header_matched) {
+            if (strcmp(line, CACHE_MANIFEST_HEADER)) return 0;
+            header_matched = 1;
+
+        } else if (!strncmp(line, "file ", 5) || !strncmp(line, "dir ", 4)) {
+            b32 is_file = line[0] == 'f';
+            char *hash_text = line + (is_file ? 5 : 4);
+
+            char *path;
+            u64 expected_hash = strtoull(hash_text, &path, 16);
+            if (*path != ' ') return 0;
+            path += 1;
+
+            u64 actual_hash;
+            if (is_file) {
+                if (!cache_hash_file(path, &actual_hash)) return 0;
+            } else {
+                if (!cache_hash_folder(path, &actual_hash)) return 0;
+            }
+
+            if (actual_hash != expected_hash) return 0;
+
+        } else if (!strncmp(line, "missing ", 8)) {
+            if (bh_file_exists(line + 8)) return 0;
+
+        } else {
+            return 0;
+        }
+
+        line = newline + 1;
+    }
+
+    return header_matched;
+}
+
+b32 compile_cache_lookup(bh_buffer *out_code) {
+    if (!cache.enabled) return 0;
+    if (!bh_file_exists(cache.manifest_path) || !bh_file_exists(cache.output_path)) return 0;
+
+    bh_file_contents manifest = bh_file_read_contents(bh_heap_allocator(), cache.manifest_path);
+    b32 current = cache_manifest_is_current(&manifest);
+    bh_file_contents_free(&manifest);
+    bh_free(bh_heap_allocator(), (char *) manifest.filename);
+
+    if (!current) return 0;
+
+    bh_file_contents output = bh_file_read_contents(bh_heap_allocator(), cache.output_path);
+    bh_free(bh_heap_allocator(), (char *) output.filename);
+    if (output.data == NULL) return 0;
+
+    out_code->allocator = bh_heap_allocator();
+    out_code->data      = output.data;
+    out_code->length    = output.length;
+    out_code->capacity  = output.length;
+    return 1;
+}
+
+void compile_cache_track_folder(const char *folder) {
+    if (!cache.enabled) return;
+
+    CacheFolder cf;
+    cf.path = bh_path_get_full_name(folder, bh_heap_allocator());
+    if (cf.path == folder) cf.path = bh_strdup(bh_heap_allocator(), (char *) folder);
+
+    if (!cache_hash_folder(cf.path, &cf.hash)) {
+        bh_free(bh_heap_allocator(), cf.path);
+        return;
+    }
+
+    bh_arr_push(cache.folders, cf);
+}
+
+//
+// This follows the search that bh_lookup_file does through the included folders.
+void compile_cache_track_lookup(const char *name, const char *suffix) {
+    if (!cache.enabled) return;
+
+    // These are only looked for next to the including file.
+    if (bh_str_starts_with((char *) name, "./")) return;
+
+    char fn[256];
+    if (!bh_str_ends_with((char *) name, (char *) suffix)) bh_snprintf(fn, 256, "%s%s", name, suffix);
+    else                                                    bh_snprintf(fn, 256, "%s", name);
+    bh_path_convert_separators(fn);
+
+    char path[512];
+    bh_arr_each(const char *, folder, context.options->included_folders) {
+        if ((*folder)[strlen(*folder) - 1] != DIR_SEPARATOR)
+            bh_snprintf(path, 512, "%s%c%s", *folder, DIR_SEPARATOR, fn);
+        else
+            bh_snprintf(path, 512, "%s%s", *folder, fn);
+
+        if (bh_file_exists(path)) return;
+
+        shput(cache.missing, path, 1);
+    }
+}
+
+static void cache_manifest_add(bh_buffer *manifest, const char *kind, u64 hash, const char *path) {
+    char hash_text[17];
+    snprintf(hash_text, 17, "%016llx", (unsigned long long) hash);
+
+    char *line = bh_aprintf(global_scratch_allocator, "%s %s %s\n", kind, hash_text, path);
+    bh_buffer_append(manifest, line, strlen(line));
+}
+
+static b32 cache_write_file(const char *path, void *data, isize length) {
+    char *temp_path = bh_aprintf(global_scratch_allocator, "%s.tmp", path);
+
+    bh_file file;
+    if (bh_file_create(&file, temp_path) != BH_FILE_ERROR_NONE) return 0;
+
+    bh_file_write(&file, data, length);
+    bh_file_close(&file);
+
+    // Rename over the old file, so another compiler reading the cache at the same
+    // time never sees a partially written file.
+    bh_file_remove(path);
+    return rename(temp_path, path) == 0;
+}
+
+void compile_cache_store(bh_buffer code) {
+    if (!cache.enabled) return;
+
+    // Only successful compilations are stored. Warnings are not reprinted when
+    // the cached output is used.
+    if (onyx_has_errors()) return;
+
+    bh_buffer manifest;
+    bh_buffer_init(&manifest, bh_heap_allocator(), 4096);
+    bh_buffer_append(&manifest, CACHE_MANIFEST_HEADER "\n", strlen(CACHE_MANIFEST_HEADER) + 1);
+
+    bh_arr_each(bh_file_contents, fc, context.loaded_files) {
+        u64 hash = cache_hash(0xcbf29ce484222325ull, fc->data, fc->length);
+        cache_manifest_add(&manifest, "file", hash, fc->filename);
+    }
+
+    //
+    // Files included with #file_contents are not kept in memory, so they are read
+    // again here.
+    fori (i, 0, shlen(context.wasm_module->loaded_file_info)) {
+        char *filename = context.wasm_module->loaded_file_info[i].key;
+
+        u64 hash;
+        if (!cache_hash_file(filename, &hash)) goto failed;
+
+        cache_manifest_add(&manifest, "file", hash, filename);
+    }
+
+    bh_arr_each(CacheFolder, cf, cache.folders) {
+        cache_manifest_add(&manifest, "dir", cf->hash, cf->path);
+    }
+
+    fori (i, 0, shlen(cache.missing)) {
+        char *line = bh_aprintf(global_scratch_allocator, "missing %s\n", cache.missing[i].key);
+        bh_buffer_append(&manifest, line, strlen(line));
+    }
+
+    // The old manifest is removed first and the new one is written last, so a
+    // manifest never describes a different output than the one stored next to it.
+    bh_file_remove(cache.manifest_path);
+    if (cache_write_file(cache.output_path, code.data, code.length)) {
+        cache_write_file(cache.manifest_path, manifest.data, manifest.length);
+    }
+
+  failed:
+    bh_buffer_free(&manifest);
+}
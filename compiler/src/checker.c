@@ -33,6 +33,18 @@
     } \
     } while (0)
 
+// Like YIELD, but also records the entity that is blocking progress, so the
+// current entity can be parked until that entity changes state.
+#define YIELD_ON(dependency, loc, msg) do { \
+    entity_wait_on(&context.entities, (dependency)); \
+    YIELD(loc, msg); \
+    } while (0)
+
+#define YIELD_ON_(dependency, loc, msg, ...) do { \
+    entity_wait_on(&context.entities, (dependency)); \
+    YIELD_(loc, msg, __VA_ARGS__); \
+    } while (0)
+
 #define YIELD_ERROR(loc, msg) do { \
     if (context.cycle_detected) { \
         onyx_report_error(loc, Error_Critical, msg); \
@@ -1083,7 +1095,7 @@ CheckStatus check_binaryop_assignment(AstBinaryOp** pbinop) {
         // the right hand side.
         if (binop->left->type == NULL) {
             if (binop->left->type_node != NULL && binop->left->entity && binop->left->entity->state <= Entity_State_Check_Types) {
-                YIELD(binop->token->pos, "Waiting for type to be constructed on left hand side.");
+                YIELD_ON(binop->left->entity, binop->token->pos, "Waiting for type to be constructed on left hand side.");
             }
 
             // NOTE: There is a subtlety here. You cannot use the result of `resolve_expression_type` directly,
@@ -1171,7 +1183,7 @@ CheckStatus check_binaryop_assignment(AstBinaryOp** pbinop) {
 
     if (binop->right->type == NULL) {
         if (binop->right->entity != NULL && binop->right->entity->state <= Entity_State_Check_Types) {
-            YIELD(binop->token->pos, "Trying to resolve type of right hand side.");
+            YIELD_ON(binop->right->entity, binop->token->pos, "Trying to resolve type of right hand side.");
         }
     }
 
@@ -1437,10 +1449,10 @@ CheckStatus check_binaryop(AstBinaryOp** pbinop) {
     if (binop_is_assignment(binop->operation)) return check_binaryop_assignment(pbinop);
 
     if (binop->left->type == NULL && binop->left->entity && binop->left->entity->state <= Entity_State_Check_Types) {
-        YIELD(binop->left->token->pos, "Waiting for this type to be known");
+        YIELD_ON(binop->left->entity, binop->left->token->pos, "Waiting for this type to be known");
     }
     if (binop->right->type == NULL && binop->right->entity && binop->right->entity->state <= Entity_State_Check_Types) {
-        YIELD(binop->right->token->pos, "Waiting for this type to be known");
+        YIELD_ON(binop->right->entity, binop->right->token->pos, "Waiting for this type to be known");
     }
 
     // NOTE: Comparision operators and boolean operators are handled separately.
@@ -1755,7 +1767,7 @@ CheckStatus check_struct_literal(AstStructLiteral* sl) {
 
         CHECK(expression, actual);
         if ((*actual)->type == NULL && (*actual)->entity != NULL && (*actual)->entity->state <= Entity_State_Check_Types) {
-            YIELD((*actual)->token->pos, "Trying to resolve type of expression for member.");
+            YIELD_ON((*actual)->entity, (*actual)->token->pos, "Trying to resolve type of expression for member.");
         }
 
         TYPE_CHECK(actual, formal) {
@@ -1813,7 +1825,7 @@ CheckStatus check_array_literal(AstArrayLiteral* al) {
         if ((*expr)->type == NULL &&
             (*expr)->entity != NULL &&
             (*expr)->entity->state <= Entity_State_Check_Types) {
-            YIELD_(al->token->pos, "Trying to resolve type of %d%s element of array literal.", expr - al->values, bh_num_suffix(expr - al->values));
+            YIELD_ON_((*expr)->entity, al->token->pos, "Trying to resolve type of %d%s element of array literal.", expr - al->values, bh_num_suffix(expr - al->values));
         }
 
         al->flags &= ((*expr)->flags & Ast_Flag_Comptime) | (al->flags &~ Ast_Flag_Comptime);
@@ -2429,7 +2441,7 @@ CheckStatus check_expression(AstTyped** pexpr) {
 
         case Ast_Kind_Function:
             if (expr->type == NULL)
-                YIELD(expr->token->pos, "Waiting for function type to be resolved.");
+                YIELD_ON(((AstFunction *) expr)->entity_header, expr->token->pos, "Waiting for function type to be resolved.");
 
             break;
 
@@ -2476,7 +2488,7 @@ CheckStatus check_expression(AstTyped** pexpr) {
             break;
 
         case Ast_Kind_Memres:
-            if (expr->type == NULL) YIELD(expr->token->pos, "Waiting to know globals type.");
+            if (expr->type == NULL) YIELD_ON(expr->entity, expr->token->pos, "Waiting to know globals type.");
             break;
 
         case Ast_Kind_Directive_First:
@@ -2896,7 +2908,7 @@ CheckStatus check_block(AstBlock* block) {
 CheckStatus check_function(AstFunction* func) {
     if (func->flags & Ast_Flag_Has_Been_Checked) return Check_Success;
     if (func->entity_header && func->entity_header->state < Entity_State_Code_Gen)
-        YIELD(func->token->pos, "Waiting for procedure header to pass type-checking");
+        YIELD_ON(func->entity_header, func->token->pos, "Waiting for procedure header to pass type-checking");
 
     bh_arr_clear(context.checker.expected_return_type_stack);
     bh_arr_push(context.checker.expected_return_type_stack, &func->type->Function.return_type);
@@ -2943,12 +2955,10 @@ CheckStatus check_function(AstFunction* func) {
 CheckStatus check_overloaded_function(AstOverloadedFunction* ofunc) {
     b32 done = 1;
 
-    bh_imap all_overloads;
-    bh_imap_init(&all_overloads, global_heap_allocator, 4);
-    build_all_overload_options(ofunc->overloads, &all_overloads);
+    OverloadSet *set = get_overload_set(ofunc->overloads);
 
-    bh_arr_each(bh__imap_entry, entry, all_overloads.entries) {
-        AstTyped* node = (AstTyped *) strip_aliases((AstNode *) entry->key);
+    bh_arr_each(AstTyped *, option, set->options) {
+        AstTyped* node = (AstTyped *) strip_aliases((AstNode *) *option);
         if (node->kind == Ast_Kind_Overloaded_Function) continue;
 
         if (   node->kind != Ast_Kind_Function
@@ -2957,7 +2967,6 @@ CheckStatus check_overloaded_function(AstOverloadedFunction* ofunc) {
             onyx_report_error(node->token->pos, Error_Critical, "Overload option not procedure or macro. Got '%s'",
                 onyx_ast_node_kind_string(node->kind));
 
-            bh_imap_free(&all_overloads);
             return Check_Error;
         }
 
@@ -2967,13 +2976,13 @@ CheckStatus check_overloaded_function(AstOverloadedFunction* ofunc) {
             AstFunction* func = (AstFunction *) node;
 
             if (func->entity_header && func->entity_header->state <= Entity_State_Check_Types) {
+                if (done) entity_wait_on(&context.entities, func->entity_header);
                 done = 0;
             }
         }
     }
 
     if (!done) {
-        bh_imap_free(&all_overloads);
         YIELD(ofunc->token->pos, "Waiting for all options to pass type-checking.");
     }
 
@@ -2996,7 +3005,6 @@ CheckStatus check_overloaded_function(AstOverloadedFunction* ofunc) {
 
                 // Return early here because the following code does not work with a
                 // polymorphic expected return type.
-                bh_imap_free(&all_overloads);
                 return Check_Success;
             }
         }
@@ -3004,8 +3012,8 @@ CheckStatus check_overloaded_function(AstOverloadedFunction* ofunc) {
         ofunc->expected_return_type = type_build_from_ast(context.ast_alloc, expected_return_node);
         if (!ofunc->expected_return_type) YIELD(ofunc->token->pos, "Waiting to construct expected return type.");
 
-        bh_arr_each(bh__imap_entry, entry, all_overloads.entries) {
-            AstTyped* node = (AstTyped *) entry->key;
+        bh_arr_each(AstTyped *, option, set->options) {
+            AstTyped* node = *option;
 
             if (node->kind == Ast_Kind_Function) {
                 AstFunction *func = (AstFunction *) node;
@@ -3018,15 +3026,12 @@ CheckStatus check_overloaded_function(AstOverloadedFunction* ofunc) {
 
                 if (!types_are_compatible(return_type, ofunc->expected_return_type)) {
                     report_incorrect_overload_expected_type(return_type, ofunc->expected_return_type, func->token, ofunc->token);
-                    bh_imap_free(&all_overloads);
                     return Check_Error;
                 }
             }
         }
     }
 
-
-    bh_imap_free(&all_overloads);
     return Check_Success;
 }
 
@@ -3048,7 +3053,7 @@ CheckStatus check_meta_tags(bh_arr(AstTyped *) tags) {
 
 CheckStatus check_struct(AstStructType* s_node) {
     if (s_node->entity_defaults && s_node->entity_defaults->state < Entity_State_Check_Types)
-        YIELD(s_node->token->pos, "Waiting for struct member defaults to pass symbol resolution.");
+        YIELD_ON(s_node->entity_defaults, s_node->token->pos, "Waiting for struct member defaults to pass symbol resolution.");
 
     if (s_node->min_size_)      CHECK(expression, &s_node->min_size_);
     if (s_node->min_alignment_) CHECK(expression, &s_node->min_alignment_);
@@ -3136,7 +3141,7 @@ CheckStatus check_struct(AstStructType* s_node) {
 
 CheckStatus check_struct_defaults(AstStructType* s_node) {
     if (s_node->entity_type && s_node->entity_type->state < Entity_State_Code_Gen)
-        YIELD(s_node->token->pos, "Waiting for struct type to be constructed before checking defaulted members.");
+        YIELD_ON(s_node->entity_type, s_node->token->pos, "Waiting for struct type to be constructed before checking defaulted members.");
     if (s_node->entity_type && s_node->entity_type->state == Entity_State_Failed)
         return Check_Failed;
 
@@ -3368,7 +3373,7 @@ CheckStatus check_memres_type(AstMemRes* memres) {
 
 CheckStatus check_memres(AstMemRes* memres) {
     assert(memres->type_entity);
-    if (memres->type_entity->state < Entity_State_Code_Gen) YIELD(memres->token->pos, "Waiting for global to pass type construction.");
+    if (memres->type_entity->state < Entity_State_Code_Gen) YIELD_ON(memres->type_entity, memres->token->pos, "Waiting for global to pass type construction.");
 
     if (memres->initial_value != NULL) {
         if (memres->threadlocal) {
@@ -3390,14 +3395,14 @@ CheckStatus check_memres(AstMemRes* memres) {
         } else {
             resolve_expression_type(memres->initial_value);
             if (memres->initial_value->type == NULL && memres->initial_value->entity != NULL && memres->initial_value->entity->state <= Entity_State_Check_Types) {
-                YIELD(memres->token->pos, "Waiting for global type to be constructed.");
+                YIELD_ON(memres->initial_value->entity, memres->token->pos, "Waiting for global type to be constructed.");
             }
             memres->type = memres->initial_value->type;
         }
 
         if ((memres->initial_value->flags & Ast_Flag_Comptime) == 0) {
             if (memres->initial_value->entity != NULL && memres->initial_value->entity->state <= Entity_State_Check_Types) {
-                YIELD(memres->token->pos, "Waiting for initial value to be checked.");
+                YIELD_ON(memres->initial_value->entity, memres->token->pos, "Waiting for initial value to be checked.");
             }
 
             ERROR(memres->initial_value->token->pos, "Top level expressions must be compile time known.");
@@ -3558,7 +3563,7 @@ CheckStatus check_process_directive(AstNode* directive) {
         AstDirectiveExport *export = (AstDirectiveExport *) directive;
         AstTyped *exported = export->export;
         if (exported->entity && exported->entity->state <= Entity_State_Check_Types)
-            YIELD(directive->token->pos, "Waiting for exported type to be known.");
+            YIELD_ON(exported->entity, directive->token->pos, "Waiting for exported type to be known.");
 
         if (exported->kind != Ast_Kind_Function) {
             onyx_report_error(export->token->pos, Error_Critical, "Cannot export something that is not a procedure.");
@@ -3606,7 +3611,7 @@ CheckStatus check_process_directive(AstNode* directive) {
 
                 assert(d->entity);
                 if (d->entity->state != Entity_State_Finalized) {
-                    YIELD(init->token->pos, "Circular dependency in #init nodes. Here are the nodes involved.");
+                    YIELD_ON(d->entity, init->token->pos, "Circular dependency in #init nodes. Here are the nodes involved.");
                 }
 
                 i++;
@@ -1,6 +1,7 @@
 #include "bh.h"
 #include "astnodes.h"
 #include "utils.h"
+#include "frontend.h"
 
 static inline i32 entity_phase(Entity* e1) {
     if (e1->state <= Entity_State_Parse && e1->macro_attempts == 0) return 1;
@@ -72,17 +73,20 @@ static void eh_shift_down(EntityHeap* entities, i32 index) {
 
 void entity_heap_init(EntityHeap* entities) {
     bh_arena_init(&entities->entity_arena, global_heap_allocator, 32 * 1024);
+    entities->entity_alloc = counting_allocator(&entities->entity_alloc_stats, bh_arena_allocator(&entities->entity_arena));
 }
 
 // Allocates the entity in the entity heap. Don't quite feel this is necessary...
 Entity* entity_heap_register(EntityHeap* entities, Entity e) {
-    bh_allocator alloc = bh_arena_allocator(&entities->entity_arena);
-    Entity* entity = bh_alloc_item(alloc, Entity);
+    Entity* entity = bh_alloc_item(entities->entity_alloc, Entity);
     *entity = e;
     entity->id = context.next_entity_id++;
     entity->macro_attempts = 0;
     entity->micro_attempts = 0;
     entity->entered_in_queue = 0;
+    entity->parked = 0;
+    entity->waiting_on = NULL;
+    entity->waiters = NULL;
 
     return entity;
 }
@@ -104,6 +108,10 @@ void entity_heap_insert_existing(EntityHeap* entities, Entity* e) {
 
     e->entered_in_queue = 1;
 
+    if (e->type == Entity_Type_Load_File) {
+        frontend_prefetch_include(e->include);
+    }
+
     entities->state_count[e->state]++;
     entities->type_count[e->type]++;
     entities->all_count[e->state][e->type]++;
@@ -170,6 +178,8 @@ void entity_change_state(EntityHeap* entities, Entity *ent, EntityState new_stat
     entities->state_count[ent->state]--;
     entities->state_count[new_state]++;
     ent->state = new_state;
+
+    entity_heap_wake_waiters(entities, ent);
 }
 
 void entity_heap_add_job(EntityHeap *entities, TypeMatch (*func)(void *), void *job_data) {
@@ -185,6 +195,87 @@ void entity_heap_add_job(EntityHeap *entities, TypeMatch (*func)(void *), void *
     entity_heap_insert(entities, ent);
 }
 
+// NOTE: Records that the entity currently being processed cannot make progress
+// until `dependency` changes state. This should be called right before yielding.
+void entity_wait_on(EntityHeap *entities, Entity *dependency) {
+    if (entities->current == NULL || dependency == NULL) return;
+    if (entities->current == dependency) return;
+
+    entities->current->waiting_on = dependency;
+}
+
+// NOTE: Parks an entity that yielded while waiting on another entity. Returns 0
+// if the entity could not be parked, in which case it should be placed back into
+// the heap like normal.
+b32 entity_heap_park(EntityHeap *entities, Entity *e) {
+    Entity *dependency = e->waiting_on;
+    if (entities->parking_disabled || dependency == NULL) return 0;
+    if (e->entered_in_queue || e->parked) return 0;
+
+    // Entities in these states live in the unsorted queue and are cheap to retry.
+    if (e->state <= Entity_State_Introduce_Symbols) return 0;
+
+    // These will never change state again, so nothing would wake the entity up.
+    if (dependency->state == Entity_State_Finalized || dependency->state == Entity_State_Failed) return 0;
+
+    if (dependency->waiters == NULL) {
+        bh_arr_new(global_heap_allocator, dependency->waiters, 4);
+    }
+    bh_arr_push(dependency->waiters, e);
+
+    if (entities->parked_entities == NULL) {
+        bh_arr_new(global_heap_allocator, entities->parked_entities, 128);
+    }
+
+    // Woken up entities are only removed from this list lazily.
+    if (bh_arr_length(entities->parked_entities) > 2 * entities->parked_count + 64) {
+        i32 j = 0;
+        bh_arr_each(Entity *, parked, entities->parked_entities) {
+            if ((*parked)->parked) entities->parked_entities[j++] = *parked;
+        }
+        bh_arr_set_length(entities->parked_entities, j);
+    }
+
+    bh_arr_push(entities->parked_entities, e);
+    entities->parked_count++;
+    e->parked = 1;
+    return 1;
+}
+
+void entity_heap_wake_waiters(EntityHeap *entities, Entity *dependency) {
+    if (dependency->waiters == NULL) return;
+
+    bh_arr_each(Entity *, pwaiter, dependency->waiters) {
+        Entity *waiter = *pwaiter;
+        if (!waiter->parked || waiter->waiting_on != dependency) continue;
+
+        waiter->parked = 0;
+        entities->parked_count--;
+        entity_heap_insert_existing(entities, waiter);
+    }
+
+    bh_arr_clear(dependency->waiters);
+}
+
+// NOTE: Places every parked entity back into the heap. Returns the number of
+// entities that were woken up.
+i32 entity_heap_unpark_all(EntityHeap *entities) {
+    i32 count = 0;
+
+    bh_arr_each(Entity *, parked, entities->parked_entities) {
+        Entity *e = *parked;
+        if (!e->parked) continue;
+
+        e->parked = 0;
+        entity_heap_insert_existing(entities, e);
+        count++;
+    }
+
+    bh_arr_clear(entities->parked_entities);
+    entities->parked_count = 0;
+    return count;
+}
+
 // NOTE(Brendan Hansen): Uses the entity heap in the context structure
 void add_entities_for_node(bh_arr(Entity *) *target_arr, AstNode* node, Scope* scope, Package* package) {
 #define ENTITY_INSERT(_ent)                                     \
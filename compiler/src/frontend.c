@@ -0,0 +1,441 @@
+#include "frontend.h"
+#include "utils.h"
+#include "profile.h"
+
+#if defined(_BH_LINUX) || defined(_BH_DARWIN)
+
+typedef enum FrontendJobState {
+    Frontend_Job_Queued,
+    Frontend_Job_Running,
+    Frontend_Job_Done,
+
+    // The main thread needed the file before any worker started on it,
+    // so the main thread processes it itself and the workers skip it.
+    Frontend_Job_Claimed,
+} FrontendJobState;
+
+typedef struct FrontendJob {
+    char *filename;
+    FrontendJobState state;
+    b32 failed : 1;
+
+    bh_file_contents fc;
+    OnyxTokenizer tokenizer;
+
+    // Used for the profile. `worker` is -1 if the job ran on the main thread.
+    i32 worker;
+    u64 start_time;
+    u64 end_time;
+} FrontendJob;
+
+typedef struct FrontendPool {
+    pthread_t *threads;
+    i32 thread_count;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t  work_available;
+    pthread_cond_t  work_finished;
+    b32 shutting_down;
+
+    // Guarded by the mutex.
+    bh_arr(FrontendJob *) queue;
+    i32 queue_head;
+
+    // Only used by the main thread.
+    Table(FrontendJob *) jobs;
+    bh_arr(FrontendJob *) all_jobs;
+} FrontendPool;
+
+static FrontendPool pool;
+
+typedef struct ResidentFile {
+    bh_file_contents fc;
+    OnyxTokenizer tokenizer;
+
+    isize size;
+    u64 modified_time;
+
+    // Set when the file was loaded by the current (or last) compilation.
+    b32 used : 1;
+} ResidentFile;
+
+typedef struct ResidentFiles {
+    b32 enabled;
+
+    // This is not a Table, because tables are allocated from the global heap,
+    // which is freed after every compilation.
+    bh_arr(ResidentFile *) files;
+} ResidentFiles;
+
+// Unlike the pool, this lives across compilations.
+static ResidentFiles resident;
+
+static i32 resident_file_index(const char *filename) {
+    bh_arr_each(ResidentFile *, rf, resident.files) {
+        if (!strcmp((*rf)->fc.filename, filename)) return rf - resident.files;
+    }
+
+    return -1;
+}
+
+static void resident_file_free(ResidentFile *rf) {
+    bh_file_contents_free(&rf->fc);
+    bh_free(bh_heap_allocator(), (char *) rf->fc.filename);
+    bh_arr_free(rf->tokenizer.tokens);
+    bh_free(bh_heap_allocator(), rf);
+}
+
+static void resident_file_remove(char *filename) {
+    i32 index = resident_file_index(filename);
+    if (index == -1) return;
+
+    ResidentFile *rf = resident.files[index];
+    bh_arr_fastdelete(resident.files, index);
+    resident_file_free(rf);
+}
+
+//
+// Returns the resident copy of the file, if there is one and the file was not
+// modified since it was read.
+static ResidentFile *resident_file_lookup(char *filename) {
+    if (!resident.enabled) return NULL;
+
+    i32 index = resident_file_index(filename);
+    if (index == -1) return NULL;
+
+    ResidentFile *rf = resident.files[index];
+
+    bh_file_stats stats;
+    if (!bh_file_stat(filename, &stats) || stats.size != rf->size || stats.modified_time != rf->modified_time) {
+        resident_file_remove(filename);
+        return NULL;
+    }
+
+    return rf;
+}
+
+static void resident_file_add(bh_file_contents *fc, OnyxTokenizer *tokenizer) {
+    bh_file_stats stats;
+    if (!bh_file_stat(fc->filename, &stats)) return;
+
+    resident_file_remove((char *) fc->filename);
+
+    ResidentFile *rf = bh_alloc_item(bh_heap_allocator(), ResidentFile);
+    memset(rf, 0, sizeof(*rf));
+    rf->fc = *fc;
+    rf->tokenizer = *tokenizer;
+    rf->size = stats.size;
+    rf->modified_time = stats.modified_time;
+    rf->used = 1;
+
+    if (resident.files == NULL) bh_arr_new(bh_heap_allocator(), resident.files, 128);
+    bh_arr_push(resident.files, rf);
+}
+
+//
+// Everything done in here has to be safe to do off of the main thread. In particular,
+// nothing is allocated from the global heap or scratch allocators, and no errors are
+// reported. Instead, the job is marked as failed and the main thread redoes the work.
+static void frontend_job_run(FrontendJob *job) {
+    bh_allocator alloc = bh_heap_allocator();
+
+    bh_file file;
+    if (bh_file_open(&file, job->filename) != BH_FILE_ERROR_NONE) {
+        job->failed = 1;
+        return;
+    }
+
+    job->fc = bh_file_read_contents(alloc, &file);
+    bh_file_close(&file);
+
+    job->tokenizer = onyx_tokenizer_create(alloc, &job->fc);
+    job->tokenizer.defer_errors = 1;
+    onyx_lex_tokens(&job->tokenizer);
+
+    if (job->tokenizer.encountered_error) {
+        job->failed = 1;
+    }
+}
+
+static void profile_job(FrontendJob *job) {
+    if (!profile_enabled()) return;
+
+    profile_span("lex", job->filename, job->start_time, job->end_time, job->worker + 1,
+        bh_aprintf(global_scratch_allocator, "\"bytes\": %l, \"tokens\": %d",
+            job->fc.length, bh_arr_length(job->tokenizer.tokens)));
+}
+
+static void *frontend_worker(void *data) {
+    i32 worker = (i32) (i64) data;
+
+    pthread_mutex_lock(&pool.mutex);
+
+    while (1) {
+        while (!pool.shutting_down && pool.queue_head == bh_arr_length(pool.queue)) {
+            pthread_cond_wait(&pool.work_available, &pool.mutex);
+        }
+
+        if (pool.shutting_down) break;
+
+        FrontendJob *job = pool.queue[pool.queue_head++];
+        if (pool.queue_head == bh_arr_length(pool.queue)) {
+            pool.queue_head = 0;
+            bh_arr_clear(pool.queue);
+        }
+
+        if (job->state != Frontend_Job_Queued) continue;
+        job->state = Frontend_Job_Running;
+
+        pthread_mutex_unlock(&pool.mutex);
+        job->worker = worker;
+        job->start_time = profile_now();
+        frontend_job_run(job);
+        job->end_time = profile_now();
+        pthread_mutex_lock(&pool.mutex);
+
+        job->state = Frontend_Job_Done;
+        pthread_cond_broadcast(&pool.work_finished);
+    }
+
+    pthread_mutex_unlock(&pool.mutex);
+    return NULL;
+}
+
+void frontend_pool_init(i32 job_count) {
+    memset(&pool, 0, sizeof(pool));
+
+    bh_arr_each(ResidentFile *, rf, resident.files) (*rf)->used = 0;
+
+    if (job_count <= 1) return;
+
+    pthread_mutex_init(&pool.mutex, NULL);
+    pthread_cond_init(&pool.work_available, NULL);
+    pthread_cond_init(&pool.work_finished, NULL);
+
+    bh_arr_new(bh_heap_allocator(), pool.queue, 64);
+    bh_arr_new(bh_heap_allocator(), pool.all_jobs, 64);
+
+    pool.thread_count = job_count;
+    pool.threads = bh_alloc_array(bh_heap_allocator(), pthread_t, job_count);
+    fori (i, 0, job_count) {
+        pthread_create(&pool.threads[i], NULL, frontend_worker, (void *) (i64) i);
+    }
+}
+
+void frontend_pool_free() {
+    if (pool.threads == NULL) return;
+
+    pthread_mutex_lock(&pool.mutex);
+    pool.shutting_down = 1;
+    pthread_cond_broadcast(&pool.work_available);
+    pthread_mutex_unlock(&pool.mutex);
+
+    fori (i, 0, pool.thread_count) {
+        pthread_join(pool.threads[i], NULL);
+    }
+
+    // The file contents and tokens of taken jobs are still referenced by the AST,
+    // so they are only freed here, when the whole compilation is cleaned up.
+    bh_arr_each(FrontendJob *, pjob, pool.all_jobs) {
+        FrontendJob *job = *pjob;
+        if (job->fc.data) bh_file_contents_free(&job->fc);
+        if (job->fc.filename) bh_free(bh_heap_allocator(), (char *) job->fc.filename);
+        if (job->tokenizer.tokens) bh_arr_free(job->tokenizer.tokens);
+        bh_free(bh_heap_allocator(), job->filename);
+        bh_free(bh_heap_allocator(), job);
+    }
+
+    bh_arr_free(pool.all_jobs);
+    bh_arr_free(pool.queue);
+    shfree(pool.jobs);
+    bh_free(bh_heap_allocator(), pool.threads);
+
+    pthread_cond_destroy(&pool.work_finished);
+    pthread_cond_destroy(&pool.work_available);
+    pthread_mutex_destroy(&pool.mutex);
+
+    memset(&pool, 0, sizeof(pool));
+}
+
+void frontend_prefetch_include(AstInclude *include) {
+    if (pool.threads == NULL) return;
+    if (include->kind != Ast_Kind_Load_File) return;
+    if (include->prefetched) return;
+    include->prefetched = 1;
+
+    char name[256];
+    if (include->name != NULL) {
+        bh_snprintf(name, 255, "%s", include->name);
+
+    } else {
+        // The name is only known this early if it is a plain string literal.
+        // Anything else is resolved later by symres, and loaded synchronously.
+        if (include->name_node == NULL || include->name_node->kind != Ast_Kind_StrLit) return;
+
+        OnyxToken *str_token = include->name_node->token;
+        if (str_token == NULL || str_token->length >= 255) return;
+
+        // Escape sequences would need to be processed first. These are rare enough
+        // in file names that they are not worth handling here.
+        fori (i, 0, str_token->length) {
+            if (str_token->text[i] == '\\') return;
+        }
+
+        memcpy(name, str_token->text, str_token->length);
+        name[str_token->length] = '\0';
+    }
+
+    // :RelativeFiles
+    const char* parent_file = include->token->pos.filename;
+    if (parent_file == NULL) parent_file = ".";
+
+    char* parent_folder = bh_path_get_parent(parent_file, global_scratch_allocator);
+    char* filename = bh_lookup_file(name, parent_folder, ".onyx", 1, context.options->included_folders, 1);
+    if (!bh_file_exists(filename)) return;
+
+    if (shgeti(pool.jobs, filename) != -1) return;
+    if (resident_file_lookup(filename)) return;
+
+    bh_arr_each(bh_file_contents, fc, context.loaded_files) {
+        if (!strcmp(fc->filename, filename)) return;
+    }
+
+    FrontendJob *job = bh_alloc_item(bh_heap_allocator(), FrontendJob);
+    memset(job, 0, sizeof(*job));
+    job->filename = bh_strdup(bh_heap_allocator(), filename);
+    job->state = Frontend_Job_Queued;
+
+    shput(pool.jobs, job->filename, job);
+    bh_arr_push(pool.all_jobs, job);
+
+    pthread_mutex_lock(&pool.mutex);
+    bh_arr_push(pool.queue, job);
+    pthread_cond_signal(&pool.work_available);
+    pthread_mutex_unlock(&pool.mutex);
+}
+
+b32 frontend_take_prefetched(char *filename, bh_file_contents *out_fc, OnyxTokenizer *out_tokenizer) {
+    ResidentFile *rf = resident_file_lookup(filename);
+    if (rf) {
+        rf->used = 1;
+        *out_fc = rf->fc;
+        *out_tokenizer = rf->tokenizer;
+        return 1;
+    }
+
+    i32 index = shgeti(pool.jobs, filename);
+    if (index == -1) {
+        if (!resident.enabled) return 0;
+
+        // Files that were not prefetched are loaded here, so they can be kept resident.
+        FrontendJob job;
+        memset(&job, 0, sizeof(job));
+        job.filename = filename;
+        job.worker = -1;
+        job.start_time = profile_now();
+        frontend_job_run(&job);
+        job.end_time = profile_now();
+
+        if (job.failed) {
+            if (job.fc.data) bh_file_contents_free(&job.fc);
+            if (job.fc.filename) bh_free(bh_heap_allocator(), (char *) job.fc.filename);
+            if (job.tokenizer.tokens) bh_arr_free(job.tokenizer.tokens);
+            return 0;
+        }
+
+        profile_job(&job);
+
+        resident_file_add(&job.fc, &job.tokenizer);
+        *out_fc = job.fc;
+        *out_tokenizer = job.tokenizer;
+        return 1;
+    }
+
+    FrontendJob *job = pool.jobs[index].value;
+
+    pthread_mutex_lock(&pool.mutex);
+    if (job->state == Frontend_Job_Queued) {
+        job->state = Frontend_Job_Claimed;
+    }
+
+    while (job->state == Frontend_Job_Running) {
+        pthread_cond_wait(&pool.work_finished, &pool.mutex);
+    }
+    pthread_mutex_unlock(&pool.mutex);
+
+    if (job->state != Frontend_Job_Done || job->failed) return 0;
+
+    // A job can only be taken once.
+    job->state = Frontend_Job_Claimed;
+    profile_job(job);
+
+    *out_fc = job->fc;
+    *out_tokenizer = job->tokenizer;
+
+    if (resident.enabled) {
+        // The resident copy owns the contents now.
+        resident_file_add(&job->fc, &job->tokenizer);
+        memset(&job->fc, 0, sizeof(job->fc));
+        memset(&job->tokenizer, 0, sizeof(job->tokenizer));
+    }
+
+    return 1;
+}
+
+void frontend_resident_enable() {
+    resident.enabled = 1;
+}
+
+void frontend_resident_free() {
+    bh_arr_each(ResidentFile *, rf, resident.files) resident_file_free(*rf);
+    bh_arr_free(resident.files);
+    memset(&resident, 0, sizeof(resident));
+}
+
+b32 frontend_resident_unchanged() {
+    b32 unchanged = 1;
+
+    bh_arr_each(ResidentFile *, prf, resident.files) {
+        ResidentFile *rf = *prf;
+        if (!rf->used) continue;
+
+        bh_file_stats stats;
+        if (!bh_file_stat(rf->fc.filename, &stats)) return 0;
+        if (stats.size == rf->size && stats.modified_time == rf->modified_time) continue;
+
+        b32 same_contents = 0;
+        if (stats.size == rf->size) {
+            bh_file_contents contents = bh_file_read_contents(bh_heap_allocator(), rf->fc.filename);
+            same_contents = contents.length == rf->fc.length
+                         && !memcmp(contents.data, rf->fc.data, contents.length);
+
+            bh_file_contents_free(&contents);
+            bh_free(bh_heap_allocator(), (char *) contents.filename);
+        }
+
+        // The file was saved without being changed. Remember the new modification
+        // time, so it is not read again next time.
+        if (same_contents) {
+            rf->modified_time = stats.modified_time;
+            continue;
+        }
+
+        unchanged = 0;
+    }
+
+    return unchanged;
+}
+
+#else
+
+// No worker pool on this platform; everything is loaded on the main thread.
+
+void frontend_pool_init(i32 job_count) {}
+void frontend_pool_free() {}
+void frontend_prefetch_include(AstInclude *include) {}
+b32 frontend_take_prefetched(char *filename, bh_file_contents *out_fc, OnyxTokenizer *out_tokenizer) { return 0; }
+void frontend_resident_enable() {}
+void frontend_resident_free() {}
+b32 frontend_resident_unchanged() { return 0; }
+
+#endif
@@ -149,6 +149,18 @@ void token_toggle_end(OnyxToken* tkn) {
     backup = tmp;
 }
 
+// When lexing off of the main thread, errors cannot be submitted directly.
+// Instead, the tokenizer remembers that an error happened and the file is
+// lexed again on the main thread, where the error is reported normally.
+static void lexer_report_error(OnyxTokenizer* tokenizer, OnyxFilePos pos, char* msg) {
+    if (tokenizer->defer_errors) {
+        tokenizer->encountered_error = 1;
+        return;
+    }
+
+    onyx_report_error(pos, Error_Critical, msg);
+}
+
 OnyxToken* onyx_get_token(OnyxTokenizer* tokenizer) {
     OnyxToken tk;
 
@@ -288,7 +300,7 @@ whitespace_skipped:
 
             if (*tokenizer->curr == '\n' && ch == '\'') {
                 tk.pos.length = (u16) len;
-                onyx_report_error(tk.pos, Error_Critical, "Character literal not terminated by end of line.");
+                lexer_report_error(tokenizer, tk.pos, "Character literal not terminated by end of line.");
                 break;
             }
 
@@ -301,7 +313,7 @@ whitespace_skipped:
 
             INCREMENT_CURR_TOKEN(tokenizer);
             if (tokenizer->curr == tokenizer->end) {
-                onyx_report_error(tk.pos, Error_Critical, "String literal not closed. String literal starts here.");
+                lexer_report_error(tokenizer, tk.pos, "String literal not closed. String literal starts here.");
                 break;
             }
         }
@@ -565,6 +577,8 @@ OnyxTokenizer onyx_tokenizer_create(bh_allocator allocator, bh_file_contents *fc
 
         .optional_semicolons = context.options->enable_optional_semicolons,
         .insert_semicolon = 0,
+        .defer_errors = 0,
+        .encountered_error = 0,
     };
 
     bh_arr_new(allocator, tknizer.tokens, 1 << 12);
@@ -580,9 +594,6 @@ void onyx_lex_tokens(OnyxTokenizer* tokenizer) {
     do {
         tk = onyx_get_token(tokenizer);
     } while (tk->type != Token_Type_End_Stream);
-
-    context.lexer_lines_processed += tokenizer->line_number - 1;
-    context.lexer_tokens_processed += bh_arr_length(tokenizer->tokens);
 }
 
 b32 token_equals(OnyxToken* tkn1, OnyxToken* tkn2) {
@@ -18,6 +18,9 @@ extern struct bh_allocator global_heap_allocator;
 #include "utils.h"
 #include "wasm_emit.h"
 #include "doc.h"
+#include "frontend.h"
+#include "cache.h"
+#include "profile.h"
 
 
 #define VERSION__(m,i,p) "v" #m "." #i "." #p
@@ -36,6 +39,10 @@ extern struct bh_allocator global_heap_allocator;
 
 Context context;
 
+// NOTE: These are file-level so the memory statistics can be reported during the compilation.
+static bh_managed_heap mh;
+static AllocatorStats scratch_alloc_stats;
+
 #define VERSION_STRING "Onyx toolchain version " VERSION "\n" \
     "Built on " __TIMESTAMP__ "\n" \
     "Runtime: " STRINGIFY(ONYX_RUNTIME_LIBRARY_MAPPED) "\n"
@@ -94,7 +101,18 @@ static const char *build_docstring = DOCSTRING_HEADER
     "\t                        Can drastically increase binary size.\n"
     "\t--generate-foreign-info Generate information for foreign blocks. Rarely needed, so disabled by default.\n"
     "\t--wasm-mvp              Use only WebAssembly MVP features.\n"
+    "\t-O1, -O2                Optimizes the generated WebAssembly. -O2 runs more passes.\n"
+    "\t                        Ignored when debug information is generated.\n"
     "\t--feature <feature>     Enable an experimental language feature.\n"
+    "\t--jobs, -j <count>      Number of threads used to read and lex source files.\n"
+    "\t                        (default: number of processors, at most 8)\n"
+    "\t--cache-dir <dir>       Reuse the output of a previous compilation stored in <dir>,\n"
+    "\t                        if none of the files it read have changed since.\n"
+    "\t--profile <file>        Writes a timeline of the compilation to <file>, as Chrome trace-event JSON.\n"
+#ifdef ONYX_RUNTIME_LIBRARY
+    "\t--run-profile <file>    With \"onyx run\", counts the instructions the program runs, writes them\n"
+    "\t                        to <file> as folded stacks, and prints the hottest functions and lines.\n"
+#endif
     "\n"
     "Developer options:\n"
     "\t--no-colors               Disables colors in the error message.\n"
@@ -126,6 +144,8 @@ static CompileOptions compile_opts_parse(bh_allocator alloc, int argc, char *arg
 
         .enable_optional_semicolons = 0,
 
+        .optimization_level = 0,
+
         .runtime = Runtime_Onyx,
 
         .files = NULL,
@@ -134,6 +154,9 @@ static CompileOptions compile_opts_parse(bh_allocator alloc, int argc, char *arg
         .documentation_file = NULL,
         .symbol_info_file   = NULL,
         .help_subcommand    = NULL,
+        .cache_dir          = NULL,
+        .profile_file       = NULL,
+        .run_profile_file   = NULL,
 
         .defined_variables = NULL,
 
@@ -147,8 +170,14 @@ static CompileOptions compile_opts_parse(bh_allocator alloc, int argc, char *arg
         .generate_lsp_info_file = 0,
 
         .running_perf = 0,
+
+        .job_count = 1,
     };
 
+    #if defined(_BH_LINUX) || defined(_BH_DARWIN)
+    options.job_count = bh_clamp(sysconf(_SC_NPROCESSORS_ONLN), 1, 8);
+    #endif
+
     bh_arr_new(alloc, options.files, 2);
     bh_arr_new(alloc, options.included_folders, 2);
     bh_arr_new(alloc, options.defined_variables, 2);
@@ -265,6 +294,15 @@ static CompileOptions compile_opts_parse(bh_allocator alloc, int argc, char *arg
             else if (!strcmp(argv[i], "--wasm-mvp")) {
                 options.use_post_mvp_features = 0;
             }
+            else if (!strcmp(argv[i], "-O0")) {
+                options.optimization_level = 0;
+            }
+            else if (!strcmp(argv[i], "-O1")) {
+                options.optimization_level = 1;
+            }
+            else if (!strcmp(argv[i], "-O2")) {
+                options.optimization_level = 2;
+            }
             else if (!strcmp(argv[i], "--multi-threaded")) {
                 options.use_multi_threading = 1;
             }
@@ -292,6 +330,19 @@ static CompileOptions compile_opts_parse(bh_allocator alloc, int argc, char *arg
                     options.enable_optional_semicolons = 1;
                 }
             }
+            else if (!strcmp(argv[i], "--jobs") || !strcmp(argv[i], "-j")) {
+                options.job_count = atoi(argv[++i]);
+                if (options.job_count < 1) options.job_count = 1;
+            }
+            else if (!strcmp(argv[i], "--cache-dir")) {
+                options.cache_dir = argv[++i];
+            }
+            else if (!strcmp(argv[i], "--profile")) {
+                options.profile_file = argv[++i];
+            }
+            else if (!strcmp(argv[i], "--run-profile")) {
+                options.run_profile_file = argv[++i];
+            }
             else if (!strcmp(argv[i], "-I")) {
                 bh_arr_push(options.included_folders, argv[++i]);
             }
@@ -488,6 +539,8 @@ static void context_init(CompileOptions* opts) {
     // NOTE: This will be initialized upon the first call to entity_heap_insert.
     context.entities.next_id  = 0;
     context.entities.entities = NULL;
+    context.entities.parked_entities = NULL;
+    context.entities.parked_count = 0;
 
     onyx_errors_init(&context.loaded_files);
 
@@ -496,7 +549,7 @@ static void context_init(CompileOptions* opts) {
     // NOTE: Create the arena where tokens and AST nodes will exist
     // Prevents nodes from being scattered across memory due to fragmentation
     bh_arena_init(&context.ast_arena, global_heap_allocator, 16 * 1024 * 1024); // 16MB
-    context.ast_alloc = bh_arena_allocator(&context.ast_arena);
+    context.ast_alloc = counting_allocator(&context.ast_alloc_stats, bh_arena_allocator(&context.ast_arena));
 
     context.wasm_module = bh_alloc_item(global_heap_allocator, OnyxWasmModule);
     *context.wasm_module = onyx_wasm_module_create(global_heap_allocator);
@@ -606,19 +659,45 @@ static void context_init(CompileOptions* opts) {
 
 static void context_free() {
     bh_arena_free(&context.ast_arena);
+    counting_allocator_reset(&context.ast_alloc_stats);
     bh_arr_free(context.loaded_files);
+
+    if (context.cached_output.data) bh_buffer_free(&context.cached_output);
 }
 
-static void parse_source_file(bh_file_contents* file_contents) {
-    // :Remove passing the allocators as parameters
-    OnyxTokenizer tokenizer = onyx_tokenizer_create(context.token_alloc, file_contents);
-    onyx_lex_tokens(&tokenizer);
+static void parse_source_file(bh_file_contents* file_contents, OnyxTokenizer* prefetched_tokenizer) {
+    OnyxTokenizer tokenizer;
+    if (prefetched_tokenizer) {
+        tokenizer = *prefetched_tokenizer;
+    } else {
+        u64 lex_start = profile_now();
+
+        // :Remove passing the allocators as parameters
+        tokenizer = onyx_tokenizer_create(context.token_alloc, file_contents);
+        onyx_lex_tokens(&tokenizer);
+
+        if (profile_enabled()) {
+            profile_span("lex", file_contents->filename, lex_start, profile_now(), 0,
+                bh_aprintf(global_scratch_allocator, "\"tokens\": %d", bh_arr_length(tokenizer.tokens)));
+        }
+    }
+
+    u64 parse_start = profile_now();
 
     file_contents->line_count = tokenizer.line_number;
 
+    context.lexer_lines_processed += tokenizer.line_number - 1;
+    context.lexer_tokens_processed += bh_arr_length(tokenizer.tokens);
+
     OnyxParser parser = onyx_parser_create(context.ast_alloc, &tokenizer);
     onyx_parse(&parser);
     onyx_parser_free(&parser);
+
+    if (profile_enabled()) {
+        profile_span("parse", file_contents->filename, parse_start, profile_now(), 0,
+            bh_aprintf(global_scratch_allocator, "\"lines\": %d, \"tokens\": %d",
+                tokenizer.line_number - 1, bh_arr_length(tokenizer.tokens)));
+    }
 }
 
 static b32 process_source_file(char* filename, OnyxFilePos error_pos) {
@@ -628,6 +707,18 @@ static b32 process_source_file(char* filename, OnyxFilePos error_pos) {
         if (!strcmp(fc->filename, filename)) return 1;
     }
 
+    bh_file_contents prefetched_fc;
+    OnyxTokenizer prefetched_tokenizer;
+    if (frontend_take_prefetched(filename, &prefetched_fc, &prefetched_tokenizer)) {
+        bh_arr_push(context.loaded_files, prefetched_fc);
+
+        if (context.options->verbose_output == 2)
+            bh_printf("Processing source file:    %s (%d bytes)\n", filename, prefetched_fc.length);
+
+        parse_source_file(&bh_arr_last(context.loaded_files), &prefetched_tokenizer);
+        return 1;
+    }
+
     bh_file file;
     bh_file_error err = bh_file_open(&file, filename);
     if (err != BH_FILE_ERROR_NONE) {
@@ -645,7 +736,7 @@ static b32 process_source_file(char* filename, OnyxFilePos error_pos) {
     if (context.options->verbose_output == 2)
         bh_printf("Processing source file:    %s (%d bytes)\n", file.filename, fc.length);
 
-    parse_source_file(&bh_arr_last(context.loaded_files));
+    parse_source_file(&bh_arr_last(context.loaded_files), NULL);
     return 1;
 }
 
@@ -663,6 +754,8 @@ static b32 process_load_entity(Entity* ent) {
         char* filename = bh_lookup_file(include->name, parent_folder, ".onyx", 1, context.options->included_folders, 1);
         char* formatted_name = bh_strdup(global_heap_allocator, filename);
 
+        compile_cache_track_lookup(include->name, ".onyx");
+
         return process_source_file(formatted_name, include->token->pos);
 
     } else if (include->kind == Ast_Kind_Load_All) {
@@ -693,6 +786,8 @@ static b32 process_load_entity(Entity* ent) {
                 return 0;
             }
 
+            compile_cache_track_folder(folder);
+
             bh_dirent entry;
             char fullpath[512];
             while (bh_dir_read(dir, &entry)) {
@@ -876,10 +971,60 @@ static void output_dummy_progress_bar() {
 }
 #endif
 
+static void report_entity_cycle(Entity *start) {
+    Entity *ent = start;
+    do {
+        Entity *dep = ent->waiting_on;
+
+        if (ent->expr && ent->expr->token && dep->expr && dep->expr->token) {
+            OnyxFilePos dep_pos = dep->expr->token->pos;
+            onyx_report_error(ent->expr->token->pos, Error_Critical,
+                "Circular dependency: this %s is waiting on the %s at %s:%d:%d.",
+                entity_type_strings[ent->type],
+                entity_type_strings[dep->type],
+                dep_pos.filename, dep_pos.line, dep_pos.column);
+        }
+
+        ent = dep;
+    } while (ent != start);
+}
+
+//
+// Follows the dependencies that entities recorded the last time they yielded. If
+// following them leads back to the same entity, no entity in that chain can make
+// progress, and that is the cycle to report. Each cycle is reported once, starting
+// from the entity with the lowest id.
+static void report_dependency_cycles() {
+    i32 max_steps = bh_arr_length(context.entities.entities);
+
+    bh_arr_each(Entity *, pent, context.entities.entities) {
+        Entity *start = *pent;
+        Entity *ent = start->waiting_on;
+        b32 lowest_id = 1;
+
+        fori (i, 0, max_steps) {
+            if (ent == NULL || ent == start) break;
+            if (ent->state == Entity_State_Finalized || ent->state == Entity_State_Failed) {
+                ent = NULL;
+                break;
+            }
+
+            if (ent->id < start->id) lowest_id = 0;
+            ent = ent->waiting_on;
+        }
+
+        if (ent == start && lowest_id) {
+            report_entity_cycle(start);
+        }
+    }
+}
+
 static void dump_cycles() {
     context.cycle_detected = 1;
     Entity* ent;
 
+    report_dependency_cycles();
+
     while (1) {
         ent = entity_heap_top(&context.entities);
         entity_heap_remove_top(&context.entities);
@@ -892,13 +1037,133 @@ static void dump_cycles() {
     }
 }
 
+static void profile_entity(Entity *ent, EntityState state, u64 start, b32 changed) {
+    OnyxToken *token = ent->expr ? ent->expr->token : NULL;
+
+    char *name = (char *) entity_type_strings[ent->type];
+    if (token && token->type == Token_Type_Symbol) {
+        name = bh_aprintf(global_scratch_allocator, "%s %b", name, token->text, token->length);
+    }
+
+    char *location = "null";
+    if (token && token->pos.filename) {
+        char *pos = bh_aprintf(global_scratch_allocator, "%s:%d:%d", token->pos.filename, token->pos.line, token->pos.column);
+        location = profile_json_string(pos, -1);
+    }
+
+    profile_span(entity_state_strings[state], name, start, profile_now(), 0,
+        bh_aprintf(global_scratch_allocator,
+            "\"entity\": %d, \"phase\": \"%s\", \"next_phase\": \"%s\", \"yielded\": %s, \"location\": %s",
+            ent->id, entity_state_strings[state], entity_state_strings[ent->state],
+            changed ? "false" : "true", location));
+}
+
+static void profile_memory_usage() {
+    static u64 last_sample_time = 0;
+
+    // Sampling once a millisecond keeps the profile small, while still
+    // showing where the memory is being allocated.
+    u64 now = profile_now();
+    if (now < last_sample_time) last_sample_time = 0;
+    if (last_sample_time != 0 && now - last_sample_time < 1000) return;
+    last_sample_time = now;
+
+    profile_counter("Memory", now,
+        bh_aprintf(global_scratch_allocator,
+            "\"global heap\": %l, \"AST arena\": %l, \"entity arena\": %l, \"scratch\": %l",
+            (u64) mh.live_bytes,
+            context.ast_alloc_stats.live_bytes,
+            context.entities.entity_alloc_stats.live_bytes,
+            scratch_alloc_stats.live_bytes));
+
+    profile_counter("Objects", now,
+        bh_aprintf(global_scratch_allocator,
+            "\"entities\": %d, \"types\": %d, \"solidified procedures\": %d",
+            context.next_entity_id,
+            context.next_type_id,
+            context.solidified_function_count));
+}
+
+static void print_allocator_statistics(const char *name, AllocatorStats *stats, u64 reserved) {
+    printf("    %-16s %14llu %14llu %14llu %12llu %14llu\n", name,
+        (unsigned long long) stats->live_bytes, (unsigned long long) stats->peak_bytes,
+        (unsigned long long) stats->total_bytes, (unsigned long long) stats->allocation_count,
+        (unsigned long long) reserved);
+}
+
+static void print_memory_statistics() {
+    // TODO: Replace these with bh_printf when padded formatting is added.
+    printf("Memory:\n");
+    printf("    %-16s %14s %14s %14s %12s %14s\n", "Allocator", "Live bytes", "Peak bytes", "Total bytes", "Allocations", "Reserved");
+    printf("    %-16s %14lld %14lld %14lld %12llu %14s\n", "Global heap",
+        (long long) mh.live_bytes, (long long) mh.peak_bytes, (long long) mh.total_bytes, (unsigned long long) mh.allocation_count, "-");
+    print_allocator_statistics("AST arena", &context.ast_alloc_stats, arena_reserved_bytes(&context.ast_arena));
+    print_allocator_statistics("Entity arena", &context.entities.entity_alloc_stats, arena_reserved_bytes(&context.entities.entity_arena));
+    print_allocator_statistics("Scratch", &scratch_alloc_stats, global_scratch.end - global_scratch.memory);
+    printf("    (The scratch buffer starts over when it is full. Its live bytes count from the last time it did.)\n");
+
+    u64 peak_rss = peak_resident_bytes();
+    if (peak_rss > 0) printf("    Peak resident memory: %llu bytes\n", (unsigned long long) peak_rss);
+    printf("\n");
+
+    printf("    Types:                   %u\n", context.next_type_id);
+    printf("    Entities:                %u\n", context.next_entity_id);
+    printf("    Solidified procedures:   %u\n", context.solidified_function_count);
+    printf("    Solidified structures:   %u\n", context.solidified_struct_count);
+    printf("    Solidified unions:       %u\n", context.solidified_union_count);
+    printf("\n");
+
+    // NOTE: Only the node kinds that were allocated, from the most bytes to the fewest.
+    // Without -VV, only the largest ones are shown.
+    i32 kinds[Ast_Kind_Count];
+    i32 kind_count = 0;
+    fori (i, 0, Ast_Kind_Count) {
+        if (context.ast_nodes_per_kind[i] == 0) continue;
+
+        i32 j = kind_count++;
+        while (j > 0 && context.ast_bytes_per_kind[kinds[j - 1]] < context.ast_bytes_per_kind[i]) {
+            kinds[j] = kinds[j - 1];
+            j--;
+        }
+        kinds[j] = i;
+    }
+
+    i32 shown = context.options->verbose_output >= 2 ? kind_count : bh_min(kind_count, 12);
+
+    printf("    %-24s %10s %14s\n", "AST node kind", "Nodes", "Bytes");
+    fori (i, 0, shown) {
+        printf("    %-24s %10llu %14llu\n",
+            onyx_ast_node_kind_string(kinds[i]),
+            (unsigned long long) context.ast_nodes_per_kind[kinds[i]],
+            (unsigned long long) context.ast_bytes_per_kind[kinds[i]]);
+    }
+    printf("\n");
+}
+
 static i32 onyx_compile() {
     u64 start_time = bh_time_curr();
 
     if (context.options->fun_output)
         printf("\e[2J");
 
-    while (!bh_arr_is_empty(context.entities.entities)) {
+    // Set when any entity made progress since parked entities were last woken up.
+    b32 progress_since_unpark = 0;
+
+    while (1) {
+        if (bh_arr_is_empty(context.entities.entities)) {
+            if (context.entities.parked_count == 0) break;
+
+            // Every remaining entity is waiting on another entity. If nothing happened
+            // since the last time they were woken up, the recorded dependencies are not
+            // enough to make progress, so fall back to retrying every entity, which lets
+            // the cycle detection below run.
+            if (!progress_since_unpark) context.entities.parking_disabled = 1;
+
+            entity_heap_unpark_all(&context.entities);
+            progress_since_unpark = 0;
+            continue;
+        }
+
         Entity* ent = entity_heap_top(&context.entities);
 
 #if defined(_BH_LINUX)
@@ -944,8 +1209,28 @@ static i32 onyx_compile() {
             perf_entity_state = ent->state;
         }
 
+        context.entities.current = ent;
+        ent->waiting_on = NULL;
+
+        u64 profile_start = profile_now();
+        EntityState profile_state = ent->state;
+
         b32 changed = process_entity(ent);
 
+        if (profile_enabled()) {
+            profile_entity(ent, profile_state, profile_start, changed);
+            profile_memory_usage();
+        }
+
+        context.entities.current = NULL;
+        if (changed) {
+            ent->waiting_on = NULL;
+            entity_heap_wake_waiters(&context.entities, ent);
+
+            progress_since_unpark = 1;
+            context.entities.parking_disabled = 0;
+        }
+
         // NOTE: VERY VERY dumb cycle breaking. Basically, remember the first entity that did
         // not change (i.e. did not make any progress). Then everytime an entity doesn't change,
         // check if it is the same entity. If it is, it means all other entities that were processed
@@ -969,7 +1254,16 @@ static i32 onyx_compile() {
                     entity_heap_insert_existing(&context.entities, ent);
 
                     if (context.cycle_almost_detected == 3) {
-                        dump_cycles();
+                        if (context.entities.parked_count > 0) {
+                            // Parked entities have not been retried, so it is too early
+                            // to call this a cycle. Retry everything before giving up.
+                            context.entities.parking_disabled = 1;
+                            entity_heap_unpark_all(&context.entities);
+                            context.cycle_almost_detected = 0;
+                            watermarked_node = NULL;
+                        } else {
+                            dump_cycles();
+                        }
                     } else {
                         context.cycle_almost_detected += 1;
                     }
@@ -989,8 +1283,13 @@ static i32 onyx_compile() {
             return ONYX_COMPILER_PROGRESS_ERROR;
         }
 
-        if (ent->state != Entity_State_Finalized && ent->state != Entity_State_Failed)
-            entity_heap_insert_existing(&context.entities, ent);
+        if (ent->state != Entity_State_Finalized && ent->state != Entity_State_Failed) {
+            // An entity that yielded while waiting on another entity is parked until
+            // that entity changes state, instead of being retried right away.
+            if (changed || !entity_heap_park(&context.entities, ent)) {
+                entity_heap_insert_existing(&context.entities, ent);
+            }
+        }
 
         if (context.options->running_perf) {
             u64 perf_end = bh_time_curr_micro();
@@ -1014,6 +1313,8 @@ static i32 onyx_compile() {
         printf("    Processed %llu lines (%f lines/second).\n", context.lexer_lines_processed, ((f32) 1000 * context.lexer_lines_processed) / (duration));
         printf("    Processed %llu tokens (%f tokens/second).\n", context.lexer_tokens_processed, ((f32) 1000 * context.lexer_tokens_processed) / (duration));
         printf("\n");
+
+        print_memory_statistics();
     }
 
     if (context.options->generate_tag_file) {
@@ -1055,10 +1356,32 @@ static void link_wasm_module() {
     // CLEANUP: Properly handle this case.
     assert(onyx_wasm_build_link_options_from_node(&link_opts, link_options_node));
 
+    u64 link_start = profile_now();
     onyx_wasm_module_link(context.wasm_module, &link_opts);
+    profile_span("link", "Link module", link_start, profile_now(), 0, NULL);
+
+    u64 optimize_start = profile_now();
+    onyx_wasm_module_optimize(context.wasm_module, context.options->optimization_level);
+    profile_span("optimize", "Optimize module", optimize_start, profile_now(), 0, NULL);
+}
+
+static CompilerProgress onyx_flush_cached_module() {
+    bh_file output_file;
+    if (bh_file_create(&output_file, context.options->target_file) != BH_FILE_ERROR_NONE)
+        return ONYX_COMPILER_PROGRESS_FAILED_OUTPUT;
+
+    if (context.options->verbose_output)
+        bh_printf("Outputting cached WASM file: %s\n", output_file.filename);
+
+    bh_file_write(&output_file, context.cached_output.data, context.cached_output.length);
+    bh_file_close(&output_file);
+
+    return ONYX_COMPILER_PROGRESS_SUCCESS;
 }
 
 static CompilerProgress onyx_flush_module() {
+    if (context.cached_output.data) return onyx_flush_cached_module();
+
     link_wasm_module();
 
     // NOTE: Output to file
@@ -1095,17 +1418,22 @@ static CompilerProgress onyx_flush_module() {
 
         bh_file_close(&data_file);
     } else {
-        onyx_wasm_module_write_to_file(context.wasm_module, output_file);
+        bh_buffer code_buffer;
+        onyx_wasm_module_write_to_buffer(context.wasm_module, &code_buffer);
+        bh_file_write(&output_file, code_buffer.data, code_buffer.length);
+
+        compile_cache_store(code_buffer);
     }
 
     bh_file_close(&output_file);
 
+    profile_write_and_free();
     return ONYX_COMPILER_PROGRESS_SUCCESS;
 }
 
 #ifdef ONYX_RUNTIME_LIBRARY
 static b32 onyx_run_module(bh_buffer code_buffer) {
-    onyx_run_initialize(context.options->debug_session);
+    onyx_run_initialize(context.options->debug_session, context.options->run_profile_file);
 
     if (context.options->verbose_output > 0)
         bh_printf("Running program:\n");
@@ -1124,31 +1452,52 @@ static b32 onyx_run_wasm_file(const char *filename) {
 }
 
 static b32 onyx_run() {
+    if (context.cached_output.data) return onyx_run_module(context.cached_output);
+
     link_wasm_module();
 
     bh_buffer code_buffer;
     onyx_wasm_module_write_to_buffer(context.wasm_module, &code_buffer);
 
+    compile_cache_store(code_buffer);
+
+    // Written before running, because the program can exit without returning.
+    profile_write_and_free();
     return onyx_run_module(code_buffer);
 
 }
 #endif
 
-static bh_managed_heap mh;
-
 CompilerProgress do_compilation(CompileOptions *compile_opts) {
     bh_scratch_init(&global_scratch, bh_heap_allocator(), 256 * 1024); // NOTE: 256 KiB
-    global_scratch_allocator = bh_scratch_allocator(&global_scratch);
+    memset(&scratch_alloc_stats, 0, sizeof(scratch_alloc_stats));
+    global_scratch_allocator = counting_allocator(&scratch_alloc_stats, bh_scratch_allocator(&global_scratch));
+    scratch_alloc_stats.wraps_around = 1;
 
     bh_managed_heap_init(&mh);
     global_heap_allocator = bh_managed_heap_allocator(&mh);
     // global_heap_allocator = bh_heap_allocator();
+    profile_init(compile_opts->profile_file);
+    frontend_pool_init(compile_opts->job_count);
     context_init(compile_opts);
 
+    // A cached output would leave nothing to profile.
+    compile_cache_init(compile_opts);
+    if (!profile_enabled() && compile_cache_lookup(&context.cached_output)) {
+        if (compile_opts->verbose_output)
+            bh_printf("Using cached output:       nothing changed since the last compilation.\n");
+
+        return ONYX_COMPILER_PROGRESS_SUCCESS;
+    }
+
     return onyx_compile();
 }
 
 void cleanup_compilation() {
+    // Nothing is left to write if the profile was written after the output.
+    profile_write_and_free();
+
+    frontend_pool_free();
     context_free();
 
     bh_scratch_free(&global_scratch);
@@ -1168,21 +1517,29 @@ static void onyx_watch_stop(int sig) {
 static void onyx_watch(CompileOptions *compile_opts) {
     signal(SIGINT, onyx_watch_stop);
 
+    // Keep the tokens of every file between compilations, so only the files
+    // that changed are read and lexed again.
+    frontend_resident_enable();
+
     b32 running_watch = 1;
 
     do {
         bh_printf("\e[2J\e[?25l\n");
         bh_printf("\e[3;1H");
 
+        u64 start_time = bh_time_curr();
+
         if (do_compilation(compile_opts) == ONYX_COMPILER_PROGRESS_SUCCESS) {
             onyx_flush_module();
             bh_printf("\e[92mNo errors.\n");
         }
 
+        u64 duration = bh_time_duration(start_time);
+
         char time_buf[128] = {0};
         time_t now = time(NULL);
         strftime(time_buf, 128, "%X", localtime(&now));
-        bh_printf("\e[1;1H\e[30;105m Onyx " VERSION " \e[30;104m Built %s \e[0m", time_buf);
+        bh_printf("\e[1;1H\e[30;105m Onyx " VERSION " \e[30;104m Built %s in %l ms \e[0m", time_buf, duration);
 
         i32 errors = bh_arr_length(context.errors.errors);
         if (errors == 0) {
@@ -1199,13 +1556,20 @@ static void onyx_watch(CompileOptions *compile_opts) {
 
         cleanup_compilation();
 
-        if (!bh_file_watch_wait(&watches)) {
-            running_watch = 0;
-        }
+        // Editors can write a file without changing it. Rebuilding would produce
+        // the same result, so keep waiting until something actually changed.
+        do {
+            if (!bh_file_watch_wait(&watches)) {
+                running_watch = 0;
+                break;
+            }
+        } while (frontend_resident_unchanged());
 
         bh_file_watch_free(&watches);
     } while(running_watch);
 
+    frontend_resident_free();
+
 
     bh_printf("\e[2J\e[1;1H\e[?25h\n");
 }
@@ -8,11 +8,11 @@
 extern const char _binary__tmp_out_wasm_start;
 extern const char _binary__tmp_out_wasm_end;
 
-void onyx_run_initialize(int debug);
+void onyx_run_initialize(int debug, const char *profile_path);
 int  onyx_run_wasm(bh_buffer, int argc, char **argv);
 
 int main(int argc, char *argv[]) {
-    onyx_run_initialize(0);
+    onyx_run_initialize(0, NULL);
 
     bh_buffer data;
     data.data = (char *) &_binary__tmp_out_wasm_start;
@@ -23,7 +23,7 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    onyx_run_initialize(debug);
+    onyx_run_initialize(debug, NULL);
 
     bh_file wasm_file;
     bh_file_error err = bh_file_open(&wasm_file, argv[wasm_file_idx]);
@@ -3050,6 +3050,10 @@ static AstFunction* parse_function_definition(OnyxParser* parser, OnyxToken* tok
             func_def->deprecated_warning = (AstStrLit *) parse_expression(parser, 0);
         }
 
+        else if (parse_possible_directive(parser, "inline")) {
+            func_def->is_inline = 1;
+        }
+
         else {
             OnyxToken* directive_token = expect_token(parser, '#');
             OnyxToken* symbol_token = expect_token(parser, Token_Type_Symbol);
@@ -4197,6 +4201,9 @@ void* onyx_ast_node_new(bh_allocator alloc, i32 size, AstKind kind) {
     memset(node, 0, size);
     *(AstKind *) node = kind;
 
+    context.ast_nodes_per_kind[kind] += 1;
+    context.ast_bytes_per_kind[kind] += size;
+
     return node;
 }
 
@@ -21,7 +21,8 @@ AstTyped node_that_signals_a_yield = { Ast_Kind_Function, 0 };
 AstTyped node_that_signals_failure = { Ast_Kind_Error, 0 };
 
 static void ensure_polyproc_cache_is_created(AstFunction* pp) {
-    if (pp->concrete_funcs == NULL)        sh_new_arena(pp->concrete_funcs);
+    // The table is created eagerly, because partially applied procedures share it.
+    if (pp->concrete_funcs == NULL)        hmdefault(pp->concrete_funcs, (AstSolidifiedFunction) { 0 });
     if (pp->active_queries.hashes == NULL) bh_imap_init(&pp->active_queries, global_heap_allocator, 31);
 }
 
@@ -60,50 +61,145 @@ static void insert_poly_slns_into_scope(Scope* scope, bh_arr(AstPolySolution) sl
     }
 }
 
-// NOTE: This might return a volatile string. Do not store it without copying it.
-static char* build_poly_solution_key(AstPolySolution* sln) {
-    if (sln->kind == PSK_Type) {
-        return (char *) type_get_unique_name(sln->type);
+//
+// Polymorphic solutions are interned so that the caches of solidified procedures, structures
+// and unions can be keyed by an integer. Looking up a list of solutions hashes it and probes
+// a single table, and nothing is allocated unless the list has not been seen before.
+//
+// Two lists are the same if their variables have the same names and their solutions are the
+// same. Nominal types (structures, enums, unions and distinct types) are compared by id, but
+// other types are compared structurally, because function and compound types are not always
+// deduplicated by the type system.
+//
+
+static inline u64 poly_hash_combine(u64 hash, u64 value) {
+    return (hash ^ value) * 0x100000001b3;
+}
 
-    } else if (sln->kind == PSK_Value) {
-        static char buffer[256];
+static u64 poly_hash_string(u64 hash, const char *text, i32 length) {
+    fori (i, 0, length) hash = poly_hash_combine(hash, (u8) text[i]);
+    return hash;
+}
 
-        fori (i, 0, 256) buffer[i] = 0;
+static u64 poly_hash_type(u64 hash, Type *type) {
+    if (type == NULL) return poly_hash_combine(hash, 0);
 
-        if (sln->value->kind == Ast_Kind_NumLit) {
-            strncat(buffer, "NUMLIT:", 127);
-            strncat(buffer, bh_bprintf("%l", ((AstNumLit *) sln->value)->value.l), 127);
+    hash = poly_hash_combine(hash, type->kind);
 
-        } else {
-            // HACK: For now, the value pointer is just used. This means that
-            // sometimes, even through the solution is the same, it won't be
-            // stored the same.
-            bh_snprintf(buffer, 128, "%p", sln->value);
-        }
+    switch (type->kind) {
+        case Type_Kind_Basic:        return poly_hash_string(hash, type->Basic.name, strlen(type->Basic.name));
+        case Type_Kind_Pointer:      return poly_hash_type(hash, type->Pointer.elem);
+        case Type_Kind_MultiPointer: return poly_hash_type(hash, type->MultiPointer.elem);
+        case Type_Kind_Slice:        return poly_hash_type(hash, type->Slice.elem);
+        case Type_Kind_VarArgs:      return poly_hash_type(hash, type->VarArgs.elem);
+        case Type_Kind_DynArray:     return poly_hash_type(hash, type->DynArray.elem);
+        case Type_Kind_Array:        return poly_hash_type(poly_hash_combine(hash, type->Array.count), type->Array.elem);
+
+        case Type_Kind_Function:
+            hash = poly_hash_combine(hash, type->Function.needed_param_count);
+            fori (i, 0, type->Function.param_count) hash = poly_hash_type(hash, type->Function.params[i]);
+            return poly_hash_type(hash, type->Function.return_type);
+
+        case Type_Kind_Compound:
+            fori (i, 0, type->Compound.count) hash = poly_hash_type(hash, type->Compound.types[i]);
+            return hash;
 
-        return buffer;
+        default: return poly_hash_combine(hash, type->id);
     }
+}
 
-    return NULL;
+static b32 poly_types_match(Type *a, Type *b) {
+    if (a == b) return 1;
+    if (a == NULL || b == NULL) return 0;
+    if (a->kind != b->kind) return 0;
+
+    switch (a->kind) {
+        case Type_Kind_Basic:        return !strcmp(a->Basic.name, b->Basic.name);
+        case Type_Kind_Pointer:      return poly_types_match(a->Pointer.elem, b->Pointer.elem);
+        case Type_Kind_MultiPointer: return poly_types_match(a->MultiPointer.elem, b->MultiPointer.elem);
+        case Type_Kind_Slice:        return poly_types_match(a->Slice.elem, b->Slice.elem);
+        case Type_Kind_VarArgs:      return poly_types_match(a->VarArgs.elem, b->VarArgs.elem);
+        case Type_Kind_DynArray:     return poly_types_match(a->DynArray.elem, b->DynArray.elem);
+        case Type_Kind_Array:        return a->Array.count == b->Array.count && poly_types_match(a->Array.elem, b->Array.elem);
+
+        case Type_Kind_Function:
+            if (a->Function.param_count != b->Function.param_count) return 0;
+            if (a->Function.needed_param_count != b->Function.needed_param_count) return 0;
+            fori (i, 0, a->Function.param_count) {
+                if (!poly_types_match(a->Function.params[i], b->Function.params[i])) return 0;
+            }
+            return poly_types_match(a->Function.return_type, b->Function.return_type);
+
+        case Type_Kind_Compound:
+            if (a->Compound.count != b->Compound.count) return 0;
+            fori (i, 0, a->Compound.count) {
+                if (!poly_types_match(a->Compound.types[i], b->Compound.types[i])) return 0;
+            }
+            return 1;
+
+        default: return a->id == b->id;
+    }
 }
 
-// NOTE: This returns a volatile string. Do not store it without copying it.
-static char* build_poly_slns_unique_key(bh_arr(AstPolySolution) slns) {
-    static char key_buf[1024];
-    fori (i, 0, 1024) key_buf[i] = 0;
+static u64 poly_hash_solution(u64 hash, AstPolySolution *sln) {
+    OnyxToken *name = sln->poly_sym->token;
+    hash = poly_hash_string(hash, name->text, name->length);
+    hash = poly_hash_combine(hash, sln->kind);
 
-    bh_arr_each(AstPolySolution, sln, slns) {
-        token_toggle_end(sln->poly_sym->token);
+    if (sln->kind == PSK_Type) return poly_hash_type(hash, sln->type);
+
+    // HACK: Values other than numeric literals are identified by their node. This means
+    // that sometimes, even though the solution is the same, it won't be stored the same.
+    if (sln->value->kind == Ast_Kind_NumLit) return poly_hash_combine(hash, ((AstNumLit *) sln->value)->value.l);
+    return poly_hash_combine(hash, (u64) sln->value);
+}
+
+static b32 poly_solutions_match(AstPolySolution *a, AstPolySolution *b) {
+    OnyxToken *a_name = a->poly_sym->token;
+    OnyxToken *b_name = b->poly_sym->token;
+    if (a_name->length != b_name->length || strncmp(a_name->text, b_name->text, a_name->length)) return 0;
 
-        strncat(key_buf, sln->poly_sym->token->text, 1023);
-        strncat(key_buf, "=", 1023);
-        strncat(key_buf, build_poly_solution_key(sln), 1023);
-        strncat(key_buf, ";", 1023);
+    if (a->kind != b->kind) return 0;
+    if (a->kind == PSK_Type) return poly_types_match(a->type, b->type);
 
-        token_toggle_end(sln->poly_sym->token);
+    if (a->value->kind == Ast_Kind_NumLit && b->value->kind == Ast_Kind_NumLit) {
+        return ((AstNumLit *) a->value)->value.l == ((AstNumLit *) b->value)->value.l;
     }
 
-    return key_buf;
+    return a->value == b->value;
+}
+
+static u64 intern_poly_solutions(bh_arr(AstPolySolution) slns) {
+    u64 hash = 0xcbf29ce484222325;
+    bh_arr_each(AstPolySolution, sln, slns) hash = poly_hash_solution(hash, sln);
+
+    // Colliding lists are placed at the next hash in this sequence.
+    while (1) {
+        i32 index = hmgeti(context.caches.poly_solution_tuples, hash);
+        if (index == -1) break;
+
+        PolySolutionTuple *tuple = context.caches.poly_solution_tuples[index].value;
+        if (bh_arr_length(tuple->slns) == bh_arr_length(slns)) {
+            b32 all_match = 1;
+            fori (i, 0, bh_arr_length(slns)) {
+                if (!poly_solutions_match(&tuple->slns[i], &slns[i])) {
+                    all_match = 0;
+                    break;
+                }
+            }
+
+            if (all_match) return tuple->id;
+        }
+
+        hash = poly_hash_combine(hash, 1);
+    }
+
+    PolySolutionTuple *tuple = bh_alloc_item(global_heap_allocator, PolySolutionTuple);
+    tuple->id = context.caches.next_poly_solution_tuple_id++;
+    tuple->slns = bh_arr_copy(global_heap_allocator, slns);
+
+    hmput(context.caches.poly_solution_tuples, hash, tuple);
+    return tuple->id;
 }
 
 // NOTE: This function adds a solidified function to the entity heap for it to be processed
@@ -779,6 +875,7 @@ static bh_arr(AstPolySolution) find_polymorphic_slns(AstFunction* pp, PolyProcLo
         if (query->entity->state == Entity_State_Finalized) return query->slns;
         if (query->entity->state == Entity_State_Failed)    return NULL;
 
+        entity_wait_on(&context.entities, query->entity);
         flag_to_yield = 1;
         return NULL;
     }
@@ -818,7 +915,10 @@ AstFunction* polymorphic_proc_lookup(AstFunction* pp, PolyProcLookupMethod pp_lo
 
     // Ensure the polymorphic procedure is ready to be solved for.
     assert(pp->entity);
-    if (pp->entity->state < Entity_State_Check_Types) return (AstFunction *) &node_that_signals_a_yield;
+    if (pp->entity->state < Entity_State_Check_Types) {
+        entity_wait_on(&context.entities, pp->entity);
+        return (AstFunction *) &node_that_signals_a_yield;
+    }
 
     ensure_polyproc_cache_is_created(pp);
 
@@ -840,8 +940,8 @@ AstFunction* polymorphic_proc_solidify(AstFunction* pp, bh_arr(AstPolySolution)
     ensure_polyproc_cache_is_created(pp);
 
     // NOTE: Check if a version of this polyproc has already been created.
-    char* unique_key = build_poly_slns_unique_key(slns);
-    i32 index = shgeti(pp->concrete_funcs, unique_key);
+    u64 slns_id = intern_poly_solutions(slns);
+    i32 index = hmgeti(pp->concrete_funcs, slns_id);
     if (index != -1) {
         AstSolidifiedFunction solidified_func = pp->concrete_funcs[index].value;
 
@@ -861,9 +961,11 @@ AstFunction* polymorphic_proc_solidify(AstFunction* pp, bh_arr(AstPolySolution)
 
     AstSolidifiedFunction solidified_func = generate_solidified_function(pp, slns, tkn, 0);
     add_solidified_function_entities(&solidified_func);
+    entity_wait_on(&context.entities, solidified_func.func_header_entity);
 
     // NOTE: Cache the function for later use, reducing duplicate functions.
-    shput(pp->concrete_funcs, unique_key, solidified_func);
+    hmput(pp->concrete_funcs, slns_id, solidified_func);
+    context.solidified_function_count += 1;
 
     return (AstFunction *) &node_that_signals_a_yield;
 }
@@ -940,8 +1042,8 @@ AstFunction* polymorphic_proc_build_only_header(AstFunction* pp, PolyProcLookupM
 AstFunction* polymorphic_proc_build_only_header_with_slns(AstFunction* pp, bh_arr(AstPolySolution) slns, b32 error_if_failed) {
     AstSolidifiedFunction solidified_func;
 
-    char* unique_key = build_poly_slns_unique_key(slns);
-    i32 index = shgeti(pp->concrete_funcs, unique_key);
+    u64 slns_id = intern_poly_solutions(slns);
+    i32 index = hmgeti(pp->concrete_funcs, slns_id);
     if (index != -1) {
         solidified_func = pp->concrete_funcs[index].value;
 
@@ -956,6 +1058,7 @@ AstFunction* polymorphic_proc_build_only_header_with_slns(AstFunction* pp, bh_ar
         if (solidified_func.func_header_entity->state == Entity_State_Finalized) return solidified_func.func;
         if (solidified_func.func_header_entity->state == Entity_State_Failed)    return NULL;
 
+        entity_wait_on(&context.entities, solidified_func.func_header_entity);
         return (AstFunction *) &node_that_signals_a_yield;
     }
 
@@ -971,9 +1074,11 @@ AstFunction* polymorphic_proc_build_only_header_with_slns(AstFunction* pp, bh_ar
 
     Entity* func_header_entity_ptr = entity_heap_insert(&context.entities, func_header_entity);
     solidified_func.func_header_entity = func_header_entity_ptr;
+    entity_wait_on(&context.entities, func_header_entity_ptr);
 
     // NOTE: Cache the function for later use.
-    shput(pp->concrete_funcs, unique_key, solidified_func);
+    hmput(pp->concrete_funcs, slns_id, solidified_func);
+    context.solidified_function_count += 1;
 
     return (AstFunction *) &node_that_signals_a_yield;
 }
@@ -1167,10 +1272,6 @@ Type* polymorphic_struct_lookup(AstPolyStructType* ps_type, bh_arr(AstPolySoluti
 
     assert(!ps_type->base_struct->scope);
 
-    if (ps_type->concrete_structs == NULL) {
-        sh_new_arena(ps_type->concrete_structs);
-    }
-
     if (bh_arr_length(slns) != bh_arr_length(ps_type->poly_params)) {
         onyx_report_error(pos, Error_Critical, "Wrong number of arguments for '%s'. Expected %d, got %d.",
             ps_type->name,
@@ -1186,12 +1287,13 @@ Type* polymorphic_struct_lookup(AstPolyStructType* ps_type, bh_arr(AstPolySoluti
         i++;
     }
 
-    char* unique_key = build_poly_slns_unique_key(slns);
-    i32 index = shgeti(ps_type->concrete_structs, unique_key);
+    u64 slns_id = intern_poly_solutions(slns);
+    i32 index = hmgeti(ps_type->concrete_structs, slns_id);
     if (index != -1) {
         AstStructType* concrete_struct = ps_type->concrete_structs[index].value;
 
         if (concrete_struct->entity_type->state < Entity_State_Check_Types) {
+            entity_wait_on(&context.entities, concrete_struct->entity_type);
             return NULL;
         }
 
@@ -1228,7 +1330,8 @@ Type* polymorphic_struct_lookup(AstPolyStructType* ps_type, bh_arr(AstPolySoluti
         concrete_struct->polymorphic_argument_types[i] = (AstType *) ast_clone(context.ast_alloc, ps_type->poly_params[i].type_node);
     }
 
-    shput(ps_type->concrete_structs, unique_key, concrete_struct);
+    hmput(ps_type->concrete_structs, slns_id, concrete_struct);
+    context.solidified_struct_count += 1;
     add_entities_for_node(NULL, (AstNode *) concrete_struct, sln_scope, NULL);
     return NULL;
 }
@@ -1240,10 +1343,6 @@ Type* polymorphic_union_lookup(AstPolyUnionType* pu_type, bh_arr(AstPolySolution
 
     assert(!pu_type->base_union->scope);
 
-    if (pu_type->concrete_unions == NULL) {
-        sh_new_arena(pu_type->concrete_unions);
-    }
-
     if (bh_arr_length(slns) != bh_arr_length(pu_type->poly_params)) {
         onyx_report_error(pos, Error_Critical, "Wrong number of arguments for '%s'. Expected %d, got %d.",
             pu_type->name,
@@ -1259,12 +1358,13 @@ Type* polymorphic_union_lookup(AstPolyUnionType* pu_type, bh_arr(AstPolySolution
         i++;
     }
 
-    char* unique_key = build_poly_slns_unique_key(slns);
-    i32 index = shgeti(pu_type->concrete_unions, unique_key);
+    u64 slns_id = intern_poly_solutions(slns);
+    i32 index = hmgeti(pu_type->concrete_unions, slns_id);
     if (index != -1) {
         AstUnionType* concrete_union = pu_type->concrete_unions[index].value;
 
         if (concrete_union->entity->state < Entity_State_Check_Types) {
+            entity_wait_on(&context.entities, concrete_union->entity);
             return NULL;
         }
 
@@ -1301,7 +1401,8 @@ Type* polymorphic_union_lookup(AstPolyUnionType* pu_type, bh_arr(AstPolySolution
         concrete_union->polymorphic_argument_types[i] = (AstType *) ast_clone(context.ast_alloc, pu_type->poly_params[i].type_node);
     }
 
-    shput(pu_type->concrete_unions, unique_key, concrete_union);
+    hmput(pu_type->concrete_unions, slns_id, concrete_union);
+    context.solidified_union_count += 1;
     add_entities_for_node(NULL, (AstNode *) concrete_union, sln_scope, NULL);
     return NULL;
 }
@@ -0,0 +1,233 @@
+#include "profile.h"
+#include "utils.h"
+
+typedef struct ProfileEvent {
+    const char *category;
+    char *name;
+    char *args;
+
+    u64 start;
+    u64 duration;
+    i32 thread;
+
+    // 'X' for spans, 'C' for counters.
+    char phase;
+} ProfileEvent;
+
+typedef struct Profile {
+    b32 enabled;
+    char *filename;
+    u64 start_time;
+    i32 thread_count;
+
+    bh_arr(ProfileEvent) events;
+} Profile;
+
+// The profile is allocated from the C heap, because it is written after
+// the compilation is done, and can include work done by worker threads.
+static Profile profile;
+
+void profile_init(const char *filename) {
+    memset(&profile, 0, sizeof(profile));
+    if (filename == NULL) return;
+
+    profile.enabled = 1;
+    profile.filename = bh_strdup(bh_heap_allocator(), (char *) filename);
+    profile.start_time = bh_time_curr_micro();
+    profile.thread_count = 1;
+    bh_arr_new(bh_heap_allocator(), profile.events, 1024);
+}
+
+b32 profile_enabled() {
+    return profile.enabled;
+}
+
+u64 profile_now() {
+    return bh_time_curr_micro() - profile.start_time;
+}
+
+void profile_span(const char *category, const char *name, u64 start, u64 end, i32 thread, const char *args) {
+    if (!profile.enabled) return;
+
+    ProfileEvent event;
+    event.category = category;
+    event.name = bh_strdup(bh_heap_allocator(), (char *) name);
+    event.args = args ? bh_strdup(bh_heap_allocator(), (char *) args) : NULL;
+    event.start = start;
+    event.duration = end >= start ? end - start : 0;
+    event.thread = thread;
+    event.phase = 'X';
+    bh_arr_push(profile.events, event);
+
+    profile.thread_count = bh_max(profile.thread_count, thread + 1);
+}
+
+void profile_counter(const char *name, u64 time, const char *args) {
+    if (!profile.enabled) return;
+
+    ProfileEvent event;
+    event.category = "memory";
+    event.name = bh_strdup(bh_heap_allocator(), (char *) name);
+    event.args = bh_strdup(bh_heap_allocator(), (char *) args);
+    event.start = time;
+    event.duration = 0;
+    event.thread = 0;
+    event.phase = 'C';
+    bh_arr_push(profile.events, event);
+}
+
+char *profile_json_string(const char *str, i32 length) {
+    if (str == NULL) return "null";
+    if (length < 0) length = strlen(str);
+
+    // Every character takes at most 6 bytes, for \u00XX.
+    char *out = bh_alloc(global_scratch_allocator, length * 6 + 3);
+    char *c = out;
+
+    *c++ = '"';
+    fori (i, 0, length) {
+        u8 ch = str[i];
+        switch (ch) {
+            case '"':  *c++ = '\\'; *c++ = '"';  break;
+            case '\\': *c++ = '\\'; *c++ = '\\'; break;
+            case '\n': *c++ = '\\'; *c++ = 'n';  break;
+            case '\t': *c++ = '\\'; *c++ = 't';  break;
+            case '\r': *c++ = '\\'; *c++ = 'r';  break;
+            default:
+                if (ch < 0x20) {
+                    c += snprintf(c, 7, "\\u%04x", ch);
+                } else {
+                    *c++ = ch;
+                }
+                break;
+        }
+    }
+    *c++ = '"';
+    *c = '\0';
+
+    return out;
+}
+
+void profile_write_and_free() {
+    if (!profile.enabled) return;
+
+    bh_file file;
+    if (bh_file_create(&file, profile.filename) != BH_FILE_ERROR_NONE) {
+        bh_printf_err("Failed to open profile file for writing: '%s'\n", profile.filename);
+
+    } else {
+        bh_fprintf(&file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+        bh_fprintf(&file, "{\"ph\": \"M\", \"name\": \"process_name\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"onyx\"}}");
+        fori (i, 0, profile.thread_count) {
+            bh_fprintf(&file, ",\n{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s %d\"}}",
+                i, i == 0 ? "Main thread" : "Front end worker", i);
+        }
+
+        // bh_fprintf formats into a fixed buffer, so names and arguments are
+        // written directly instead of being formatted.
+        bh_arr_each(ProfileEvent, event, profile.events) {
+            if (event->phase == 'C') {
+                bh_fprintf(&file, ",\n{\"ph\": \"C\", \"pid\": 1, \"tid\": 0, \"ts\": %l, \"cat\": \"%s\", \"name\": ",
+                    event->start, event->category);
+            } else {
+                bh_fprintf(&file, ",\n{\"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %l, \"dur\": %l, \"cat\": \"%s\", \"name\": ",
+                    event->thread, event->start, event->duration, event->category);
+            }
+
+            char *name = profile_json_string(event->name, -1);
+            bh_file_write(&file, name, strlen(name));
+
+            if (event->args) {
+                bh_fprintf(&file, ", \"args\": {");
+                bh_file_write(&file, event->args, strlen(event->args));
+                bh_fprintf(&file, "}");
+            }
+
+            bh_fprintf(&file, "}");
+        }
+
+        bh_fprintf(&file, "\n]}\n");
+        bh_file_close(&file);
+    }
+
+    bh_arr_each(ProfileEvent, event, profile.events) {
+        bh_free(bh_heap_allocator(), event->name);
+        if (event->args) bh_free(bh_heap_allocator(), event->args);
+    }
+
+    bh_arr_free(profile.events);
+    bh_free(bh_heap_allocator(), profile.filename);
+    memset(&profile, 0, sizeof(profile));
+}
+
+
+//
+// Allocator statistics
+//
+
+static BH_ALLOCATOR_PROC(counting_allocator_proc) {
+    AllocatorStats *stats = (AllocatorStats *) data;
+
+    ptr result = stats->backing.proc(stats->backing.data, action, size, alignment, prev_memory, flags);
+
+    if (result != NULL && (action == bh_allocator_action_alloc || action == bh_allocator_action_resize)) {
+        if (stats->wraps_around && stats->last_allocation != NULL && (u8 *) result < (u8 *) stats->last_allocation) {
+            stats->live_bytes = 0;
+        }
+
+        stats->last_allocation = result;
+        stats->allocation_count += 1;
+        stats->total_bytes += size;
+        stats->live_bytes += size;
+        if (stats->live_bytes > stats->peak_bytes) stats->peak_bytes = stats->live_bytes;
+    }
+
+    return result;
+}
+
+bh_allocator counting_allocator(AllocatorStats *stats, bh_allocator backing) {
+    stats->backing = backing;
+
+    return (bh_allocator) {
+        .proc = counting_allocator_proc,
+        .data = stats,
+    };
+}
+
+void counting_allocator_reset(AllocatorStats *stats) {
+    stats->live_bytes = 0;
+    stats->last_allocation = NULL;
+}
+
+u64 arena_reserved_bytes(bh_arena *arena) {
+    u64 chunks = 0;
+
+    bh__arena_internal *walker = (bh__arena_internal *) arena->first_arena;
+    while (walker != NULL) {
+        chunks += 1;
+        walker = walker->next_arena;
+    }
+
+    return chunks * arena->arena_size;
+}
+
+#if defined(_BH_LINUX) || defined(_BH_DARWIN)
+#include <sys/resource.h>
+#endif
+
+u64 peak_resident_bytes() {
+#if defined(_BH_LINUX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return (u64) usage.ru_maxrss * 1024;
+
+#elif defined(_BH_DARWIN)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return (u64) usage.ru_maxrss;
+
+#else
+    return 0;
+#endif
+}
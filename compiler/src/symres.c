@@ -1207,7 +1207,10 @@ SymresStatus symres_function_header(AstFunction* func) {
 }
 
 SymresStatus symres_function(AstFunction* func) {
-    if (func->entity_header && func->entity_header->state < Entity_State_Check_Types) return Symres_Yield_Macro;
+    if (func->entity_header && func->entity_header->state < Entity_State_Check_Types) {
+        entity_wait_on(&context.entities, func->entity_header);
+        return Symres_Yield_Macro;
+    }
     if (func->kind == Ast_Kind_Polymorphic_Proc) return Symres_Complete;
     if (func->flags & Ast_Flag_Function_Is_Lambda_Inside_PolyProc) return Symres_Complete;
     assert(func->scope);
@@ -416,7 +416,10 @@ static Type* type_build_from_ast_inner(bh_allocator alloc, AstType* type_node, b
             AstStructType* s_node = (AstStructType *) type_node;
             if (s_node->stcache != NULL) return s_node->stcache;
             if (s_node->pending_type != NULL && s_node->pending_type_is_valid) return s_node->pending_type;
-            if (!s_node->ready_to_build_type) return NULL;
+            if (!s_node->ready_to_build_type) {
+                entity_wait_on(&context.entities, s_node->entity_type);
+                return NULL;
+            }
 
             Type* s_type;
             if (s_node->pending_type == NULL) {
@@ -465,6 +468,11 @@ static Type* type_build_from_ast_inner(bh_allocator alloc, AstType* type_node, b
                 }
 
                 if (!type_is_ready_to_be_used_in_construction((*member)->type)) {
+                    AstType *member_ast = (*member)->type->ast_type;
+                    if (member_ast && member_ast->kind == Ast_Kind_Struct_Type) {
+                        entity_wait_on(&context.entities, ((AstStructType *) member_ast)->entity_type);
+                    }
+
                     s_node->pending_type_is_valid = 0;
                     return accept_partial_types ? s_node->pending_type : NULL;
                 }
@@ -499,6 +499,9 @@ void add_overload_option(bh_arr(OverloadOption)* poverloads, u64 order, AstTyped
     }
 
     *poverloads = overloads;
+
+    // Any cached overload set could include this group, so they all have to be rebuilt.
+    context.caches.overload_generation++;
 }
 
 // NOTE: The job of this function is to take a set of overloads, and traverse it to add all possible
@@ -532,21 +535,132 @@ void build_all_overload_options(bh_arr(OverloadOption) overloads, bh_imap* all_o
     }
 }
 
-AstTyped* find_matching_overload_by_arguments(bh_arr(OverloadOption) overloads, Arguments* param_args) {
-    Arguments args;
-    arguments_clone(&args, param_args);
-    arguments_ensure_length(&args, bh_arr_length(args.values) + bh_arr_length(args.named_values));
+// NOTE: Overloaded functions like hash.hash or conv.format are looked up thousands of times
+// in a single compilation, so the flattened list of options is cached per set of overloads.
+// The cache is keyed by the bh_arr itself, which is only ever reallocated by add_overload_option,
+// and that invalidates every set anyway.
+OverloadSet *get_overload_set(bh_arr(OverloadOption) overloads) {
+    if (context.caches.overload_sets.entries == NULL) {
+        bh_imap_init(&context.caches.overload_sets, global_heap_allocator, 64);
+    }
+
+    OverloadSet *set = (OverloadSet *) bh_imap_get(&context.caches.overload_sets, (u64) overloads);
+    if (set == NULL) {
+        set = bh_alloc_item(global_heap_allocator, OverloadSet);
+        memset(set, 0, sizeof *set);
+
+        bh_imap_put(&context.caches.overload_sets, (u64) overloads, (u64) set);
+
+    } else if (set->generation == context.caches.overload_generation) {
+        return set;
+    }
 
-    // CLEANUP SPEED: This currently rebuilds the complete set of overloads every time one is looked up.
-    // This should be cached in the AstOverloadedFunction or somewhere like that.
     bh_imap all_overloads;
     bh_imap_init(&all_overloads, global_heap_allocator, bh_arr_length(overloads) * 2);
     build_all_overload_options(overloads, &all_overloads);
 
+    // A new array is used instead of clearing the old one, because a lookup further up the
+    // stack could still be iterating over the old options.
+    set->options = NULL;
+    bh_arr_new(global_heap_allocator, set->options, bh_arr_length(all_overloads.entries));
+    bh_arr_each(bh__imap_entry, entry, all_overloads.entries) {
+        bh_arr_push(set->options, (AstTyped *) entry->key);
+    }
+
+    bh_imap_free(&all_overloads);
+
+    if (set->matches != NULL) {
+        shfree(set->matches);
+        set->matches = NULL;
+    }
+
+    set->generation = context.caches.overload_generation;
+    return set;
+}
+
+//
+// Returns the type used to key the overload memo for this argument, or NULL if the
+// result of matching the argument could depend on more than its type. Literals,
+// auto-casts, struct literals and the like are unified specially against each option,
+// and baked arguments depend on their value, so none of those are memoized.
+static Type* overload_memo_argument_type(AstTyped *node) {
+    if (node == NULL) return NULL;
+
+    if (node->kind == Ast_Kind_Argument) {
+        if (((AstArgument *) node)->is_baked) return NULL;
+        node = ((AstArgument *) node)->value;
+    }
+
+    if (node == NULL) return NULL;
+
+    switch (node->kind) {
+        case Ast_Kind_Local:
+        case Ast_Kind_Param:
+        case Ast_Kind_Global:
+        case Ast_Kind_Field_Access:
+        case Ast_Kind_Subscript:
+        case Ast_Kind_Dereference:
+        case Ast_Kind_Call:
+            break;
+
+        default: return NULL;
+    }
+
+    Type *type = node->type;
+    if (type == NULL) return NULL;
+
+    // Function types can have their return type filled in by unification, and compound
+    // types record how many return values are ignored, so these are not safe to skip.
+    if (type->kind == Type_Kind_Function || type->kind == Type_Kind_Compound) return NULL;
+
+    return type;
+}
+
+static char* build_overload_memo_key(Arguments *args) {
+    static char key_buf[1024];
+    i32 len = 0;
+
+    bh_arr_each(AstTyped *, arg, args->values) {
+        Type *type = overload_memo_argument_type(*arg);
+        if (type == NULL) return NULL;
+
+        len += snprintf(key_buf + len, 1024 - len, "%u;", type->id);
+        if (len >= 1000) return NULL;
+    }
+
+    bh_arr_each(AstNamedValue *, named_value, args->named_values) {
+        Type *type = overload_memo_argument_type((*named_value)->value);
+        if (type == NULL) return NULL;
+
+        OnyxToken *name = (*named_value)->token;
+        len += snprintf(key_buf + len, 1024 - len, "%.*s=%u;", name->length, name->text, type->id);
+        if (len >= 1000) return NULL;
+    }
+
+    return key_buf;
+}
+
+AstTyped* find_matching_overload_by_arguments(bh_arr(OverloadOption) overloads, Arguments* param_args) {
+    OverloadSet *set = get_overload_set(overloads);
+    u32 generation = set->generation;
+
+    // If these argument types have already matched an option, the same option will match
+    // again. Every option before it was definitively rejected, not yielded on, and the
+    // options cannot change without invalidating the set.
+    char *memo_key = build_overload_memo_key(param_args);
+    if (memo_key != NULL && set->matches != NULL) {
+        i32 index = shgeti(set->matches, memo_key);
+        if (index != -1) return set->matches[index].value;
+    }
+
+    Arguments args;
+    arguments_clone(&args, param_args);
+    arguments_ensure_length(&args, bh_arr_length(args.values) + bh_arr_length(args.named_values));
+
     AstTyped *matched_overload = NULL;
 
-    bh_arr_each(bh__imap_entry, entry, all_overloads.entries) {
-        AstTyped* node = (AstTyped *) strip_aliases((AstNode *) entry->key);
+    bh_arr_each(AstTyped *, option, set->options) {
+        AstTyped* node = (AstTyped *) strip_aliases((AstNode *) *option);
         arguments_copy(&args, param_args);
 
         AstFunction* overload = NULL;
@@ -569,7 +683,7 @@ AstTyped* find_matching_overload_by_arguments(bh_arr(OverloadOption) overloads,
 
             // return and not continue because if the overload that didn't have a type will
             // work in the future, then it has to take precedence over the other options available.
-            bh_imap_free(&all_overloads);
+            if (overload->type == NULL) entity_wait_on(&context.entities, overload->entity_header);
             bh_arr_free(args.values);
             return (AstTyped *) &node_that_signals_a_yield;
         }
@@ -589,28 +703,35 @@ AstTyped* find_matching_overload_by_arguments(bh_arr(OverloadOption) overloads,
         }
 
         if (tm == TYPE_MATCH_YIELD) {
-            bh_imap_free(&all_overloads);
             bh_arr_free(args.values);
             return (AstTyped *) &node_that_signals_a_yield;
         }
     }
 
-    bh_imap_free(&all_overloads);
     bh_arr_free(args.values);
+
+    // The set is not memoized into if it went stale while matching. The key is
+    // rebuilt because matching can look up other overloads, which reuses its buffer.
+    if (matched_overload != NULL && generation == context.caches.overload_generation) {
+        memo_key = build_overload_memo_key(param_args);
+        if (memo_key != NULL) {
+            if (set->matches == NULL) sh_new_arena(set->matches);
+            shput(set->matches, memo_key, matched_overload);
+        }
+    }
+
     return matched_overload;
 }
 
 AstTyped* find_matching_overload_by_type(bh_arr(OverloadOption) overloads, Type* type) {
     if (type->kind != Type_Kind_Function) return NULL;
 
-    bh_imap all_overloads;
-    bh_imap_init(&all_overloads, global_heap_allocator, bh_arr_length(overloads) * 2);
-    build_all_overload_options(overloads, &all_overloads);
+    OverloadSet *set = get_overload_set(overloads);
 
     AstTyped *matched_overload = NULL;
 
-    bh_arr_each(bh__imap_entry, entry, all_overloads.entries) {
-        AstTyped* node = (AstTyped *) entry->key;
+    bh_arr_each(AstTyped *, option, set->options) {
+        AstTyped* node = *option;
         if (node->kind == Ast_Kind_Overloaded_Function) continue;
 
         TypeMatch tm = unify_node_and_type(&node, type);
@@ -623,8 +744,7 @@ AstTyped* find_matching_overload_by_type(bh_arr(OverloadOption) overloads, Type*
             return (AstTyped *) &node_that_signals_a_yield;
         }
     }
-    
-    bh_imap_free(&all_overloads);
+
     return matched_overload;
 }
 
@@ -661,19 +781,13 @@ void report_unable_to_match_overload(AstCall* call, bh_arr(OverloadOption) overl
 
     bh_free(global_scratch_allocator, arg_str);
 
-    // CLEANUP SPEED: This currently rebuilds the complete set of overloads every time one is looked up.
-    // This should be cached in the AstOverloadedFunction or somewhere like that.
-    bh_imap all_overloads;
-    bh_imap_init(&all_overloads, global_heap_allocator, bh_arr_length(overloads) * 2);
-    build_all_overload_options(overloads, &all_overloads);
+    OverloadSet *set = get_overload_set(overloads);
 
     i32 i = 1;
-    bh_arr_each(bh__imap_entry, entry, all_overloads.entries) {
-        AstTyped* node = (AstTyped *) strip_aliases((AstNode *) entry->key);
-        onyx_report_error(node->token->pos, Error_Critical, "Here is one of the overloads. %d/%d", i++, bh_arr_length(all_overloads.entries));
+    bh_arr_each(AstTyped *, option, set->options) {
+        AstTyped* node = (AstTyped *) strip_aliases((AstNode *) *option);
+        onyx_report_error(node->token->pos, Error_Critical, "Here is one of the overloads. %d/%d", i++, bh_arr_length(set->options));
     }
-
-    bh_imap_free(&all_overloads);
 }
 
 void report_incorrect_overload_expected_type(Type *given, Type *expected, OnyxToken *overload, OnyxToken *group) {
@@ -17,6 +17,7 @@
 #define BH_DEBUG
 #include "wasm_emit.h"
 #include "utils.h"
+#include "profile.h"
 
 #define WASM_TYPE_INT32   0x7F
 #define WASM_TYPE_INT64   0x7E
@@ -2035,7 +2036,10 @@ EMIT_FUNC(binop, AstBinaryOp* binop) {
     // Unsigned instructions are always right after
     // the signed equivalent
     if (is_sign_significant) {
-        if (binop->left->type->Basic.flags & Basic_Flag_Unsigned) {
+        Type *operand_type = binop->left->type;
+        if (operand_type->kind == Type_Kind_Enum) operand_type = operand_type->Enum.backing;
+
+        if (operand_type->kind == Type_Kind_Basic && (operand_type->Basic.flags & Basic_Flag_Unsigned)) {
             binop_instr = (WasmInstructionType) ((i32) binop_instr + 1);
         }
     }
@@ -4516,11 +4520,13 @@ static void emit_function(OnyxWasmModule* mod, AstFunction* fd) {
         return;
     }
 
+    u64 profile_start = profile_now();
     i32 type_idx = generate_type_idx(mod, fd->type);
 
     WasmFunc wasm_func = { 0 };
     wasm_func.type_idx = type_idx;
     wasm_func.location = fd->token;
+    wasm_func.inline_hint = fd->is_inline;
 
     bh_arr_new(mod->allocator, wasm_func.code, 16);
 
@@ -4649,6 +4655,21 @@ static void emit_function(OnyxWasmModule* mod, AstFunction* fd) {
     mod->current_func_idx = -1;
 
     debug_end_function(mod);
+
+    if (profile_enabled()) {
+        // Solidified polymorphic procedures are marked, so their sizes can be found in the profile.
+        b32 polymorph = (fd->flags & Ast_Flag_From_Polymorphism) != 0;
+        char *location = "null";
+        if (fd->token && fd->token->pos.filename) {
+            location = profile_json_string(bh_aprintf(global_scratch_allocator, "%s:%d:%d",
+                fd->token->pos.filename, fd->token->pos.line, fd->token->pos.column), -1);
+        }
+
+        profile_span("emit", get_function_name(fd), profile_start, profile_now(), 0,
+            bh_aprintf(global_scratch_allocator,
+                "\"instructions\": %d, \"polymorph\": %s, \"location\": %s",
+                bh_arr_length(wasm_func.code), polymorph ? "true" : "false", location));
+    }
 }
 
 static void encode_type_as_dyncall_symbol(char *out, Type *t) {
@@ -5683,4 +5704,5 @@ b32 onyx_wasm_build_link_options_from_node(OnyxWasmLinkOptions *opts, AstTyped *
     return 1;
 }
 
+#include "wasm_optimize.h"
 #include "wasm_output.h"
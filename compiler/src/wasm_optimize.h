@@ -0,0 +1,911 @@
+// This file is included in src/wasm_emit.c.
+// It is separated because it only works on the generated instructions,
+// never on the AST.
+
+//-------------------------------------------------
+// OPTIMIZATION PASSES
+//-------------------------------------------------
+
+//
+// These passes run after linking, once every patch has been applied to the
+// instructions, so instructions can be freely removed and replaced. They do not
+// run when debug information is generated, because the debug information maps
+// every emitted instruction back to a source location.
+//
+// Removed instructions are first replaced with a WI_NOP, and opt_remove_nops
+// compacts the array between passes. Because of that, every pattern below only
+// looks at instructions that are directly next to each other.
+//
+
+#define OPT_MAX_ROUNDS 8
+
+static b32 opt_is_block_start(WasmInstructionType type) {
+    return type == WI_BLOCK_START || type == WI_LOOP_START || type == WI_IF_START;
+}
+
+static b32 opt_is_const(WasmInstruction *instr) {
+    return instr->type == WI_I32_CONST || instr->type == WI_I64_CONST
+        || instr->type == WI_F32_CONST || instr->type == WI_F64_CONST;
+}
+
+static b32 opt_is_int_const(WasmInstruction *instr, i64 value) {
+    if (instr->type == WI_I32_CONST) return instr->data.i1 == (i32) value;
+    if (instr->type == WI_I64_CONST) return instr->data.l  == value;
+    return 0;
+}
+
+static void opt_set_i32(WasmInstruction *instr, i32 value) {
+    instr->type = WI_I32_CONST;
+    instr->data.l = 0;
+    instr->data.i1 = value;
+}
+
+static void opt_set_i64(WasmInstruction *instr, i64 value) {
+    instr->type = WI_I64_CONST;
+    instr->data.l = value;
+}
+
+static void opt_remove_nops(WasmFunc *func) {
+    i32 length = bh_arr_length(func->code);
+
+    i32 out = 0;
+    fori (i, 0, length) {
+        if (func->code[i].type == WI_NOP) continue;
+        func->code[out++] = func->code[i];
+    }
+
+    bh_arr_set_length(func->code, out);
+}
+
+//
+// Returns the index of the WI_ELSE and WI_IF_END that belong to the block
+// starting at `start`. `out_else` is -1 if there is no else.
+static i32 opt_find_block_end(WasmFunc *func, i32 start, i32 *out_else) {
+    i32 depth = 0;
+    if (out_else) *out_else = -1;
+
+    fori (i, start + 1, bh_arr_length(func->code)) {
+        WasmInstructionType type = func->code[i].type;
+
+        if (opt_is_block_start(type)) depth++;
+        else if (type == WI_ELSE && depth == 0 && out_else) *out_else = i;
+        else if (type == WI_BLOCK_END) {
+            if (depth == 0) return i;
+            depth--;
+        }
+    }
+
+    assert("Unbalanced blocks in function." && 0);
+    return -1;
+}
+
+static void opt_remove_range(WasmFunc *func, i32 start, i32 end) {
+    fori (i, start, end) func->code[i].type = WI_NOP;
+}
+
+//
+// Removes everything after an unconditional branch up to the end of the
+// enclosing block, or the else of the enclosing if.
+static b32 opt_remove_unreachable(WasmFunc *func) {
+    b32 changed = 0;
+    i32 length = bh_arr_length(func->code);
+
+    fori (i, 0, length) {
+        WasmInstructionType type = func->code[i].type;
+        if (type != WI_RETURN && type != WI_JUMP && type != WI_JUMP_TABLE && type != WI_UNREACHABLE) continue;
+
+        i32 depth = 0;
+        i32 j = i + 1;
+        for (; j < length; j++) {
+            WasmInstructionType next = func->code[j].type;
+
+            if (next == WI_BLOCK_END) {
+                if (depth == 0) break;
+                depth--;
+
+            } else if (next == WI_ELSE && depth == 0) {
+                break;
+
+            } else if (opt_is_block_start(next)) {
+                depth++;
+            }
+
+            if (next != WI_NOP) changed = 1;
+            func->code[j].type = WI_NOP;
+        }
+
+        i = j - 1;
+    }
+
+    return changed;
+}
+
+static b32 opt_fold_unary(WasmInstruction *c, WasmInstruction *op) {
+    if (c->type == WI_I32_CONST) {
+        i32 a = c->data.i1;
+
+        switch (op->type) {
+            case WI_I32_EQZ:         opt_set_i32(c, a == 0); return 1;
+            case WI_I32_EXTEND_8_S:  opt_set_i32(c, (i8) a); return 1;
+            case WI_I32_EXTEND_16_S: opt_set_i32(c, (i16) a); return 1;
+            case WI_I64_FROM_I32_S:  opt_set_i64(c, (i64) a); return 1;
+            case WI_I64_FROM_I32_U:  opt_set_i64(c, (i64) (u32) a); return 1;
+            default: return 0;
+        }
+    }
+
+    if (c->type == WI_I64_CONST) {
+        i64 a = c->data.l;
+
+        switch (op->type) {
+            case WI_I64_EQZ:         opt_set_i32(c, a == 0); return 1;
+            case WI_I32_FROM_I64:    opt_set_i32(c, (i32) a); return 1;
+            case WI_I64_EXTEND_8_S:  opt_set_i64(c, (i8) a); return 1;
+            case WI_I64_EXTEND_16_S: opt_set_i64(c, (i16) a); return 1;
+            case WI_I64_EXTEND_32_S: opt_set_i64(c, (i32) a); return 1;
+            default: return 0;
+        }
+    }
+
+    return 0;
+}
+
+//
+// Folds the operation into `lhs`. Division and remainder by zero are left
+// alone, so they still trap at runtime.
+static b32 opt_fold_binary(WasmInstruction *lhs, WasmInstruction *rhs, WasmInstruction *op) {
+    if (lhs->type != rhs->type) return 0;
+
+    if (lhs->type == WI_I32_CONST) {
+        i32 a = lhs->data.i1, b = rhs->data.i1;
+        u32 ua = (u32) a, ub = (u32) b;
+
+        switch (op->type) {
+            case WI_I32_ADD:   opt_set_i32(lhs, (i32) (ua + ub)); return 1;
+            case WI_I32_SUB:   opt_set_i32(lhs, (i32) (ua - ub)); return 1;
+            case WI_I32_MUL:   opt_set_i32(lhs, (i32) (ua * ub)); return 1;
+            case WI_I32_AND:   opt_set_i32(lhs, a & b); return 1;
+            case WI_I32_OR:    opt_set_i32(lhs, a | b); return 1;
+            case WI_I32_XOR:   opt_set_i32(lhs, a ^ b); return 1;
+            case WI_I32_SHL:   opt_set_i32(lhs, (i32) (ua << (ub & 31))); return 1;
+            case WI_I32_SHR_S: opt_set_i32(lhs, a >> (ub & 31)); return 1;
+            case WI_I32_SHR_U: opt_set_i32(lhs, (i32) (ua >> (ub & 31))); return 1;
+            case WI_I32_EQ:    opt_set_i32(lhs, a == b); return 1;
+            case WI_I32_NE:    opt_set_i32(lhs, a != b); return 1;
+            case WI_I32_LT_S:  opt_set_i32(lhs, a <  b); return 1;
+            case WI_I32_LT_U:  opt_set_i32(lhs, ua <  ub); return 1;
+            case WI_I32_GT_S:  opt_set_i32(lhs, a >  b); return 1;
+            case WI_I32_GT_U:  opt_set_i32(lhs, ua >  ub); return 1;
+            case WI_I32_LE_S:  opt_set_i32(lhs, a <= b); return 1;
+            case WI_I32_LE_U:  opt_set_i32(lhs, ua <= ub); return 1;
+            case WI_I32_GE_S:  opt_set_i32(lhs, a >= b); return 1;
+            case WI_I32_GE_U:  opt_set_i32(lhs, ua >= ub); return 1;
+
+            case WI_I32_DIV_S:
+                if (b == 0 || (a == INT32_MIN && b == -1)) return 0;
+                opt_set_i32(lhs, a / b); return 1;
+
+            case WI_I32_DIV_U:
+                if (b == 0) return 0;
+                opt_set_i32(lhs, (i32) (ua / ub)); return 1;
+
+            case WI_I32_REM_S:
+                if (b == 0) return 0;
+                opt_set_i32(lhs, b == -1 ? 0 : a % b); return 1;
+
+            case WI_I32_REM_U:
+                if (b == 0) return 0;
+                opt_set_i32(lhs, (i32) (ua % ub)); return 1;
+
+            default: return 0;
+        }
+    }
+
+    if (lhs->type == WI_I64_CONST) {
+        i64 a = lhs->data.l, b = rhs->data.l;
+        u64 ua = (u64) a, ub = (u64) b;
+
+        switch (op->type) {
+            case WI_I64_ADD:   opt_set_i64(lhs, (i64) (ua + ub)); return 1;
+            case WI_I64_SUB:   opt_set_i64(lhs, (i64) (ua - ub)); return 1;
+            case WI_I64_MUL:   opt_set_i64(lhs, (i64) (ua * ub)); return 1;
+            case WI_I64_AND:   opt_set_i64(lhs, a & b); return 1;
+            case WI_I64_OR:    opt_set_i64(lhs, a | b); return 1;
+            case WI_I64_XOR:   opt_set_i64(lhs, a ^ b); return 1;
+            case WI_I64_SHL:   opt_set_i64(lhs, (i64) (ua << (ub & 63))); return 1;
+            case WI_I64_SHR_S: opt_set_i64(lhs, a >> (ub & 63)); return 1;
+            case WI_I64_SHR_U: opt_set_i64(lhs, (i64) (ua >> (ub & 63))); return 1;
+            case WI_I64_EQ:    opt_set_i32(lhs, a == b); return 1;
+            case WI_I64_NE:    opt_set_i32(lhs, a != b); return 1;
+            case WI_I64_LT_S:  opt_set_i32(lhs, a <  b); return 1;
+            case WI_I64_LT_U:  opt_set_i32(lhs, ua <  ub); return 1;
+            case WI_I64_GT_S:  opt_set_i32(lhs, a >  b); return 1;
+            case WI_I64_GT_U:  opt_set_i32(lhs, ua >  ub); return 1;
+            case WI_I64_LE_S:  opt_set_i32(lhs, a <= b); return 1;
+            case WI_I64_LE_U:  opt_set_i32(lhs, ua <= ub); return 1;
+            case WI_I64_GE_S:  opt_set_i32(lhs, a >= b); return 1;
+            case WI_I64_GE_U:  opt_set_i32(lhs, ua >= ub); return 1;
+
+            case WI_I64_DIV_S:
+                if (b == 0 || (a == INT64_MIN && b == -1)) return 0;
+                opt_set_i64(lhs, a / b); return 1;
+
+            case WI_I64_DIV_U:
+                if (b == 0) return 0;
+                opt_set_i64(lhs, (i64) (ua / ub)); return 1;
+
+            case WI_I64_REM_S:
+                if (b == 0) return 0;
+                opt_set_i64(lhs, b == -1 ? 0 : a % b); return 1;
+
+            case WI_I64_REM_U:
+                if (b == 0) return 0;
+                opt_set_i64(lhs, (i64) (ua % ub)); return 1;
+
+            default: return 0;
+        }
+    }
+
+    return 0;
+}
+
+//
+// Returns true if `x <op> c` is always `x`.
+static b32 opt_is_identity(WasmInstruction *c, WasmInstruction *op) {
+    switch (op->type) {
+        case WI_I32_ADD: case WI_I32_SUB: case WI_I32_OR: case WI_I32_XOR:
+        case WI_I32_SHL: case WI_I32_SHR_S: case WI_I32_SHR_U:
+        case WI_I32_ROTL: case WI_I32_ROTR:
+        case WI_I64_ADD: case WI_I64_SUB: case WI_I64_OR: case WI_I64_XOR:
+        case WI_I64_SHL: case WI_I64_SHR_S: case WI_I64_SHR_U:
+        case WI_I64_ROTL: case WI_I64_ROTR:
+            return opt_is_int_const(c, 0);
+
+        case WI_I32_MUL: case WI_I64_MUL:
+        case WI_I32_DIV_S: case WI_I32_DIV_U:
+        case WI_I64_DIV_S: case WI_I64_DIV_U:
+            return opt_is_int_const(c, 1);
+
+        case WI_I32_AND: case WI_I64_AND:
+            return opt_is_int_const(c, -1);
+
+        default:
+            return 0;
+    }
+}
+
+//
+// `if` with a constant condition. The taken branch becomes a plain block, so
+// branches inside of it still target the same label.
+static void opt_simplify_constant_if(WasmFunc *func, i32 const_idx) {
+    i32 if_idx = const_idx + 1;
+    b32 condition = func->code[const_idx].data.i1 != 0;
+
+    i32 else_idx;
+    i32 end_idx = opt_find_block_end(func, if_idx, &else_idx);
+
+    func->code[const_idx].type = WI_NOP;
+    func->code[if_idx].type = WI_BLOCK_START;
+
+    if (condition) {
+        if (else_idx >= 0) opt_remove_range(func, else_idx, end_idx);
+
+    } else {
+        opt_remove_range(func, if_idx + 1, else_idx >= 0 ? else_idx + 1 : end_idx);
+    }
+}
+
+static b32 opt_peephole(WasmFunc *func) {
+    b32 changed = 0;
+
+    // The kinds of the enclosing blocks, needed to know where `br 0` goes.
+    bh_arr(WasmInstructionType) blocks = NULL;
+    bh_arr_new(global_heap_allocator, blocks, 16);
+
+    i32 length = bh_arr_length(func->code);
+    fori (i, 0, length) {
+        WasmInstruction *curr = &func->code[i];
+        WasmInstruction *next = i + 1 < length ? &func->code[i + 1] : NULL;
+        WasmInstruction *last = i + 2 < length ? &func->code[i + 2] : NULL;
+
+        if (curr->type == WI_NOP) continue;
+
+        if (next && opt_is_const(curr)) {
+            // c1 c2 op  ->  c
+            if (last && opt_is_const(next) && opt_fold_binary(curr, next, last)) {
+                next->type = WI_NOP;
+                last->type = WI_NOP;
+                changed = 1;
+                continue;
+            }
+
+            // c op  ->  c
+            if (opt_fold_unary(curr, next)) {
+                next->type = WI_NOP;
+                changed = 1;
+                continue;
+            }
+
+            // x 0 add  ->  x
+            if (opt_is_identity(curr, next)) {
+                curr->type = WI_NOP;
+                next->type = WI_NOP;
+                changed = 1;
+                continue;
+            }
+
+            // c drop  ->
+            if (next->type == WI_DROP) {
+                curr->type = WI_NOP;
+                next->type = WI_NOP;
+                changed = 1;
+                continue;
+            }
+
+            if (curr->type == WI_I32_CONST && next->type == WI_COND_JUMP) {
+                if (curr->data.i1 != 0) next->type = WI_JUMP;
+                else                    next->type = WI_NOP;
+
+                curr->type = WI_NOP;
+                changed = 1;
+                continue;
+            }
+
+            if (curr->type == WI_I32_CONST && next->type == WI_IF_START) {
+                opt_simplify_constant_if(func, i);
+                changed = 1;
+                continue;
+            }
+        }
+
+        if (next && (curr->type == WI_LOCAL_GET || curr->type == WI_GLOBAL_GET) && next->type == WI_DROP) {
+            curr->type = WI_NOP;
+            next->type = WI_NOP;
+            changed = 1;
+            continue;
+        }
+
+        if (next && curr->type == WI_LOCAL_SET && next->type == WI_LOCAL_GET && curr->data.l == next->data.l) {
+            curr->type = WI_LOCAL_TEE;
+            next->type = WI_NOP;
+            changed = 1;
+            continue;
+        }
+
+        if (next && curr->type == WI_LOCAL_TEE && next->type == WI_DROP) {
+            curr->type = WI_LOCAL_SET;
+            next->type = WI_NOP;
+            changed = 1;
+            continue;
+        }
+
+        if (next && curr->type == WI_LOCAL_GET && next->type == WI_LOCAL_SET && curr->data.l == next->data.l) {
+            curr->type = WI_NOP;
+            next->type = WI_NOP;
+            changed = 1;
+            continue;
+        }
+
+        // eqz eqz br_if  ->  br_if
+        if (last && curr->type == WI_I32_EQZ && next->type == WI_I32_EQZ
+            && (last->type == WI_COND_JUMP || last->type == WI_IF_START)) {
+            curr->type = WI_NOP;
+            next->type = WI_NOP;
+            changed = 1;
+            continue;
+        }
+
+        // An empty block or loop cannot be the target of any branch.
+        if (next && (curr->type == WI_BLOCK_START || curr->type == WI_LOOP_START) && next->type == WI_BLOCK_END) {
+            curr->type = WI_NOP;
+            next->type = WI_NOP;
+            changed = 1;
+            continue;
+        }
+
+        // A branch to the end of the block it is at the end of.
+        if (next && curr->type == WI_JUMP && curr->data.i1 == 0 && bh_arr_length(blocks) > 0
+            && (next->type == WI_BLOCK_END || next->type == WI_ELSE)
+            && bh_arr_last(blocks) != WI_LOOP_START) {
+            curr->type = WI_NOP;
+            changed = 1;
+            continue;
+        }
+
+        if (opt_is_block_start(curr->type)) bh_arr_push(blocks, curr->type);
+        if (curr->type == WI_BLOCK_END && bh_arr_length(blocks) > 0) bh_arr_pop(blocks);
+    }
+
+    bh_arr_free(blocks);
+    return changed;
+}
+
+typedef struct OptKnownLocal {
+    u64 local;
+    WasmInstruction value;
+} OptKnownLocal;
+
+#define OPT_MAX_KNOWN_LOCALS 32
+
+//
+// Replaces reads of locals that were just set to a constant. Only straight-line
+// code is considered: anything that another branch could jump into forgets
+// every known value.
+static b32 opt_propagate_constants(WasmFunc *func) {
+    b32 changed = 0;
+
+    OptKnownLocal known[OPT_MAX_KNOWN_LOCALS];
+    i32 known_count = 0;
+
+    i32 length = bh_arr_length(func->code);
+    fori (i, 0, length) {
+        WasmInstruction *curr = &func->code[i];
+
+        switch (curr->type) {
+            case WI_LOOP_START:
+            case WI_IF_START:
+            case WI_ELSE:
+            case WI_BLOCK_END:
+                known_count = 0;
+                break;
+
+            case WI_LOCAL_GET: {
+                fori (k, 0, known_count) {
+                    if (known[k].local == (u64) curr->data.l) {
+                        *curr = known[k].value;
+                        changed = 1;
+                        break;
+                    }
+                }
+                break;
+            }
+
+            case WI_LOCAL_SET:
+            case WI_LOCAL_TEE: {
+                fori (k, 0, known_count) {
+                    if (known[k].local == (u64) curr->data.l) {
+                        known[k] = known[--known_count];
+                        break;
+                    }
+                }
+
+                if (i > 0 && opt_is_const(&func->code[i - 1]) && known_count < OPT_MAX_KNOWN_LOCALS) {
+                    known[known_count].local = curr->data.l;
+                    known[known_count].value = func->code[i - 1];
+                    known_count++;
+                }
+                break;
+            }
+
+            default: break;
+        }
+    }
+
+    return changed;
+}
+
+static i32 opt_local_count(WasmFunc *func) {
+    LocalAllocator *la = &func->locals;
+    return la->param_count + la->allocated[0] + la->allocated[1] + la->allocated[2] + la->allocated[3] + la->allocated[4];
+}
+
+//
+// Stores to locals that are never read are turned into drops, and locals that
+// are not used at all are removed from the function.
+static b32 opt_remove_dead_locals(WasmFunc *func) {
+    b32 changed = 0;
+
+    i32 local_count = opt_local_count(func);
+    if (local_count == 0) return 0;
+
+    u32 *reads = bh_alloc_array(global_heap_allocator, u32, local_count);
+    memset(reads, 0, sizeof(u32) * local_count);
+
+    bh_arr_each(WasmInstruction, instr, func->code) {
+        if (instr->type == WI_LOCAL_GET) reads[local_lookup_idx(&func->locals, instr->data.l)]++;
+    }
+
+    bh_arr_each(WasmInstruction, instr, func->code) {
+        if (instr->type != WI_LOCAL_SET && instr->type != WI_LOCAL_TEE) continue;
+        if (reads[local_lookup_idx(&func->locals, instr->data.l)] > 0) continue;
+
+        instr->type = instr->type == WI_LOCAL_SET ? WI_DROP : WI_NOP;
+        changed = 1;
+    }
+
+    bh_free(global_heap_allocator, reads);
+    return changed;
+}
+
+//
+// Renumbers the locals of each type so the unused ones are not declared.
+static void opt_compact_locals(WasmFunc *func) {
+    LocalAllocator *la = &func->locals;
+
+    i32 local_count = opt_local_count(func);
+    if (local_count == (i32) la->param_count) return;
+
+    i32 *remap = bh_alloc_array(global_heap_allocator, i32, local_count);
+    fori (i, 0, local_count) remap[i] = -1;
+
+    bh_arr_each(WasmInstruction, instr, func->code) {
+        if (instr->type == WI_LOCAL_GET || instr->type == WI_LOCAL_SET || instr->type == WI_LOCAL_TEE) {
+            remap[local_lookup_idx(la, instr->data.l)] = 0;
+        }
+    }
+
+    // The locals are laid out as the parameters, followed by the locals of each
+    // type, in the same order as output_locals.
+    u32 new_allocated[5];
+    i32 offset = la->param_count;
+    fori (t, 0, 5) {
+        new_allocated[t] = 0;
+        fori (i, offset, offset + (i32) la->allocated[t]) {
+            if (remap[i] == 0) remap[i] = la->param_count + new_allocated[t]++;
+        }
+
+        offset += la->allocated[t];
+    }
+
+    bh_arr_each(WasmInstruction, instr, func->code) {
+        if (instr->type != WI_LOCAL_GET && instr->type != WI_LOCAL_SET && instr->type != WI_LOCAL_TEE) continue;
+
+        i32 idx = local_lookup_idx(la, instr->data.l);
+        if (idx < (i32) la->param_count) continue;
+
+        instr->data.l = (instr->data.l & ~0xFFFFFFFFull) | (u64) remap[idx];
+    }
+
+    fori (t, 0, 5) la->allocated[t] = new_allocated[t];
+
+    bh_free(global_heap_allocator, remap);
+}
+
+static void opt_function(WasmFunc *func, i32 level) {
+    i32 rounds = level >= 2 ? OPT_MAX_ROUNDS : 1;
+
+    fori (round, 0, rounds) {
+        b32 changed = 0;
+
+        changed |= opt_remove_unreachable(func);
+        opt_remove_nops(func);
+
+        changed |= opt_peephole(func);
+        opt_remove_nops(func);
+
+        if (level >= 2) {
+            changed |= opt_propagate_constants(func);
+        }
+
+        changed |= opt_remove_dead_locals(func);
+        opt_remove_nops(func);
+
+        if (!changed) break;
+    }
+
+    opt_compact_locals(func);
+}
+
+
+//
+// Inlining
+//
+// Calls to small leaf functions, and to functions marked with #inline, are
+// replaced with the body of the called function. The body is wrapped in a block,
+// which takes the place of the implicit block of the function body, so every
+// branch in the body still targets the same label. A return becomes a branch out
+// of that block, with the returned value stored in a new local.
+//
+// The parameters and locals of the called function become new locals of the
+// caller. Locals that could be read before they are written are set to zero
+// first, because they are no longer zeroed on entry to a function.
+//
+// Everything the body does with the stack pointer, defer statements and
+// closures is already part of the generated instructions, so it is kept as is.
+//
+
+#define OPT_INLINE_LEAF_SIZE       16
+#define OPT_INLINE_MAX_CALLER_SIZE 20000
+
+typedef struct OptInlineInfo {
+    b32 candidate : 1;
+    b32 hinted    : 1;
+
+    WasmFuncType *type;
+
+    // Copies of the function as it was before anything was inlined into it.
+    bh_arr(WasmInstruction) code;
+    LocalAllocator locals;
+
+    // The WasmType of every parameter and local, and whether it has to be zeroed.
+    WasmType *local_types;
+    u8       *needs_zero;
+    i32       local_count;
+} OptInlineInfo;
+
+static WasmType opt_local_class_types[5] = {
+    WASM_TYPE_INT32, WASM_TYPE_INT64, WASM_TYPE_FLOAT32, WASM_TYPE_FLOAT64, WASM_TYPE_VAR128
+};
+
+static b32 opt_prepare_inline_candidate(OnyxWasmModule *module, WasmFunc *func, OptInlineInfo *info, i32 level) {
+    memset(info, 0, sizeof(*info));
+    if (func->code == NULL) return 0;
+
+    info->hinted = func->inline_hint;
+
+    if (!info->hinted) {
+        if (level <= 0) return 0;
+        if (bh_arr_length(func->code) > OPT_INLINE_LEAF_SIZE) return 0;
+
+        bh_arr_each(WasmInstruction, instr, func->code) {
+            if (instr->type == WI_CALL || instr->type == WI_CALL_INDIRECT) return 0;
+        }
+    }
+
+    opt_remove_unreachable(func);
+    opt_remove_nops(func);
+
+    info->type = module->types[func->type_idx];
+    info->local_count = opt_local_count(func);
+    info->local_types = bh_alloc_array(global_heap_allocator, WasmType, info->local_count);
+    info->needs_zero  = bh_alloc_array(global_heap_allocator, u8, info->local_count);
+
+    LocalAllocator *la = &func->locals;
+    fori (i, 0, (i32) la->param_count) info->local_types[i] = info->type->param_types[i];
+
+    i32 offset = la->param_count;
+    fori (t, 0, 5) {
+        fori (i, offset, offset + (i32) la->allocated[t]) info->local_types[i] = opt_local_class_types[t];
+        offset += la->allocated[t];
+    }
+
+    // A local has to be zeroed, unless the first thing that uses it is a store
+    // outside of any block.
+    u8 *seen = bh_alloc_array(global_heap_allocator, u8, info->local_count);
+    memset(seen, 0, info->local_count);
+    memset(info->needs_zero, 0, info->local_count);
+
+    i32 depth = 0;
+    bh_arr_each(WasmInstruction, instr, func->code) {
+        if (opt_is_block_start(instr->type)) depth++;
+        if (instr->type == WI_BLOCK_END) depth--;
+
+        if (instr->type != WI_LOCAL_GET && instr->type != WI_LOCAL_SET && instr->type != WI_LOCAL_TEE) continue;
+
+        i32 idx = local_lookup_idx(la, instr->data.l);
+        if (seen[idx] || idx < (i32) la->param_count) continue;
+        seen[idx] = 1;
+
+        if (instr->type == WI_LOCAL_GET || depth > 0) info->needs_zero[idx] = 1;
+    }
+
+    bh_free(global_heap_allocator, seen);
+
+    // There is no simple zero value for these.
+    fori (i, 0, info->local_count) {
+        if (info->needs_zero[i] && info->local_types[i] == WASM_TYPE_VAR128) return 0;
+    }
+
+    info->locals = func->locals;
+    bh_arr_new(global_heap_allocator, info->code, bh_arr_length(func->code));
+    bh_arr_each(WasmInstruction, instr, func->code) bh_arr_push(info->code, *instr);
+
+    info->candidate = 1;
+    return 1;
+}
+
+static u64 opt_new_local(LocalAllocator *la, WasmType wt) {
+    // The locals that were freed at the end of the function could still be
+    // in use where the call is.
+    fori (i, 0, 5) la->freed[i] = 0;
+
+    return local_raw_allocate(la, wt);
+}
+
+static WasmInstruction opt_zero_value(WasmType wt) {
+    WasmInstruction instr = { 0 };
+
+    switch (wt) {
+        case WASM_TYPE_INT32:   instr.type = WI_I32_CONST; break;
+        case WASM_TYPE_INT64:   instr.type = WI_I64_CONST; break;
+        case WASM_TYPE_FLOAT32: instr.type = WI_F32_CONST; instr.data.f = 0; break;
+        case WASM_TYPE_FLOAT64: instr.type = WI_F64_CONST; instr.data.d = 0; break;
+        default: assert(0);
+    }
+
+    return instr;
+}
+
+static void opt_inline_call(bh_arr(WasmInstruction) *out, WasmFunc *caller, OptInlineInfo *info) {
+    bh_arr(WasmInstruction) code = *out;
+
+    u64 *local_map = bh_alloc_array(global_heap_allocator, u64, info->local_count);
+    fori (i, 0, info->local_count) local_map[i] = opt_new_local(&caller->locals, info->local_types[i]);
+
+    b32 has_result = info->type->return_type != WASM_TYPE_VOID;
+    u64 result_local = 0;
+    if (has_result) result_local = opt_new_local(&caller->locals, info->type->return_type);
+
+    // The arguments are on the stack, with the last one on top.
+    for (i32 i = info->type->param_count - 1; i >= 0; i--) {
+        bh_arr_push(code, ((WasmInstruction) { WI_LOCAL_SET, { .l = local_map[i] } }));
+    }
+
+    fori (i, 0, info->local_count) {
+        if (!info->needs_zero[i]) continue;
+
+        bh_arr_push(code, opt_zero_value(info->local_types[i]));
+        bh_arr_push(code, ((WasmInstruction) { WI_LOCAL_SET, { .l = local_map[i] } }));
+    }
+
+    bh_arr_push(code, ((WasmInstruction) { WI_BLOCK_START, 0x40 }));
+
+    // The last instruction is the end of the function body.
+    i32 body_length = bh_arr_length(info->code) - 1;
+    WasmInstructionType last_type = body_length > 0 ? info->code[body_length - 1].type : WI_NOP;
+
+    // A return at the very end falls through to the end of the block instead.
+    if (last_type == WI_RETURN) body_length--;
+
+    i32 depth = 0;
+    fori (i, 0, body_length) {
+        WasmInstruction instr = info->code[i];
+
+        switch (instr.type) {
+            case WI_LOCAL_GET:
+            case WI_LOCAL_SET:
+            case WI_LOCAL_TEE:
+                instr.data.l = local_map[local_lookup_idx(&info->locals, instr.data.l)];
+                break;
+
+            case WI_BLOCK_START:
+            case WI_LOOP_START:
+            case WI_IF_START:
+                depth++;
+                break;
+
+            case WI_BLOCK_END:
+                depth--;
+                break;
+
+            case WI_RETURN:
+                if (has_result) bh_arr_push(code, ((WasmInstruction) { WI_LOCAL_SET, { .l = result_local } }));
+
+                instr.type = WI_JUMP;
+                instr.data.l = 0;
+                instr.data.i1 = depth;
+                break;
+
+            default: break;
+        }
+
+        bh_arr_push(code, instr);
+    }
+
+    // After an unconditional branch there is no value to store.
+    b32 falls_through = last_type != WI_JUMP && last_type != WI_JUMP_TABLE && last_type != WI_UNREACHABLE;
+    if (has_result && falls_through) {
+        bh_arr_push(code, ((WasmInstruction) { WI_LOCAL_SET, { .l = result_local } }));
+    }
+
+    bh_arr_push(code, ((WasmInstruction) { WI_BLOCK_END, 0x00 }));
+
+    if (has_result) {
+        bh_arr_push(code, ((WasmInstruction) { WI_LOCAL_GET, { .l = result_local } }));
+    }
+
+    bh_free(global_heap_allocator, local_map);
+    *out = code;
+}
+
+static i32 opt_inline_calls(OnyxWasmModule *module, i32 level) {
+    i32 func_count = bh_arr_length(module->funcs);
+
+    OptInlineInfo *infos = bh_alloc_array(global_heap_allocator, OptInlineInfo, func_count);
+    b32 any_candidates = 0;
+    fori (i, 0, func_count) {
+        any_candidates |= opt_prepare_inline_candidate(module, &module->funcs[i], &infos[i], level);
+    }
+
+    // A procedure marked with #inline is called normally when its body cannot be
+    // copied into the caller, so say which ones were left alone.
+    if (context.options->verbose_output > 0) {
+        fori (i, 0, func_count) {
+            WasmFunc *func = &module->funcs[i];
+            if (!func->inline_hint || func->code == NULL || infos[i].candidate) continue;
+
+            if (func->location) {
+                OnyxFilePos pos = func->location->pos;
+                bh_printf("(%s:%l,%l) Procedure marked #inline could not be inlined.\n", pos.filename, pos.line, pos.column);
+            } else {
+                bh_printf("Procedure marked #inline could not be inlined.\n");
+            }
+        }
+    }
+
+    i32 inlined_count = 0;
+    if (!any_candidates) goto done;
+
+    fori (i, 0, func_count) {
+        WasmFunc *caller = &module->funcs[i];
+        if (caller->code == NULL) continue;
+
+        b32 has_inlinable_call = 0;
+        bh_arr_each(WasmInstruction, instr, caller->code) {
+            if (instr->type != WI_CALL) continue;
+
+            i64 callee_idx = instr->data.l - module->next_foreign_func_idx;
+            if (callee_idx < 0 || callee_idx == i || !infos[callee_idx].candidate) continue;
+
+            has_inlinable_call = 1;
+            break;
+        }
+
+        if (!has_inlinable_call) continue;
+
+        bh_arr(WasmInstruction) code = NULL;
+        bh_arr_new(module->allocator, code, bh_arr_length(caller->code));
+
+        bh_arr_each(WasmInstruction, instr, caller->code) {
+            if (instr->type == WI_CALL) {
+                i64 callee_idx = instr->data.l - module->next_foreign_func_idx;
+
+                if (callee_idx >= 0 && callee_idx != i && infos[callee_idx].candidate
+                    && (infos[callee_idx].hinted || bh_arr_length(code) < OPT_INLINE_MAX_CALLER_SIZE)) {
+                    opt_inline_call(&code, caller, &infos[callee_idx]);
+                    inlined_count++;
+                    continue;
+                }
+            }
+
+            bh_arr_push(code, *instr);
+        }
+
+        bh_arr_free(caller->code);
+        caller->code = code;
+    }
+
+  done:
+    fori (i, 0, func_count) {
+        if (infos[i].local_types) bh_free(global_heap_allocator, infos[i].local_types);
+        if (infos[i].needs_zero)  bh_free(global_heap_allocator, infos[i].needs_zero);
+        if (infos[i].code)        bh_arr_free(infos[i].code);
+    }
+
+    bh_free(global_heap_allocator, infos);
+    return inlined_count;
+}
+
+void onyx_wasm_module_optimize(OnyxWasmModule *module, i32 level) {
+    // The debug information refers to every instruction that was emitted.
+    if (context.options->debug_info_enabled) return;
+
+    i32 instructions_before = 0, instructions_after = 0;
+
+    bh_arr_each(WasmFunc, func, module->funcs) {
+        if (func->code == NULL) continue;
+
+        instructions_before += bh_arr_length(func->code);
+        if (level > 0) opt_function(func, level);
+    }
+
+    // Functions marked with #inline are inlined even when not optimizing.
+    i32 inlined_count = opt_inline_calls(module, level);
+
+    bh_arr_each(WasmFunc, func, module->funcs) {
+        if (func->code == NULL) continue;
+
+        // Inlining leaves behind many stores to locals that are only read once.
+        if (level > 0 && inlined_count > 0) opt_function(func, level);
+        instructions_after += bh_arr_length(func->code);
+    }
+
+    if (context.options->verbose_output > 0) {
+        if (inlined_count > 0) bh_printf("Inlined %d calls.\n", inlined_count);
+
+        if (level > 0) {
+            bh_printf("Optimization removed %d of %d instructions.\n",
+                instructions_before - instructions_after, instructions_before);
+        }
+    }
+}
@@ -120,6 +120,7 @@ static void *locate_symbol_in_dynamic_library(LinkLibraryContext *ctx, char *lib
 }
 
 typedef void *(*LinkLibraryer)(OnyxRuntime *runtime);
+typedef int (*LibraryVersioner)();
 
 static WasmFuncDefinition** onyx_load_library(LinkLibraryContext *ctx, char *name) {
     #if defined(_BH_LINUX) || defined(_BH_DARWIN)
@@ -144,7 +145,38 @@ static WasmFuncDefinition** onyx_load_library(LinkLibraryContext *ctx, char *nam
         return NULL;
     }
 
-    return library_load(runtime);
+    // Libraries built before the version was exported are version 1. Older
+    // versions only lack fields at the end of the structures, so they still
+    // load, but a library built against a newer header does not.
+    char *library_version_name_tmp = bh_bprintf("onyx_library_version_%s", library);
+    char *library_version_name = alloca(strlen(library_version_name_tmp) + 1);
+    strcpy(library_version_name, library_version_name_tmp);
+
+    LibraryVersioner library_version = locate_symbol_in_dynamic_library(ctx, name, library_version_name);
+    i32 version = library_version ? library_version() : 1;
+    if (version < 1 || version > ONYX_LIBRARY_VERSION) {
+        printf("ERROR LOADING '%s': built against version %d of onyx_library.h, but this runtime only supports up to version %d.\n",
+            name, version, ONYX_LIBRARY_VERSION);
+        return NULL;
+    }
+
+    WasmFuncDefinition **funcs = library_load(runtime);
+    if (funcs == NULL || version >= 2) return funcs;
+
+    // Definitions from version 1 end before `direct`, so they are copied into
+    // full definitions without a direct function.
+    i32 func_count = 0;
+    while (funcs[func_count] != NULL) func_count++;
+
+    WasmFuncDefinition **upgraded = bh_alloc_array(bh_heap_allocator(), WasmFuncDefinition *, func_count + 1);
+    fori (i, 0, func_count) {
+        upgraded[i] = bh_alloc_item(bh_heap_allocator(), WasmFuncDefinition);
+        memset(upgraded[i], 0, sizeof(WasmFuncDefinition));
+        memcpy(upgraded[i], funcs[i], offsetof(WasmFuncDefinition, direct));
+    }
+
+    upgraded[func_count] = NULL;
+    return upgraded;
 }
 
 static void lookup_and_load_custom_libraries(LinkLibraryContext *ctx, bh_arr(WasmFuncDefinition **)* p_out) {
@@ -517,6 +549,17 @@ static b32 link_wasm_imports(
                     wasm_functype_t* wasm_functype = wasm_functype_new(&wasm_params, &wasm_results);
 
                     wasm_func_t* wasm_func = wasm_func_new(wasm_store, wasm_functype, cf->func);
+
+#ifdef USE_OVM_DEBUGGER
+                    // Functions defined with ONYX_DEF_DIRECT are called with OVM's own
+                    // values, unless this is set.
+                    char *no_direct_calls = getenv("ONYX_OVM_NO_DIRECT_CALLS");
+                    if (cf->direct && !(no_direct_calls && *no_direct_calls)) {
+                        void wasm_func_set_onyx_direct(wasm_func_t *func, void *direct);
+                        wasm_func_set_onyx_direct(wasm_func, (void *) cf->direct);
+                    }
+#endif
+
                     import = wasm_func_as_extern(wasm_func);
                     goto import_found;
                 }
@@ -553,7 +596,7 @@ static b32 link_wasm_imports(
     return 1;
 }
 
-void onyx_run_initialize(b32 debug_enabled) {
+void onyx_run_initialize(b32 debug_enabled, const char *profile_path) {
     wasm_config = wasm_config_new();
     if (!wasm_config) {
         cleanup_wasm_objects();
@@ -574,6 +617,26 @@ void onyx_run_initialize(b32 debug_enabled) {
         void wasm_config_set_listen_path(wasm_config_t *config, char *listen_path);
         wasm_config_set_listen_path(wasm_config, socket_path);
     #endif
+
+    // Translated programs are cached here, so later runs of the same
+    // binary can skip translating it.
+    char *image_cache_dir = getenv("ONYX_OVM_CACHE_DIR");
+    if (image_cache_dir && *image_cache_dir) {
+        void wasm_config_set_image_cache_dir(wasm_config_t *config, char *image_cache_dir);
+        wasm_config_set_image_cache_dir(wasm_config, image_cache_dir);
+    }
+
+    // Hot functions are compiled to native code, unless this is set.
+    char *no_jit = getenv("ONYX_OVM_NO_JIT");
+    if (no_jit && *no_jit) {
+        void wasm_config_enable_jit(wasm_config_t *config, bool enabled);
+        wasm_config_enable_jit(wasm_config, false);
+    }
+
+    if (profile_path) {
+        void wasm_config_set_profile_path(wasm_config_t *config, char *profile_path);
+        wasm_config_set_profile_path(wasm_config, (char *) profile_path);
+    }
 #endif
 
 #ifndef USE_OVM_DEBUGGER
@@ -581,6 +644,10 @@ void onyx_run_initialize(b32 debug_enabled) {
         printf("Warning: --debug does nothing if libovmwasm.so is not being used!\n");
     }
 
+    if (profile_path) {
+        printf("Warning: --run-profile does nothing if libovmwasm.so is not being used!\n");
+    }
+
     wasmer_features_t* features = wasmer_features_new();
     wasmer_features_simd(features, 1);
     wasmer_features_threads(features, 1);
@@ -602,6 +669,7 @@ void onyx_run_initialize(b32 debug_enabled) {
 
     // See comment in onyx_library.h about us being the linker.
     wasm_runtime.wasm_memory_data = &wasm_memory_data;
+    wasm_runtime.wasm_memory_data_size = &wasm_memory_data_size;
     wasm_runtime.wasm_extern_lookup_by_name = &wasm_extern_lookup_by_name;
     wasm_runtime.wasm_extern_as_func = &wasm_extern_as_func;
     wasm_runtime.wasm_func_call = &wasm_func_call;
@@ -610,6 +678,10 @@ void onyx_run_initialize(b32 debug_enabled) {
     wasm_runtime.wasm_store_new = &wasm_store_new;
     wasm_runtime.wasm_store_delete = &wasm_store_delete;
     wasm_runtime.onyx_print_trap = &onyx_print_trap;
+
+#ifdef USE_OVM_DEBUGGER
+    wasm_runtime.wasm_memory_fixed = 1;
+#endif
 }
 
 b32 onyx_run_wasm(bh_buffer wasm_bytes, int argc, char *argv[]) {
@@ -645,6 +717,12 @@ b32 onyx_run_wasm(bh_buffer wasm_bytes, int argc, char *argv[]) {
 
     wasm_instance = wasm_instance_new(wasm_store, wasm_module, &wasm_imports, &traps);
     if (!wasm_instance) {
+        if (traps) {
+            wasm_message_t msg;
+            wasm_trap_message(traps, &msg);
+            bh_printf("ERROR INSTANTIATING: %b\n", msg.data, msg.size);
+        }
+
         cleanup_wasm_objects();
         return 0;
     }
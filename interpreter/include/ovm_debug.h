@@ -229,8 +229,18 @@ typedef struct debug_info_t {
 
     // type id -> type info
     bh_arr(debug_type_info_t) types;
+
+    // instruction index -> set if the instruction is the first of a
+    // source line, one bit per instruction. Built once all the code has
+    // been translated, so line stepping needs no lookups.
+    u64 *line_starts;
+    u32  line_start_count;
 } debug_info_t;
 
+static inline bool debug_instr_bit_test(u64 *bits, u32 count, u32 instr) {
+    return instr < count && ((bits[instr >> 6] >> (instr & 63)) & 1);
+}
+
 void debug_info_init(debug_info_t *);
 void debug_info_free(debug_info_t *);
 void debug_info_import_file_info(debug_info_t *, u8 *data, u32 len);
@@ -243,6 +253,11 @@ bool debug_info_lookup_file(debug_info_t *info, u32 file_id, debug_file_info_t *
 bool debug_info_lookup_file_by_name(debug_info_t *info, char *name, debug_file_info_t *out);
 bool debug_info_lookup_func(debug_info_t *info, u32 func_id, debug_func_info_t *out);
 i32  debug_info_lookup_instr_by_file_line(debug_info_t *info, char *filename, u32 line);
+void debug_info_build_line_starts(debug_info_t *info);
+
+static inline bool debug_info_is_line_start(debug_info_t *info, u32 instruction) {
+    return debug_instr_bit_test(info->line_starts, info->line_start_count, instruction);
+}
 
 char *debug_info_type_enum_find_name(debug_info_t *info, u32 enum_type, u64 value);
 
@@ -345,6 +360,12 @@ typedef struct debug_state_t {
     u32 next_breakpoint_id;
     bh_arr(debug_breakpoint_t) breakpoints;
 
+    // instruction index -> set if any breakpoint is on the instruction, one
+    // bit per instruction. Sized once the program is built, and only changed
+    // with atomic operations, so running threads can test it without a lock.
+    u64 *breakpoint_bits;
+    u32  breakpoint_bit_count;
+
     pthread_t debug_thread;
     bool debug_thread_running;
 
@@ -361,6 +382,8 @@ void debug_host_start(debug_state_t *debug);
 void debug_host_stop(debug_state_t *debug);
 u32  debug_host_register_thread(debug_state_t *debug, struct ovm_state_t *ovm_state);
 debug_thread_state_t *debug_host_lookup_thread(debug_state_t *debug, u32 id);
+void debug_host_prepare_breakpoints(debug_state_t *debug, u32 instr_count);
+void debug_host_update_breakpoint_bit(debug_state_t *debug, u32 instr);
 
 
 
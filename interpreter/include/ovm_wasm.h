@@ -10,10 +10,18 @@
 struct wasm_config_t {
     bool debug_enabled;
     char *listen_path;
+    char *image_cache_dir;
+    bool lazy_translation;
+    bool jit_enabled;
+    char *profile_path;
 };
 
 void wasm_config_enable_debug(wasm_config_t *config, bool enabled);
 void wasm_config_set_listen_path(wasm_config_t *config, char *listen_path);
+void wasm_config_set_image_cache_dir(wasm_config_t *config, char *image_cache_dir);
+void wasm_config_enable_lazy_translation(wasm_config_t *config, bool enabled);
+void wasm_config_enable_jit(wasm_config_t *config, bool enabled);
+void wasm_config_set_profile_path(wasm_config_t *config, char *profile_path);
 
 struct wasm_engine_t {
     wasm_config_t *config;
@@ -163,6 +171,18 @@ struct wasm_module_t {
     int memory_init_idx;
     int memory_init_external_idx;
 
+    // Set when functions are translated lazily, which needs the code
+    // section and where each function body starts in it.
+    wasm_byte_vec_t lazy_code;
+    unsigned int *lazy_body_offsets;
+    int lazy_func_base;
+    int func_table_arr_idx;
+
+    // Set when translated functions are cached. See module_build.
+    char *image_path;
+    u64 image_hash;
+    ovm_program_image_t image_layout;
+
     Table(struct wasm_custom_section_t) custom_sections;
 
     debug_info_t debug_info;
@@ -174,9 +194,15 @@ struct wasm_func_inner_t {
     void (*func_ptr)();
     void (*finalizer)(void *);
 
+    // Set for runtime library functions defined with ONYX_DEF_DIRECT. These
+    // are called with the interpreter's values, instead of through func_ptr.
+    void (*direct_func_ptr)(ovm_value_t *params, ovm_value_t *results, char *memory_base);
+
     const wasm_functype_t *type;
 };
 
+void wasm_func_set_onyx_direct(wasm_func_t *func, void *direct);
+
 struct wasm_global_inner_t {
     int register_index;
     ovm_state_t  *state;
@@ -23,6 +23,9 @@ typedef struct ovm_value_t ovm_value_t;
 typedef struct ovm_instr_t ovm_instr_t;
 typedef struct ovm_static_data_t ovm_static_data_t;
 typedef struct ovm_static_integer_array_t ovm_static_integer_array_t;
+typedef struct ovm_jit_func_t ovm_jit_func_t;
+typedef struct ovm_profiler_t ovm_profiler_t;
+typedef struct ovm_profile_thread_t ovm_profile_thread_t;
 
 
 //
@@ -60,18 +63,29 @@ struct ovm_static_integer_array_t {
 
 struct ovm_value_t {
     union {
-        i8  i8;
-        i16 i16;
-        i32 i32;
-        i64 i64;
-        u8  u8;
-        u16 u16;
-        u32 u32;
-        u64 u64;
-        f32 f32;
-        f64 f64;
+        struct {
+            union {
+                i8  i8;
+                i16 i16;
+                i32 i32;
+                i64 i64;
+                u8  u8;
+                u16 u16;
+                u32 u32;
+                u64 u64;
+                f32 f32;
+                f64 f64;
+            };
+            ovm_valtype_t type;
+        };
+
+        // A vector uses all 16 bytes, including the type, so vector values do
+        // not have a type. This keeps values small enough to be returned in
+        // registers, which the threaded dispatch relies on for its tail calls.
+        // Code that needs the type of a value that could be a vector has to
+        // get it from the function signature instead.
+        u8 v128[16];
     };
-    ovm_valtype_t type;
 };
 
 
@@ -90,18 +104,56 @@ struct ovm_program_t {
 
     i32 register_count;
     ovm_store_t *store;
+
+    //
+    // Functions registered with ovm_program_register_lazy_func are only
+    // translated the first time they are called, by calling translate_func.
+    // Translation is serialized by translate_mutex. Because other threads
+    // keep running while a function is translated, a program with lazy
+    // functions must use fixed storage, so its arrays never move.
+    bool (*translate_func)(void *userdata, i32 func_idx, i32 *start_instr, i32 *value_number_count);
+    void *translate_userdata;
+    pthread_mutex_t translate_mutex;
+
+    //
+    // When set, hot functions are compiled to native code. This is
+    // also serialized by translate_mutex.
+    bool jit_enabled;
 };
 
 ovm_program_t *ovm_program_new(ovm_store_t *store);
+void ovm_program_use_fixed_storage(ovm_program_t *program);
 void ovm_program_delete(ovm_program_t *program);
 void ovm_program_add_instructions(ovm_program_t *program, i32 instr_count, ovm_instr_t *instrs);
 
 int  ovm_program_register_static_ints(ovm_program_t *program, int len, int *data);
 int  ovm_program_register_func(ovm_program_t *program, char *name, i32 instr, i32 param_count, i32 value_number_count);
 int  ovm_program_register_external_func(ovm_program_t *program, char *name, i32 param_count, i32 external_func_idx);
+int  ovm_program_register_lazy_func(ovm_program_t *program, char *name, i32 param_count);
+void ovm_program_translate_func(ovm_program_t *program, i32 func_idx);
 void ovm_program_begin_func(ovm_program_t *program, char *name, i32 param_count, i32 value_number_count);
 void ovm_program_modify_static_int(ovm_program_t *program, int arr, int idx, int new_value);
 
+//
+// Threads blocked in memory.atomic.wait are parked on a queue for the
+// address they are waiting on. Addresses are hashed into a fixed number
+// of buckets, each with their own lock, so unrelated waits do not contend.
+//
+typedef struct ovm_parked_thread_t ovm_parked_thread_t;
+struct ovm_parked_thread_t {
+    ovm_parked_thread_t *next;
+    u32  addr;
+    bool woken;
+    pthread_cond_t cond;
+};
+
+typedef struct ovm_parking_bucket_t {
+    pthread_mutex_t      mutex;
+    ovm_parked_thread_t *waiters;
+} ovm_parking_bucket_t;
+
+#define OVM_PARKING_BUCKETS 64
+
 //
 // Represents the running configuration and static
 // data needed by the VM. This is for more "global" data.
@@ -110,22 +162,167 @@ void ovm_program_modify_static_int(ovm_program_t *program, int arr, int idx, int
 struct ovm_engine_t {
     ovm_store_t *store;
 
-    pthread_mutex_t atomic_mutex;
-
     i64   memory_size; // This is probably going to always be 4GiB.
     void *memory;
 
+    ovm_parking_bucket_t parking_lot[OVM_PARKING_BUCKETS];
+
     debug_state_t *debug;
+    ovm_profiler_t *profiler;
 };
 
 ovm_engine_t *ovm_engine_new(ovm_store_t *store);
 void          ovm_engine_delete(ovm_engine_t *engine);
 void          ovm_engine_enable_debug(ovm_engine_t *engine, debug_state_t *debug);
+void          ovm_engine_enable_profiler(ovm_engine_t *engine, ovm_profiler_t *profiler);
 bool          ovm_engine_memory_ensure_capacity(ovm_engine_t *engine, i64 minimum_size);
 void          ovm_engine_memory_copy(ovm_engine_t *engine, i64 target, void *data, i64 size);
+i32           ovm_engine_atomic_wait(ovm_engine_t *engine, u32 addr, u64 expected, i32 size, i64 timeout_ns);
+i32           ovm_engine_atomic_notify(ovm_engine_t *engine, u32 addr, u32 count);
 
 bool ovm_program_load_from_file(ovm_program_t *program, ovm_engine_t *engine, char *filename);
 
+//
+// A program image holds the functions that a program translated lazily:
+// their instructions, and the static integer arrays (br_table targets and
+// vector constants) they added. Images are cached on disk, keyed by a hash
+// of the module binary, so a later run of the same module can map in the
+// functions it translated before. Functions that are not in the image keep
+// their translate stubs, and are translated when they are first called.
+//
+// The instructions are mapped straight over the program's code, which only
+// works with fixed storage. ovm_program_image_prepare pads the code so that
+// the translated functions start at the same offset into a page in every
+// run, and records where they start in the layout that is later given to
+// ovm_program_image_write.
+//
+// Images are written in the byte order of the machine that wrote them, and
+// are rejected on a machine with a different byte order, or by a different
+// build of the interpreter.
+//
+typedef struct ovm_program_image_t ovm_program_image_t;
+typedef struct ovm_image_func_t ovm_image_func_t;
+
+struct ovm_image_func_t {
+    i32 func_idx;
+    i32 start_instr;
+    i32 value_number_count;
+};
+
+struct ovm_program_image_t {
+    i32 func_count;
+    ovm_image_func_t *funcs;
+
+    i32 static_integer_base;
+    i32 static_integer_count;
+    i32 *static_integers;
+
+    i32 static_data_base;
+    i32 static_data_count;
+    ovm_static_integer_array_t *static_data;
+
+    i32 code_base;
+    i32 code_count;
+    i32 code_prefix;  // Bytes between the start of the page and code_base.
+    u64 code_offset;  // Page aligned offset of that page in the file.
+
+    int   fd;
+    void *mapping;
+    u64   mapping_size;
+};
+
+u64  ovm_image_hash(u64 hash, const void *data, u64 length);
+void ovm_program_image_prepare(ovm_program_image_t *layout, ovm_program_t *program);
+bool ovm_program_image_map(ovm_program_image_t *image, char *filename, u64 module_hash);
+void ovm_program_image_unmap(ovm_program_image_t *image);
+bool ovm_program_image_apply(ovm_program_image_t *image, ovm_program_t *program, i32 func_base, i32 func_count);
+bool ovm_program_image_write(ovm_program_image_t *layout, ovm_program_t *program, i32 func_base, i32 func_count, char *filename, u64 module_hash);
+
+//
+// Baseline JIT
+//
+// Hot functions are compiled to native code, with one fixed template for
+// each instruction. Instructions without a template become exits, which
+// store the pc of the instruction and return to the interpreter. Native
+// code can be entered at any instruction in the function, so after the
+// interpreter has handled an exit, it enters the native code again at
+// the next call or loop back-edge.
+//
+// Native code keeps every value in the frame's value numbers, so the
+// interpreter and native code can hand over at any instruction.
+//
+#define OVM_JIT_CALL_THRESHOLD      1000
+#define OVM_JIT_BACKEDGE_THRESHOLD  10000
+
+typedef void (*ovm_jit_entry_t)(ovm_value_t *values, u8 *memory, ovm_state_t *state, void *target);
+
+struct ovm_jit_func_t {
+    i32 start_instr;
+    i32 instr_count;
+
+    // Offset of the native code of each instruction, from the start of code.
+    u32 *instr_offsets;
+
+    // Starts with the entry trampoline, of type ovm_jit_entry_t.
+    u8  *code;
+    u64  code_size;
+};
+
+ovm_jit_func_t *ovm_jit_compile(ovm_program_t *program, ovm_func_t *func);
+void            ovm_jit_free(ovm_jit_func_t *jit);
+
+//
+// Profiler
+//
+// When the engine has a profiler, code runs with a dispatch table that
+// counts every instruction, both against the calling context it ran in,
+// and against its pc. The calling contexts form a tree, with a node for
+// each distinct path of calls from the root. Each thread has its own tree,
+// so counting needs no synchronization.
+//
+// When the program ends, the trees are written as folded stacks, one line
+// per path, which flamegraph.pl, inferno and speedscope all read. A table
+// of each function's calls, self and inclusive instruction counts, and of
+// the most run source lines, is printed to stderr.
+//
+typedef struct ovm_profile_node_t {
+    i32 func_idx;       // -1 for the root.
+    i32 parent;
+    i32 first_child;
+    i32 next_sibling;
+
+    u64 calls;
+    u64 self_instrs;
+} ovm_profile_node_t;
+
+struct ovm_profile_thread_t {
+    bh_arr(ovm_profile_node_t) nodes;
+    i32 current;
+    i32 depth;
+
+    // Indexed by pc.
+    u64 *instr_counts;
+    i32  instr_count_length;
+};
+
+struct ovm_profiler_t {
+    char *output_path;
+
+    pthread_mutex_t mutex;
+    bh_arr(ovm_profile_thread_t *) threads;
+
+    ovm_program_t *program;
+    debug_info_t  *debug_info;
+    bool written;
+};
+
+ovm_profiler_t       *ovm_profiler_new(char *output_path);
+void                  ovm_profiler_delete(ovm_profiler_t *profiler);
+void                  ovm_profiler_attach_program(ovm_profiler_t *profiler, ovm_program_t *program, debug_info_t *debug_info);
+ovm_profile_thread_t *ovm_profiler_new_thread(ovm_profiler_t *profiler);
+void                  ovm_profile_thread_sync(ovm_profile_thread_t *thread, ovm_state_t *state);
+void                  ovm_profiler_write(ovm_profiler_t *profiler);
+
 //
 // Represents ephemeral state / execution context.
 // If multiple threads are used, multiple states are needed.
@@ -166,6 +363,13 @@ struct ovm_state_t {
 
     debug_thread_state_t *debug;
     i32                   call_depth;
+
+    //
+    // Set when an instruction traps. The value returned by ovm_run_code cannot
+    // be checked for OVM_TYPE_ERR, because a vector result has no type.
+    bool trapped;
+
+    ovm_profile_thread_t *profile;
 };
 
 ovm_state_t *ovm_state_new(ovm_engine_t *engine, ovm_program_t *program);
@@ -209,6 +413,13 @@ struct ovm_func_t {
         i32 start_instr;
         i32 external_func_idx;
     };
+
+    //
+    // Counted while the function is interpreted. When either count reaches
+    // its threshold, the function is compiled to native code.
+    u32 call_count;
+    u32 backedge_count;
+    ovm_jit_func_t *jit;
 };
 
 struct ovm_external_func_t {
@@ -352,13 +563,123 @@ struct ovm_instr_t {
 #define OVMI_TRANSMUTE_F32     0x4a   // %r = *(t *) &%a (reinterpret bytes)
 #define OVMI_TRANSMUTE_F64     0x4b   // %r = *(t *) &%a (reinterpret bytes)
 
-#define OVMI_CMPXCHG           0x4c   // %r = %r == %a ? %b : %r
+#define OVMI_CMPXCHG           0x4c   // %r = atomic (%r == %a ? %b : %r)
 
 #define OVMI_BREAK             0x4d
 
 #define OVMI_MEM_SIZE          0x4e   // %r = <size in bytes of memory>
 #define OVMI_MEM_GROW          0x4f   // %r = <grow memory, return new size in bytes>
 
+//
+// 128-bit vector instructions
+//
+// The type of a vector instruction is the type of one lane, so
+// OVM_TYPED_INSTR(OVMI_VADD, OVM_TYPE_I32) adds two i32x4 vectors. The
+// bitwise instructions are untyped. Vectors are loaded and stored with
+// OVMI_LOAD and OVMI_STORE, typed OVM_TYPE_V128.
+//
+// For conversions, the type is the lane type of the result, like the
+// scalar conversions.
+#define OVMI_VCONST            0x50   // %r = (a)   (4 static integers)
+#define OVMI_VSPLAT            0x51   // %r = splat(%a)
+#define OVMI_VEXTRACT          0x52   // %r = %a[b]
+#define OVMI_VEXTRACT_S        0x53   // %r = %a[b] (sign aware)
+#define OVMI_VREPLACE          0x54   // %r = %a, with %r[lane] = %b (see OVM_INSTR_LANE)
+#define OVMI_VSWIZZLE          0x55   // %r = swizzle(%a, %b)
+#define OVMI_VNOT              0x56   // %r = ~%a
+#define OVMI_VAND              0x57   // %r = %a & %b
+#define OVMI_VANDNOT           0x58   // %r = %a & ~%b
+#define OVMI_VOR               0x59   // %r = %a | %b
+#define OVMI_VXOR              0x5a   // %r = %a ^ %b
+#define OVMI_VANY_TRUE         0x5b   // %r = any bit of %a is set
+#define OVMI_VALL_TRUE         0x5c   // %r = every lane of %a is non-zero
+#define OVMI_VBITMASK          0x5d   // %r = top bit of every lane of %a
+#define OVMI_VEQ               0x5e   // %r = %a == %b
+#define OVMI_VNE               0x5f   // %r = %a != %b
+#define OVMI_VLT               0x60   // %r = %a < %b
+#define OVMI_VLT_S             0x61   // %r = %a < %b
+#define OVMI_VLE               0x62   // %r = %a <= %b
+#define OVMI_VLE_S             0x63   // %r = %a <= %b
+#define OVMI_VGT               0x64   // %r = %a > %b
+#define OVMI_VGT_S             0x65   // %r = %a > %b
+#define OVMI_VGE               0x66   // %r = %a >= %b
+#define OVMI_VGE_S             0x67   // %r = %a >= %b
+#define OVMI_VABS              0x68   // %r = |%a|
+#define OVMI_VNEG              0x69   // %r = -%a
+#define OVMI_VSQRT             0x6a   // %r = sqrt(%a)
+#define OVMI_VADD              0x6b   // %r = %a + %b
+#define OVMI_VADD_SAT          0x6c   // %r = %a + %b (saturating)
+#define OVMI_VADD_SAT_S        0x6d   // %r = %a + %b (saturating, sign aware)
+#define OVMI_VSUB              0x6e   // %r = %a - %b
+#define OVMI_VSUB_SAT          0x6f   // %r = %a - %b (saturating)
+#define OVMI_VSUB_SAT_S        0x70   // %r = %a - %b (saturating, sign aware)
+#define OVMI_VMUL              0x71   // %r = %a * %b
+#define OVMI_VDIV              0x72   // %r = %a / %b
+#define OVMI_VMIN              0x73   // %r = min(%a, %b)
+#define OVMI_VMIN_S            0x74   // %r = min(%a, %b)
+#define OVMI_VMAX              0x75   // %r = max(%a, %b)
+#define OVMI_VMAX_S            0x76   // %r = max(%a, %b)
+#define OVMI_VAVGR             0x77   // %r = (%a + %b + 1) / 2
+#define OVMI_VSHL              0x78   // %r = %a << %b
+#define OVMI_VSHR              0x79   // %r = %a >> %b
+#define OVMI_VSAR              0x7a   // %r = %a >>> %b
+#define OVMI_VNARROW           0x7b   // %r = narrow(%a, %b)
+#define OVMI_VNARROW_S         0x7c   // %r = narrow(%a, %b) (sign aware)
+#define OVMI_VWIDEN_LOW        0x7d   // %r = widen(low half of %a)
+#define OVMI_VWIDEN_LOW_S      0x7e   // %r = widen(low half of %a) (sign aware)
+#define OVMI_VWIDEN_HIGH       0x7f   // %r = widen(high half of %a)
+#define OVMI_VWIDEN_HIGH_S     0x80   // %r = widen(high half of %a) (sign aware)
+#define OVMI_VTRUNC_SAT        0x81   // %r = (t) %a (saturating)
+#define OVMI_VTRUNC_SAT_S      0x82   // %r = (t) %a (saturating, sign aware)
+#define OVMI_VCONVERT          0x83   // %r = (t) %a
+#define OVMI_VCONVERT_S        0x84   // %r = (t) %a (sign aware)
+
+//
+// Atomic memory instructions. These are always sequentially consistent,
+// and only have integer variants.
+//
+#define OVMI_ATOMIC_LOAD       0x85   // %r = atomic mem[%a + b]
+#define OVMI_ATOMIC_STORE      0x86   // atomic mem[%r + b] = %a
+#define OVMI_ATOMIC_ADD        0x87   // %r = mem[%a], mem[%a] += %b
+#define OVMI_ATOMIC_SUB        0x88   // %r = mem[%a], mem[%a] -= %b
+#define OVMI_ATOMIC_AND        0x89   // %r = mem[%a], mem[%a] &= %b
+#define OVMI_ATOMIC_OR         0x8a   // %r = mem[%a], mem[%a] |= %b
+#define OVMI_ATOMIC_XOR        0x8b   // %r = mem[%a], mem[%a] ^= %b
+#define OVMI_ATOMIC_XCHG       0x8c   // %r = mem[%a], mem[%a] = %b
+#define OVMI_ATOMIC_WAIT       0x8d   // %r = wait until mem[%r] != %a, or %b nanoseconds pass
+#define OVMI_ATOMIC_NOTIFY     0x8e   // %r = wake up to %b threads waiting on mem[%a]
+#define OVMI_ATOMIC_FENCE      0x8f
+
+//
+// Fused instructions. These are never emitted directly, but are
+// produced by the code builder from common sequences of instructions.
+// The compare-and-branch instructions only have integer variants,
+// and are in the same order as the comparison instructions.
+//
+#define OVMI_ADD_IMM           0x90   // %r = %a + b
+#define OVMI_BR_LT             0x91   // br pc + r if %a < %b
+#define OVMI_BR_LT_S           0x92   // br pc + r if %a < %b
+#define OVMI_BR_LE             0x93   // br pc + r if %a <= %b
+#define OVMI_BR_LE_S           0x94   // br pc + r if %a <= %b
+#define OVMI_BR_EQ             0x95   // br pc + r if %a == %b
+#define OVMI_BR_GE             0x96   // br pc + r if %a >= %b
+#define OVMI_BR_GE_S           0x97   // br pc + r if %a >= %b
+#define OVMI_BR_GT             0x98   // br pc + r if %a > %b
+#define OVMI_BR_GT_S           0x99   // br pc + r if %a > %b
+#define OVMI_BR_NE             0x9a   // br pc + r if %a != %b
+
+//
+// Every lazily translated function starts as a single translate
+// instruction. Executing it translates the function, then continues
+// at the start of the translated code.
+//
+#define OVMI_TRANSLATE         0x9b   // translate func a, and enter it
+
+// OVMI_VREPLACE has three operands, so the lane is stored above the
+// instruction and type bits.
+#define OVM_INSTR_LANE(instr)  (((instr).full_instr >> 11) & 0xf)
+#define OVM_LANE(lane)         (((lane) & 0xf) << 11)
+
 //
 // OVM_TYPED_INSTR(OVMI_ADD, OVM_TYPE_I32) == instruction for adding i32s
 //
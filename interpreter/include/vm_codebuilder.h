@@ -15,6 +15,13 @@ typedef enum label_kind_t label_kind_t;
 struct ovm_code_builder_t {
     bh_arr(i32) execution_stack;
 
+    // Temporaries are only live while they are on the execution stack.
+    // These track which temporaries are live, so the lowest dead one can
+    // be reused. A temporary can be on the stack more than once, so each
+    // one is reference counted.
+    bh_arr(u64) live_temporaries;
+    bh_arr(i32) temporary_refs;
+
     i32 next_label_idx;
     bh_arr(label_target_t) label_stack;
     bh_arr(branch_patch_t) branch_patches;
@@ -24,6 +31,11 @@ struct ovm_code_builder_t {
     ovm_program_t *program;
     i32 start_instr;
 
+    // The index of the most recent instruction that can be branched to.
+    // The last instruction can only be fused with the next one if this
+    // is not the next one. See :Fusion.
+    i32 last_branch_target;
+
     i32 func_table_arr_idx;
     i32 highest_value_number;
 
@@ -47,6 +59,7 @@ struct label_target_t {
 
 enum branch_patch_kind_t {
     branch_patch_instr_a,    // For patching the '.a' register of a branch instruction.
+    branch_patch_instr_r,    // For patching the '.r' register of a fused compare-and-branch instruction.
     branch_patch_static_idx, // For patching an integer in the static integers section.
 };
 
@@ -87,9 +100,18 @@ void               ovm_code_builder_add_store(ovm_code_builder_t *builder, u32 o
 void               ovm_code_builder_add_atomic_load(ovm_code_builder_t *builder, u32 ovm_type, i32 offset);
 void               ovm_code_builder_add_atomic_store(ovm_code_builder_t *builder, u32 ovm_type, i32 offset);
 void               ovm_code_builder_add_cmpxchg(ovm_code_builder_t *builder, u32 ovm_type, i32 offset);
+void               ovm_code_builder_add_atomic_rmw(ovm_code_builder_t *builder, u32 instr, u32 ovm_type, i32 offset);
+void               ovm_code_builder_add_atomic_wait(ovm_code_builder_t *builder, u32 ovm_type, i32 offset);
+void               ovm_code_builder_add_atomic_notify(ovm_code_builder_t *builder, i32 offset);
+void               ovm_code_builder_add_atomic_fence(ovm_code_builder_t *builder);
 void               ovm_code_builder_add_memory_copy(ovm_code_builder_t *builder);
 void               ovm_code_builder_add_memory_fill(ovm_code_builder_t *builder);
 void               ovm_code_builder_add_memory_size(ovm_code_builder_t *builder);
 void               ovm_code_builder_add_memory_grow(ovm_code_builder_t *builder);
+void               ovm_code_builder_add_vector_const(ovm_code_builder_t *builder, u8 *bytes);
+void               ovm_code_builder_add_extract_lane(ovm_code_builder_t *builder, u32 instr, i32 lane);
+void               ovm_code_builder_add_replace_lane(ovm_code_builder_t *builder, u32 instr, i32 lane);
+void               ovm_code_builder_add_bitselect(ovm_code_builder_t *builder);
+void               ovm_code_builder_add_shuffle(ovm_code_builder_t *builder, u8 *lanes);
 
 #endif
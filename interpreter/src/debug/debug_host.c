@@ -64,3 +64,46 @@ debug_thread_state_t *debug_host_lookup_thread(debug_state_t *debug, u32 id) {
     return NULL;
 }
 
+//
+// Called once the program has been built. The debug thread is already
+// running by then, so breakpoints may have been set before there was a bitmap
+// to mark them in. Their bits are set here, and set again once the bitmap is
+// published, in case one was added in between. A bit that is no longer used
+// only costs a look at the list.
+void debug_host_prepare_breakpoints(debug_state_t *debug, u32 instr_count) {
+    u32 word_count = (instr_count + 63) / 64 + 1;
+    u64 *bits = bh_alloc_array(debug->alloc, u64, word_count);
+    memset(bits, 0, sizeof(u64) * word_count);
+
+    bh_arr_each(debug_breakpoint_t, bp, debug->breakpoints) {
+        if (bp->instr < instr_count) bits[bp->instr >> 6] |= 1ull << (bp->instr & 63);
+    }
+
+    u64 *old_bits = debug->breakpoint_bits;
+    __atomic_store_n(&debug->breakpoint_bits, bits, __ATOMIC_RELEASE);
+    __atomic_store_n(&debug->breakpoint_bit_count, instr_count, __ATOMIC_RELEASE);
+    if (old_bits) bh_free(debug->alloc, old_bits);
+
+    bh_arr_each(debug_breakpoint_t, bp, debug->breakpoints) {
+        debug_host_update_breakpoint_bit(debug, bp->instr);
+    }
+}
+
+//
+// Sets or clears the instruction's bit, depending on if any breakpoint is
+// still on it. Only the debug thread changes breakpoints.
+void debug_host_update_breakpoint_bit(debug_state_t *debug, u32 instr) {
+    if (instr >= __atomic_load_n(&debug->breakpoint_bit_count, __ATOMIC_ACQUIRE)) return;
+
+    bool used = false;
+    bh_arr_each(debug_breakpoint_t, bp, debug->breakpoints) {
+        if (bp->instr == instr) {
+            used = true;
+            break;
+        }
+    }
+
+    u64 mask = 1ull << (instr & 63);
+    if (used) __atomic_fetch_or (&debug->breakpoint_bits[instr >> 6],  mask, __ATOMIC_RELEASE);
+    else      __atomic_fetch_and(&debug->breakpoint_bits[instr >> 6], ~mask, __ATOMIC_RELEASE);
+}
@@ -20,6 +20,8 @@ void debug_info_free(debug_info_t *info) {
     bh_arr_free(info->line_info);
     bh_arr_free(info->instruction_reducer);
 
+    if (info->line_starts) bh_free(info->alloc, info->line_starts);
+
     bh_arr_each(debug_file_info_t, file, info->files) {
         bh_free(info->alloc, file->name);
     }
@@ -249,6 +251,34 @@ bool debug_info_lookup_file(debug_info_t *info, u32 file_id, debug_file_info_t *
     return true;
 }
 
+//
+// An instruction starts a line if it has a location, and the instruction
+// before it is on a different line, or has no location.
+void debug_info_build_line_starts(debug_info_t *info) {
+    if (info->line_starts) bh_free(info->alloc, info->line_starts);
+
+    u32 count = bh_arr_length(info->instruction_reducer);
+    info->line_start_count = count;
+    info->line_starts = bh_alloc_array(info->alloc, u64, (count + 63) / 64 + 1);
+    memset(info->line_starts, 0, sizeof(u64) * ((count + 63) / 64 + 1));
+
+    if (!info->has_debug_info) return;
+
+    i32 line_info_count = bh_arr_length(info->line_info);
+    debug_loc_info_t *prev = NULL;
+
+    fori (i, 0, (i32) count) {
+        i32 loc = (i32) info->instruction_reducer[i];
+        debug_loc_info_t *curr = (loc >= 0 && loc < line_info_count) ? &info->line_info[loc] : NULL;
+
+        if (curr && (!prev || prev->file_id != curr->file_id || prev->line != curr->line)) {
+            info->line_starts[i >> 6] |= 1ull << (i & 63);
+        }
+
+        prev = curr;
+    }
+}
+
 i32 debug_info_lookup_instr_by_file_line(debug_info_t *info, char *filename, u32 line) {
     if (!info || !info->has_debug_info) return 0;
 
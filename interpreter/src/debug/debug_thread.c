@@ -193,6 +193,7 @@ static DEBUG_COMMAND_HANDLER(debug_command_brk) {
     bp.file_id = file_info.file_id;
     bp.line = line;
     bh_arr_push(debug->breakpoints, bp);
+    debug_host_update_breakpoint_bit(debug, bp.instr);
 
     send_response_header(debug, msg_id);
     send_bool(debug, true);
@@ -220,10 +221,14 @@ static DEBUG_COMMAND_HANDLER(debug_command_clr_brk) {
 
     bh_arr_each(debug_breakpoint_t, bp, debug->breakpoints) {
         if (bp->file_id == file_info.file_id) {
+            u32 instr = bp->instr;
+
             // This is kind of hacky but it does successfully delete
             // a single element from the array and move the iterator.
             bh_arr_fastdelete(debug->breakpoints, bp - debug->breakpoints);
             bp--;
+
+            debug_host_update_breakpoint_bit(debug, instr);
         }
     }
 
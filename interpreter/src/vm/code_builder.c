@@ -4,49 +4,110 @@
 
 // #define BUILDER_DEBUG
 
+#define IS_TEMPORARY_VALUE(b, r) (r >= (b->param_count + b->local_count))
+
+static inline void retain_value(ovm_code_builder_t *b, i32 r) {
+    if (!IS_TEMPORARY_VALUE(b, r)) return;
+
+    i32 t = r - (b->param_count + b->local_count);
+    while (bh_arr_length(b->temporary_refs) <= t) {
+        bh_arr_push(b->temporary_refs, 0);
+    }
+
+    while (bh_arr_length(b->live_temporaries) <= (t >> 6)) {
+        bh_arr_push(b->live_temporaries, 0);
+    }
+
+    if (b->temporary_refs[t]++ == 0) {
+        b->live_temporaries[t >> 6] |= 1ull << (t & 63);
+    }
+}
+
+static inline i32 release_value(ovm_code_builder_t *b, i32 r) {
+    if (!IS_TEMPORARY_VALUE(b, r)) return r;
+
+    i32 t = r - (b->param_count + b->local_count);
+    if (--b->temporary_refs[t] == 0) {
+        b->live_temporaries[t >> 6] &= ~(1ull << (t & 63));
+    }
+
+    return r;
+}
+
 #if defined(BUILDER_DEBUG)
-    #define POP_VALUE(b)     (bh_arr_length((b)->execution_stack) == 0 ? (assert(0 && "invalid value pop"), 0) : bh_arr_pop((b)->execution_stack))
+    #define POP_VALUE(b)     (bh_arr_length((b)->execution_stack) == 0 ? (assert(0 && "invalid value pop"), 0) : release_value((b), bh_arr_pop((b)->execution_stack)))
 #else
-    #define POP_VALUE(b) bh_arr_pop((b)->execution_stack)
+    #define POP_VALUE(b) release_value((b), bh_arr_pop((b)->execution_stack))
 #endif
 
-#define PUSH_VALUE(b, r) (bh_arr_push((b)->execution_stack, r))
+#define PUSH_VALUE(b, r) (retain_value((b), (r)), bh_arr_push((b)->execution_stack, r))
 
 #define LAST_VALUE(b) bh_arr_last((b)->execution_stack)
 
-#define IS_TEMPORARY_VALUE(b, r) (r >= (b->param_count + b->local_count))
-
+//
+// Returns the lowest temporary that is not on the execution stack. Because
+// WebAssembly is a stack machine, a temporary is dead as soon as it is popped,
+// so this is all the liveness information needed to reuse value numbers.
 static inline int NEXT_VALUE(ovm_code_builder_t *b) {
 #if defined(BUILDER_DEBUG)
     b->highest_value_number += 1;
     return b->highest_value_number - 1;
 
 #else
-    if (bh_arr_length(b->execution_stack) == 0) {
-        return b->param_count + b->local_count;
-    }
+    i32 t = 0;
+    bh_arr_each(u64, live, b->live_temporaries) {
+        if (~*live != 0) {
+            t += __builtin_ctzll(~*live);
+            break;
+        }
 
-    i32 max = b->param_count + b->local_count;
-    bh_arr_each(i32, reg, b->execution_stack) {
-        max = bh_max(*reg, max);
+        t += 64;
     }
 
-    b->highest_value_number = bh_max(b->highest_value_number, max + 1);
-    return max + 1;
+    i32 r = b->param_count + b->local_count + t;
+    b->highest_value_number = bh_max(b->highest_value_number, r);
+    return r;
 #endif
 }
 
+//
+// :Fusion
+// Some common sequences of instructions are fused into a single instruction,
+// to save on dispatch. This is done by rewriting the last instruction emitted
+// instead of emitting a new one, which is only safe if nothing branches to
+// the instruction that would have been emitted, and the value produced by the
+// last instruction is a temporary that is only used by the new instruction.
+static inline ovm_instr_t *fusable_last_instr(ovm_code_builder_t *builder, i32 value) {
+    if (bh_arr_length(builder->program->code) <= builder->last_branch_target) return NULL;
+    if (!IS_TEMPORARY_VALUE(builder, value)) return NULL;
+
+    ovm_instr_t *last_instr = &bh_arr_last(builder->program->code);
+    if (last_instr->r != value) return NULL;
+
+    return last_instr;
+}
+
+static inline void mark_branch_target(ovm_code_builder_t *builder) {
+    builder->last_branch_target = bh_arr_length(builder->program->code);
+}
+
 ovm_code_builder_t ovm_code_builder_new(ovm_program_t *program, debug_info_builder_t *debug, i32 param_count, i32 result_count, i32 local_count) {
     ovm_code_builder_t builder;
     builder.param_count = param_count;
     builder.result_count = result_count;
     builder.local_count = local_count;
     builder.start_instr = bh_arr_length(program->code);
+    builder.last_branch_target = builder.start_instr;
     builder.program = program;
 
     builder.execution_stack = NULL;
     bh_arr_new(bh_heap_allocator(), builder.execution_stack, 32);
 
+    builder.live_temporaries = NULL;
+    builder.temporary_refs = NULL;
+    bh_arr_new(bh_heap_allocator(), builder.live_temporaries, 4);
+    bh_arr_new(bh_heap_allocator(), builder.temporary_refs, 32);
+
     builder.next_label_idx = 0;
     builder.label_stack = NULL;
     builder.branch_patches = NULL;
@@ -62,6 +123,8 @@ ovm_code_builder_t ovm_code_builder_new(ovm_program_t *program, debug_info_build
 
 void ovm_code_builder_free(ovm_code_builder_t *builder) {
     bh_arr_free(builder->execution_stack);
+    bh_arr_free(builder->live_temporaries);
+    bh_arr_free(builder->temporary_refs);
     bh_arr_free(builder->label_stack);
     bh_arr_free(builder->branch_patches);
 }
@@ -81,6 +144,7 @@ i32 ovm_code_builder_push_label_target(ovm_code_builder_t *builder, label_kind_t
 
     if (kind == label_kind_loop) {
         target.instr = bh_arr_length(builder->program->code);
+        mark_branch_target(builder);
     }
 
     bh_arr_push(builder->label_stack, target);
@@ -92,6 +156,7 @@ void ovm_code_builder_pop_label_target(ovm_code_builder_t *builder) {
     label_target_t target = bh_arr_pop(builder->label_stack);
     if (target.instr == -1) {
         target.instr = bh_arr_length(builder->program->code);
+        mark_branch_target(builder);
     }
 
     fori (i, 0, bh_arr_length(builder->branch_patches)) {
@@ -105,6 +170,10 @@ void ovm_code_builder_pop_label_target(ovm_code_builder_t *builder) {
                 builder->program->code[patch.branch_instr].a = br_delta;
                 break;
 
+            case branch_patch_instr_r:
+                builder->program->code[patch.branch_instr].r = br_delta;
+                break;
+
             case branch_patch_static_idx:
                 ovm_program_modify_static_int(builder->program, patch.static_arr, patch.static_idx, br_delta);
                 break;
@@ -129,9 +198,14 @@ void ovm_code_builder_patch_else(ovm_code_builder_t *builder, label_target_t if_
         if (!patch.targets_else) continue;
 
         int br_delta = bh_arr_length(builder->program->code) - patch.branch_instr - 1;
-        assert(patch.kind == branch_patch_instr_a);
+        mark_branch_target(builder);
 
-        builder->program->code[patch.branch_instr].a = br_delta;
+        if (patch.kind == branch_patch_instr_r) {
+            builder->program->code[patch.branch_instr].r = br_delta;
+        } else {
+            assert(patch.kind == branch_patch_instr_a);
+            builder->program->code[patch.branch_instr].a = br_delta;
+        }
 
         bh_arr_fastdelete(builder->branch_patches, i);
         return;
@@ -166,6 +240,36 @@ void ovm_code_builder_add_break(ovm_code_builder_t *builder) {
 }
 
 void ovm_code_builder_add_binop(ovm_code_builder_t *builder, u32 instr) {
+    // :Fusion
+    // imm.x %t, k; add.x %r, %a, %t  =>  add_imm.x %r, %a, k
+    u32 instr_kind = (instr >> 3) & 0xff;
+    u32 instr_type = instr & 0x7;
+    if ((instr_kind == OVMI_ADD || instr_kind == OVMI_SUB)
+        && (instr_type == OVM_TYPE_I32 || instr_type == OVM_TYPE_I64)) {
+        ovm_instr_t *last_instr = fusable_last_instr(builder, LAST_VALUE(builder));
+
+        if (last_instr && OVM_INSTR_INSTR(*last_instr) == OVMI_IMM && OVM_INSTR_TYPE(*last_instr) == instr_type) {
+            i64 imm = instr_type == OVM_TYPE_I32 ? (i64) last_instr->i : last_instr->l;
+
+            // INT64_MIN cannot be negated; it is out of range for the immediate anyway.
+            b32 fusable = imm != INT64_MIN;
+            if (fusable && instr_kind == OVMI_SUB) imm = -imm;
+
+            if (fusable && imm >= INT32_MIN && imm <= INT32_MAX) {
+                POP_VALUE(builder);
+                i32 left = POP_VALUE(builder);
+
+                last_instr->full_instr = OVM_TYPED_INSTR(OVMI_ADD_IMM, instr_type);
+                last_instr->r = NEXT_VALUE(builder);
+                last_instr->a = left;
+                last_instr->b = (i32) imm;
+
+                PUSH_VALUE(builder, last_instr->r);
+                return;
+            }
+        }
+    }
+
     i32 right  = POP_VALUE(builder);
     i32 left   = POP_VALUE(builder);
     i32 result = NEXT_VALUE(builder);
@@ -232,6 +336,36 @@ void ovm_code_builder_add_branch(ovm_code_builder_t *builder, i32 label_idx) {
 }
 
 void ovm_code_builder_add_cond_branch(ovm_code_builder_t *builder, i32 label_idx, bool branch_if_true, bool targets_else) {
+    // :Fusion
+    // lt.x %t, %a, %b; br_nz L, %t  =>  br_lt.x L, %a, %b
+    // Branching on false inverts the comparison, which is only valid for integers.
+    ovm_instr_t *last_instr = fusable_last_instr(builder, LAST_VALUE(builder));
+    if (last_instr
+        && OVM_INSTR_INSTR(*last_instr) >= OVMI_LT && OVM_INSTR_INSTR(*last_instr) <= OVMI_NE
+        && (OVM_INSTR_TYPE(*last_instr) == OVM_TYPE_I32 || OVM_INSTR_TYPE(*last_instr) == OVM_TYPE_I64)) {
+
+        static const u32 inverted_comparisons[] = {
+            OVMI_GE, OVMI_GE_S, OVMI_GT, OVMI_GT_S, OVMI_NE,
+            OVMI_LT, OVMI_LT_S, OVMI_LE, OVMI_LE_S, OVMI_EQ,
+        };
+
+        u32 comparison = OVM_INSTR_INSTR(*last_instr);
+        if (!branch_if_true) comparison = inverted_comparisons[comparison - OVMI_LT];
+
+        last_instr->full_instr = OVM_TYPED_INSTR(OVMI_BR_LT + (comparison - OVMI_LT), OVM_INSTR_TYPE(*last_instr));
+        last_instr->r = -1;
+        POP_VALUE(builder);
+
+        branch_patch_t patch;
+        patch.kind = branch_patch_instr_r;
+        patch.branch_instr = bh_arr_length(builder->program->code) - 1;
+        patch.label_idx = label_idx;
+        patch.targets_else = targets_else;
+
+        bh_arr_push(builder->branch_patches, patch);
+        return;
+    }
+
     ovm_instr_t branch_instr = {0};
     if (branch_if_true) {
         branch_instr.full_instr = OVM_TYPED_INSTR(OVMI_BR_NZ, OVM_TYPE_NONE);
@@ -424,17 +558,51 @@ static void maybe_copy_register_if_going_to_be_replaced(ovm_code_builder_t *buil
         bh_arr_each(i32, reg, builder->execution_stack) {
             if (*reg == local_idx) {
                 *reg = new_register;
+                retain_value(builder, new_register);
             }
         }
     }
 }
 
+//
+// Whether %r is only written to by the instruction, so the result can be
+// stored straight into a local instead of being moved there afterwards.
+// Stores, copies and fills read an address out of %r, the branches store
+// a branch offset in it, and CMPXCHG and ATOMIC_WAIT read it before writing.
+//
+static b32 instr_writes_destination(ovm_instr_t *instr) {
+    u32 op = OVM_INSTR_INSTR(*instr);
+
+    if (op >= OVMI_ADD && op <= OVMI_SAR)                   return 1;
+    if (op >= OVMI_LT && op <= OVMI_NE)                     return 1;
+    if (op >= OVMI_CLZ && op <= OVMI_TRANSMUTE_F64)         return 1;
+    if (op >= OVMI_MEM_SIZE && op <= OVMI_VCONVERT_S)       return 1;
+    if (op >= OVMI_ATOMIC_ADD && op <= OVMI_ATOMIC_XCHG)    return 1;
+
+    switch (op) {
+        case OVMI_IMM:
+        case OVMI_MOV:
+        case OVMI_LOAD:
+        case OVMI_REG_GET:
+        case OVMI_IDX_ARR:
+        case OVMI_CALL:
+        case OVMI_CALLI:
+        case OVMI_ATOMIC_LOAD:
+        case OVMI_ATOMIC_NOTIFY:
+        case OVMI_ADD_IMM:
+            return 1;
+    }
+
+    return 0;
+}
+
 void ovm_code_builder_add_local_set(ovm_code_builder_t *builder, i32 local_idx) {
     maybe_copy_register_if_going_to_be_replaced(builder, local_idx);
 
     // :PrimitiveOptimization
     ovm_instr_t *last_instr = &bh_arr_last(builder->program->code);
-    if (IS_TEMPORARY_VALUE(builder, last_instr->r) && last_instr->r == LAST_VALUE(builder)) {
+    if (instr_writes_destination(last_instr)
+        && IS_TEMPORARY_VALUE(builder, last_instr->r) && last_instr->r == LAST_VALUE(builder)) {
         last_instr->r = local_idx;
         POP_VALUE(builder);
         return;
@@ -496,6 +664,20 @@ void ovm_code_builder_add_register_set(ovm_code_builder_t *builder, i32 reg_idx)
 }
 
 void ovm_code_builder_add_load(ovm_code_builder_t *builder, u32 ovm_type, i32 offset) {
+    // :Fusion
+    // add_imm.i32 %t, %a, k; load.x %r, [%t + o]  =>  load.x %r, [%a + k + o]
+    ovm_instr_t *last_instr = fusable_last_instr(builder, LAST_VALUE(builder));
+    if (last_instr && last_instr->full_instr == OVM_TYPED_INSTR(OVMI_ADD_IMM, OVM_TYPE_I32)) {
+        POP_VALUE(builder);
+
+        last_instr->full_instr = OVM_TYPED_INSTR(OVMI_LOAD, ovm_type);
+        last_instr->b = (i32) ((u32) last_instr->b + (u32) offset);
+        last_instr->r = NEXT_VALUE(builder);
+
+        PUSH_VALUE(builder, last_instr->r);
+        return;
+    }
+
     ovm_instr_t load_instr = {0};
     load_instr.full_instr = OVM_TYPED_INSTR(OVMI_LOAD, ovm_type);
     load_instr.b = offset;
@@ -509,6 +691,23 @@ void ovm_code_builder_add_load(ovm_code_builder_t *builder, u32 ovm_type, i32 of
 }
 
 void ovm_code_builder_add_store(ovm_code_builder_t *builder, u32 ovm_type, i32 offset) {
+    // :Fusion
+    // add_imm.i32 %t, %a, k; store.x [%t + o], %v  =>  store.x [%a + k + o], %v
+    // This only applies when computing %v did not need any instructions.
+    i32 value_reg = LAST_VALUE(builder);
+    i32 addr_reg  = builder->execution_stack[bh_arr_length(builder->execution_stack) - 2];
+    ovm_instr_t *last_instr = fusable_last_instr(builder, addr_reg);
+    if (last_instr && value_reg != addr_reg && last_instr->full_instr == OVM_TYPED_INSTR(OVMI_ADD_IMM, OVM_TYPE_I32)) {
+        POP_VALUE(builder);
+        POP_VALUE(builder);
+
+        last_instr->full_instr = OVM_TYPED_INSTR(OVMI_STORE, ovm_type);
+        last_instr->r = last_instr->a;
+        last_instr->a = value_reg;
+        last_instr->b = (i32) ((u32) last_instr->b + (u32) offset);
+        return;
+    }
+
     ovm_instr_t store_instr = {0};
     store_instr.full_instr = OVM_TYPED_INSTR(OVMI_STORE, ovm_type);
     store_instr.b = offset;
@@ -618,7 +817,7 @@ void ovm_code_builder_add_memory_fill(ovm_code_builder_t *builder) {
 // CopyNPaste from _add_load
 void ovm_code_builder_add_atomic_load(ovm_code_builder_t *builder, u32 ovm_type, i32 offset) {
     ovm_instr_t load_instr = {0};
-    load_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(OVMI_LOAD, ovm_type);
+    load_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(OVMI_ATOMIC_LOAD, ovm_type);
     load_instr.b = offset;
     load_instr.a = POP_VALUE(builder);
     load_instr.r = NEXT_VALUE(builder);
@@ -633,7 +832,7 @@ void ovm_code_builder_add_atomic_load(ovm_code_builder_t *builder, u32 ovm_type,
 // CopyNPaste from _add_store
 void ovm_code_builder_add_atomic_store(ovm_code_builder_t *builder, u32 ovm_type, i32 offset) {
     ovm_instr_t store_instr = {0};
-    store_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(OVMI_STORE, ovm_type);
+    store_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(OVMI_ATOMIC_STORE, ovm_type);
     store_instr.b = offset;
     store_instr.a = POP_VALUE(builder);
     store_instr.r = POP_VALUE(builder);
@@ -641,3 +840,217 @@ void ovm_code_builder_add_atomic_store(ovm_code_builder_t *builder, u32 ovm_type
     debug_info_builder_emit_location(builder->debug_builder);
     ovm_program_add_instructions(builder->program, 1, &store_instr);
 }
+
+//
+// Computes `address + offset` into a new register, for the atomic instructions
+// that do not have room in their encoding for an offset. `address_depth` is
+// how far down the value stack the address is.
+static i32 emit_atomic_address(ovm_code_builder_t *builder, i32 address_depth, i32 offset) {
+    ovm_instr_t instrs[2] = {0};
+    // imm.i32 %n, offset
+    instrs[0].full_instr = OVM_TYPED_INSTR(OVMI_IMM, OVM_TYPE_I32);
+    instrs[0].i = offset;
+    instrs[0].r = NEXT_VALUE(builder);
+
+    // add.i32 %n, %n, %addr
+    instrs[1].full_instr = OVM_TYPED_INSTR(OVMI_ADD, OVM_TYPE_I32);
+    instrs[1].r = instrs[0].r;
+    instrs[1].a = builder->execution_stack[bh_arr_length(builder->execution_stack) - 1 - address_depth];
+    instrs[1].b = instrs[0].r;
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 2, instrs);
+
+    return instrs[1].r;
+}
+
+void ovm_code_builder_add_atomic_rmw(ovm_code_builder_t *builder, u32 instr, u32 ovm_type, i32 offset) {
+    ovm_instr_t rmw_instr = {0};
+    rmw_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(instr, ovm_type);
+
+    if (offset != 0) {
+        rmw_instr.a = emit_atomic_address(builder, 1, offset);
+        rmw_instr.b = POP_VALUE(builder);
+        POP_VALUE(builder);
+    } else {
+        rmw_instr.b = POP_VALUE(builder);
+        rmw_instr.a = POP_VALUE(builder);
+    }
+
+    rmw_instr.r = NEXT_VALUE(builder);
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 1, &rmw_instr);
+
+    PUSH_VALUE(builder, rmw_instr.r);
+}
+
+void ovm_code_builder_add_atomic_wait(ovm_code_builder_t *builder, u32 ovm_type, i32 offset) {
+    // Like CMPXCHG, the address is read out of %r, so it is always
+    // computed into a fresh register.
+    ovm_instr_t wait_instr = {0};
+    wait_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(OVMI_ATOMIC_WAIT, ovm_type);
+    wait_instr.r = emit_atomic_address(builder, 2, offset);
+    wait_instr.b = POP_VALUE(builder);
+    wait_instr.a = POP_VALUE(builder);
+    POP_VALUE(builder);
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 1, &wait_instr);
+
+    PUSH_VALUE(builder, wait_instr.r);
+}
+
+void ovm_code_builder_add_atomic_notify(ovm_code_builder_t *builder, i32 offset) {
+    ovm_instr_t notify_instr = {0};
+    notify_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(OVMI_ATOMIC_NOTIFY, OVM_TYPE_NONE);
+
+    if (offset != 0) {
+        notify_instr.a = emit_atomic_address(builder, 1, offset);
+        notify_instr.b = POP_VALUE(builder);
+        POP_VALUE(builder);
+    } else {
+        notify_instr.b = POP_VALUE(builder);
+        notify_instr.a = POP_VALUE(builder);
+    }
+
+    notify_instr.r = NEXT_VALUE(builder);
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 1, &notify_instr);
+
+    PUSH_VALUE(builder, notify_instr.r);
+}
+
+void ovm_code_builder_add_atomic_fence(ovm_code_builder_t *builder) {
+    ovm_instr_t fence_instr = {0};
+    fence_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(OVMI_ATOMIC_FENCE, OVM_TYPE_NONE);
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 1, &fence_instr);
+}
+
+//
+// Vector instructions
+//
+
+void ovm_code_builder_add_vector_const(ovm_code_builder_t *builder, u8 *bytes) {
+    i32 data[4];
+    memcpy(data, bytes, 16);
+
+    ovm_instr_t instr = {0};
+    instr.full_instr = OVM_TYPED_INSTR(OVMI_VCONST, OVM_TYPE_NONE);
+    instr.a = ovm_program_register_static_ints(builder->program, 4, data);
+    instr.r = NEXT_VALUE(builder);
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 1, &instr);
+
+    PUSH_VALUE(builder, instr.r);
+}
+
+void ovm_code_builder_add_extract_lane(ovm_code_builder_t *builder, u32 instr, i32 lane) {
+    ovm_instr_t extract = {0};
+    extract.full_instr = instr;
+    extract.a = POP_VALUE(builder);
+    extract.b = lane;
+    extract.r = NEXT_VALUE(builder);
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 1, &extract);
+
+    PUSH_VALUE(builder, extract.r);
+}
+
+void ovm_code_builder_add_replace_lane(ovm_code_builder_t *builder, u32 instr, i32 lane) {
+    ovm_code_builder_add_binop(builder, instr | OVM_LANE(lane));
+}
+
+//
+// OVM instructions never read their result value number, because local.set can
+// retarget the result of the previous instruction. So bitselect is done as
+// (a & c) | (b & ~c), with the operands kept on the stack until the end so the
+// temporaries do not overwrite them.
+void ovm_code_builder_add_bitselect(ovm_code_builder_t *builder) {
+    i32 mask = LAST_VALUE(builder);
+    i32 b    = builder->execution_stack[bh_arr_length(builder->execution_stack) - 2];
+    i32 a    = builder->execution_stack[bh_arr_length(builder->execution_stack) - 3];
+
+    ovm_instr_t instrs[3] = {0};
+    instrs[0].full_instr = OVM_TYPED_INSTR(OVMI_VAND, OVM_TYPE_NONE);
+    instrs[0].r = NEXT_VALUE(builder);
+    instrs[0].a = a;
+    instrs[0].b = mask;
+    PUSH_VALUE(builder, instrs[0].r);
+
+    instrs[1].full_instr = OVM_TYPED_INSTR(OVMI_VANDNOT, OVM_TYPE_NONE);
+    instrs[1].r = NEXT_VALUE(builder);
+    instrs[1].a = b;
+    instrs[1].b = mask;
+    PUSH_VALUE(builder, instrs[1].r);
+
+    fori (i, 0, 5) POP_VALUE(builder);
+
+    instrs[2].full_instr = OVM_TYPED_INSTR(OVMI_VOR, OVM_TYPE_NONE);
+    instrs[2].r = NEXT_VALUE(builder);
+    instrs[2].a = instrs[0].r;
+    instrs[2].b = instrs[1].r;
+
+    fori (i, 0, 3) debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 3, instrs);
+
+    PUSH_VALUE(builder, instrs[2].r);
+}
+
+//
+// A shuffle is two swizzles, one for the lanes taken from each input, with
+// the lanes taken from the other input set to 0x80 so they become zero.
+void ovm_code_builder_add_shuffle(ovm_code_builder_t *builder, u8 *lanes) {
+    u8 first_lanes[16], second_lanes[16];
+    fori (i, 0, 16) {
+        first_lanes[i]  = lanes[i] < 16 ? lanes[i] : 0x80;
+        second_lanes[i] = lanes[i] < 16 ? 0x80 : lanes[i] - 16;
+    }
+
+    i32 b = LAST_VALUE(builder);
+    i32 a = builder->execution_stack[bh_arr_length(builder->execution_stack) - 2];
+
+    ovm_code_builder_add_vector_const(builder, first_lanes);
+    i32 first_mask = LAST_VALUE(builder);
+
+    ovm_instr_t swizzle = {0};
+    swizzle.full_instr = OVM_TYPED_INSTR(OVMI_VSWIZZLE, OVM_TYPE_NONE);
+    swizzle.r = NEXT_VALUE(builder);
+    swizzle.a = a;
+    swizzle.b = first_mask;
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 1, &swizzle);
+    POP_VALUE(builder);
+    PUSH_VALUE(builder, swizzle.r);
+    i32 first = swizzle.r;
+
+    ovm_code_builder_add_vector_const(builder, second_lanes);
+    i32 second_mask = LAST_VALUE(builder);
+
+    swizzle.r = NEXT_VALUE(builder);
+    swizzle.a = b;
+    swizzle.b = second_mask;
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 1, &swizzle);
+    POP_VALUE(builder);
+    PUSH_VALUE(builder, swizzle.r);
+
+    fori (i, 0, 4) POP_VALUE(builder);
+
+    ovm_instr_t or_instr = {0};
+    or_instr.full_instr = OVM_TYPED_INSTR(OVMI_VOR, OVM_TYPE_NONE);
+    or_instr.r = NEXT_VALUE(builder);
+    or_instr.a = first;
+    or_instr.b = swizzle.r;
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 1, &or_instr);
+
+    PUSH_VALUE(builder, or_instr.r);
+}
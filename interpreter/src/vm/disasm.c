@@ -25,6 +25,13 @@ enum instr_format_kind_t {
 
     instr_format_call,
     instr_format_calli,
+
+    instr_format_vconst,
+    instr_format_extract,
+    instr_format_replace,
+
+    instr_format_rai,
+    instr_format_br_cmp,
 };
 
 typedef struct instr_format_t {
@@ -127,21 +134,108 @@ static instr_format_t instr_formats[] = {
     { "break", instr_format_none },
 
     { "memory_size", instr_format_none },
-    { "memory_grow", instr_format_ra }
+    { "memory_grow", instr_format_ra },
+
+    { "const", instr_format_vconst },
+    { "splat", instr_format_ra },
+    { "extract_lane", instr_format_extract },
+    { "extract_lane_s", instr_format_extract },
+    { "replace_lane", instr_format_replace },
+    { "swizzle", instr_format_rab },
+    { "not", instr_format_ra },
+    { "and", instr_format_rab },
+    { "andnot", instr_format_rab },
+    { "or", instr_format_rab },
+    { "xor", instr_format_rab },
+    { "any_true", instr_format_ra },
+    { "all_true", instr_format_ra },
+    { "bitmask", instr_format_ra },
+    { "eq", instr_format_rab },
+    { "ne", instr_format_rab },
+    { "lt", instr_format_rab },
+    { "lt_s", instr_format_rab },
+    { "le", instr_format_rab },
+    { "le_s", instr_format_rab },
+    { "gt", instr_format_rab },
+    { "gt_s", instr_format_rab },
+    { "ge", instr_format_rab },
+    { "ge_s", instr_format_rab },
+    { "abs", instr_format_ra },
+    { "neg", instr_format_ra },
+    { "sqrt", instr_format_ra },
+    { "add", instr_format_rab },
+    { "add_sat", instr_format_rab },
+    { "add_sat_s", instr_format_rab },
+    { "sub", instr_format_rab },
+    { "sub_sat", instr_format_rab },
+    { "sub_sat_s", instr_format_rab },
+    { "mul", instr_format_rab },
+    { "div", instr_format_rab },
+    { "min", instr_format_rab },
+    { "min_s", instr_format_rab },
+    { "max", instr_format_rab },
+    { "max_s", instr_format_rab },
+    { "avgr", instr_format_rab },
+    { "shl", instr_format_rab },
+    { "shr", instr_format_rab },
+    { "sar", instr_format_rab },
+    { "narrow", instr_format_rab },
+    { "narrow_s", instr_format_rab },
+    { "widen_low", instr_format_ra },
+    { "widen_low_s", instr_format_ra },
+    { "widen_high", instr_format_ra },
+    { "widen_high_s", instr_format_ra },
+    { "trunc_sat", instr_format_ra },
+    { "trunc_sat_s", instr_format_ra },
+    { "convert", instr_format_ra },
+    { "convert_s", instr_format_ra },
+
+    { "atomic_load", instr_format_load },
+    { "atomic_store", instr_format_store },
+    { "atomic_add", instr_format_rab },
+    { "atomic_sub", instr_format_rab },
+    { "atomic_and", instr_format_rab },
+    { "atomic_or", instr_format_rab },
+    { "atomic_xor", instr_format_rab },
+    { "atomic_xchg", instr_format_rab },
+    { "atomic_wait", instr_format_rab },
+    { "atomic_notify", instr_format_rab },
+    { "atomic_fence", instr_format_none },
+
+    { "add_imm", instr_format_rai },
+    { "br_lt", instr_format_br_cmp },
+    { "br_lt_s", instr_format_br_cmp },
+    { "br_le", instr_format_br_cmp },
+    { "br_le_s", instr_format_br_cmp },
+    { "br_eq", instr_format_br_cmp },
+    { "br_ge", instr_format_br_cmp },
+    { "br_ge_s", instr_format_br_cmp },
+    { "br_gt", instr_format_br_cmp },
+    { "br_gt_s", instr_format_br_cmp },
+    { "br_ne", instr_format_br_cmp },
+
+    { "translate", instr_format_call },
 };
 
+static char *vector_shapes[] = { "v128.", "i8x16.", "i16x8.", "i32x4.", "i64x2.", "f32x4.", "f64x2.", "v128." };
+
 void ovm_disassemble(ovm_program_t *program, u32 instr_addr, bh_buffer *instr_text) {
     static char buf[256];
 
     ovm_instr_t *instr = &program->code[instr_addr];
-    switch (OVM_INSTR_TYPE(*instr)) {
-        case OVM_TYPE_I8: bh_buffer_write_string(instr_text, "i8."); break;
-        case OVM_TYPE_I16: bh_buffer_write_string(instr_text, "i16."); break;
-        case OVM_TYPE_I32: bh_buffer_write_string(instr_text, "i32."); break;
-        case OVM_TYPE_I64: bh_buffer_write_string(instr_text, "i64."); break;
-        case OVM_TYPE_F32: bh_buffer_write_string(instr_text, "f32."); break;
-        case OVM_TYPE_F64: bh_buffer_write_string(instr_text, "f64."); break;
-        case OVM_TYPE_V128: bh_buffer_write_string(instr_text, "v128."); break;
+    if (OVM_INSTR_INSTR(*instr) >= OVMI_VCONST && OVM_INSTR_INSTR(*instr) <= OVMI_VCONVERT_S) {
+        bh_buffer_write_string(instr_text, vector_shapes[OVM_INSTR_TYPE(*instr)]);
+
+    } else {
+        switch (OVM_INSTR_TYPE(*instr)) {
+            case OVM_TYPE_I8: bh_buffer_write_string(instr_text, "i8."); break;
+            case OVM_TYPE_I16: bh_buffer_write_string(instr_text, "i16."); break;
+            case OVM_TYPE_I32: bh_buffer_write_string(instr_text, "i32."); break;
+            case OVM_TYPE_I64: bh_buffer_write_string(instr_text, "i64."); break;
+            case OVM_TYPE_F32: bh_buffer_write_string(instr_text, "f32."); break;
+            case OVM_TYPE_F64: bh_buffer_write_string(instr_text, "f64."); break;
+            case OVM_TYPE_V128: bh_buffer_write_string(instr_text, "v128."); break;
+        }
     }
 
     instr_format_t *format = &instr_formats[OVM_INSTR_INSTR(*instr)];
@@ -191,6 +285,13 @@ void ovm_disassemble(ovm_program_t *program, u32 instr_addr, bh_buffer *instr_te
             }
             break;
 
+        case instr_format_vconst:  formatted = snprintf(buf, 255, "%%%d, __global_arr_%d", instr->r, instr->a); break;
+        case instr_format_extract: formatted = snprintf(buf, 255, "%%%d, %%%d[%d]", instr->r, instr->a, instr->b); break;
+        case instr_format_replace: formatted = snprintf(buf, 255, "%%%d, %%%d[%d] = %%%d", instr->r, instr->a, OVM_INSTR_LANE(*instr), instr->b); break;
+
+        case instr_format_rai:    formatted = snprintf(buf, 255, "%%%d, %%%d, %d", instr->r, instr->a, instr->b); break;
+        case instr_format_br_cmp: formatted = snprintf(buf, 255, "%d, %%%d, %%%d", instr_addr + instr->r + 1, instr->a, instr->b); break;
+
         default: break;
     }
 
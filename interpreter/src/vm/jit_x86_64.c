@@ -0,0 +1,707 @@
+//
+// Baseline x86-64 JIT
+//
+// Each instruction is compiled with a fixed template that works directly on
+// the frame's value numbers, so there is no register allocation and the
+// interpreter can hand over to native code at any instruction. See the
+// comment above OVM_JIT_CALL_THRESHOLD in vm.h.
+//
+// While native code runs, these registers are fixed:
+//
+//     rbx   values (the frame's value numbers)
+//     r12   memory
+//     r13   state
+//
+// rax, rcx, rdx and xmm0 are scratch. An exit stores the pc of the next
+// instruction to interpret in eax, and jumps to the epilogue.
+//
+
+#include "vm.h"
+
+#if defined(__x86_64__)
+
+#include <sys/mman.h>
+#include <stddef.h>
+
+//
+// A function is only worth compiling if most of it has templates. Otherwise,
+// the time spent going in and out of native code costs more than it saves.
+#define JIT_MIN_SUPPORTED_PERCENT 50
+#define JIT_MAX_INSTR_COUNT       (1 << 20)
+
+#define RAX 0
+#define RCX 1
+#define RDX 2
+
+typedef struct jit_patch_t {
+    i32 offset;         // Offset of a rel32 in the code.
+    i32 target_instr;   // Instruction the branch goes to.
+} jit_patch_t;
+
+typedef struct jit_builder_t {
+    bh_buffer code;
+    bh_arr(jit_patch_t) patches;
+
+    i32 start_instr;
+    i32 instr_count;
+    u32 *instr_offsets;
+
+    i32 epilogue_offset;
+} jit_builder_t;
+
+static inline void emit_byte(jit_builder_t *b, u8 byte) {
+    bh_buffer_write_byte(&b->code, byte);
+}
+
+static inline void emit_u32(jit_builder_t *b, u32 value) {
+    bh_buffer_write_u32(&b->code, value);
+}
+
+static inline void emit_u64(jit_builder_t *b, u64 value) {
+    bh_buffer_write_u64(&b->code, value);
+}
+
+static void emit_bytes(jit_builder_t *b, int count, const u8 *bytes) {
+    fori (i, 0, count) emit_byte(b, bytes[i]);
+}
+
+//
+// Emits `op reg, [base + disp32]`. base is rbx, r13 or rax.
+static void emit_modrm_disp32(jit_builder_t *b, u8 prefix, bool wide, bool base_ext, u8 base, int oplen, const u8 *op, int reg, i32 disp) {
+    if (prefix) emit_byte(b, prefix);
+
+    u8 rex = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | (base_ext ? 1 : 0);
+    if (rex != 0x40) emit_byte(b, rex);
+
+    emit_bytes(b, oplen, op);
+    emit_byte(b, 0x80 | ((reg & 7) << 3) | (base & 7));
+    emit_u32(b, (u32) disp);
+}
+
+#define VALUE_DISP(v)  ((i32) (v) * (i32) sizeof(ovm_value_t))
+#define TYPE_DISP(v)   (VALUE_DISP(v) + (i32) offsetof(ovm_value_t, type))
+
+// op reg, [rbx + 16 * v]
+static inline void emit_value_op(jit_builder_t *b, u8 prefix, bool wide, int oplen, const u8 *op, int reg, i32 v) {
+    emit_modrm_disp32(b, prefix, wide, false, 3, oplen, op, reg, VALUE_DISP(v));
+}
+
+// op reg, [r12 + rax]
+static void emit_memory_op(jit_builder_t *b, u8 prefix, bool wide, int oplen, const u8 *op, int reg) {
+    if (prefix) emit_byte(b, prefix);
+    emit_byte(b, 0x41 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0));
+    emit_bytes(b, oplen, op);
+    emit_byte(b, 0x04 | ((reg & 7) << 3));
+    emit_byte(b, 0x04);
+}
+
+static inline void emit_load32(jit_builder_t *b, int reg, i32 v)  { emit_value_op(b, 0, false, 1, (u8[]) { 0x8B }, reg, v); }
+static inline void emit_load64(jit_builder_t *b, int reg, i32 v)  { emit_value_op(b, 0, true,  1, (u8[]) { 0x8B }, reg, v); }
+static inline void emit_store8(jit_builder_t *b, int reg, i32 v)  { emit_value_op(b, 0, false, 1, (u8[]) { 0x88 }, reg, v); }
+static inline void emit_store16(jit_builder_t *b, int reg, i32 v) { emit_value_op(b, 0x66, false, 1, (u8[]) { 0x89 }, reg, v); }
+static inline void emit_store32(jit_builder_t *b, int reg, i32 v) { emit_value_op(b, 0, false, 1, (u8[]) { 0x89 }, reg, v); }
+static inline void emit_store64(jit_builder_t *b, int reg, i32 v) { emit_value_op(b, 0, true,  1, (u8[]) { 0x89 }, reg, v); }
+
+static void emit_set_type(jit_builder_t *b, i32 v, u8 type) {
+    // mov byte [rbx + disp], type
+    emit_modrm_disp32(b, 0, false, false, 3, 1, (u8[]) { 0xC6 }, 0, TYPE_DISP(v));
+    emit_byte(b, type);
+}
+
+// add eax, imm32
+static void emit_add_eax_imm(jit_builder_t *b, bool wide, i32 imm) {
+    if (!wide && imm == 0) return;
+    if (wide) emit_byte(b, 0x48);
+    emit_byte(b, 0x05);
+    emit_u32(b, (u32) imm);
+}
+
+// movzx eax, al
+static inline void emit_movzx_eax_al(jit_builder_t *b) {
+    emit_bytes(b, 3, (u8[]) { 0x0F, 0xB6, 0xC0 });
+}
+
+static void emit_exit(jit_builder_t *b, i32 pc) {
+    // mov eax, pc
+    emit_byte(b, 0xB8);
+    emit_u32(b, (u32) pc);
+
+    // jmp epilogue
+    emit_byte(b, 0xE9);
+    emit_u32(b, (u32) (b->epilogue_offset - (b->code.length + 4)));
+}
+
+static void emit_branch_to(jit_builder_t *b, i32 target_instr) {
+    jit_patch_t patch;
+    patch.offset = b->code.length;
+    patch.target_instr = target_instr;
+    bh_arr_push(b->patches, patch);
+
+    emit_u32(b, 0);
+}
+
+// jmp target
+static void emit_jmp(jit_builder_t *b, i32 target_instr) {
+    emit_byte(b, 0xE9);
+    emit_branch_to(b, target_instr);
+}
+
+// jcc target, where cc is the second byte of the rel32 form (0x80 - 0x8F).
+static void emit_jcc(jit_builder_t *b, u8 cc, i32 target_instr) {
+    emit_byte(b, 0x0F);
+    emit_byte(b, cc);
+    emit_branch_to(b, target_instr);
+}
+
+//
+// Condition codes for the compares, in the order of OVMI_LT .. OVMI_NE,
+// which is the same as OVMI_BR_LT .. OVMI_BR_NE. These are the jcc forms;
+// setcc is 0x10 more.
+static const u8 integer_conditions[] = {
+    0x82, // lt    jb
+    0x8C, // lt_s  jl
+    0x86, // le    jbe
+    0x8E, // le_s  jle
+    0x84, // eq    je
+    0x83, // ge    jae
+    0x8D, // ge_s  jge
+    0x87, // gt    ja
+    0x8F, // gt_s  jg
+    0x85, // ne    jne
+};
+
+static void emit_integer_compare(jit_builder_t *b, bool wide, i32 a, i32 v) {
+    // mov eax, %a
+    // cmp eax, %b
+    emit_value_op(b, 0, wide, 1, (u8[]) { 0x8B }, RAX, a);
+    emit_value_op(b, 0, wide, 1, (u8[]) { 0x3B }, RAX, v);
+}
+
+static void emit_float_compare(jit_builder_t *b, bool is_f64, int compare, i32 a, i32 v) {
+    //
+    // ucomiss sets the flags like an unsigned compare, and sets the parity
+    // flag when either side is NaN. Less than is done as greater than with
+    // the sides swapped, so NaN makes every ordered compare false.
+    i32 x = a, y = v;
+    if (compare == OVMI_LT || compare == OVMI_LT_S || compare == OVMI_LE || compare == OVMI_LE_S) {
+        x = v;
+        y = a;
+    }
+
+    // movss xmm0, %x
+    // ucomiss xmm0, %y
+    emit_value_op(b, is_f64 ? 0xF2 : 0xF3, false, 2, (u8[]) { 0x0F, 0x10 }, 0, x);
+    emit_value_op(b, is_f64 ? 0x66 : 0, false, 2, (u8[]) { 0x0F, 0x2E }, 0, y);
+
+    switch (compare) {
+        case OVMI_EQ:
+            emit_bytes(b, 3, (u8[]) { 0x0F, 0x94, 0xC0 }); // sete al
+            emit_bytes(b, 3, (u8[]) { 0x0F, 0x9B, 0xC1 }); // setnp cl
+            emit_bytes(b, 2, (u8[]) { 0x20, 0xC8 });       // and al, cl
+            break;
+
+        case OVMI_NE:
+            emit_bytes(b, 3, (u8[]) { 0x0F, 0x95, 0xC0 }); // setne al
+            emit_bytes(b, 3, (u8[]) { 0x0F, 0x9A, 0xC1 }); // setp cl
+            emit_bytes(b, 2, (u8[]) { 0x08, 0xC8 });       // or al, cl
+            break;
+
+        case OVMI_LT: case OVMI_LT_S:
+        case OVMI_GT: case OVMI_GT_S:
+            emit_bytes(b, 3, (u8[]) { 0x0F, 0x97, 0xC0 }); // seta al
+            break;
+
+        default:
+            emit_bytes(b, 3, (u8[]) { 0x0F, 0x93, 0xC0 }); // setae al
+            break;
+    }
+}
+
+static bool emit_binary_op(jit_builder_t *b, ovm_instr_t *instr, i32 instr_kind, i32 type) {
+    bool wide = type == OVM_TYPE_I64;
+
+    if (type == OVM_TYPE_F32 || type == OVM_TYPE_F64) {
+        u8 op;
+        switch (instr_kind) {
+            case OVMI_ADD: op = 0x58; break;
+            case OVMI_SUB: op = 0x5C; break;
+            case OVMI_MUL: op = 0x59; break;
+            case OVMI_DIV: op = 0x5E; break;
+            default: return false;
+        }
+
+        u8 prefix = type == OVM_TYPE_F64 ? 0xF2 : 0xF3;
+        emit_value_op(b, prefix, false, 2, (u8[]) { 0x0F, 0x10 }, 0, instr->a);
+        emit_value_op(b, prefix, false, 2, (u8[]) { 0x0F, op }, 0, instr->b);
+        emit_value_op(b, prefix, false, 2, (u8[]) { 0x0F, 0x11 }, 0, instr->r);
+        emit_set_type(b, instr->r, type);
+        return true;
+    }
+
+    if (type != OVM_TYPE_I32 && type != OVM_TYPE_I64) return false;
+
+    switch (instr_kind) {
+        case OVMI_ADD: case OVMI_SUB: case OVMI_MUL:
+        case OVMI_AND: case OVMI_OR:  case OVMI_XOR: {
+            u8 op[2];
+            int oplen = 1;
+            switch (instr_kind) {
+                case OVMI_ADD: op[0] = 0x03; break;
+                case OVMI_SUB: op[0] = 0x2B; break;
+                case OVMI_AND: op[0] = 0x23; break;
+                case OVMI_OR:  op[0] = 0x0B; break;
+                case OVMI_XOR: op[0] = 0x33; break;
+                case OVMI_MUL: op[0] = 0x0F; op[1] = 0xAF; oplen = 2; break;
+            }
+
+            emit_value_op(b, 0, wide, 1, (u8[]) { 0x8B }, RAX, instr->a);
+            emit_value_op(b, 0, wide, oplen, op, RAX, instr->b);
+            break;
+        }
+
+        case OVMI_SHL: case OVMI_SHR: case OVMI_SAR: {
+            // x86 masks the shift count to the width of the operand, the
+            // same as the C shift the interpreter compiles to.
+            u8 modrm;
+            switch (instr_kind) {
+                case OVMI_SHL: modrm = 0xE0; break;
+                case OVMI_SHR: modrm = 0xE8; break;
+                case OVMI_SAR: modrm = 0xF8; break;
+            }
+
+            emit_value_op(b, 0, wide, 1, (u8[]) { 0x8B }, RAX, instr->a);
+            emit_load32(b, RCX, instr->b);
+            if (wide) emit_byte(b, 0x48);
+            emit_byte(b, 0xD3);
+            emit_byte(b, modrm);
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    if (wide) emit_store64(b, RAX, instr->r);
+    else      emit_store32(b, RAX, instr->r);
+    emit_set_type(b, instr->r, type);
+    return true;
+}
+
+static bool emit_load(jit_builder_t *b, ovm_instr_t *instr, i32 type) {
+    emit_load32(b, RAX, instr->a);
+    emit_add_eax_imm(b, false, instr->b);
+
+    switch (type) {
+        case OVM_TYPE_I8:
+            emit_memory_op(b, 0, false, 2, (u8[]) { 0x0F, 0xB6 }, RCX);
+            emit_store8(b, RCX, instr->r);
+            break;
+
+        case OVM_TYPE_I16:
+            emit_memory_op(b, 0, false, 2, (u8[]) { 0x0F, 0xB7 }, RCX);
+            emit_store16(b, RCX, instr->r);
+            break;
+
+        case OVM_TYPE_I32:
+        case OVM_TYPE_F32:
+            emit_memory_op(b, 0, false, 1, (u8[]) { 0x8B }, RCX);
+            emit_store32(b, RCX, instr->r);
+            break;
+
+        case OVM_TYPE_I64:
+        case OVM_TYPE_F64:
+            emit_memory_op(b, 0, true, 1, (u8[]) { 0x8B }, RCX);
+            emit_store64(b, RCX, instr->r);
+            break;
+    }
+
+    emit_set_type(b, instr->r, type);
+    return true;
+}
+
+static bool emit_store(jit_builder_t *b, ovm_instr_t *instr, i32 type) {
+    emit_load32(b, RAX, instr->r);
+    emit_add_eax_imm(b, false, instr->b);
+
+    switch (type) {
+        case OVM_TYPE_I8:
+            emit_load32(b, RCX, instr->a);
+            emit_memory_op(b, 0, false, 1, (u8[]) { 0x88 }, RCX);
+            break;
+
+        case OVM_TYPE_I16:
+            emit_load32(b, RCX, instr->a);
+            emit_memory_op(b, 0x66, false, 1, (u8[]) { 0x89 }, RCX);
+            break;
+
+        case OVM_TYPE_I32:
+        case OVM_TYPE_F32:
+            emit_load32(b, RCX, instr->a);
+            emit_memory_op(b, 0, false, 1, (u8[]) { 0x89 }, RCX);
+            break;
+
+        case OVM_TYPE_I64:
+        case OVM_TYPE_F64:
+            emit_load64(b, RCX, instr->a);
+            emit_memory_op(b, 0, true, 1, (u8[]) { 0x89 }, RCX);
+            break;
+    }
+
+    return true;
+}
+
+//
+// Emits the template for one instruction. Returns false, having emitted
+// nothing, when the instruction has no template.
+static bool emit_instr(jit_builder_t *b, i32 pc, ovm_instr_t *instr) {
+    // Flags above the opcode and type, such as OVMI_ATOMIC, are left to the interpreter.
+    if (instr->full_instr & ~OVM_INSTR_MASK) return false;
+
+    i32 instr_kind = OVM_INSTR_INSTR(*instr);
+    i32 type = OVM_INSTR_TYPE(*instr);
+
+    switch (instr_kind) {
+        case OVMI_NOP:
+            return true;
+
+        case OVMI_ADD: case OVMI_SUB: case OVMI_MUL:
+        case OVMI_AND: case OVMI_OR:  case OVMI_XOR:
+        case OVMI_SHL: case OVMI_SHR: case OVMI_SAR:
+            return emit_binary_op(b, instr, instr_kind, type);
+
+        case OVMI_DIV:
+            // Integer division can trap, so only float division is compiled.
+            if (type != OVM_TYPE_F32 && type != OVM_TYPE_F64) return false;
+            return emit_binary_op(b, instr, instr_kind, type);
+
+        case OVMI_LT: case OVMI_LT_S: case OVMI_LE: case OVMI_LE_S: case OVMI_EQ:
+        case OVMI_GE: case OVMI_GE_S: case OVMI_GT: case OVMI_GT_S: case OVMI_NE: {
+            if (type == OVM_TYPE_I32 || type == OVM_TYPE_I64) {
+                emit_integer_compare(b, type == OVM_TYPE_I64, instr->a, instr->b);
+
+                // setcc al
+                emit_bytes(b, 3, (u8[]) { 0x0F, integer_conditions[instr_kind - OVMI_LT] + 0x10, 0xC0 });
+
+            } else if (type == OVM_TYPE_F32 || type == OVM_TYPE_F64) {
+                emit_float_compare(b, type == OVM_TYPE_F64, instr_kind, instr->a, instr->b);
+
+            } else {
+                return false;
+            }
+
+            emit_movzx_eax_al(b);
+            emit_store32(b, RAX, instr->r);
+            emit_set_type(b, instr->r, OVM_TYPE_I32);
+            return true;
+        }
+
+        case OVMI_IMM:
+            switch (type) {
+                case OVM_TYPE_I32:
+                case OVM_TYPE_F32:
+                    // mov eax, imm32 clears the top of rax, which matches the
+                    // interpreter clearing the whole value first.
+                    emit_byte(b, 0xB8);
+                    emit_u32(b, (u32) instr->i);
+                    break;
+
+                case OVM_TYPE_I64:
+                case OVM_TYPE_F64:
+                    // mov rax, imm64
+                    emit_byte(b, 0x48);
+                    emit_byte(b, 0xB8);
+                    emit_u64(b, (u64) instr->l);
+                    break;
+
+                default:
+                    return false;
+            }
+
+            emit_store64(b, RAX, instr->r);
+            emit_set_type(b, instr->r, type);
+            return true;
+
+        case OVMI_ADD_IMM:
+            if (type != OVM_TYPE_I32 && type != OVM_TYPE_I64) return false;
+
+            emit_value_op(b, 0, type == OVM_TYPE_I64, 1, (u8[]) { 0x8B }, RAX, instr->a);
+            emit_add_eax_imm(b, type == OVM_TYPE_I64, instr->b);
+            if (type == OVM_TYPE_I64) emit_store64(b, RAX, instr->r);
+            else                      emit_store32(b, RAX, instr->r);
+            emit_set_type(b, instr->r, type);
+            return true;
+
+        case OVMI_MOV:
+            // movups xmm0, %a
+            // movups %r, xmm0
+            emit_value_op(b, 0, false, 2, (u8[]) { 0x0F, 0x10 }, 0, instr->a);
+            emit_value_op(b, 0, false, 2, (u8[]) { 0x0F, 0x11 }, 0, instr->r);
+            return true;
+
+        case OVMI_LOAD:
+            if (type == OVM_TYPE_NONE || type == OVM_TYPE_V128) return false;
+            return emit_load(b, instr, type);
+
+        case OVMI_STORE:
+            if (type == OVM_TYPE_NONE || type == OVM_TYPE_V128) return false;
+            return emit_store(b, instr, type);
+
+        case OVMI_REG_GET:
+        case OVMI_REG_SET: {
+            // mov rax, [r13 + registers]
+            emit_modrm_disp32(b, 0, true, true, 5, 1, (u8[]) { 0x8B }, RAX, offsetof(ovm_state_t, registers));
+
+            if (instr_kind == OVMI_REG_GET) {
+                emit_modrm_disp32(b, 0, false, false, RAX, 2, (u8[]) { 0x0F, 0x10 }, 0, VALUE_DISP(instr->a));
+                emit_value_op(b, 0, false, 2, (u8[]) { 0x0F, 0x11 }, 0, instr->r);
+            } else {
+                emit_value_op(b, 0, false, 2, (u8[]) { 0x0F, 0x10 }, 0, instr->a);
+                emit_modrm_disp32(b, 0, false, false, RAX, 2, (u8[]) { 0x0F, 0x11 }, 0, VALUE_DISP(instr->r));
+            }
+            return true;
+        }
+
+        case OVMI_BR:
+            emit_jmp(b, pc + 1 + instr->a);
+            return true;
+
+        case OVMI_BR_Z:
+        case OVMI_BR_NZ:
+            // test eax, eax
+            emit_load32(b, RAX, instr->b);
+            emit_bytes(b, 2, (u8[]) { 0x85, 0xC0 });
+            emit_jcc(b, instr_kind == OVMI_BR_Z ? 0x84 : 0x85, pc + 1 + instr->a);
+            return true;
+
+        case OVMI_BR_LT: case OVMI_BR_LT_S: case OVMI_BR_LE: case OVMI_BR_LE_S: case OVMI_BR_EQ:
+        case OVMI_BR_GE: case OVMI_BR_GE_S: case OVMI_BR_GT: case OVMI_BR_GT_S: case OVMI_BR_NE:
+            if (type != OVM_TYPE_I32 && type != OVM_TYPE_I64) return false;
+
+            emit_integer_compare(b, type == OVM_TYPE_I64, instr->a, instr->b);
+            emit_jcc(b, integer_conditions[instr_kind - OVMI_BR_LT], pc + 1 + instr->r);
+            return true;
+
+        case OVMI_CVT_I32:
+        case OVMI_CVT_I32_S:
+            if (type != OVM_TYPE_I64) return false;
+
+            if (instr_kind == OVMI_CVT_I32) {
+                emit_load32(b, RAX, instr->a);
+            } else {
+                // movsxd rax, %a
+                emit_value_op(b, 0, true, 1, (u8[]) { 0x63 }, RAX, instr->a);
+            }
+
+            emit_store64(b, RAX, instr->r);
+            emit_set_type(b, instr->r, OVM_TYPE_I64);
+            return true;
+
+        case OVMI_CVT_I64:
+        case OVMI_CVT_I64_S:
+            if (type != OVM_TYPE_I32) return false;
+
+            emit_load32(b, RAX, instr->a);
+            emit_store32(b, RAX, instr->r);
+            emit_set_type(b, instr->r, OVM_TYPE_I32);
+            return true;
+    }
+
+    return false;
+}
+
+//
+// Finds the last instruction of the function, by following every path
+// from the start to a return. Returns -1 if a path leaves the code.
+static i32 jit_find_function_end(ovm_program_t *program, i32 start_instr) {
+    bh_allocator alloc = bh_heap_allocator();
+    i32 code_length = bh_arr_length(program->code);
+
+    bh_arr(i32) worklist = NULL;
+    bh_arr(u8) visited = NULL;
+    bh_arr_new(alloc, worklist, 16);
+    bh_arr_new(alloc, visited, 256);
+
+    i32 end_instr = start_instr;
+    bh_arr_push(worklist, start_instr);
+
+    while (bh_arr_length(worklist) > 0) {
+        i32 pc = bh_arr_pop(worklist);
+
+        while (1) {
+            if (pc < start_instr || pc >= code_length || pc - start_instr >= JIT_MAX_INSTR_COUNT) {
+                end_instr = -1;
+                goto done;
+            }
+
+            i32 idx = pc - start_instr;
+            while (bh_arr_length(visited) <= idx) bh_arr_push(visited, 0);
+            if (visited[idx]) break;
+
+            visited[idx] = 1;
+            if (pc > end_instr) end_instr = pc;
+
+            ovm_instr_t *instr = &program->code[pc];
+            i32 instr_kind = OVM_INSTR_INSTR(*instr);
+
+            if (instr_kind == OVMI_RETURN || instr_kind == OVMI_BRI) break;
+
+            if (instr_kind == OVMI_BR) {
+                pc += 1 + instr->a;
+                continue;
+            }
+
+            if (instr_kind == OVMI_BR_Z || instr_kind == OVMI_BR_NZ) {
+                bh_arr_push(worklist, pc + 1 + instr->a);
+            }
+
+            if (instr_kind >= OVMI_BR_LT && instr_kind <= OVMI_BR_NE) {
+                bh_arr_push(worklist, pc + 1 + instr->r);
+            }
+
+            pc += 1;
+        }
+    }
+
+  done:
+    bh_arr_free(worklist);
+    bh_arr_free(visited);
+    return end_instr;
+}
+
+static ovm_jit_func_t *jit_build(ovm_program_t *program, i32 start_instr, i32 end_instr) {
+    bh_allocator alloc = bh_heap_allocator();
+
+    jit_builder_t b;
+    b.start_instr = start_instr;
+    b.instr_count = end_instr - start_instr + 1;
+    b.instr_offsets = bh_alloc_array(alloc, u32, b.instr_count);
+    b.patches = NULL;
+    bh_arr_new(alloc, b.patches, 64);
+    bh_buffer_init(&b.code, alloc, b.instr_count * 16);
+
+    //
+    // Entry trampoline, matching ovm_jit_entry_t.
+    emit_byte(&b, 0x53);                                   // push rbx
+    emit_bytes(&b, 2, (u8[]) { 0x41, 0x54 });              // push r12
+    emit_bytes(&b, 2, (u8[]) { 0x41, 0x55 });              // push r13
+    emit_bytes(&b, 3, (u8[]) { 0x48, 0x89, 0xFB });        // mov rbx, rdi
+    emit_bytes(&b, 3, (u8[]) { 0x49, 0x89, 0xF4 });        // mov r12, rsi
+    emit_bytes(&b, 3, (u8[]) { 0x49, 0x89, 0xD5 });        // mov r13, rdx
+    emit_bytes(&b, 2, (u8[]) { 0xFF, 0xE1 });              // jmp rcx
+
+    //
+    // Epilogue, which every exit jumps to.
+    b.epilogue_offset = b.code.length;
+    emit_modrm_disp32(&b, 0, false, true, 5, 1, (u8[]) { 0x89 }, RAX, offsetof(ovm_state_t, pc)); // mov [r13 + pc], eax
+    emit_bytes(&b, 2, (u8[]) { 0x41, 0x5D });              // pop r13
+    emit_bytes(&b, 2, (u8[]) { 0x41, 0x5C });              // pop r12
+    emit_byte(&b, 0x5B);                                   // pop rbx
+    emit_byte(&b, 0xC3);                                   // ret
+
+    i32 supported = 0;
+    fori (i, 0, b.instr_count) {
+        i32 pc = start_instr + i;
+        b.instr_offsets[i] = b.code.length;
+
+        if (emit_instr(&b, pc, &program->code[pc])) {
+            supported++;
+        } else {
+            emit_exit(&b, pc);
+        }
+    }
+
+    // Falling off the end cannot happen, as every path ends in a return, but
+    // exit rather than running whatever follows the code.
+    emit_exit(&b, end_instr + 1);
+
+    ovm_jit_func_t *jit = NULL;
+    if (supported * 100 < b.instr_count * JIT_MIN_SUPPORTED_PERCENT) goto cleanup;
+
+    //
+    // Branches to instructions outside the function exit to the interpreter.
+    bh_arr_each(jit_patch_t, patch, b.patches) {
+        i32 target = patch->target_instr - start_instr;
+
+        i32 target_offset;
+        if (target >= 0 && target < b.instr_count) {
+            target_offset = b.instr_offsets[target];
+        } else {
+            target_offset = b.code.length;
+            emit_exit(&b, patch->target_instr);
+        }
+
+        *(u32 *) &b.code.data[patch->offset] = (u32) (target_offset - (patch->offset + 4));
+    }
+
+    u64 code_size = b.code.length;
+    bh_align(code_size, 4096);
+
+    u8 *code = mmap(NULL, code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) goto cleanup;
+
+    memcpy(code, b.code.data, b.code.length);
+    if (mprotect(code, code_size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, code_size);
+        goto cleanup;
+    }
+
+    jit = bh_alloc_item(alloc, ovm_jit_func_t);
+    jit->start_instr = start_instr;
+    jit->instr_count = b.instr_count;
+    jit->instr_offsets = b.instr_offsets;
+    jit->code = code;
+    jit->code_size = code_size;
+    b.instr_offsets = NULL;
+
+  cleanup:
+    if (b.instr_offsets) bh_free(alloc, b.instr_offsets);
+    bh_arr_free(b.patches);
+    bh_buffer_free(&b.code);
+    return jit;
+}
+
+//
+// Compiles the function, and publishes the native code in func->jit. This
+// is serialized with lazy translation, so the function's code does not
+// change while it is compiled. Returns NULL if the function should stay
+// interpreted.
+ovm_jit_func_t *ovm_jit_compile(ovm_program_t *program, ovm_func_t *func) {
+    if (func->kind != OVM_FUNC_INTERNAL) return NULL;
+
+    pthread_mutex_lock(&program->translate_mutex);
+
+    ovm_jit_func_t *jit = func->jit;
+    if (jit) goto done;
+
+    i32 start_instr = func->start_instr;
+    if (OVM_INSTR_INSTR(program->code[start_instr]) == OVMI_TRANSLATE) goto done;
+
+    i32 end_instr = jit_find_function_end(program, start_instr);
+    if (end_instr < 0) goto done;
+
+    jit = jit_build(program, start_instr, end_instr);
+    if (jit) {
+        __atomic_store_n(&func->jit, jit, __ATOMIC_RELEASE);
+    }
+
+  done:
+    pthread_mutex_unlock(&program->translate_mutex);
+    return jit;
+}
+
+void ovm_jit_free(ovm_jit_func_t *jit) {
+    munmap(jit->code, jit->code_size);
+    bh_free(bh_heap_allocator(), jit->instr_offsets);
+    bh_free(bh_heap_allocator(), jit);
+}
+
+#else
+
+ovm_jit_func_t *ovm_jit_compile(ovm_program_t *program, ovm_func_t *func) {
+    return NULL;
+}
+
+void ovm_jit_free(ovm_jit_func_t *jit) {
+}
+
+#endif
@@ -0,0 +1,358 @@
+//
+// Profiler
+//
+// See the comment above ovm_profile_node_t in vm.h.
+//
+
+#include "vm.h"
+#include "stb_ds.h"
+
+#define PROFILE_TABLE_FUNC_COUNT  30
+#define PROFILE_TABLE_LINE_COUNT  20
+
+//
+// The program can end by calling exit from a host function, so the profile
+// is also written when the process exits, if it has not been written yet.
+static ovm_profiler_t *exit_profiler = NULL;
+
+static void ovm_profiler_write_at_exit() {
+    if (exit_profiler) ovm_profiler_write(exit_profiler);
+}
+
+ovm_profiler_t *ovm_profiler_new(char *output_path) {
+    ovm_profiler_t *profiler = bh_alloc_item(bh_heap_allocator(), ovm_profiler_t);
+    profiler->output_path = output_path;
+    profiler->threads = NULL;
+    profiler->program = NULL;
+    profiler->debug_info = NULL;
+    profiler->written = false;
+
+    pthread_mutex_init(&profiler->mutex, NULL);
+    bh_arr_new(bh_heap_allocator(), profiler->threads, 4);
+
+    if (!exit_profiler) {
+        exit_profiler = profiler;
+        atexit(ovm_profiler_write_at_exit);
+    }
+
+    return profiler;
+}
+
+void ovm_profiler_delete(ovm_profiler_t *profiler) {
+    if (exit_profiler == profiler) exit_profiler = NULL;
+
+    bh_arr_each(ovm_profile_thread_t *, pthread, profiler->threads) {
+        ovm_profile_thread_t *thread = *pthread;
+        bh_arr_free(thread->nodes);
+        if (thread->instr_counts) bh_free(bh_heap_allocator(), thread->instr_counts);
+        bh_free(bh_heap_allocator(), thread);
+    }
+
+    bh_arr_free(profiler->threads);
+    pthread_mutex_destroy(&profiler->mutex);
+    bh_free(bh_heap_allocator(), profiler);
+}
+
+void ovm_profiler_attach_program(ovm_profiler_t *profiler, ovm_program_t *program, debug_info_t *debug_info) {
+    profiler->program = program;
+    profiler->debug_info = debug_info;
+}
+
+ovm_profile_thread_t *ovm_profiler_new_thread(ovm_profiler_t *profiler) {
+    ovm_profile_thread_t *thread = bh_alloc_item(bh_heap_allocator(), ovm_profile_thread_t);
+    thread->nodes = NULL;
+    thread->current = 0;
+    thread->depth = 0;
+    thread->instr_counts = NULL;
+    thread->instr_count_length = 0;
+
+    bh_arr_new(bh_heap_allocator(), thread->nodes, 256);
+
+    ovm_profile_node_t root = { 0 };
+    root.func_idx = -1;
+    root.parent = -1;
+    root.first_child = -1;
+    root.next_sibling = -1;
+    bh_arr_push(thread->nodes, root);
+
+    //
+    // The code does not grow while the program runs, because functions are
+    // not translated lazily while profiling.
+    if (profiler->program) {
+        thread->instr_count_length = bh_arr_length(profiler->program->code);
+        thread->instr_counts = bh_alloc_array(bh_heap_allocator(), u64, thread->instr_count_length);
+        memset(thread->instr_counts, 0, sizeof(u64) * thread->instr_count_length);
+    }
+
+    pthread_mutex_lock(&profiler->mutex);
+    bh_arr_push(profiler->threads, thread);
+    pthread_mutex_unlock(&profiler->mutex);
+
+    return thread;
+}
+
+static i32 profile_thread_enter(ovm_profile_thread_t *thread, i32 func_idx) {
+    ovm_profile_node_t *current = &thread->nodes[thread->current];
+
+    i32 child = current->first_child;
+    while (child >= 0) {
+        if (thread->nodes[child].func_idx == func_idx) return child;
+        child = thread->nodes[child].next_sibling;
+    }
+
+    ovm_profile_node_t node = { 0 };
+    node.func_idx = func_idx;
+    node.parent = thread->current;
+    node.first_child = -1;
+    node.next_sibling = current->first_child;
+
+    child = bh_arr_length(thread->nodes);
+    thread->nodes[thread->current].first_child = child;
+    bh_arr_push(thread->nodes, node);
+    return child;
+}
+
+//
+// Moves the thread's current node to match the stack frames. Between two
+// instructions there is usually one call or return, but calls into and
+// out of host functions can change the stack by more than one frame.
+void ovm_profile_thread_sync(ovm_profile_thread_t *thread, ovm_state_t *state) {
+    i32 depth = bh_arr_length(state->stack_frames);
+
+    while (thread->depth > depth) {
+        thread->current = thread->nodes[thread->current].parent;
+        thread->depth--;
+    }
+
+    while (thread->depth > 0 && thread->nodes[thread->current].func_idx != state->stack_frames[thread->depth - 1].func->id) {
+        thread->current = thread->nodes[thread->current].parent;
+        thread->depth--;
+    }
+
+    while (thread->depth < depth) {
+        thread->current = profile_thread_enter(thread, state->stack_frames[thread->depth].func->id);
+        thread->nodes[thread->current].calls++;
+        thread->depth++;
+    }
+}
+
+
+//
+// Writing the profile
+//
+
+typedef struct profile_func_total_t {
+    i32 func_idx;
+    u64 calls;
+    u64 self_instrs;
+    u64 inclusive_instrs;
+} profile_func_total_t;
+
+typedef struct profile_line_total_t {
+    u64 key;    // file_id << 32 | line
+    u64 value;
+} profile_line_total_t;
+
+static char *profile_func_name(ovm_profiler_t *profiler, i32 func_idx, char *buf, i32 buf_size) {
+    debug_func_info_t func_info;
+    if (debug_info_lookup_func(profiler->debug_info, func_idx, &func_info) && func_info.name && func_info.name[0]) {
+        return func_info.name;
+    }
+
+    ovm_func_t *func = &profiler->program->funcs[func_idx];
+    if (func->name && func->name[0]) return func->name;
+
+    snprintf(buf, buf_size, "func_%d", func_idx);
+    return buf;
+}
+
+//
+// Writes one line per calling context that ran instructions itself. The
+// frames are separated by ';', so any ';' in a name is replaced.
+static void profile_write_folded(ovm_profiler_t *profiler, ovm_profile_thread_t *thread, FILE *file) {
+    bh_arr(i32) path = NULL;
+    bh_arr_new(bh_heap_allocator(), path, 32);
+
+    char name_buf[32];
+
+    fori (i, 1, bh_arr_length(thread->nodes)) {
+        ovm_profile_node_t *node = &thread->nodes[i];
+        if (node->self_instrs == 0) continue;
+
+        bh_arr_clear(path);
+        for (i32 n = i; n > 0; n = thread->nodes[n].parent) {
+            bh_arr_push(path, thread->nodes[n].func_idx);
+        }
+
+        for (i32 p = bh_arr_length(path) - 1; p >= 0; p--) {
+            char *name = profile_func_name(profiler, path[p], name_buf, sizeof(name_buf));
+            for (char *c = name; *c; c++) {
+                fputc(*c == ';' ? ':' : *c, file);
+            }
+
+            if (p > 0) fputc(';', file);
+        }
+
+        fprintf(file, " %llu\n", (unsigned long long) node->self_instrs);
+    }
+
+    bh_arr_free(path);
+}
+
+//
+// Adds the thread's counts to the per function totals. A function's
+// inclusive count only includes a node if the function is not already
+// further up the path, so recursion is not counted more than once.
+static void profile_total_funcs(ovm_profile_thread_t *thread, profile_func_total_t *totals, u32 *on_path) {
+    i32 node_count = bh_arr_length(thread->nodes);
+
+    // Children always come after their parent, so one backwards pass sums every subtree.
+    u64 *subtree = bh_alloc_array(bh_heap_allocator(), u64, node_count);
+    fori (i, 0, node_count) subtree[i] = thread->nodes[i].self_instrs;
+    for (i32 i = node_count - 1; i > 0; i--) {
+        subtree[thread->nodes[i].parent] += subtree[i];
+    }
+
+    //
+    // Depth first walk, tracking how many times each function is on the path.
+    i32 n = thread->nodes[0].first_child;
+    while (n >= 0) {
+        ovm_profile_node_t *node = &thread->nodes[n];
+        profile_func_total_t *total = &totals[node->func_idx];
+        total->calls += node->calls;
+        total->self_instrs += node->self_instrs;
+        if (on_path[node->func_idx] == 0) total->inclusive_instrs += subtree[n];
+
+        if (node->first_child >= 0) {
+            on_path[node->func_idx]++;
+            n = node->first_child;
+            continue;
+        }
+
+        while (n > 0 && thread->nodes[n].next_sibling < 0) {
+            n = thread->nodes[n].parent;
+            if (n > 0) on_path[thread->nodes[n].func_idx]--;
+        }
+
+        n = n > 0 ? thread->nodes[n].next_sibling : -1;
+    }
+
+    bh_free(bh_heap_allocator(), subtree);
+}
+
+static int profile_compare_funcs(const void *a, const void *b) {
+    u64 x = ((profile_func_total_t *) a)->self_instrs;
+    u64 y = ((profile_func_total_t *) b)->self_instrs;
+    return x < y ? 1 : (x > y ? -1 : 0);
+}
+
+static int profile_compare_lines(const void *a, const void *b) {
+    u64 x = ((profile_line_total_t *) a)->value;
+    u64 y = ((profile_line_total_t *) b)->value;
+    return x < y ? 1 : (x > y ? -1 : 0);
+}
+
+static double profile_percent(u64 part, u64 whole) {
+    return whole ? 100.0 * (double) part / (double) whole : 0;
+}
+
+static void profile_print_lines(ovm_profiler_t *profiler, u64 total_instrs) {
+    if (!profiler->debug_info || !profiler->debug_info->has_debug_info) {
+        fprintf(stderr, "\nNo debug information, so instructions were not counted per line. Compile with --debug-info to include them.\n");
+        return;
+    }
+
+    profile_line_total_t *lines = NULL;
+    i32 located_count = bh_arr_length(profiler->debug_info->instruction_reducer);
+
+    bh_arr_each(ovm_profile_thread_t *, pthread, profiler->threads) {
+        ovm_profile_thread_t *thread = *pthread;
+
+        fori (pc, 0, bh_min(thread->instr_count_length, located_count)) {
+            if (thread->instr_counts[pc] == 0) continue;
+
+            debug_loc_info_t loc;
+            if (!debug_info_lookup_location(profiler->debug_info, pc, &loc)) continue;
+
+            u64 key = ((u64) loc.file_id << 32) | loc.line;
+            u64 count = hmget(lines, key);
+            hmput(lines, key, count + thread->instr_counts[pc]);
+        }
+    }
+
+    i32 line_count = hmlen(lines);
+    qsort(lines, line_count, sizeof(*lines), profile_compare_lines);
+
+    fprintf(stderr, "\n%14s %7s  %s\n", "Instructions", "%", "Line");
+    fori (i, 0, bh_min(line_count, PROFILE_TABLE_LINE_COUNT)) {
+        debug_file_info_t file_info;
+        char *filename = "<unknown>";
+        if (debug_info_lookup_file(profiler->debug_info, lines[i].key >> 32, &file_info)) {
+            filename = file_info.name;
+        }
+
+        fprintf(stderr, "%14llu %6.2f%%  %s:%u\n",
+            (unsigned long long) lines[i].value, profile_percent(lines[i].value, total_instrs),
+            filename, (u32) lines[i].key);
+    }
+
+    hmfree(lines);
+}
+
+void ovm_profiler_write(ovm_profiler_t *profiler) {
+    pthread_mutex_lock(&profiler->mutex);
+    if (profiler->written || !profiler->program) goto done;
+    profiler->written = true;
+
+    ovm_program_t *program = profiler->program;
+    i32 func_count = bh_arr_length(program->funcs);
+
+    FILE *file = fopen(profiler->output_path, "w");
+    if (!file) {
+        fprintf(stderr, "Failed to open '%s' to write the profile.\n", profiler->output_path);
+        goto done;
+    }
+
+    profile_func_total_t *totals = bh_alloc_array(bh_heap_allocator(), profile_func_total_t, func_count);
+    u32 *on_path = bh_alloc_array(bh_heap_allocator(), u32, func_count);
+    memset(totals, 0, sizeof(*totals) * func_count);
+    memset(on_path, 0, sizeof(*on_path) * func_count);
+    fori (i, 0, func_count) totals[i].func_idx = i;
+
+    bh_arr_each(ovm_profile_thread_t *, pthread, profiler->threads) {
+        profile_write_folded(profiler, *pthread, file);
+        profile_total_funcs(*pthread, totals, on_path);
+    }
+
+    fclose(file);
+
+    u64 total_instrs = 0;
+    fori (i, 0, func_count) total_instrs += totals[i].self_instrs;
+
+    qsort(totals, func_count, sizeof(*totals), profile_compare_funcs);
+
+    fprintf(stderr, "\nProfile: %llu instructions on %d thread(s). Folded stacks written to '%s'.\n\n",
+        (unsigned long long) total_instrs, bh_arr_length(profiler->threads), profiler->output_path);
+
+    fprintf(stderr, "%12s %14s %7s %14s %7s  %s\n", "Calls", "Self", "%", "Inclusive", "%", "Function");
+
+    char name_buf[32];
+    fori (i, 0, bh_min(func_count, PROFILE_TABLE_FUNC_COUNT)) {
+        profile_func_total_t *total = &totals[i];
+        if (total->calls == 0) break;
+
+        fprintf(stderr, "%12llu %14llu %6.2f%% %14llu %6.2f%%  %s\n",
+            (unsigned long long) total->calls,
+            (unsigned long long) total->self_instrs, profile_percent(total->self_instrs, total_instrs),
+            (unsigned long long) total->inclusive_instrs, profile_percent(total->inclusive_instrs, total_instrs),
+            profile_func_name(profiler, total->func_idx, name_buf, sizeof(name_buf)));
+    }
+
+    profile_print_lines(profiler, total_instrs);
+
+    bh_free(bh_heap_allocator(), totals);
+    bh_free(bh_heap_allocator(), on_path);
+
+  done:
+    pthread_mutex_unlock(&profiler->mutex);
+}
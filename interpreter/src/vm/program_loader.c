@@ -1,5 +1,10 @@
 #include "vm.h"
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 //
 // I'm very lazy and silly, so this code make the drastic assumption that the
 // endianness of the machine that the file was built on and the machine the
@@ -124,3 +129,378 @@ void ovm_state_link_external_funcs(ovm_program_t *program, ovm_state_t *state, o
         }
     }
 }
+
+
+//
+// Program images
+//
+
+#define OVM_IMAGE_VERSION    3
+#define OVM_IMAGE_BYTE_ORDER 0x01020304
+
+//
+// An image file is laid out as the header, the functions, the static
+// integers and the static integer arrays, followed by the code. The code
+// starts at code_offset + code_prefix, where code_offset is page aligned,
+// so the pages holding the code can be mapped over the program's code.
+//
+typedef struct ovm_image_header_t {
+    char magic[4];
+    u32  version;
+    u32  byte_order;
+    u32  instr_size;
+
+    u64  build_hash;
+    u64  module_hash;
+    u64  payload_size;
+    u64  payload_checksum;
+    u64  code_offset;
+
+    i32  func_count;
+    i32  static_integer_base;
+    i32  static_integer_count;
+    i32  static_data_base;
+    i32  static_data_count;
+    i32  code_base;
+    i32  code_count;
+    i32  code_prefix;
+} ovm_image_header_t;
+
+//
+// FNV-1a, taken a word at a time. This is only used to notice a stale or
+// damaged image, so the weaker mixing is worth being several times faster
+// on large modules.
+u64 ovm_image_hash(u64 hash, const void *data, u64 length) {
+    const u8 *bytes = data;
+
+    while (length >= 8) {
+        u64 word;
+        memcpy(&word, bytes, 8);
+        hash ^= word;
+        hash *= 0x100000001b3ull;
+
+        bytes  += 8;
+        length -= 8;
+    }
+
+    while (length > 0) {
+        hash ^= *bytes++;
+        hash *= 0x100000001b3ull;
+        length -= 1;
+    }
+
+    return hash;
+}
+
+//
+// Images are only valid for the build of the interpreter that wrote them,
+// as instruction numbering and layout change between builds.
+static u64 image_build_hash() {
+    static const char build[] = "ovm " __DATE__ " " __TIME__;
+    return ovm_image_hash(0xcbf29ce484222325ull, build, sizeof(build));
+}
+
+static u64 image_page_size() {
+    return (u64) sysconf(_SC_PAGESIZE);
+}
+
+static u64 image_metadata_size(ovm_image_header_t *header) {
+    return (u64) header->func_count           * sizeof(ovm_image_func_t)
+         + (u64) header->static_integer_count * sizeof(i32)
+         + (u64) header->static_data_count    * sizeof(ovm_static_integer_array_t);
+}
+
+static u64 image_checksum(ovm_program_image_t *image, ovm_instr_t *code) {
+    u64 hash = 0xcbf29ce484222325ull;
+    hash = ovm_image_hash(hash, image->funcs, image->func_count * sizeof(ovm_image_func_t));
+    hash = ovm_image_hash(hash, image->static_integers, image->static_integer_count * sizeof(i32));
+    hash = ovm_image_hash(hash, image->static_data, image->static_data_count * sizeof(ovm_static_integer_array_t));
+    hash = ovm_image_hash(hash, code, image->code_count * sizeof(ovm_instr_t));
+    return hash;
+}
+
+//
+// Pads the code with no-ops until the next instruction starts within the
+// first instruction's width of a page. The no-op before it covers the part
+// of the page in front of it, so mapping that page from an image only
+// replaces padding. Fixed storage is page aligned, so this lands on the
+// same offset into a page in every run that built the program the same way.
+void ovm_program_image_prepare(ovm_program_image_t *layout, ovm_program_t *program) {
+    memset(layout, 0, sizeof(*layout));
+    layout->fd = -1;
+
+    u64 page_size = image_page_size();
+
+    ovm_instr_t nop = {0};
+    do {
+        bh_arr_push(program->code, nop);
+    } while (((u64) &program->code[bh_arr_length(program->code)]) % page_size >= sizeof(ovm_instr_t));
+
+    layout->code_base   = bh_arr_length(program->code);
+    layout->code_prefix = ((u64) &program->code[layout->code_base]) % page_size;
+    layout->static_integer_base = bh_arr_length(program->static_integers);
+    layout->static_data_base    = bh_arr_length(program->static_data);
+}
+
+bool ovm_program_image_map(ovm_program_image_t *image, char *filename, u64 module_hash) {
+    memset(image, 0, sizeof(*image));
+    image->fd = -1;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (u64) st.st_size < sizeof(ovm_image_header_t)) {
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    image->fd = fd;
+    image->mapping = mapping;
+    image->mapping_size = st.st_size;
+
+    ovm_image_header_t *header = mapping;
+    if (strncmp(header->magic, "OVMI", 4)
+        || header->version    != OVM_IMAGE_VERSION
+        || header->byte_order != OVM_IMAGE_BYTE_ORDER
+        || header->instr_size != sizeof(ovm_instr_t)
+        || header->build_hash  != image_build_hash()
+        || header->module_hash != module_hash) {
+        goto bad_image;
+    }
+
+    if (header->func_count < 0
+        || header->static_integer_base < 0 || header->static_integer_count < 0
+        || header->static_data_base < 0 || header->static_data_count < 0
+        || header->code_base < 0 || header->code_count < 0
+        || header->code_prefix < 0 || header->code_prefix >= (i32) sizeof(ovm_instr_t)) {
+        goto bad_image;
+    }
+
+    u64 metadata_end = sizeof(ovm_image_header_t) + image_metadata_size(header);
+    u64 code_size    = (u64) header->code_count * sizeof(ovm_instr_t);
+    if (header->code_offset % image_page_size() != 0
+        || header->code_offset < metadata_end
+        || header->payload_size != image->mapping_size - sizeof(ovm_image_header_t)
+        || image->mapping_size != header->code_offset + header->code_prefix + code_size) {
+        goto bad_image;
+    }
+
+    u8 *payload = (u8 *) (header + 1);
+    image->func_count = header->func_count;
+    image->funcs = (ovm_image_func_t *) payload;
+    payload += image->func_count * sizeof(ovm_image_func_t);
+
+    image->static_integer_base  = header->static_integer_base;
+    image->static_integer_count = header->static_integer_count;
+    image->static_integers = (i32 *) payload;
+    payload += image->static_integer_count * sizeof(i32);
+
+    image->static_data_base  = header->static_data_base;
+    image->static_data_count = header->static_data_count;
+    image->static_data = (ovm_static_integer_array_t *) payload;
+
+    image->code_base   = header->code_base;
+    image->code_count  = header->code_count;
+    image->code_prefix = header->code_prefix;
+    image->code_offset = header->code_offset;
+
+    ovm_instr_t *code = (ovm_instr_t *) ((u8 *) mapping + image->code_offset + image->code_prefix);
+    if (image_checksum(image, code) != header->payload_checksum) goto bad_image;
+
+    fori (i, 0, image->func_count) {
+        ovm_image_func_t *func = &image->funcs[i];
+        if (func->start_instr < image->code_base || func->start_instr >= image->code_base + image->code_count) goto bad_image;
+    }
+
+    fori (i, 0, image->static_data_count) {
+        ovm_static_integer_array_t *data = &image->static_data[i];
+        i64 end = (i64) data->start_idx + data->len;
+        if (data->start_idx < image->static_integer_base || data->len < 0
+            || end > image->static_integer_base + image->static_integer_count) {
+            goto bad_image;
+        }
+    }
+
+    return true;
+
+  bad_image:
+    ovm_program_image_unmap(image);
+    return false;
+}
+
+//
+// The code that was mapped over the program stays mapped after this.
+void ovm_program_image_unmap(ovm_program_image_t *image) {
+    if (image->mapping) {
+        munmap(image->mapping, image->mapping_size);
+    }
+
+    if (image->fd >= 0) {
+        close(image->fd);
+    }
+
+    memset(image, 0, sizeof(*image));
+    image->fd = -1;
+}
+
+//
+// The image can only be applied to a program that is in the same state as
+// the one it was taken from, which is the case when the program was built
+// from the same module and then prepared with ovm_program_image_prepare.
+// Every function in the image has to be one of the lazy functions in
+// [func_base, func_base + func_count) that has not been translated yet.
+bool ovm_program_image_apply(ovm_program_image_t *image, ovm_program_t *program, i32 func_base, i32 func_count) {
+    if (bh_arr_length(program->code) != image->code_base
+        || bh_arr_length(program->static_integers) != image->static_integer_base
+        || bh_arr_length(program->static_data) != image->static_data_base) {
+        return false;
+    }
+
+    u8 *code_start = (u8 *) &program->code[image->code_base];
+    if (((u64) code_start) % image_page_size() != (u64) image->code_prefix) return false;
+
+    u8 *page_start = code_start - image->code_prefix;
+    if (memcmp(page_start, (u8 *) image->mapping + image->code_offset, image->code_prefix)) return false;
+
+    fori (i, 0, image->func_count) {
+        i32 func_idx = image->funcs[i].func_idx;
+        if (func_idx < func_base || func_idx >= func_base + func_count) return false;
+
+        ovm_func_t *func = &program->funcs[func_idx];
+        if (func->kind != OVM_FUNC_INTERNAL || OVM_INSTR_INSTR(program->code[func->start_instr]) != OVMI_TRANSLATE) {
+            return false;
+        }
+    }
+
+    //
+    // The code is grown first, because growing clears the new elements.
+    // Mapping the pages is copy-on-write, so translating more functions
+    // later can still append to the last page.
+    bh_arr_insert_end(program->code, image->code_count);
+
+    u64 map_size = image->code_prefix + (u64) image->code_count * sizeof(ovm_instr_t);
+    void *code_pages = mmap(page_start, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, image->fd, image->code_offset);
+    if (code_pages == MAP_FAILED) {
+        bh_arr_set_length(program->code, image->code_base);
+        return false;
+    }
+
+    fori (i, 0, image->func_count) {
+        ovm_image_func_t *image_func = &image->funcs[i];
+        ovm_func_t *func = &program->funcs[image_func->func_idx];
+        func->start_instr = image_func->start_instr;
+        func->value_number_count = image_func->value_number_count;
+    }
+
+    bh_arr_insert_end(program->static_integers, image->static_integer_count);
+    memcpy(&program->static_integers[image->static_integer_base], image->static_integers, image->static_integer_count * sizeof(i32));
+
+    bh_arr_insert_end(program->static_data, image->static_data_count);
+    memcpy(&program->static_data[image->static_data_base], image->static_data, image->static_data_count * sizeof(ovm_static_integer_array_t));
+
+    return true;
+}
+
+//
+// Writes every function in [func_base, func_base + func_count) that has
+// been translated, with everything that was added to the program after it
+// was prepared. layout->func_count is the number of functions that came
+// from an applied image; nothing is written unless more were translated
+// since. The image is written to a temporary file that is renamed into
+// place, so concurrent runs never see a partially written image.
+bool ovm_program_image_write(ovm_program_image_t *layout, ovm_program_t *program, i32 func_base, i32 func_count, char *filename, u64 module_hash) {
+    bh_allocator alloc = bh_heap_allocator();
+
+    ovm_program_image_t out = *layout;
+    out.func_count = 0;
+    out.funcs = bh_alloc_array(alloc, ovm_image_func_t, func_count);
+    fori (i, func_base, func_base + func_count) {
+        ovm_func_t *func = &program->funcs[i];
+        assert(func->kind == OVM_FUNC_INTERNAL);
+
+        if (func->start_instr < layout->code_base) continue;
+
+        ovm_image_func_t *image_func = &out.funcs[out.func_count++];
+        image_func->func_idx = i;
+        image_func->start_instr = func->start_instr;
+        image_func->value_number_count = func->value_number_count;
+    }
+
+    if (out.func_count <= layout->func_count) {
+        bh_free(alloc, out.funcs);
+        return false;
+    }
+
+    out.code_count = bh_arr_length(program->code) - out.code_base;
+    ovm_instr_t *code = &program->code[out.code_base];
+
+    out.static_integer_count = bh_arr_length(program->static_integers) - out.static_integer_base;
+    out.static_integers = &program->static_integers[out.static_integer_base];
+
+    out.static_data_count = bh_arr_length(program->static_data) - out.static_data_base;
+    out.static_data = &program->static_data[out.static_data_base];
+
+    ovm_image_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "OVMI", 4);
+    header.version    = OVM_IMAGE_VERSION;
+    header.byte_order = OVM_IMAGE_BYTE_ORDER;
+    header.instr_size = sizeof(ovm_instr_t);
+    header.build_hash  = image_build_hash();
+    header.module_hash = module_hash;
+
+    header.func_count = out.func_count;
+    header.static_integer_base  = out.static_integer_base;
+    header.static_integer_count = out.static_integer_count;
+    header.static_data_base  = out.static_data_base;
+    header.static_data_count = out.static_data_count;
+    header.code_base   = out.code_base;
+    header.code_count  = out.code_count;
+    header.code_prefix = out.code_prefix;
+
+    u64 page_size    = image_page_size();
+    u64 metadata_end = sizeof(ovm_image_header_t) + image_metadata_size(&header);
+    header.code_offset = metadata_end;
+    bh_align(header.code_offset, page_size);
+
+    header.payload_size = header.code_offset + header.code_prefix
+        + (u64) out.code_count * sizeof(ovm_instr_t) - sizeof(ovm_image_header_t);
+    header.payload_checksum = image_checksum(&out, code);
+
+    // The padding, and then the part of the page in front of the code,
+    // which is the tail of the no-op that the code was aligned with.
+    u64 padding_size = header.code_offset - metadata_end + header.code_prefix;
+    u8 *padding = bh_alloc(alloc, padding_size);
+    memset(padding, 0, padding_size);
+    memcpy(padding + padding_size - header.code_prefix, (u8 *) code - header.code_prefix, header.code_prefix);
+
+    char *temp_name = bh_aprintf(alloc, "%s.%d.tmp", filename, (i32) getpid());
+
+    bool success = false;
+    FILE *file = fopen(temp_name, "wb");
+    if (file) {
+        success = fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(out.funcs, sizeof(ovm_image_func_t), out.func_count, file) == (u64) out.func_count
+            && fwrite(out.static_integers, sizeof(i32), out.static_integer_count, file) == (u64) out.static_integer_count
+            && fwrite(out.static_data, sizeof(ovm_static_integer_array_t), out.static_data_count, file) == (u64) out.static_data_count
+            && fwrite(padding, 1, padding_size, file) == padding_size
+            && fwrite(code, sizeof(ovm_instr_t), out.code_count, file) == (u64) out.code_count;
+
+        success = (fclose(file) == 0) && success;
+        success = success && rename(temp_name, filename) == 0;
+
+        if (!success) remove(temp_name);
+    }
+
+    bh_free(alloc, temp_name);
+    bh_free(alloc, padding);
+    bh_free(alloc, out.funcs);
+    return success;
+}
@@ -76,18 +76,81 @@ ovm_program_t *ovm_program_new(ovm_store_t *store) {
     bh_arr_new(store->heap_allocator, program->static_integers, 128);
     bh_arr_new(store->heap_allocator, program->static_data, 128);
 
+    program->translate_func = NULL;
+    program->translate_userdata = NULL;
+    pthread_mutex_init(&program->translate_mutex, NULL);
+
+    program->jit_enabled = false;
+
     return program;
 }
 
 void ovm_program_delete(ovm_program_t *program) {
+    bh_arr_each(ovm_func_t, func, program->funcs) {
+        if (func->jit) ovm_jit_free(func->jit);
+    }
+
     bh_arr_free(program->funcs);
     bh_arr_free(program->code);
     bh_arr_free(program->static_integers);
     bh_arr_free(program->static_data);
 
+    pthread_mutex_destroy(&program->translate_mutex);
+
     bh_free(program->store->heap_allocator, program);
 }
 
+//
+// An allocator for arrays that are appended to while other threads read
+// them. The largest size the array could grow to is reserved up front,
+// so resizing never moves the array. Only the pages that are touched
+// take up memory.
+static BH_ALLOCATOR_PROC(ovm_fixed_allocator_proc) {
+    isize reserved_size = (isize) data;
+
+    switch (action) {
+        case bh_allocator_action_alloc: {
+            if (size > reserved_size) return NULL;
+
+            void *memory = mmap(NULL, reserved_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (memory == MAP_FAILED) return NULL;
+            return memory;
+        }
+
+        case bh_allocator_action_resize:
+            if (size > reserved_size) return NULL;
+            return prev_memory;
+
+        case bh_allocator_action_free:
+            munmap(prev_memory, reserved_size);
+            return NULL;
+    }
+
+    return NULL;
+}
+
+#define OVM_FIXED_CODE_SIZE            (1ll << 30)
+#define OVM_FIXED_STATIC_INTEGER_SIZE  (1ll << 28)
+#define OVM_FIXED_STATIC_DATA_SIZE     (1ll << 26)
+
+void ovm_program_use_fixed_storage(ovm_program_t *program) {
+    assert(bh_arr_length(program->code) == 0);
+    assert(bh_arr_length(program->static_integers) == 0);
+    assert(bh_arr_length(program->static_data) == 0);
+
+    bh_arr_free(program->code);
+    bh_arr_free(program->static_integers);
+    bh_arr_free(program->static_data);
+
+    bh_allocator code_alloc = { ovm_fixed_allocator_proc, (ptr) OVM_FIXED_CODE_SIZE };
+    bh_allocator static_integer_alloc = { ovm_fixed_allocator_proc, (ptr) OVM_FIXED_STATIC_INTEGER_SIZE };
+    bh_allocator static_data_alloc = { ovm_fixed_allocator_proc, (ptr) OVM_FIXED_STATIC_DATA_SIZE };
+
+    bh_arr_new(code_alloc, program->code, 1024);
+    bh_arr_new(static_integer_alloc, program->static_integers, 128);
+    bh_arr_new(static_data_alloc, program->static_data, 128);
+}
+
 int ovm_program_register_static_ints(ovm_program_t *program, int len, int *data) {
     ovm_static_integer_array_t new_entry;
     new_entry.start_idx = bh_arr_length(program->static_integers);
@@ -118,6 +181,9 @@ int ovm_program_register_func(ovm_program_t *program, char *name, i32 instr, i32
     func.start_instr = instr;
     func.param_count = param_count;
     func.value_number_count = value_number_count;
+    func.call_count = 0;
+    func.backedge_count = 0;
+    func.jit = NULL;
 
     bh_arr_push(program->funcs, func);
     return func.id;
@@ -131,11 +197,50 @@ int ovm_program_register_external_func(ovm_program_t *program, char *name, i32 p
     func.param_count = param_count;
     func.external_func_idx = external_func_idx;
     func.value_number_count = param_count;
+    func.call_count = 0;
+    func.backedge_count = 0;
+    func.jit = NULL;
 
     bh_arr_push(program->funcs, func);
     return func.id;
 }
 
+int ovm_program_register_lazy_func(ovm_program_t *program, char *name, i32 param_count) {
+    ovm_instr_t stub = {0};
+    stub.full_instr = OVM_TYPED_INSTR(OVMI_TRANSLATE, OVM_TYPE_NONE);
+    stub.r = -1;
+    stub.a = bh_arr_length(program->funcs);
+    bh_arr_push(program->code, stub);
+
+    return ovm_program_register_func(program, name, bh_arr_length(program->code) - 1, param_count, param_count);
+}
+
+//
+// Called by the translate instruction at the start of a lazy function.
+// Several threads can call the function for the first time at once, so
+// translation is done under a lock, and skipped if another thread got
+// there first. The value number count is published before the start
+// instruction, which callers read with acquire ordering, so a caller that
+// sees the translated code also sees how many value numbers it needs.
+void ovm_program_translate_func(ovm_program_t *program, i32 func_idx) {
+    ovm_func_t *func = &program->funcs[func_idx];
+
+    pthread_mutex_lock(&program->translate_mutex);
+
+    if (OVM_INSTR_INSTR(program->code[func->start_instr]) == OVMI_TRANSLATE) {
+        i32 start_instr, value_number_count;
+        if (!program->translate_func || !program->translate_func(program->translate_userdata, func_idx, &start_instr, &value_number_count)) {
+            fprintf(stderr, "Failed to translate function '%s'.\n", func->name);
+            exit(1);
+        }
+
+        __atomic_store_n(&func->value_number_count, value_number_count, __ATOMIC_RELAXED);
+        __atomic_store_n(&func->start_instr, start_instr, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&program->translate_mutex);
+}
+
 void ovm_program_begin_func(ovm_program_t *program, char *name, i32 param_count, i32 value_number_count) {
     ovm_func_t func;
     func.id = bh_arr_length(program->funcs);
@@ -143,6 +248,9 @@ void ovm_program_begin_func(ovm_program_t *program, char *name, i32 param_count,
     func.start_instr = bh_arr_length(program->code);
     func.param_count = param_count;
     func.value_number_count = value_number_count;
+    func.call_count = 0;
+    func.backedge_count = 0;
+    func.jit = NULL;
 
     bh_arr_push(program->funcs, func);
 }
@@ -163,7 +271,12 @@ ovm_engine_t *ovm_engine_new(ovm_store_t *store) {
     engine->memory_size = 0;
     engine->memory = NULL;
     engine->debug = NULL;
-    pthread_mutex_init(&engine->atomic_mutex, NULL);
+    engine->profiler = NULL;
+
+    fori (i, 0, OVM_PARKING_BUCKETS) {
+        pthread_mutex_init(&engine->parking_lot[i].mutex, NULL);
+        engine->parking_lot[i].waiters = NULL;
+    }
 
     //
     // HACK: This should not be necessary, but because moving the memory around
@@ -186,9 +299,112 @@ void ovm_engine_delete(ovm_engine_t *engine) {
         munmap(engine->memory, engine->memory_size);
     }
 
+    fori (i, 0, OVM_PARKING_BUCKETS) {
+        pthread_mutex_destroy(&engine->parking_lot[i].mutex);
+    }
+
+    if (engine->profiler) {
+        ovm_profiler_delete(engine->profiler);
+    }
+
     bh_free(store->heap_allocator, engine);
 }
 
+static inline ovm_parking_bucket_t *ovm_engine_parking_bucket(ovm_engine_t *engine, u32 addr) {
+    // Waits are always on naturally aligned addresses, so the low bits carry nothing.
+    u32 hash = (addr >> 2) * 0x9E3779B1;
+    return &engine->parking_lot[hash >> 26];
+}
+
+//
+// Returns 0 if the thread was woken up, 1 if the value in memory
+// did not match the expected value, and 2 if the timeout elapsed.
+// A negative timeout waits forever.
+i32 ovm_engine_atomic_wait(ovm_engine_t *engine, u32 addr, u64 expected, i32 size, i64 timeout_ns) {
+    ovm_parking_bucket_t *bucket = ovm_engine_parking_bucket(engine, addr);
+    void *ptr = ((u8 *) engine->memory) + addr;
+
+    pthread_mutex_lock(&bucket->mutex);
+
+    u64 current = size == 8
+        ? __atomic_load_n((u64 *) ptr, __ATOMIC_SEQ_CST)
+        : __atomic_load_n((u32 *) ptr, __ATOMIC_SEQ_CST);
+
+    if (current != expected) {
+        pthread_mutex_unlock(&bucket->mutex);
+        return 1;
+    }
+
+    // Waiters are queued at the end, so notify wakes them in the order they arrived.
+    ovm_parked_thread_t self;
+    self.addr  = addr;
+    self.woken = false;
+    self.next  = NULL;
+    pthread_cond_init(&self.cond, NULL);
+
+    ovm_parked_thread_t **tail = &bucket->waiters;
+    while (*tail) tail = &(*tail)->next;
+    *tail = &self;
+
+    struct timespec deadline;
+    if (timeout_ns >= 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec  += timeout_ns / 1000000000;
+        deadline.tv_nsec += timeout_ns % 1000000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec  += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    while (!self.woken) {
+        if (timeout_ns < 0) {
+            pthread_cond_wait(&self.cond, &bucket->mutex);
+        } else if (pthread_cond_timedwait(&self.cond, &bucket->mutex, &deadline) != 0) {
+            break;
+        }
+    }
+
+    // A notify removes the thread from the queue, so only a timeout has to.
+    if (!self.woken) {
+        ovm_parked_thread_t **walker = &bucket->waiters;
+        while (*walker != &self) walker = &(*walker)->next;
+        *walker = self.next;
+    }
+
+    pthread_mutex_unlock(&bucket->mutex);
+    pthread_cond_destroy(&self.cond);
+
+    return self.woken ? 0 : 2;
+}
+
+//
+// Wakes up to `count` threads waiting on `addr`, oldest first.
+// Returns how many threads were woken up.
+i32 ovm_engine_atomic_notify(ovm_engine_t *engine, u32 addr, u32 count) {
+    ovm_parking_bucket_t *bucket = ovm_engine_parking_bucket(engine, addr);
+
+    pthread_mutex_lock(&bucket->mutex);
+
+    i32 woken = 0;
+    ovm_parked_thread_t **walker = &bucket->waiters;
+    while (*walker && (u32) woken < count) {
+        ovm_parked_thread_t *waiter = *walker;
+        if (waiter->addr != addr) {
+            walker = &waiter->next;
+            continue;
+        }
+
+        *walker = waiter->next;
+        waiter->woken = true;
+        pthread_cond_signal(&waiter->cond);
+        woken++;
+    }
+
+    pthread_mutex_unlock(&bucket->mutex);
+    return woken;
+}
+
 static i32 hit_signaled_exception = 0;
 static void signal_handler(int signo, siginfo_t *info, void *context) {
     hit_signaled_exception = 1;
@@ -212,6 +428,10 @@ void ovm_engine_enable_debug(ovm_engine_t *engine, debug_state_t *debug) {
     // sigaction(SIGINT, &sa, NULL);   Don't overload Ctrl+C
 }
 
+void ovm_engine_enable_profiler(ovm_engine_t *engine, ovm_profiler_t *profiler) {
+    engine->profiler = profiler;
+}
+
 bool ovm_engine_memory_ensure_capacity(ovm_engine_t *engine, i64 minimum_size) {
     if (engine->memory_size >= minimum_size) return true;
 
@@ -270,6 +490,7 @@ ovm_state_t *ovm_state_new(ovm_engine_t *engine, ovm_program_t *program) {
     state->program = program;
     state->pc = 0;
     state->value_number_offset = 0;
+    state->trapped = false;
 
     state->numbered_values = NULL;
     state->stack_frames = NULL;
@@ -290,6 +511,11 @@ ovm_state_t *ovm_state_new(ovm_engine_t *engine, ovm_program_t *program) {
         state->debug = debug_host_lookup_thread(engine->debug, thread_id);
     }
 
+    state->profile = NULL;
+    if (engine->profiler) {
+        state->profile = ovm_profiler_new_thread(engine->profiler);
+    }
+
     return state;
 }
 
@@ -353,6 +579,21 @@ static void ovm__func_setup_stack_frame(ovm_state_t *state, ovm_func_t *func, i3
     }
 }
 
+//
+// A lazy function is entered with only enough value numbers for its
+// parameters, so the frame is grown once the function is translated.
+static void ovm__func_grow_stack_frame(ovm_state_t *state, ovm_func_t *func) {
+    ovm_stack_frame_t *frame = &bh_arr_last(state->stack_frames);
+
+    i32 extra_values = func->value_number_count - frame->value_number_count;
+    if (extra_values > 0) {
+        bh_arr_insert_end(state->numbered_values, extra_values);
+        frame->value_number_count = func->value_number_count;
+    }
+
+    state->__frame_values = &state->numbered_values[state->value_number_offset];
+}
+
 static ovm_stack_frame_t ovm__func_teardown_stack_frame(ovm_state_t *state) {
     ovm_stack_frame_t frame = bh_arr_pop(state->stack_frames);
     bh_arr_fastdeleten(state->numbered_values, frame.value_number_count);
@@ -383,13 +624,14 @@ ovm_value_t ovm_func_call(ovm_engine_t *engine, ovm_state_t *state, ovm_program_
 
     switch (func->kind) {
         case OVM_FUNC_INTERNAL: {
+            i32 start_instr = __atomic_load_n(&func->start_instr, __ATOMIC_ACQUIRE);
             ovm__func_setup_stack_frame(state, func, 0);
 
             fori (i, 0, param_count) {
                 state->numbered_values[i + state->value_number_offset] = params[i];
             }
 
-            state->pc = func->start_instr;
+            state->pc = start_instr;
             ovm_value_t result = ovm_run_code(engine, state, program);
 
             state->call_depth -= 1;
@@ -455,6 +697,194 @@ static inline double __ovm_copysign(double a, double b) {
     return -a;
 }
 
+
+//
+// 128-bit vectors
+//
+// Most vector operations are written with GCC/Clang vector extensions, which
+// compile to SSE2 on x86_64 and NEON on arm64. The operations that do not have
+// an operator use the host intrinsics directly.
+//
+
+typedef i8  ovm_i8x16 __attribute__((vector_size(16)));
+typedef u8  ovm_u8x16 __attribute__((vector_size(16)));
+typedef i16 ovm_i16x8 __attribute__((vector_size(16)));
+typedef u16 ovm_u16x8 __attribute__((vector_size(16)));
+typedef i32 ovm_i32x4 __attribute__((vector_size(16)));
+typedef u32 ovm_u32x4 __attribute__((vector_size(16)));
+typedef i64 ovm_i64x2 __attribute__((vector_size(16)));
+typedef u64 ovm_u64x2 __attribute__((vector_size(16)));
+typedef f32 ovm_f32x4 __attribute__((vector_size(16)));
+typedef f64 ovm_f64x2 __attribute__((vector_size(16)));
+
+#if defined(__x86_64__)
+    #define OVM_V128_NATIVE __m128i
+#else
+    #define OVM_V128_NATIVE uint8x16_t
+#endif
+
+#define OVM_V128_INTRINSIC(name, x86, arm, ntype) \
+    static inline ovm_i8x16 name(ovm_i8x16 a, ovm_i8x16 b) { \
+        OVM_V128_NATIVE na, nb, nr; \
+        memcpy(&na, &a, 16); memcpy(&nb, &b, 16); \
+        nr = OVM_V128_SELECT(x86, arm, ntype); \
+        memcpy(&a, &nr, 16); \
+        return a; \
+    }
+
+#if defined(__x86_64__)
+    #define OVM_V128_SELECT(x86, arm, ntype) x86(na, nb)
+#else
+    #define OVM_V128_SELECT(x86, arm, ntype) vreinterpretq_u8_##ntype(arm(vreinterpretq_##ntype##_u8(na), vreinterpretq_##ntype##_u8(nb)))
+#endif
+
+OVM_V128_INTRINSIC(__ovm_v128_add_sat_i8,    _mm_adds_epu8,  vqaddq_u8,  u8)
+OVM_V128_INTRINSIC(__ovm_v128_add_sat_s_i8,  _mm_adds_epi8,  vqaddq_s8,  s8)
+OVM_V128_INTRINSIC(__ovm_v128_add_sat_i16,   _mm_adds_epu16, vqaddq_u16, u16)
+OVM_V128_INTRINSIC(__ovm_v128_add_sat_s_i16, _mm_adds_epi16, vqaddq_s16, s16)
+OVM_V128_INTRINSIC(__ovm_v128_sub_sat_i8,    _mm_subs_epu8,  vqsubq_u8,  u8)
+OVM_V128_INTRINSIC(__ovm_v128_sub_sat_s_i8,  _mm_subs_epi8,  vqsubq_s8,  s8)
+OVM_V128_INTRINSIC(__ovm_v128_sub_sat_i16,   _mm_subs_epu16, vqsubq_u16, u16)
+OVM_V128_INTRINSIC(__ovm_v128_sub_sat_s_i16, _mm_subs_epi16, vqsubq_s16, s16)
+OVM_V128_INTRINSIC(__ovm_v128_avgr_i8,       _mm_avg_epu8,   vrhaddq_u8,  u8)
+OVM_V128_INTRINSIC(__ovm_v128_avgr_i16,      _mm_avg_epu16,  vrhaddq_u16, u16)
+
+#undef OVM_V128_SELECT
+#undef OVM_V128_INTRINSIC
+
+// Narrowing treats the inputs as signed, and saturates to the signed or
+// unsigned range of the result.
+static inline ovm_i8x16 __ovm_v128_narrow_s_i8(ovm_i8x16 a, ovm_i8x16 b) {
+#if defined(__x86_64__)
+    __m128i na, nb, nr;
+    memcpy(&na, &a, 16); memcpy(&nb, &b, 16);
+    nr = _mm_packs_epi16(na, nb);
+    memcpy(&a, &nr, 16);
+    return a;
+#else
+    int16x8_t na, nb;
+    memcpy(&na, &a, 16); memcpy(&nb, &b, 16);
+    int8x16_t nr = vcombine_s8(vqmovn_s16(na), vqmovn_s16(nb));
+    memcpy(&a, &nr, 16);
+    return a;
+#endif
+}
+
+static inline ovm_i8x16 __ovm_v128_narrow_i8(ovm_i8x16 a, ovm_i8x16 b) {
+#if defined(__x86_64__)
+    __m128i na, nb, nr;
+    memcpy(&na, &a, 16); memcpy(&nb, &b, 16);
+    nr = _mm_packus_epi16(na, nb);
+    memcpy(&a, &nr, 16);
+    return a;
+#else
+    int16x8_t na, nb;
+    memcpy(&na, &a, 16); memcpy(&nb, &b, 16);
+    uint8x16_t nr = vcombine_u8(vqmovun_s16(na), vqmovun_s16(nb));
+    memcpy(&a, &nr, 16);
+    return a;
+#endif
+}
+
+static inline ovm_i8x16 __ovm_v128_narrow_s_i16(ovm_i8x16 a, ovm_i8x16 b) {
+#if defined(__x86_64__)
+    __m128i na, nb, nr;
+    memcpy(&na, &a, 16); memcpy(&nb, &b, 16);
+    nr = _mm_packs_epi32(na, nb);
+    memcpy(&a, &nr, 16);
+    return a;
+#else
+    int32x4_t na, nb;
+    memcpy(&na, &a, 16); memcpy(&nb, &b, 16);
+    int16x8_t nr = vcombine_s16(vqmovn_s32(na), vqmovn_s32(nb));
+    memcpy(&a, &nr, 16);
+    return a;
+#endif
+}
+
+static inline ovm_i8x16 __ovm_v128_narrow_i16(ovm_i8x16 a, ovm_i8x16 b) {
+#if defined(__arm64__)
+    int32x4_t na, nb;
+    memcpy(&na, &a, 16); memcpy(&nb, &b, 16);
+    uint16x8_t nr = vcombine_u16(vqmovun_s32(na), vqmovun_s32(nb));
+    memcpy(&a, &nr, 16);
+    return a;
+#else
+    // _mm_packus_epi32 needs SSE4.1, which is not part of the x86_64 baseline.
+    ovm_i32x4 wa, wb;
+    ovm_u16x8 nr;
+    memcpy(&wa, &a, 16); memcpy(&wb, &b, 16);
+    fori (i, 0, 4) {
+        nr[i]     = (u16) bh_clamp(wa[i], 0, 0xffff);
+        nr[i + 4] = (u16) bh_clamp(wb[i], 0, 0xffff);
+    }
+    memcpy(&a, &nr, 16);
+    return a;
+#endif
+}
+
+static inline i32 __ovm_v128_bitmask_i8(ovm_i8x16 a) {
+#if defined(__x86_64__)
+    __m128i na;
+    memcpy(&na, &a, 16);
+    return _mm_movemask_epi8(na);
+#else
+    i32 mask = 0;
+    fori (i, 0, 16) mask |= (a[i] < 0) << i;
+    return mask;
+#endif
+}
+
+// The lane is masked, so a bad lane index cannot read outside of the vector.
+#define __ovm_v128_lane(v, l) ((v)[(l) & (sizeof(v) / sizeof((v)[0]) - 1)])
+
+static inline ovm_i8x16 __ovm_v128_swizzle(ovm_u8x16 a, ovm_u8x16 s) {
+    ovm_i8x16 r;
+    fori (i, 0, 16) r[i] = s[i] < 16 ? a[s[i]] : 0;
+    return r;
+}
+
+static inline ovm_i32x4 __ovm_v128_trunc_sat_s_i32(ovm_f32x4 a) {
+    ovm_i32x4 r;
+    fori (i, 0, 4) {
+        if (a[i] != a[i])                 r[i] = 0;
+        else if (a[i] <= -2147483648.0f) r[i] = INT32_MIN;
+        else if (a[i] >=  2147483648.0f) r[i] = INT32_MAX;
+        else                              r[i] = (i32) a[i];
+    }
+    return r;
+}
+
+static inline ovm_i32x4 __ovm_v128_trunc_sat_i32(ovm_f32x4 a) {
+    ovm_i32x4 r;
+    fori (i, 0, 4) {
+        if (a[i] != a[i] || a[i] <= 0)    r[i] = 0;
+        else if (a[i] >= 4294967296.0f)   r[i] = (i32) UINT32_MAX;
+        else                              r[i] = (i32) (u32) a[i];
+    }
+    return r;
+}
+
+// WebAssembly's min and max propagate NaNs, and order -0 before +0.
+#define OVM_V128_FLOAT_MINMAX(name, vtype, ctype, lanes, pick_a) \
+    static inline vtype name(vtype a, vtype b) { \
+        vtype r; \
+        fori (i, 0, lanes) { \
+            ctype x = a[i], y = b[i]; \
+            if (x != x || y != y) r[i] = x + y; \
+            else if (x == y)      r[i] = (signbit(x) != 0) == (pick_a) ? x : y; \
+            else                  r[i] = (x < y) == (pick_a) ? x : y; \
+        } \
+        return r; \
+    }
+
+OVM_V128_FLOAT_MINMAX(__ovm_v128_min_f32, ovm_f32x4, f32, 4, 1)
+OVM_V128_FLOAT_MINMAX(__ovm_v128_max_f32, ovm_f32x4, f32, 4, 0)
+OVM_V128_FLOAT_MINMAX(__ovm_v128_min_f64, ovm_f64x2, f64, 2, 1)
+OVM_V128_FLOAT_MINMAX(__ovm_v128_max_f64, ovm_f64x2, f64, 2, 0)
+
+#undef OVM_V128_FLOAT_MINMAX
+
 static void __ovm_trigger_exception(ovm_state_t *state) {
     if (state->debug) {
         state->debug->state = debug_state_pausing;
@@ -489,12 +919,7 @@ static void __ovm_debug_hook(ovm_engine_t *engine, ovm_state_t *state) {
 
     if (state->debug->pause_at_next_line) {
         if (state->debug->pause_within == -1 || state->debug->pause_within == bh_arr_last(state->stack_frames).func->id) {
-
-            debug_loc_info_t l1, l2;
-            debug_info_lookup_location(engine->debug->info, state->pc - 1, &l1);
-            debug_info_lookup_location(engine->debug->info, state->pc,     &l2);
-
-            if (l1.file_id != l2.file_id || l1.line != l2.line) {
+            if (debug_info_is_line_start(engine->debug->info, state->pc)) {
                 state->debug->pause_at_next_line = false;
                 state->debug->pause_reason = debug_pause_step;
                 state->debug->state = debug_state_pausing;
@@ -504,11 +929,13 @@ static void __ovm_debug_hook(ovm_engine_t *engine, ovm_state_t *state) {
     }
 
     ovm_assert(engine->debug);
-    bh_arr_each(debug_breakpoint_t, bp, engine->debug->breakpoints) {
-        if (bp->instr == (u32) state->pc) {
-            state->debug->state = debug_state_hit_breakpoint;
-            state->debug->last_breakpoint_hit = bp->id;
-            goto should_wait;
+    if (debug_instr_bit_test(engine->debug->breakpoint_bits, engine->debug->breakpoint_bit_count, state->pc)) {
+        bh_arr_each(debug_breakpoint_t, bp, engine->debug->breakpoints) {
+            if (bp->instr == (u32) state->pc) {
+                state->debug->state = debug_state_hit_breakpoint;
+                state->debug->last_breakpoint_hit = bp->id;
+                goto should_wait;
+            }
         }
     }
 
@@ -523,11 +950,66 @@ static void __ovm_debug_hook(ovm_engine_t *engine, ovm_state_t *state) {
     if (state->debug->run_count > 0) state->debug->run_count--;
 }
 
+
+//
+// Entered from the interpreter at the start of a call and after a loop
+// back-edge is taken. If the function has native code, it is run from the
+// current instruction until it exits, and the interpreter continues from
+// the pc stored by the exit. Otherwise the function's counter is bumped,
+// and the function is compiled when the counter reaches its threshold.
+// The counters are only a heuristic, so racing increments from several
+// threads are not a problem.
+static inline void __ovm_jit_enter(ovm_state_t *state, ovm_jit_func_t *jit, ovm_value_t *values, u8 *memory) {
+    i32 offset = state->pc - jit->start_instr;
+    if (offset < 0 || offset >= jit->instr_count) return;
+
+    ovm_jit_entry_t entry = (ovm_jit_entry_t) jit->code;
+    entry(values, memory, state, jit->code + jit->instr_offsets[offset]);
+}
+
+static __attribute__((noinline)) void __ovm_jit_compile(ovm_state_t *state, ovm_func_t *func, ovm_value_t *values, u8 *memory) {
+    if (!state->program->jit_enabled) return;
+
+    ovm_jit_func_t *jit = ovm_jit_compile(state->program, func);
+    if (jit) __ovm_jit_enter(state, jit, values, memory);
+}
+
+static inline void __ovm_jit_call_hook(ovm_state_t *state, ovm_func_t *func, ovm_value_t *values, u8 *memory) {
+    ovm_jit_func_t *jit = __atomic_load_n(&func->jit, __ATOMIC_ACQUIRE);
+    if (jit) {
+        __ovm_jit_enter(state, jit, values, memory);
+        return;
+    }
+
+    u32 count = __atomic_load_n(&func->call_count, __ATOMIC_RELAXED) + 1;
+    __atomic_store_n(&func->call_count, count, __ATOMIC_RELAXED);
+    if (count == OVM_JIT_CALL_THRESHOLD) {
+        __ovm_jit_compile(state, func, values, memory);
+    }
+}
+
+static inline void __ovm_jit_backedge_hook(ovm_state_t *state, ovm_value_t *values, u8 *memory) {
+    ovm_func_t *func = bh_arr_last(state->stack_frames).func;
+    ovm_jit_func_t *jit = __atomic_load_n(&func->jit, __ATOMIC_ACQUIRE);
+    if (jit) {
+        __ovm_jit_enter(state, jit, values, memory);
+        return;
+    }
+
+    u32 count = __atomic_load_n(&func->backedge_count, __ATOMIC_RELAXED) + 1;
+    __atomic_store_n(&func->backedge_count, count, __ATOMIC_RELAXED);
+    if (count == OVM_JIT_BACKEDGE_THRESHOLD) {
+        __ovm_jit_compile(state, func, values, memory);
+    }
+}
+
 #define OVMI_FUNC_NAME(n) ovmi_exec_##n
 #define OVMI_DISPATCH_NAME ovmi_dispatch
 #define OVMI_DEBUG_HOOK ((void)0)
 #define OVMI_EXCEPTION_HOOK ((void)0)
 #define OVMI_DIVIDE_CHECK_HOOK(_) ((void)0)
+#define OVMI_JIT_CALL_HOOK(func) __ovm_jit_call_hook(state, func, values, memory)
+#define OVMI_JIT_BACKEDGE_HOOK(delta) if ((delta) < 0) __ovm_jit_backedge_hook(state, values, memory)
 #include "./vm_instrs.h"
 
 #define OVMI_FUNC_NAME(n) ovmi_exec_debug_##n
@@ -535,6 +1017,35 @@ static void __ovm_debug_hook(ovm_engine_t *engine, ovm_state_t *state) {
 #define OVMI_DEBUG_HOOK __ovm_debug_hook(state->engine, state)
 #define OVMI_EXCEPTION_HOOK __ovm_trigger_exception(state)
 #define OVMI_DIVIDE_CHECK_HOOK(ctype) if (VAL(instr->b).ctype == 0) __ovm_trigger_exception(state)
+#define OVMI_JIT_CALL_HOOK(func) ((void)0)
+#define OVMI_JIT_BACKEDGE_HOOK(delta) ((void)0)
+#include "./vm_instrs.h"
+
+//
+// Counts the instruction about to run. The calling context only needs to be
+// found again when a call or return has happened since the last instruction.
+static inline void __ovm_profile_hook(ovm_state_t *state) {
+    ovm_profile_thread_t *profile = state->profile;
+
+    i32 depth = bh_arr_length(state->stack_frames);
+    if (depth != profile->depth || profile->nodes[profile->current].func_idx != bh_arr_last(state->stack_frames).func->id) {
+        ovm_profile_thread_sync(profile, state);
+    }
+
+    profile->nodes[profile->current].self_instrs++;
+
+    if (state->pc < profile->instr_count_length) {
+        profile->instr_counts[state->pc]++;
+    }
+}
+
+#define OVMI_FUNC_NAME(n) ovmi_exec_profile_##n
+#define OVMI_DISPATCH_NAME ovmi_profile_dispatch
+#define OVMI_DEBUG_HOOK __ovm_profile_hook(state)
+#define OVMI_EXCEPTION_HOOK ((void)0)
+#define OVMI_DIVIDE_CHECK_HOOK(_) ((void)0)
+#define OVMI_JIT_CALL_HOOK(func) ((void)0)
+#define OVMI_JIT_BACKEDGE_HOOK(delta) ((void)0)
 #include "./vm_instrs.h"
 
 ovm_value_t ovm_run_code(ovm_engine_t *engine, ovm_state_t *state, ovm_program_t *program) {
@@ -545,6 +1056,8 @@ ovm_value_t ovm_run_code(ovm_engine_t *engine, ovm_state_t *state, ovm_program_t
     ovmi_instr_exec_t *exec_table = ovmi_dispatch;
     if (state->debug) {
         exec_table = ovmi_debug_dispatch;
+    } else if (state->profile) {
+        exec_table = ovmi_profile_dispatch;
     }
 
     ovm_instr_t *code = program->code;
@@ -217,6 +217,18 @@ OVMI_INSTR_EXEC(imm_f64) { OVM_IMM(OVM_TYPE_F64, f64, d); NEXT_OP; }
 
 #undef OVM_IMM
 
+OVMI_INSTR_EXEC(add_imm_i32) {
+    VAL(instr->r).i32 = (i32) ((u32) VAL(instr->a).i32 + (u32) instr->b);
+    VAL(instr->r).type = OVM_TYPE_I32;
+    NEXT_OP;
+}
+
+OVMI_INSTR_EXEC(add_imm_i64) {
+    VAL(instr->r).i64 = (i64) ((u64) VAL(instr->a).i64 + (u64) (i64) instr->b);
+    VAL(instr->r).type = OVM_TYPE_I64;
+    NEXT_OP;
+}
+
 OVMI_INSTR_EXEC(mov) {
     VAL(instr->r) = VAL(instr->a);
     NEXT_OP;
@@ -241,6 +253,14 @@ OVM_LOAD(f64, OVM_TYPE_F64, f64)
 
 #undef OVM_LOAD
 
+OVMI_INSTR_EXEC(load_v128) {
+    ovm_assert(VAL(instr->a).type == OVM_TYPE_I32);
+    u32 dest = VAL(instr->a).u32 + (u32) instr->b;
+    if (dest == 0) OVMI_EXCEPTION_HOOK;
+    memcpy(VAL(instr->r).v128, &memory[dest], 16);
+    NEXT_OP;
+}
+
 #define OVM_STORE(otype, type_, stype) \
     OVMI_INSTR_EXEC(store_##otype) { \
         ovm_assert(VAL(instr->r).type == OVM_TYPE_I32); \
@@ -260,6 +280,14 @@ OVM_STORE(f64, OVM_TYPE_F64, f64)
 
 #undef OVM_STORE
 
+OVMI_INSTR_EXEC(store_v128) {
+    ovm_assert(VAL(instr->r).type == OVM_TYPE_I32);
+    u32 dest = VAL(instr->r).u32 + (u32) instr->b;
+    if (dest == 0) OVMI_EXCEPTION_HOOK;
+    memcpy(&memory[dest], VAL(instr->a).v128, 16);
+    NEXT_OP;
+}
+
 OVMI_INSTR_EXEC(copy) {
     u32 dest  = VAL(instr->r).u32;
     u32 src   = VAL(instr->a).u32;
@@ -300,6 +328,7 @@ OVMI_INSTR_EXEC(idx_arr) {
     ovm_static_integer_array_t data_elem = state->program->static_data[instr->a];
     if (VAL(instr->b).u32 >= (u32) data_elem.len) {
         OVMI_EXCEPTION_HOOK;
+        state->trapped = true;
         ovm_value_t bad_val;
         bad_val.type = OVM_TYPE_ERR;
         return bad_val;
@@ -353,9 +382,13 @@ OVMI_INSTR_EXEC(return) {
 }
 
 
+//
+// The start instruction is read before the stack frame is set up. See
+// ovm_program_translate_func for why.
 #define OVM_CALL_CODE(func_idx) \
     i32 fidx = func_idx; \
     ovm_func_t *func = &state->program->funcs[fidx]; \
+    i32 start_instr = __atomic_load_n(&func->start_instr, __ATOMIC_ACQUIRE); \
     i32 extra_params = state->param_count - func->param_count; \
     ovm_assert(extra_params >= 0); \
     ovm__func_setup_stack_frame(state, func, instr->r); \
@@ -363,7 +396,8 @@ OVMI_INSTR_EXEC(return) {
     if (func->kind == OVM_FUNC_INTERNAL) { \
         values = state->__frame_values; \
         memcpy(&VAL(0), &state->param_buf[extra_params], func->param_count * sizeof(ovm_value_t)); \
-        state->pc = func->start_instr; \
+        state->pc = start_instr; \
+        OVMI_JIT_CALL_HOOK(func); \
     } else { \
         ovm_external_func_t external_func = state->external_funcs[func->external_func_idx]; \
         external_func.native_func(external_func.userdata, &state->param_buf[extra_params], &state->__tmp_value); \
@@ -389,19 +423,51 @@ OVMI_INSTR_EXEC(calli) {
 
 #undef OVM_CALL_CODE
 
+OVMI_INSTR_EXEC(translate) {
+    ovm_func_t *func = &state->program->funcs[instr->a];
+    ovm_program_translate_func(state->program, instr->a);
+
+    ovm__func_grow_stack_frame(state, func);
+    values = state->__frame_values;
+    state->pc = func->start_instr;
+    NEXT_OP;
+}
+
 
 
 //
 // Branching Instructions
 //
 
-OVMI_INSTR_EXEC(br)     { state->pc += instr->a; NEXT_OP; }
+OVMI_INSTR_EXEC(br)     { state->pc += instr->a; OVMI_JIT_BACKEDGE_HOOK(instr->a); NEXT_OP; }
 OVMI_INSTR_EXEC(bri)    { state->pc += VAL(instr->a).i32; NEXT_OP; }
-OVMI_INSTR_EXEC(br_nz)  { if (VAL(instr->b).i32 != 0) state->pc += instr->a; NEXT_OP; }
+OVMI_INSTR_EXEC(br_nz)  { if (VAL(instr->b).i32 != 0) { state->pc += instr->a; OVMI_JIT_BACKEDGE_HOOK(instr->a); } NEXT_OP; }
 OVMI_INSTR_EXEC(bri_nz) { if (VAL(instr->b).i32 != 0) state->pc += VAL(instr->a).i32; NEXT_OP; }
-OVMI_INSTR_EXEC(br_z)   { if (VAL(instr->b).i32 == 0) state->pc += instr->a; NEXT_OP; }
+OVMI_INSTR_EXEC(br_z)   { if (VAL(instr->b).i32 == 0) { state->pc += instr->a; OVMI_JIT_BACKEDGE_HOOK(instr->a); } NEXT_OP; }
 OVMI_INSTR_EXEC(bri_z)  { if (VAL(instr->b).i32 == 0) state->pc += VAL(instr->a).i32; NEXT_OP; }
 
+#define OVM_BR_CMP(name, op) \
+    OVMI_INSTR_EXEC(br_##name##_i32) { if (VAL(instr->a).u32 op VAL(instr->b).u32) { state->pc += instr->r; OVMI_JIT_BACKEDGE_HOOK(instr->r); } NEXT_OP; } \
+    OVMI_INSTR_EXEC(br_##name##_i64) { if (VAL(instr->a).u64 op VAL(instr->b).u64) { state->pc += instr->r; OVMI_JIT_BACKEDGE_HOOK(instr->r); } NEXT_OP; }
+
+#define OVM_BR_CMP_S(name, op) \
+    OVMI_INSTR_EXEC(br_##name##_i32) { if (VAL(instr->a).i32 op VAL(instr->b).i32) { state->pc += instr->r; OVMI_JIT_BACKEDGE_HOOK(instr->r); } NEXT_OP; } \
+    OVMI_INSTR_EXEC(br_##name##_i64) { if (VAL(instr->a).i64 op VAL(instr->b).i64) { state->pc += instr->r; OVMI_JIT_BACKEDGE_HOOK(instr->r); } NEXT_OP; }
+
+OVM_BR_CMP(lt, <)
+OVM_BR_CMP(le, <=)
+OVM_BR_CMP(eq, ==)
+OVM_BR_CMP(ge, >=)
+OVM_BR_CMP(gt, >)
+OVM_BR_CMP(ne, !=)
+OVM_BR_CMP_S(lt_s, <)
+OVM_BR_CMP_S(le_s, <=)
+OVM_BR_CMP_S(ge_s, >=)
+OVM_BR_CMP_S(gt_s, >)
+
+#undef OVM_BR_CMP_S
+#undef OVM_BR_CMP
+
 
 //
 // Conversion
@@ -488,30 +554,125 @@ OVM_CVT(f64, i64, f64, u64, OVM_TYPE_I64, u64);
 // Compare exchange
 //
 
-#define CMPXCHG(otype, ctype) \
-    OVMI_INSTR_EXEC(cmpxchg_##ctype) { \
-        pthread_mutex_lock(&state->engine->atomic_mutex); \
+#define CMPXCHG(otype, type_, stype) \
+    OVMI_INSTR_EXEC(cmpxchg_##otype) { \
         if (VAL(instr->r).u32 == 0) OVMI_EXCEPTION_HOOK; \
-        ctype *addr = (ctype *) &memory[VAL(instr->r).u32]; \
- \
-        VAL(instr->r).u64 = 0; \
-        VAL(instr->r).type = otype; \
-        VAL(instr->r).ctype = *addr; \
+        stype *addr = (stype *) &memory[VAL(instr->r).u32]; \
  \
-        if (*addr == VAL(instr->a).ctype) { \
-            *addr = VAL(instr->b).ctype ; \
-        } \
+        stype expected = VAL(instr->a).stype; \
+        __atomic_compare_exchange_n(addr, &expected, VAL(instr->b).stype, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); \
  \
-        pthread_mutex_unlock(&state->engine->atomic_mutex); \
+        VAL(instr->r).u64 = 0; \
+        VAL(instr->r).type = type_; \
+        VAL(instr->r).stype = expected; \
         NEXT_OP; \
     }
 
-CMPXCHG(OVM_TYPE_I32, i32)
-CMPXCHG(OVM_TYPE_I64, i64)
+CMPXCHG(i8,  OVM_TYPE_I8,  u8)
+CMPXCHG(i16, OVM_TYPE_I16, u16)
+CMPXCHG(i32, OVM_TYPE_I32, u32)
+CMPXCHG(i64, OVM_TYPE_I64, u64)
 
 #undef CMPXCHG
 
 
+//
+// Atomic memory accesses
+//
+// Narrow atomic loads are always zero-extended in WASM, so the whole
+// register is cleared before the value is written.
+//
+
+#define OVM_ATOMIC_LOAD(otype, type_, stype) \
+    OVMI_INSTR_EXEC(atomic_load_##otype) { \
+        ovm_assert(VAL(instr->a).type == OVM_TYPE_I32); \
+        u32 dest = VAL(instr->a).u32 + (u32) instr->b; \
+        if (dest == 0) OVMI_EXCEPTION_HOOK; \
+        VAL(instr->r).u64 = 0; \
+        VAL(instr->r).stype = __atomic_load_n((stype *) &memory[dest], __ATOMIC_SEQ_CST); \
+        VAL(instr->r).type = type_; \
+        NEXT_OP; \
+    }
+
+OVM_ATOMIC_LOAD(i8,  OVM_TYPE_I8,  u8)
+OVM_ATOMIC_LOAD(i16, OVM_TYPE_I16, u16)
+OVM_ATOMIC_LOAD(i32, OVM_TYPE_I32, u32)
+OVM_ATOMIC_LOAD(i64, OVM_TYPE_I64, u64)
+
+#undef OVM_ATOMIC_LOAD
+
+#define OVM_ATOMIC_STORE(otype, type_, stype) \
+    OVMI_INSTR_EXEC(atomic_store_##otype) { \
+        ovm_assert(VAL(instr->r).type == OVM_TYPE_I32); \
+        u32 dest = VAL(instr->r).u32 + (u32) instr->b; \
+        if (dest == 0) OVMI_EXCEPTION_HOOK; \
+        __atomic_store_n((stype *) &memory[dest], VAL(instr->a).stype, __ATOMIC_SEQ_CST); \
+        NEXT_OP; \
+    }
+
+OVM_ATOMIC_STORE(i8,  OVM_TYPE_I8,  u8)
+OVM_ATOMIC_STORE(i16, OVM_TYPE_I16, u16)
+OVM_ATOMIC_STORE(i32, OVM_TYPE_I32, u32)
+OVM_ATOMIC_STORE(i64, OVM_TYPE_I64, u64)
+
+#undef OVM_ATOMIC_STORE
+
+#define OVM_ATOMIC_RMW(name, builtin, otype, type_, stype) \
+    OVMI_INSTR_EXEC(atomic_##name##_##otype) { \
+        ovm_assert(VAL(instr->a).type == OVM_TYPE_I32); \
+        u32 dest = VAL(instr->a).u32; \
+        if (dest == 0) OVMI_EXCEPTION_HOOK; \
+        stype old = builtin((stype *) &memory[dest], VAL(instr->b).stype, __ATOMIC_SEQ_CST); \
+        VAL(instr->r).u64 = 0; \
+        VAL(instr->r).stype = old; \
+        VAL(instr->r).type = type_; \
+        NEXT_OP; \
+    }
+
+#define OVM_ATOMIC_RMW_ALL(name, builtin) \
+    OVM_ATOMIC_RMW(name, builtin, i8,  OVM_TYPE_I8,  u8) \
+    OVM_ATOMIC_RMW(name, builtin, i16, OVM_TYPE_I16, u16) \
+    OVM_ATOMIC_RMW(name, builtin, i32, OVM_TYPE_I32, u32) \
+    OVM_ATOMIC_RMW(name, builtin, i64, OVM_TYPE_I64, u64)
+
+OVM_ATOMIC_RMW_ALL(add,  __atomic_fetch_add)
+OVM_ATOMIC_RMW_ALL(sub,  __atomic_fetch_sub)
+OVM_ATOMIC_RMW_ALL(and,  __atomic_fetch_and)
+OVM_ATOMIC_RMW_ALL(or,   __atomic_fetch_or)
+OVM_ATOMIC_RMW_ALL(xor,  __atomic_fetch_xor)
+OVM_ATOMIC_RMW_ALL(xchg, __atomic_exchange_n)
+
+#undef OVM_ATOMIC_RMW_ALL
+#undef OVM_ATOMIC_RMW
+
+#define OVM_ATOMIC_WAIT(otype, size, stype) \
+    OVMI_INSTR_EXEC(atomic_wait_##otype) { \
+        if (VAL(instr->r).u32 == 0) OVMI_EXCEPTION_HOOK; \
+        i32 result = ovm_engine_atomic_wait(state->engine, VAL(instr->r).u32, VAL(instr->a).stype, size, VAL(instr->b).i64); \
+        VAL(instr->r).u64 = 0; \
+        VAL(instr->r).i32 = result; \
+        VAL(instr->r).type = OVM_TYPE_I32; \
+        NEXT_OP; \
+    }
+
+OVM_ATOMIC_WAIT(i32, 4, u32)
+OVM_ATOMIC_WAIT(i64, 8, u64)
+
+#undef OVM_ATOMIC_WAIT
+
+OVMI_INSTR_EXEC(atomic_notify) {
+    if (VAL(instr->a).u32 == 0) OVMI_EXCEPTION_HOOK;
+    VAL(instr->r).i32 = ovm_engine_atomic_notify(state->engine, VAL(instr->a).u32, VAL(instr->b).u32);
+    VAL(instr->r).type = OVM_TYPE_I32;
+    NEXT_OP;
+}
+
+OVMI_INSTR_EXEC(atomic_fence) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    NEXT_OP;
+}
+
+
 //
 // Memory
 //
@@ -536,6 +697,299 @@ OVMI_INSTR_EXEC(mem_grow) {
     NEXT_OP;
 }
 
+//
+// Vector operations
+//
+// Vectors are copied in and out of the value numbers with memcpy, because
+// values are only 8-byte aligned. The compiler turns these copies into
+// unaligned vector loads and stores. Vector values overlap the type of the
+// value, so it is never set.
+//
+
+#define OVM_VGET(vtype, v, loc) \
+    vtype v; memcpy(&v, VAL(loc).v128, 16);
+
+#define OVM_VSET(loc, v) \
+    memcpy(VAL(loc).v128, &v, 16);
+
+#define OVM_VOP_UNARY(name, vtype, expr) \
+    OVMI_INSTR_EXEC(name) { \
+        OVM_VGET(vtype, a, instr->a); \
+        vtype r = (vtype) (expr); \
+        OVM_VSET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+#define OVM_VOP_BINARY(name, vtype, expr) \
+    OVMI_INSTR_EXEC(name) { \
+        OVM_VGET(vtype, a, instr->a); \
+        OVM_VGET(vtype, b, instr->b); \
+        vtype r = (vtype) (expr); \
+        OVM_VSET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+#define OVM_VOP_SHIFT(name, vtype, bits, op) \
+    OVMI_INSTR_EXEC(name) { \
+        OVM_VGET(vtype, a, instr->a); \
+        vtype r = a op (VAL(instr->b).i32 & (bits - 1)); \
+        OVM_VSET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+#define OVM_VOP_SIGNED(op, name, expr) \
+    op(name##_i8,  ovm_i8x16, expr) \
+    op(name##_i16, ovm_i16x8, expr) \
+    op(name##_i32, ovm_i32x4, expr) \
+    op(name##_i64, ovm_i64x2, expr)
+
+#define OVM_VOP_UNSIGNED(op, name, expr) \
+    op(name##_i8,  ovm_u8x16, expr) \
+    op(name##_i16, ovm_u16x8, expr) \
+    op(name##_i32, ovm_u32x4, expr) \
+    op(name##_i64, ovm_u64x2, expr)
+
+#define OVM_VOP_FLOAT(op, name, expr) \
+    op(name##_f32, ovm_f32x4, expr) \
+    op(name##_f64, ovm_f64x2, expr)
+
+OVMI_INSTR_EXEC(vconst) {
+    ovm_static_integer_array_t data_elem = state->program->static_data[instr->a];
+    memcpy(VAL(instr->r).v128, &state->program->static_integers[data_elem.start_idx], 16);
+    NEXT_OP;
+}
+
+#define OVM_VSPLAT(t, vtype, ctype) \
+    OVMI_INSTR_EXEC(vsplat_##t) { \
+        vtype r = (vtype) {} + VAL(instr->a).ctype; \
+        OVM_VSET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+OVM_VSPLAT(i8,  ovm_i8x16, i8)
+OVM_VSPLAT(i16, ovm_i16x8, i16)
+OVM_VSPLAT(i32, ovm_i32x4, i32)
+OVM_VSPLAT(i64, ovm_i64x2, i64)
+OVM_VSPLAT(f32, ovm_f32x4, f32)
+OVM_VSPLAT(f64, ovm_f64x2, f64)
+
+#undef OVM_VSPLAT
+
+#define OVM_VEXTRACT(name, vtype, otype, dtype, ctype) \
+    OVMI_INSTR_EXEC(name) { \
+        OVM_VGET(vtype, a, instr->a); \
+        ctype lane = __ovm_v128_lane(a, instr->b); \
+        VAL(instr->r).u64 = 0; \
+        VAL(instr->r).dtype = lane; \
+        VAL(instr->r).type = otype; \
+        NEXT_OP; \
+    }
+
+OVM_VEXTRACT(vextract_i8,    ovm_u8x16, OVM_TYPE_I32, u32, u8)
+OVM_VEXTRACT(vextract_i16,   ovm_u16x8, OVM_TYPE_I32, u32, u16)
+OVM_VEXTRACT(vextract_i32,   ovm_u32x4, OVM_TYPE_I32, u32, u32)
+OVM_VEXTRACT(vextract_i64,   ovm_u64x2, OVM_TYPE_I64, u64, u64)
+OVM_VEXTRACT(vextract_f32,   ovm_f32x4, OVM_TYPE_F32, f32, f32)
+OVM_VEXTRACT(vextract_f64,   ovm_f64x2, OVM_TYPE_F64, f64, f64)
+OVM_VEXTRACT(vextract_s_i8,  ovm_i8x16, OVM_TYPE_I32, i32, i8)
+OVM_VEXTRACT(vextract_s_i16, ovm_i16x8, OVM_TYPE_I32, i32, i16)
+
+#undef OVM_VEXTRACT
+
+#define OVM_VREPLACE(t, vtype, ctype) \
+    OVMI_INSTR_EXEC(vreplace_##t) { \
+        OVM_VGET(vtype, r, instr->a); \
+        __ovm_v128_lane(r, OVM_INSTR_LANE(*instr)) = VAL(instr->b).ctype; \
+        OVM_VSET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+OVM_VREPLACE(i8,  ovm_i8x16, i8)
+OVM_VREPLACE(i16, ovm_i16x8, i16)
+OVM_VREPLACE(i32, ovm_i32x4, i32)
+OVM_VREPLACE(i64, ovm_i64x2, i64)
+OVM_VREPLACE(f32, ovm_f32x4, f32)
+OVM_VREPLACE(f64, ovm_f64x2, f64)
+
+#undef OVM_VREPLACE
+
+OVM_VOP_BINARY(vswizzle, ovm_u8x16, __ovm_v128_swizzle(a, b))
+
+OVM_VOP_UNARY(vnot,     ovm_u64x2, ~a)
+OVM_VOP_BINARY(vand,    ovm_u64x2, a & b)
+OVM_VOP_BINARY(vandnot, ovm_u64x2, a & ~b)
+OVM_VOP_BINARY(vor,     ovm_u64x2, a | b)
+OVM_VOP_BINARY(vxor,    ovm_u64x2, a ^ b)
+
+OVMI_INSTR_EXEC(vany_true) {
+    OVM_VGET(ovm_u64x2, a, instr->a);
+    VAL(instr->r).u64 = 0;
+    VAL(instr->r).i32 = (a[0] | a[1]) != 0;
+    VAL(instr->r).type = OVM_TYPE_I32;
+    NEXT_OP;
+}
+
+#define OVM_VALL_TRUE(t, vtype) \
+    OVMI_INSTR_EXEC(vall_true_##t) { \
+        OVM_VGET(vtype, a, instr->a); \
+        ovm_u64x2 zeros = (ovm_u64x2) (a == 0); \
+        VAL(instr->r).u64 = 0; \
+        VAL(instr->r).i32 = (zeros[0] | zeros[1]) == 0; \
+        VAL(instr->r).type = OVM_TYPE_I32; \
+        NEXT_OP; \
+    }
+
+OVM_VALL_TRUE(i8,  ovm_i8x16)
+OVM_VALL_TRUE(i16, ovm_i16x8)
+OVM_VALL_TRUE(i32, ovm_i32x4)
+OVM_VALL_TRUE(i64, ovm_i64x2)
+
+#undef OVM_VALL_TRUE
+
+#define OVM_VBITMASK(t, vtype, lanes) \
+    OVMI_INSTR_EXEC(vbitmask_##t) { \
+        OVM_VGET(vtype, a, instr->a); \
+        i32 mask = 0; \
+        fori (i, 0, lanes) mask |= (a[i] < 0) << i; \
+        VAL(instr->r).u64 = 0; \
+        VAL(instr->r).i32 = mask; \
+        VAL(instr->r).type = OVM_TYPE_I32; \
+        NEXT_OP; \
+    }
+
+OVM_VBITMASK(i16, ovm_i16x8, 8)
+OVM_VBITMASK(i32, ovm_i32x4, 4)
+OVM_VBITMASK(i64, ovm_i64x2, 2)
+
+#undef OVM_VBITMASK
+
+OVMI_INSTR_EXEC(vbitmask_i8) {
+    OVM_VGET(ovm_i8x16, a, instr->a);
+    VAL(instr->r).u64 = 0;
+    VAL(instr->r).i32 = __ovm_v128_bitmask_i8(a);
+    VAL(instr->r).type = OVM_TYPE_I32;
+    NEXT_OP;
+}
+
+OVM_VOP_SIGNED(OVM_VOP_BINARY,   veq,   a == b)
+OVM_VOP_FLOAT(OVM_VOP_BINARY,    veq,   a == b)
+OVM_VOP_SIGNED(OVM_VOP_BINARY,   vne,   a != b)
+OVM_VOP_FLOAT(OVM_VOP_BINARY,    vne,   a != b)
+OVM_VOP_UNSIGNED(OVM_VOP_BINARY, vlt,   a < b)
+OVM_VOP_FLOAT(OVM_VOP_BINARY,    vlt,   a < b)
+OVM_VOP_SIGNED(OVM_VOP_BINARY,   vlt_s, a < b)
+OVM_VOP_UNSIGNED(OVM_VOP_BINARY, vle,   a <= b)
+OVM_VOP_FLOAT(OVM_VOP_BINARY,    vle,   a <= b)
+OVM_VOP_SIGNED(OVM_VOP_BINARY,   vle_s, a <= b)
+OVM_VOP_UNSIGNED(OVM_VOP_BINARY, vgt,   a > b)
+OVM_VOP_FLOAT(OVM_VOP_BINARY,    vgt,   a > b)
+OVM_VOP_SIGNED(OVM_VOP_BINARY,   vgt_s, a > b)
+OVM_VOP_UNSIGNED(OVM_VOP_BINARY, vge,   a >= b)
+OVM_VOP_FLOAT(OVM_VOP_BINARY,    vge,   a >= b)
+OVM_VOP_SIGNED(OVM_VOP_BINARY,   vge_s, a >= b)
+
+OVM_VOP_UNARY(vabs_i8,  ovm_i8x16, (a ^ (a >> 7))  - (a >> 7))
+OVM_VOP_UNARY(vabs_i16, ovm_i16x8, (a ^ (a >> 15)) - (a >> 15))
+OVM_VOP_UNARY(vabs_i32, ovm_i32x4, (a ^ (a >> 31)) - (a >> 31))
+OVM_VOP_UNARY(vabs_i64, ovm_i64x2, (a ^ (a >> 63)) - (a >> 63))
+OVM_VOP_UNARY(vabs_f32, ovm_f32x4, (ovm_u32x4) a & 0x7fffffffu)
+OVM_VOP_UNARY(vabs_f64, ovm_f64x2, (ovm_u64x2) a & 0x7fffffffffffffffull)
+
+OVM_VOP_SIGNED(OVM_VOP_UNARY, vneg, -a)
+OVM_VOP_FLOAT(OVM_VOP_UNARY,  vneg, -a)
+
+#if defined(__x86_64__)
+OVM_VOP_UNARY(vsqrt_f32, ovm_f32x4, _mm_sqrt_ps((__m128) a))
+OVM_VOP_UNARY(vsqrt_f64, ovm_f64x2, _mm_sqrt_pd((__m128d) a))
+#else
+OVM_VOP_UNARY(vsqrt_f32, ovm_f32x4, vsqrtq_f32((float32x4_t) a))
+OVM_VOP_UNARY(vsqrt_f64, ovm_f64x2, vsqrtq_f64((float64x2_t) a))
+#endif
+
+OVM_VOP_SIGNED(OVM_VOP_BINARY, vadd, a + b)
+OVM_VOP_FLOAT(OVM_VOP_BINARY,  vadd, a + b)
+OVM_VOP_SIGNED(OVM_VOP_BINARY, vsub, a - b)
+OVM_VOP_FLOAT(OVM_VOP_BINARY,  vsub, a - b)
+OVM_VOP_SIGNED(OVM_VOP_BINARY, vmul, a * b)
+OVM_VOP_FLOAT(OVM_VOP_BINARY,  vmul, a * b)
+OVM_VOP_FLOAT(OVM_VOP_BINARY,  vdiv, a / b)
+
+OVM_VOP_BINARY(vadd_sat_i8,    ovm_i8x16, __ovm_v128_add_sat_i8(a, b))
+OVM_VOP_BINARY(vadd_sat_i16,   ovm_i8x16, __ovm_v128_add_sat_i16(a, b))
+OVM_VOP_BINARY(vadd_sat_s_i8,  ovm_i8x16, __ovm_v128_add_sat_s_i8(a, b))
+OVM_VOP_BINARY(vadd_sat_s_i16, ovm_i8x16, __ovm_v128_add_sat_s_i16(a, b))
+OVM_VOP_BINARY(vsub_sat_i8,    ovm_i8x16, __ovm_v128_sub_sat_i8(a, b))
+OVM_VOP_BINARY(vsub_sat_i16,   ovm_i8x16, __ovm_v128_sub_sat_i16(a, b))
+OVM_VOP_BINARY(vsub_sat_s_i8,  ovm_i8x16, __ovm_v128_sub_sat_s_i8(a, b))
+OVM_VOP_BINARY(vsub_sat_s_i16, ovm_i8x16, __ovm_v128_sub_sat_s_i16(a, b))
+OVM_VOP_BINARY(vavgr_i8,       ovm_i8x16, __ovm_v128_avgr_i8(a, b))
+OVM_VOP_BINARY(vavgr_i16,      ovm_i8x16, __ovm_v128_avgr_i16(a, b))
+
+OVM_VOP_UNSIGNED(OVM_VOP_BINARY, vmin,   (a & (__typeof__(a)) (a < b)) | (b & ~(__typeof__(a)) (a < b)))
+OVM_VOP_SIGNED(OVM_VOP_BINARY,   vmin_s, (a & (__typeof__(a)) (a < b)) | (b & ~(__typeof__(a)) (a < b)))
+OVM_VOP_UNSIGNED(OVM_VOP_BINARY, vmax,   (a & (__typeof__(a)) (a > b)) | (b & ~(__typeof__(a)) (a > b)))
+OVM_VOP_SIGNED(OVM_VOP_BINARY,   vmax_s, (a & (__typeof__(a)) (a > b)) | (b & ~(__typeof__(a)) (a > b)))
+OVM_VOP_BINARY(vmin_f32, ovm_f32x4, __ovm_v128_min_f32(a, b))
+OVM_VOP_BINARY(vmin_f64, ovm_f64x2, __ovm_v128_min_f64(a, b))
+OVM_VOP_BINARY(vmax_f32, ovm_f32x4, __ovm_v128_max_f32(a, b))
+OVM_VOP_BINARY(vmax_f64, ovm_f64x2, __ovm_v128_max_f64(a, b))
+
+OVM_VOP_SHIFT(vshl_i8,  ovm_i8x16, 8,  <<)
+OVM_VOP_SHIFT(vshl_i16, ovm_i16x8, 16, <<)
+OVM_VOP_SHIFT(vshl_i32, ovm_i32x4, 32, <<)
+OVM_VOP_SHIFT(vshl_i64, ovm_i64x2, 64, <<)
+OVM_VOP_SHIFT(vshr_i8,  ovm_u8x16, 8,  >>)
+OVM_VOP_SHIFT(vshr_i16, ovm_u16x8, 16, >>)
+OVM_VOP_SHIFT(vshr_i32, ovm_u32x4, 32, >>)
+OVM_VOP_SHIFT(vshr_i64, ovm_u64x2, 64, >>)
+OVM_VOP_SHIFT(vsar_i8,  ovm_i8x16, 8,  >>)
+OVM_VOP_SHIFT(vsar_i16, ovm_i16x8, 16, >>)
+OVM_VOP_SHIFT(vsar_i32, ovm_i32x4, 32, >>)
+OVM_VOP_SHIFT(vsar_i64, ovm_i64x2, 64, >>)
+
+OVM_VOP_BINARY(vnarrow_i8,    ovm_i8x16, __ovm_v128_narrow_i8(a, b))
+OVM_VOP_BINARY(vnarrow_i16,   ovm_i8x16, __ovm_v128_narrow_i16(a, b))
+OVM_VOP_BINARY(vnarrow_s_i8,  ovm_i8x16, __ovm_v128_narrow_s_i8(a, b))
+OVM_VOP_BINARY(vnarrow_s_i16, ovm_i8x16, __ovm_v128_narrow_s_i16(a, b))
+
+#define OVM_VWIDEN(name, stype, dtype, lanes, offset) \
+    OVMI_INSTR_EXEC(name) { \
+        OVM_VGET(stype, a, instr->a); \
+        dtype r; \
+        fori (i, 0, lanes) r[i] = a[i + offset]; \
+        OVM_VSET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+OVM_VWIDEN(vwiden_low_i16,    ovm_u8x16, ovm_u16x8, 8, 0)
+OVM_VWIDEN(vwiden_low_i32,    ovm_u16x8, ovm_u32x4, 4, 0)
+OVM_VWIDEN(vwiden_low_i64,    ovm_u32x4, ovm_u64x2, 2, 0)
+OVM_VWIDEN(vwiden_low_s_i16,  ovm_i8x16, ovm_i16x8, 8, 0)
+OVM_VWIDEN(vwiden_low_s_i32,  ovm_i16x8, ovm_i32x4, 4, 0)
+OVM_VWIDEN(vwiden_low_s_i64,  ovm_i32x4, ovm_i64x2, 2, 0)
+OVM_VWIDEN(vwiden_high_i16,   ovm_u8x16, ovm_u16x8, 8, 8)
+OVM_VWIDEN(vwiden_high_i32,   ovm_u16x8, ovm_u32x4, 4, 4)
+OVM_VWIDEN(vwiden_high_i64,   ovm_u32x4, ovm_u64x2, 2, 2)
+OVM_VWIDEN(vwiden_high_s_i16, ovm_i8x16, ovm_i16x8, 8, 8)
+OVM_VWIDEN(vwiden_high_s_i32, ovm_i16x8, ovm_i32x4, 4, 4)
+OVM_VWIDEN(vwiden_high_s_i64, ovm_i32x4, ovm_i64x2, 2, 2)
+
+#undef OVM_VWIDEN
+
+OVM_VOP_UNARY(vtrunc_sat_i32,   ovm_f32x4, __ovm_v128_trunc_sat_i32(a))
+OVM_VOP_UNARY(vtrunc_sat_s_i32, ovm_f32x4, __ovm_v128_trunc_sat_s_i32(a))
+OVM_VOP_UNARY(vconvert_f32,     ovm_u32x4, __builtin_convertvector(a, ovm_f32x4))
+OVM_VOP_UNARY(vconvert_s_f32,   ovm_i32x4, __builtin_convertvector(a, ovm_f32x4))
+
+#undef OVM_VGET
+#undef OVM_VSET
+#undef OVM_VOP_UNARY
+#undef OVM_VOP_BINARY
+#undef OVM_VOP_SHIFT
+#undef OVM_VOP_SIGNED
+#undef OVM_VOP_UNSIGNED
+#undef OVM_VOP_FLOAT
+
 
 OVMI_INSTR_EXEC(illegal) {
     OVMI_EXCEPTION_HOOK;
@@ -554,6 +1008,12 @@ OVMI_INSTR_EXEC(illegal) {
 #define IROW_INT(name)     NULL, NULL, NULL, D(name##_i32), D(name##_i64), NULL, NULL, NULL,
 #define IROW_FLOAT(name)   NULL, NULL, NULL, NULL, NULL, D(name##_f32), D(name##_f64), NULL,
 #define IROW_SAME(name)    D(name),D(name),D(name),D(name),D(name),D(name),D(name),NULL,
+#define IROW_MEMORY(name)  NULL, D(name##_i8), D(name##_i16), D(name##_i32), D(name##_i64), D(name##_f32), D(name##_f64), D(name##_v128),
+#define IROW_VINT(name)    NULL, D(name##_i8), D(name##_i16), D(name##_i32), D(name##_i64), NULL, NULL, NULL,
+#define IROW_VORDER(name)  NULL, D(name##_i8), D(name##_i16), D(name##_i32), NULL, D(name##_f32), D(name##_f64), NULL,
+#define IROW_VSMALL(name)  NULL, D(name##_i8), D(name##_i16), NULL, NULL, NULL, NULL, NULL,
+#define IROW_VWIDE(name)   NULL, NULL, D(name##_i16), D(name##_i32), D(name##_i64), NULL, NULL, NULL,
+#define IROW_ATOMIC(name)  NULL, D(name##_i8), D(name##_i16), D(name##_i32), D(name##_i64), NULL, NULL, NULL,
 
 static ovmi_instr_exec_t OVMI_DISPATCH_NAME[] = {
     IROW_UNTYPED(nop) // 0x00
@@ -574,8 +1034,8 @@ static ovmi_instr_exec_t OVMI_DISPATCH_NAME[] = {
     IROW_SAME(illegal)
     IROW_PARTIAL(imm) // 0x10
     IROW_UNTYPED(mov)
-    IROW_TYPED(load)
-    IROW_TYPED(store)
+    IROW_MEMORY(load)
+    IROW_MEMORY(store)
     IROW_UNTYPED(copy)
     IROW_UNTYPED(fill)
     IROW_UNTYPED(reg_get)
@@ -632,10 +1092,87 @@ static ovmi_instr_exec_t OVMI_DISPATCH_NAME[] = {
     NULL, NULL, NULL, NULL, D(transmute_i64_f64), NULL, NULL, NULL,
     NULL, NULL, NULL, NULL, NULL, D(transmute_f32_i32), NULL, NULL,
     NULL, NULL, NULL, NULL, NULL, NULL, D(transmute_f64_i64), NULL,
-    IROW_INT(cmpxchg)
+    IROW_ATOMIC(cmpxchg)
     IROW_SAME(illegal)
     IROW_UNTYPED(mem_size)
     IROW_UNTYPED(mem_grow)
+    IROW_UNTYPED(vconst)  // 0x50
+    IROW_TYPED(vsplat)
+    IROW_TYPED(vextract)
+    IROW_VSMALL(vextract_s)
+    IROW_TYPED(vreplace)
+    IROW_UNTYPED(vswizzle)
+    IROW_UNTYPED(vnot)
+    IROW_UNTYPED(vand)
+    IROW_UNTYPED(vandnot)
+    IROW_UNTYPED(vor)
+    IROW_UNTYPED(vxor)
+    IROW_UNTYPED(vany_true)
+    IROW_VINT(vall_true)
+    IROW_VINT(vbitmask)
+    IROW_TYPED(veq)
+    IROW_TYPED(vne)
+    IROW_VORDER(vlt)  // 0x60
+    IROW_VINT(vlt_s)
+    IROW_VORDER(vle)
+    IROW_VINT(vle_s)
+    IROW_VORDER(vgt)
+    IROW_VINT(vgt_s)
+    IROW_VORDER(vge)
+    IROW_VINT(vge_s)
+    IROW_TYPED(vabs)
+    IROW_TYPED(vneg)
+    IROW_FLOAT(vsqrt)
+    IROW_TYPED(vadd)
+    IROW_VSMALL(vadd_sat)
+    IROW_VSMALL(vadd_sat_s)
+    IROW_TYPED(vsub)
+    IROW_VSMALL(vsub_sat)
+    IROW_VSMALL(vsub_sat_s)  // 0x70
+    IROW_TYPED(vmul)
+    IROW_FLOAT(vdiv)
+    IROW_VORDER(vmin)
+    IROW_VINT(vmin_s)
+    IROW_VORDER(vmax)
+    IROW_VINT(vmax_s)
+    IROW_VSMALL(vavgr)
+    IROW_VINT(vshl)
+    IROW_VINT(vshr)
+    IROW_VINT(vsar)
+    IROW_VSMALL(vnarrow)
+    IROW_VSMALL(vnarrow_s)
+    IROW_VWIDE(vwiden_low)
+    IROW_VWIDE(vwiden_low_s)
+    IROW_VWIDE(vwiden_high)
+    IROW_VWIDE(vwiden_high_s)  // 0x80
+    NULL, NULL, NULL, D(vtrunc_sat_i32), NULL, NULL, NULL, NULL,
+    NULL, NULL, NULL, D(vtrunc_sat_s_i32), NULL, NULL, NULL, NULL,
+    NULL, NULL, NULL, NULL, NULL, D(vconvert_f32), NULL, NULL,
+    NULL, NULL, NULL, NULL, NULL, D(vconvert_s_f32), NULL, NULL,
+    IROW_ATOMIC(atomic_load)
+    IROW_ATOMIC(atomic_store)
+    IROW_ATOMIC(atomic_add)
+    IROW_ATOMIC(atomic_sub)
+    IROW_ATOMIC(atomic_and)
+    IROW_ATOMIC(atomic_or)
+    IROW_ATOMIC(atomic_xor)
+    IROW_ATOMIC(atomic_xchg)
+    IROW_INT(atomic_wait)
+    IROW_UNTYPED(atomic_notify)
+    IROW_UNTYPED(atomic_fence)
+    IROW_INT(add_imm)  // 0x90
+    IROW_INT(br_lt)
+    IROW_INT(br_lt_s)
+    IROW_INT(br_le)
+    IROW_INT(br_le_s)
+    IROW_INT(br_eq)
+    IROW_INT(br_ge)
+    IROW_INT(br_ge_s)
+    IROW_INT(br_gt)
+    IROW_INT(br_gt_s)
+    IROW_INT(br_ne)
+
+    IROW_UNTYPED(translate)
 };
 
 #undef D
@@ -645,6 +1182,12 @@ static ovmi_instr_exec_t OVMI_DISPATCH_NAME[] = {
 #undef IROW_INT
 #undef IROW_FLOAT
 #undef IROW_SAME
+#undef IROW_MEMORY
+#undef IROW_VINT
+#undef IROW_VORDER
+#undef IROW_VSMALL
+#undef IROW_VWIDE
+#undef IROW_ATOMIC
 
 #undef OVM_OP_EXEC
 #undef OVM_OP_UNSIGNED_EXEC
@@ -661,4 +1204,6 @@ static ovmi_instr_exec_t OVMI_DISPATCH_NAME[] = {
 #undef OVMI_DEBUG_HOOK
 #undef OVMI_EXCEPTION_HOOK
 #undef OVMI_DIVIDE_CHECK_HOOK
+#undef OVMI_JIT_CALL_HOOK
+#undef OVMI_JIT_BACKEDGE_HOOK
 
@@ -5,6 +5,10 @@ wasm_config_t *wasm_config_new() {
     wasm_config_t *config = malloc(sizeof(*config));
     config->debug_enabled = false;
     config->listen_path   = "/tmp/ovm-debug.0000";
+    config->image_cache_dir = NULL;
+    config->lazy_translation = true;
+    config->jit_enabled = true;
+    config->profile_path = NULL;
     return config;
 }
 
@@ -20,3 +24,19 @@ void wasm_config_set_listen_path(wasm_config_t *config, char *listen_path) {
     config->listen_path = listen_path;
 }
 
+
+void wasm_config_set_image_cache_dir(wasm_config_t *config, char *image_cache_dir) {
+    config->image_cache_dir = image_cache_dir;
+}
+
+void wasm_config_enable_lazy_translation(wasm_config_t *config, bool enabled) {
+    config->lazy_translation = enabled;
+}
+
+void wasm_config_enable_jit(wasm_config_t *config, bool enabled) {
+    config->jit_enabled = enabled;
+}
+
+void wasm_config_set_profile_path(wasm_config_t *config, char *profile_path) {
+    config->profile_path = profile_path;
+}
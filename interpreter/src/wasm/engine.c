@@ -26,6 +26,9 @@ wasm_engine_t *wasm_engine_new_with_config(wasm_config_t *config) {
         debug->listen_path = config->listen_path;
 
         debug_host_start(engine->engine->debug);
+
+    } else if (config && config->profile_path) {
+        ovm_engine_enable_profiler(engine->engine, ovm_profiler_new(config->profile_path));
     }
 
     return engine;
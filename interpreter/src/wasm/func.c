@@ -10,6 +10,7 @@ wasm_func_t *wasm_func_new(wasm_store_t *store, const wasm_functype_t *type, was
     func->inner.func.env = NULL;
     func->inner.func.func_ptr = (void (*)()) callback;
     func->inner.func.finalizer = NULL;
+    func->inner.func.direct_func_ptr = NULL;
 
     return func;
 }
@@ -24,10 +25,18 @@ wasm_func_t *wasm_func_new_with_env(wasm_store_t *store, const wasm_functype_t *
     func->inner.func.env = env;
     func->inner.func.func_ptr = (void (*)()) callback;
     func->inner.func.finalizer = finalizer;
+    func->inner.func.direct_func_ptr = NULL;
 
     return func;
 }
 
+//
+// `direct` is an OnyxDirectFunc from onyx_library.h, which takes values
+// with the same layout as ovm_value_t.
+void wasm_func_set_onyx_direct(wasm_func_t *func, void *direct) {
+    func->inner.func.direct_func_ptr = (void (*)(ovm_value_t *, ovm_value_t *, char *)) direct;
+}
+
 wasm_functype_t *wasm_func_type(const wasm_func_t *func) {
     return (wasm_functype_t *) func->inner.func.type;
 }
@@ -5,6 +5,7 @@
 #include <alloca.h>
 
 static_assert(sizeof(ovm_value_t) == sizeof(wasm_val_t), "Size of ovm_value_t should match size of wasm_val_t");
+static_assert(offsetof(ovm_value_t, type) == 8, "OnyxValue in onyx_library.h relies on the layout of ovm_value_t");
 
 typedef struct wasm_ovm_binding wasm_ovm_binding;
 struct wasm_ovm_binding {
@@ -14,6 +15,9 @@ struct wasm_ovm_binding {
     ovm_program_t *program;
 
     wasm_instance_t *instance;
+
+    // Taken from the signature, because a vector result has no type of its own.
+    bool returns_v128;
 };
 
 typedef struct ovm_wasm_binding ovm_wasm_binding;
@@ -22,6 +26,10 @@ struct ovm_wasm_binding {
     int result_count;
     wasm_func_t *func;
     wasm_val_vec_t param_buffer;
+
+    // Only used by direct bindings.
+    ovm_engine_t *engine;
+    ovm_valtype_t result_type;
 };
 
 #define WASM_TO_OVM(w, o) { \
@@ -106,10 +114,11 @@ static wasm_trap_t *wasm_to_ovm_func_call_binding(void *vbinding, const wasm_val
         WASM_TO_OVM(args->data[i], vals[i]);
     }
 
+    binding->state->trapped = false;
     ovm_value_t ovm_res = ovm_func_call(binding->engine, binding->state, binding->program, binding->func_idx, args->size, vals);
 
     // Check for error (trap).
-    if (ovm_res.type == OVM_TYPE_ERR) {
+    if (binding->state->trapped) {
         wasm_byte_vec_t msg;
         wasm_byte_vec_new(&msg, 9, "Hit error");
         wasm_trap_t *trap = wasm_trap_new(binding->instance->store, (void *) &msg);
@@ -118,6 +127,13 @@ static wasm_trap_t *wasm_to_ovm_func_call_binding(void *vbinding, const wasm_val
 
     if (!res || res->size == 0) return NULL;
 
+    // wasm_val_t has no room for a vector.
+    if (binding->returns_v128) {
+        wasm_byte_vec_t msg;
+        wasm_byte_vec_new(&msg, 38, "Cannot return a v128 through the C API");
+        return wasm_trap_new(binding->instance->store, (void *) &msg);
+    }
+
     OVM_TO_WASM(ovm_res, res->data[0]);
 
     return NULL;
@@ -144,6 +160,32 @@ static void ovm_to_wasm_func_call_binding(void *env, ovm_value_t* params, ovm_va
     }
 }
 
+//
+// Functions defined with ONYX_DEF_DIRECT take the interpreter's values as they
+// are, so only the type of the result needs to be filled in. The memory base
+// is read on every call, because growing memory can move it.
+static void ovm_direct_func_call_binding(void *env, ovm_value_t* params, ovm_value_t *res) {
+    ovm_wasm_binding *binding = (ovm_wasm_binding *) env;
+
+    binding->func->inner.func.direct_func_ptr(params, res, (char *) binding->engine->memory);
+
+    // A vector result fills the whole value, including the type.
+    if (binding->result_count > 0 && binding->result_type != OVM_TYPE_V128) {
+        res->type = binding->result_type;
+    }
+}
+
+static ovm_valtype_t wasm_valkind_to_ovm_type(wasm_valkind_t kind) {
+    switch (kind) {
+        case WASM_I32: return OVM_TYPE_I32;
+        case WASM_I64: return OVM_TYPE_I64;
+        case WASM_F32: return OVM_TYPE_F32;
+        case WASM_F64: return OVM_TYPE_F64;
+        case WASM_V128: return OVM_TYPE_V128;
+        default:       return OVM_TYPE_NONE;
+    }
+}
+
 static void wasm_memory_init(void *env, ovm_value_t* params, ovm_value_t *res) {
     wasm_instance_t *instr = (wasm_instance_t *) env;
 
@@ -155,7 +197,27 @@ static void wasm_memory_init(void *env, ovm_value_t* params, ovm_value_t *res) {
     ovm_engine_memory_copy(instr->store->engine->engine, params[0].i32, instr->module->data_entries[params[3].i32].data, params[2].i32);
 }
 
-static void prepare_instance(wasm_instance_t *instance, const wasm_extern_vec_t *imports) {
+//
+// Only direct functions can take or return vectors, because wasm_val_t has no
+// room for one. Other imports that do fail instantiation.
+static wasm_trap_t *check_import_has_no_vectors(wasm_instance_t *instance, wasm_importtype_t *importtype) {
+    struct wasm_functype_inner_t *functype = &importtype->type->func;
+
+    bool uses_v128 = false;
+    fori (p, 0, (int) functype->params.size)  uses_v128 |= functype->params.data[p]->kind == WASM_V128;
+    fori (r, 0, (int) functype->results.size) uses_v128 |= functype->results.data[r]->kind == WASM_V128;
+    if (!uses_v128) return NULL;
+
+    char *text = bh_bprintf("Cannot import '%b.%b': v128 parameters and results need a direct function",
+        importtype->module_name.data, importtype->module_name.size,
+        importtype->import_name.data, importtype->import_name.size);
+
+    wasm_byte_vec_t msg;
+    wasm_byte_vec_new(&msg, strlen(text), text);
+    return wasm_trap_new(instance->store, (void *) &msg);
+}
+
+static wasm_trap_t *prepare_instance(wasm_instance_t *instance, const wasm_extern_vec_t *imports) {
     ovm_store_t   *ovm_store   = instance->store->engine->store;
     ovm_engine_t  *ovm_engine  = instance->store->engine->engine;
     ovm_state_t   *ovm_state   = instance->state;
@@ -186,6 +248,20 @@ static void prepare_instance(wasm_instance_t *instance, const wasm_extern_vec_t
                 binding->func         = func;
                 binding->param_buffer.data = bh_alloc(ovm_store->arena_allocator, sizeof(wasm_val_t) * binding->param_count);
                 binding->param_buffer.size = binding->param_count;
+                binding->engine       = ovm_engine;
+                binding->result_type  = OVM_TYPE_NONE;
+
+                if (func->inner.func.direct_func_ptr) {
+                    if (binding->result_count > 0) {
+                        binding->result_type = wasm_valkind_to_ovm_type(functype->results.data[0]->kind);
+                    }
+
+                    ovm_state_register_external_func(ovm_state, importtype->external_func_idx, ovm_direct_func_call_binding, binding);
+                    break;
+                }
+
+                wasm_trap_t *vector_trap = check_import_has_no_vectors(instance, importtype);
+                if (vector_trap) return vector_trap;
 
                 ovm_state_register_external_func(ovm_state, importtype->external_func_idx, ovm_to_wasm_func_call_binding, binding);
                 break;
@@ -238,6 +314,9 @@ static void prepare_instance(wasm_instance_t *instance, const wasm_extern_vec_t
         binding->state    = ovm_state;
         binding->instance = instance;
 
+        const wasm_valtype_vec_t *results = wasm_functype_results(instance->module->functypes.data[i]);
+        binding->returns_v128 = results->size > 0 && results->data[0]->kind == WASM_V128;
+
         wasm_func_t *func = wasm_func_new_with_env(instance->store, instance->module->functypes.data[i],
             wasm_to_ovm_func_call_binding, binding, NULL);
 
@@ -322,6 +401,8 @@ static void prepare_instance(wasm_instance_t *instance, const wasm_extern_vec_t
             }
         }
     }
+
+    return NULL;
 }
 
 wasm_instance_t *wasm_instance_new(wasm_store_t *store, const wasm_module_t *module,
@@ -346,7 +427,20 @@ wasm_instance_t *wasm_instance_new(wasm_store_t *store, const wasm_module_t *mod
 
     instance->state = ovm_state_new(store->engine->engine, module->program);
 
-    prepare_instance(instance, imports);
+    wasm_trap_t *prepare_trap = prepare_instance(instance, imports);
+    if (prepare_trap) {
+        if (trap) *trap = prepare_trap;
+
+        bh_arr_free(instance->funcs);
+        bh_arr_free(instance->memories);
+        bh_arr_free(instance->globals);
+        bh_arr_free(instance->tables);
+        ovm_state_delete(instance->state);
+
+        if (store->instance == instance) store->instance = NULL;
+        bh_free(store->engine->store->heap_allocator, instance);
+        return NULL;
+    }
 
     assert(bh_arr_length(instance->memories) == 1);
     u32 memory_size = (instance->memories[0]->inner.type->memory.limits.min) * MEMORY_PAGE_SIZE;
@@ -6,6 +6,60 @@
 
 #include "./module_parsing.h"
 
+#include <sys/stat.h>
+
+//
+// The functions a program translated are cached in the directory set with
+// wasm_config_set_image_cache_dir, in a file named after the hash of the
+// module binary. Images only hold lazily translated functions, so the cache
+// is not used when debugging or profiling, which translate everything up
+// front for their line information.
+//
+static char *module_image_cache_path(wasm_module_t *module, const wasm_byte_vec_t *binary, u64 *out_hash) {
+    wasm_engine_t *engine = module->store->engine;
+    if (!engine->config || !engine->config->image_cache_dir) return NULL;
+
+    u64 module_hash = ovm_image_hash(0xcbf29ce484222325ull, binary->data, binary->size);
+    *out_hash = module_hash;
+
+    char hash_text[17];
+    snprintf(hash_text, 17, "%016llx", (unsigned long long) module_hash);
+    return bh_aprintf(bh_heap_allocator(), "%s/%s.ovmi", engine->config->image_cache_dir, hash_text);
+}
+
+//
+// Whatever else was translated is added to the image when the module is
+// deleted. Most programs end by calling exit from a host function instead,
+// so the image is also written when the process exits, like the profile.
+//
+static wasm_module_t *exit_image_module = NULL;
+
+static void module_write_image(wasm_module_t *module, bool at_exit) {
+    if (!module->image_path) return;
+
+    // At exit, another thread can still be translating. Its function is left
+    // for the next run instead of waiting for it.
+    ovm_program_t *program = module->program;
+    if (at_exit) {
+        if (pthread_mutex_trylock(&program->translate_mutex) != 0) return;
+    } else {
+        pthread_mutex_lock(&program->translate_mutex);
+    }
+
+    mkdir(module->store->engine->config->image_cache_dir, 0755);
+    ovm_program_image_write(&module->image_layout, program,
+        module->lazy_func_base, module->functypes.size, module->image_path, module->image_hash);
+
+    pthread_mutex_unlock(&program->translate_mutex);
+
+    bh_free(bh_heap_allocator(), module->image_path);
+    module->image_path = NULL;
+}
+
+static void module_write_image_at_exit() {
+    if (exit_image_module) module_write_image(exit_image_module, true);
+}
+
 static bool module_build(wasm_module_t *module, const wasm_byte_vec_t *binary) {
     wasm_engine_t *engine = module->store->engine;
     module->program = ovm_program_new(engine->store);
@@ -21,10 +75,61 @@ static bool module_build(wasm_module_t *module, const wasm_byte_vec_t *binary) {
     debug_info_builder_init(&ctx.debug_builder, &module->debug_info);
     sh_new_arena(module->custom_sections);
 
+    //
+    // Functions are translated lazily, unless the whole program is needed
+    // for the line tables used by the debugger and the profiler.
+    ctx.lazy = !engine->engine->debug && !engine->engine->profiler
+        && (!engine->config || engine->config->lazy_translation);
+
+    if (ctx.lazy) {
+        ovm_program_use_fixed_storage(module->program);
+        module->program->translate_func = translate_lazy_func;
+        module->program->translate_userdata = module;
+    }
+
+    //
+    // Native code skips the debug hooks, so it is only used without the debugger.
+    module->program->jit_enabled = !engine->engine->debug && !engine->engine->profiler
+        && (!engine->config || engine->config->jit_enabled);
+
+    if (engine->engine->profiler) {
+        ovm_profiler_attach_program(engine->engine->profiler, module->program, &module->debug_info);
+    }
+
     while (ctx.offset < binary->size) {
         parse_section(&ctx);
     }
 
+    //
+    // The functions translated by an earlier run are mapped in, and used
+    // instead of their stubs. See module_write_image for the rest.
+    if (ctx.lazy && module->lazy_body_offsets) {
+        module->image_path = module_image_cache_path(module, binary, &module->image_hash);
+    }
+
+    if (module->image_path) {
+        ovm_program_image_prepare(&module->image_layout, module->program);
+
+        ovm_program_image_t cached_image;
+        if (ovm_program_image_map(&cached_image, module->image_path, module->image_hash)) {
+            if (ovm_program_image_apply(&cached_image, module->program, module->lazy_func_base, module->functypes.size)) {
+                module->image_layout.func_count = cached_image.func_count;
+            }
+
+            ovm_program_image_unmap(&cached_image);
+        }
+
+        if (!exit_image_module) {
+            static bool exit_hook_registered = false;
+            if (!exit_hook_registered) {
+                atexit(module_write_image_at_exit);
+                exit_hook_registered = true;
+            }
+
+            exit_image_module = module;
+        }
+    }
+
     // TODO: This is not correct when the module imports a global.
     // But Onyx does not do this, so I don't care at the moment.
     module->program->register_count = module->globaltypes.size;
@@ -81,11 +186,30 @@ wasm_module_t *wasm_module_new(wasm_store_t *store, const wasm_byte_vec_t *binar
     }
 
     bool success = module_build(module, binary); 
+
+    if (store->engine->engine->debug) {
+        debug_info_build_line_starts(&module->debug_info);
+        debug_host_prepare_breakpoints(store->engine->engine->debug, bh_arr_length(module->program->code));
+    }
     return module;
 }
 
 void wasm_module_delete(wasm_module_t *module) {
+    ovm_profiler_t *profiler = module->store->engine->engine->profiler;
+    if (profiler && profiler->program == module->program) {
+        ovm_profiler_write(profiler);
+        profiler->program = NULL;
+    }
+
+    if (exit_image_module == module) exit_image_module = NULL;
+    module_write_image(module, false);
+
     ovm_program_delete(module->program);
+
+    if (module->lazy_body_offsets) {
+        wasm_byte_vec_delete(&module->lazy_code);
+        free(module->lazy_body_offsets);
+    }
 }
 
 bool wasm_module_validate(wasm_store_t *store, const wasm_byte_vec_t *binary) {
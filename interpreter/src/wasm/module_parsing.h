@@ -23,6 +23,10 @@ struct build_context {
 
     debug_info_builder_t debug_builder;
 
+    // When set, function bodies are only translated when they are first
+    // called. See translate_lazy_func.
+    bool lazy;
+
     // This will be set/reset for every code (function) entry.
     ovm_code_builder_t builder;
 };
@@ -52,7 +56,7 @@ static inline wasm_valkind_t parse_valtype(build_context *ctx) {
         case 0x7e: return WASM_I64;
         case 0x7d: return WASM_F32;
         case 0x7c: return WASM_F64;
-        case 0x7b: assert(0 && "SIMD values are not currently supported");
+        case 0x7b: return WASM_V128;
         case 0x70: return WASM_FUNCREF;
         case 0x6F: return WASM_ANYREF;
         default:   assert(0 && "Invalid valtype.");
@@ -453,6 +457,32 @@ static void parse_fe_instruction(build_context *ctx) {
     int instr_num = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
 
     switch (instr_num) {
+        case 0x00: {
+            int alignment = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+            int offset    = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+            ovm_code_builder_add_atomic_notify(&ctx->builder, offset);
+            break;
+        }
+
+        case 0x01: {
+            int alignment = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+            int offset    = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+            ovm_code_builder_add_atomic_wait(&ctx->builder, OVM_TYPE_I32, offset);
+            break;
+        }
+
+        case 0x02: {
+            int alignment = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+            int offset    = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+            ovm_code_builder_add_atomic_wait(&ctx->builder, OVM_TYPE_I64, offset);
+            break;
+        }
+
+        case 0x03: {
+            assert(CONSUME_BYTE(ctx) == 0x00);
+            ovm_code_builder_add_atomic_fence(&ctx->builder);
+            break;
+        }
 
 #define LOAD_CASE(num, type) \
         case num : { \
@@ -490,6 +520,33 @@ static void parse_fe_instruction(build_context *ctx) {
 
 #undef STORE_CASE
 
+#define RMW_CASES(base, instr) \
+        RMW_CASE(base + 0, instr, OVM_TYPE_I32) \
+        RMW_CASE(base + 1, instr, OVM_TYPE_I64) \
+        RMW_CASE(base + 2, instr, OVM_TYPE_I8) \
+        RMW_CASE(base + 3, instr, OVM_TYPE_I16) \
+        RMW_CASE(base + 4, instr, OVM_TYPE_I8) \
+        RMW_CASE(base + 5, instr, OVM_TYPE_I16) \
+        RMW_CASE(base + 6, instr, OVM_TYPE_I32)
+
+#define RMW_CASE(num, instr, type) \
+        case num : { \
+            int alignment = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset); \
+            int offset    = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset); \
+            ovm_code_builder_add_atomic_rmw(&ctx->builder, instr, type, offset); \
+            break; \
+        }
+
+        RMW_CASES(0x1E, OVMI_ATOMIC_ADD)
+        RMW_CASES(0x25, OVMI_ATOMIC_SUB)
+        RMW_CASES(0x2C, OVMI_ATOMIC_AND)
+        RMW_CASES(0x33, OVMI_ATOMIC_OR)
+        RMW_CASES(0x3A, OVMI_ATOMIC_XOR)
+        RMW_CASES(0x41, OVMI_ATOMIC_XCHG)
+
+#undef RMW_CASE
+#undef RMW_CASES
+
 #define CMPXCHG_CASE(num, type) \
         case num : { \
             int alignment = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset); \
@@ -512,6 +569,232 @@ static void parse_fe_instruction(build_context *ctx) {
     }
 }
 
+static void parse_fd_instruction(build_context *ctx) {
+    int instr_num = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+
+    switch (instr_num) {
+        case 0: {
+            int alignment = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+            int offset    = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+            ovm_code_builder_add_load(&ctx->builder, OVM_TYPE_V128, offset);
+            break;
+        }
+
+        case 11: {
+            int alignment = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+            int offset    = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+            ovm_code_builder_add_store(&ctx->builder, OVM_TYPE_V128, offset);
+            break;
+        }
+
+        case 12: {
+            ovm_code_builder_add_vector_const(&ctx->builder, (u8 *) &ctx->binary.data[ctx->offset]);
+            ctx->offset += 16;
+            break;
+        }
+
+        case 13: {
+            ovm_code_builder_add_shuffle(&ctx->builder, (u8 *) &ctx->binary.data[ctx->offset]);
+            ctx->offset += 16;
+            break;
+        }
+
+#define UNOP(num, instr, type) \
+        case num: ovm_code_builder_add_unop(&ctx->builder, OVM_TYPED_INSTR(instr, type)); break;
+
+#define BINOP(num, instr, type) \
+        case num: ovm_code_builder_add_binop(&ctx->builder, OVM_TYPED_INSTR(instr, type)); break;
+
+#define EXTRACT(num, instr, type) \
+        case num: ovm_code_builder_add_extract_lane(&ctx->builder, OVM_TYPED_INSTR(instr, type), CONSUME_BYTE(ctx)); break;
+
+#define REPLACE(num, type) \
+        case num: ovm_code_builder_add_replace_lane(&ctx->builder, OVM_TYPED_INSTR(OVMI_VREPLACE, type), CONSUME_BYTE(ctx)); break;
+
+        BINOP(14, OVMI_VSWIZZLE, OVM_TYPE_NONE)
+        UNOP(15, OVMI_VSPLAT, OVM_TYPE_I8)
+        UNOP(16, OVMI_VSPLAT, OVM_TYPE_I16)
+        UNOP(17, OVMI_VSPLAT, OVM_TYPE_I32)
+        UNOP(18, OVMI_VSPLAT, OVM_TYPE_I64)
+        UNOP(19, OVMI_VSPLAT, OVM_TYPE_F32)
+        UNOP(20, OVMI_VSPLAT, OVM_TYPE_F64)
+
+        EXTRACT(21, OVMI_VEXTRACT_S, OVM_TYPE_I8)
+        EXTRACT(22, OVMI_VEXTRACT,   OVM_TYPE_I8)
+        REPLACE(23, OVM_TYPE_I8)
+        EXTRACT(24, OVMI_VEXTRACT_S, OVM_TYPE_I16)
+        EXTRACT(25, OVMI_VEXTRACT,   OVM_TYPE_I16)
+        REPLACE(26, OVM_TYPE_I16)
+        EXTRACT(27, OVMI_VEXTRACT,   OVM_TYPE_I32)
+        REPLACE(28, OVM_TYPE_I32)
+        EXTRACT(29, OVMI_VEXTRACT,   OVM_TYPE_I64)
+        REPLACE(30, OVM_TYPE_I64)
+        EXTRACT(31, OVMI_VEXTRACT,   OVM_TYPE_F32)
+        REPLACE(32, OVM_TYPE_F32)
+        EXTRACT(33, OVMI_VEXTRACT,   OVM_TYPE_F64)
+        REPLACE(34, OVM_TYPE_F64)
+
+#define INT_COMPARISONS(base, type) \
+        BINOP(base + 0, OVMI_VEQ,   type) \
+        BINOP(base + 1, OVMI_VNE,   type) \
+        BINOP(base + 2, OVMI_VLT_S, type) \
+        BINOP(base + 3, OVMI_VLT,   type) \
+        BINOP(base + 4, OVMI_VGT_S, type) \
+        BINOP(base + 5, OVMI_VGT,   type) \
+        BINOP(base + 6, OVMI_VLE_S, type) \
+        BINOP(base + 7, OVMI_VLE,   type) \
+        BINOP(base + 8, OVMI_VGE_S, type) \
+        BINOP(base + 9, OVMI_VGE,   type)
+
+#define FLOAT_COMPARISONS(base, type) \
+        BINOP(base + 0, OVMI_VEQ, type) \
+        BINOP(base + 1, OVMI_VNE, type) \
+        BINOP(base + 2, OVMI_VLT, type) \
+        BINOP(base + 3, OVMI_VGT, type) \
+        BINOP(base + 4, OVMI_VLE, type) \
+        BINOP(base + 5, OVMI_VGE, type)
+
+        INT_COMPARISONS(35, OVM_TYPE_I8)
+        INT_COMPARISONS(45, OVM_TYPE_I16)
+        INT_COMPARISONS(55, OVM_TYPE_I32)
+        FLOAT_COMPARISONS(65, OVM_TYPE_F32)
+        FLOAT_COMPARISONS(71, OVM_TYPE_F64)
+
+#undef INT_COMPARISONS
+#undef FLOAT_COMPARISONS
+
+        UNOP(77,  OVMI_VNOT,    OVM_TYPE_NONE)
+        BINOP(78, OVMI_VAND,    OVM_TYPE_NONE)
+        BINOP(79, OVMI_VANDNOT, OVM_TYPE_NONE)
+        BINOP(80, OVMI_VOR,     OVM_TYPE_NONE)
+        BINOP(81, OVMI_VXOR,    OVM_TYPE_NONE)
+        case 82: ovm_code_builder_add_bitselect(&ctx->builder); break;
+        UNOP(83,  OVMI_VANY_TRUE, OVM_TYPE_NONE)
+
+        //
+        // The compiler emits the any_true instructions from before they were
+        // merged into v128.any_true, so those are accepted too.
+
+        UNOP(96,   OVMI_VABS,       OVM_TYPE_I8)
+        UNOP(97,   OVMI_VNEG,       OVM_TYPE_I8)
+        UNOP(98,   OVMI_VANY_TRUE,  OVM_TYPE_NONE)
+        UNOP(99,   OVMI_VALL_TRUE,  OVM_TYPE_I8)
+        UNOP(100,  OVMI_VBITMASK,   OVM_TYPE_I8)
+        BINOP(101, OVMI_VNARROW_S,  OVM_TYPE_I8)
+        BINOP(102, OVMI_VNARROW,    OVM_TYPE_I8)
+        BINOP(107, OVMI_VSHL,       OVM_TYPE_I8)
+        BINOP(108, OVMI_VSAR,       OVM_TYPE_I8)
+        BINOP(109, OVMI_VSHR,       OVM_TYPE_I8)
+        BINOP(110, OVMI_VADD,       OVM_TYPE_I8)
+        BINOP(111, OVMI_VADD_SAT_S, OVM_TYPE_I8)
+        BINOP(112, OVMI_VADD_SAT,   OVM_TYPE_I8)
+        BINOP(113, OVMI_VSUB,       OVM_TYPE_I8)
+        BINOP(114, OVMI_VSUB_SAT_S, OVM_TYPE_I8)
+        BINOP(115, OVMI_VSUB_SAT,   OVM_TYPE_I8)
+        BINOP(118, OVMI_VMIN_S,     OVM_TYPE_I8)
+        BINOP(119, OVMI_VMIN,       OVM_TYPE_I8)
+        BINOP(120, OVMI_VMAX_S,     OVM_TYPE_I8)
+        BINOP(121, OVMI_VMAX,       OVM_TYPE_I8)
+        BINOP(123, OVMI_VAVGR,      OVM_TYPE_I8)
+
+        UNOP(128,  OVMI_VABS,          OVM_TYPE_I16)
+        UNOP(129,  OVMI_VNEG,          OVM_TYPE_I16)
+        UNOP(130,  OVMI_VANY_TRUE,     OVM_TYPE_NONE)
+        UNOP(131,  OVMI_VALL_TRUE,     OVM_TYPE_I16)
+        UNOP(132,  OVMI_VBITMASK,      OVM_TYPE_I16)
+        BINOP(133, OVMI_VNARROW_S,     OVM_TYPE_I16)
+        BINOP(134, OVMI_VNARROW,       OVM_TYPE_I16)
+        UNOP(135,  OVMI_VWIDEN_LOW_S,  OVM_TYPE_I16)
+        UNOP(136,  OVMI_VWIDEN_HIGH_S, OVM_TYPE_I16)
+        UNOP(137,  OVMI_VWIDEN_LOW,    OVM_TYPE_I16)
+        UNOP(138,  OVMI_VWIDEN_HIGH,   OVM_TYPE_I16)
+        BINOP(139, OVMI_VSHL,          OVM_TYPE_I16)
+        BINOP(140, OVMI_VSAR,          OVM_TYPE_I16)
+        BINOP(141, OVMI_VSHR,          OVM_TYPE_I16)
+        BINOP(142, OVMI_VADD,          OVM_TYPE_I16)
+        BINOP(143, OVMI_VADD_SAT_S,    OVM_TYPE_I16)
+        BINOP(144, OVMI_VADD_SAT,      OVM_TYPE_I16)
+        BINOP(145, OVMI_VSUB,          OVM_TYPE_I16)
+        BINOP(146, OVMI_VSUB_SAT_S,    OVM_TYPE_I16)
+        BINOP(147, OVMI_VSUB_SAT,      OVM_TYPE_I16)
+        BINOP(149, OVMI_VMUL,          OVM_TYPE_I16)
+        BINOP(150, OVMI_VMIN_S,        OVM_TYPE_I16)
+        BINOP(151, OVMI_VMIN,          OVM_TYPE_I16)
+        BINOP(152, OVMI_VMAX_S,        OVM_TYPE_I16)
+        BINOP(153, OVMI_VMAX,          OVM_TYPE_I16)
+        BINOP(155, OVMI_VAVGR,         OVM_TYPE_I16)
+
+        UNOP(160,  OVMI_VABS,          OVM_TYPE_I32)
+        UNOP(161,  OVMI_VNEG,          OVM_TYPE_I32)
+        UNOP(162,  OVMI_VANY_TRUE,     OVM_TYPE_NONE)
+        UNOP(163,  OVMI_VALL_TRUE,     OVM_TYPE_I32)
+        UNOP(164,  OVMI_VBITMASK,      OVM_TYPE_I32)
+        UNOP(167,  OVMI_VWIDEN_LOW_S,  OVM_TYPE_I32)
+        UNOP(168,  OVMI_VWIDEN_HIGH_S, OVM_TYPE_I32)
+        UNOP(169,  OVMI_VWIDEN_LOW,    OVM_TYPE_I32)
+        UNOP(170,  OVMI_VWIDEN_HIGH,   OVM_TYPE_I32)
+        BINOP(171, OVMI_VSHL,          OVM_TYPE_I32)
+        BINOP(172, OVMI_VSAR,          OVM_TYPE_I32)
+        BINOP(173, OVMI_VSHR,          OVM_TYPE_I32)
+        BINOP(174, OVMI_VADD,          OVM_TYPE_I32)
+        BINOP(177, OVMI_VSUB,          OVM_TYPE_I32)
+        BINOP(181, OVMI_VMUL,          OVM_TYPE_I32)
+        BINOP(182, OVMI_VMIN_S,        OVM_TYPE_I32)
+        BINOP(183, OVMI_VMIN,          OVM_TYPE_I32)
+        BINOP(184, OVMI_VMAX_S,        OVM_TYPE_I32)
+        BINOP(185, OVMI_VMAX,          OVM_TYPE_I32)
+
+        UNOP(192,  OVMI_VABS,          OVM_TYPE_I64)
+        UNOP(193,  OVMI_VNEG,          OVM_TYPE_I64)
+        UNOP(195,  OVMI_VALL_TRUE,     OVM_TYPE_I64)
+        UNOP(196,  OVMI_VBITMASK,      OVM_TYPE_I64)
+        UNOP(199,  OVMI_VWIDEN_LOW_S,  OVM_TYPE_I64)
+        UNOP(200,  OVMI_VWIDEN_HIGH_S, OVM_TYPE_I64)
+        UNOP(201,  OVMI_VWIDEN_LOW,    OVM_TYPE_I64)
+        UNOP(202,  OVMI_VWIDEN_HIGH,   OVM_TYPE_I64)
+        BINOP(203, OVMI_VSHL,          OVM_TYPE_I64)
+        BINOP(204, OVMI_VSAR,          OVM_TYPE_I64)
+        BINOP(205, OVMI_VSHR,          OVM_TYPE_I64)
+        BINOP(206, OVMI_VADD,          OVM_TYPE_I64)
+        BINOP(209, OVMI_VSUB,          OVM_TYPE_I64)
+        BINOP(213, OVMI_VMUL,          OVM_TYPE_I64)
+        BINOP(214, OVMI_VEQ,           OVM_TYPE_I64)
+        BINOP(215, OVMI_VNE,           OVM_TYPE_I64)
+        BINOP(216, OVMI_VLT_S,         OVM_TYPE_I64)
+        BINOP(217, OVMI_VGT_S,         OVM_TYPE_I64)
+        BINOP(218, OVMI_VLE_S,         OVM_TYPE_I64)
+        BINOP(219, OVMI_VGE_S,         OVM_TYPE_I64)
+
+#define FLOAT_ARITHMETIC(base, type) \
+        UNOP(base + 0,  OVMI_VABS,  type) \
+        UNOP(base + 1,  OVMI_VNEG,  type) \
+        UNOP(base + 3,  OVMI_VSQRT, type) \
+        BINOP(base + 4, OVMI_VADD,  type) \
+        BINOP(base + 5, OVMI_VSUB,  type) \
+        BINOP(base + 6, OVMI_VMUL,  type) \
+        BINOP(base + 7, OVMI_VDIV,  type) \
+        BINOP(base + 8, OVMI_VMIN,  type) \
+        BINOP(base + 9, OVMI_VMAX,  type)
+
+        FLOAT_ARITHMETIC(224, OVM_TYPE_F32)
+        FLOAT_ARITHMETIC(236, OVM_TYPE_F64)
+
+#undef FLOAT_ARITHMETIC
+
+        UNOP(248, OVMI_VTRUNC_SAT_S, OVM_TYPE_I32)
+        UNOP(249, OVMI_VTRUNC_SAT,   OVM_TYPE_I32)
+        UNOP(250, OVMI_VCONVERT_S,   OVM_TYPE_F32)
+        UNOP(251, OVMI_VCONVERT,     OVM_TYPE_F32)
+
+#undef UNOP
+#undef BINOP
+#undef EXTRACT
+#undef REPLACE
+
+        default: assert(0 && "UNHANDLED SIMD INSTRUCTION");
+    }
+}
+
 static void parse_instruction(build_context *ctx) {
     debug_info_builder_step(&ctx->debug_builder);
 
@@ -899,6 +1182,7 @@ static void parse_instruction(build_context *ctx) {
         case 0xC4: ovm_code_builder_add_unop (&ctx->builder, OVM_TYPED_INSTR(OVMI_CVT_I32_S, OVM_TYPE_I64)); break;
 
         case 0xFC: parse_fc_instruction(ctx); break;
+        case 0xFD: parse_fd_instruction(ctx); break;
         case 0xFE: parse_fe_instruction(ctx); break;
 
         default: assert(0 && "UNHANDLED INSTRUCTION");
@@ -911,8 +1195,68 @@ static void parse_expression(build_context *ctx) {
     }
 }
 
+//
+// Translates the function body at the current offset, starting at its
+// locals. The code is added to the end of the program.
+static void translate_function_body(build_context *ctx, i32 code_idx, i32 func_idx, i32 *start_instr, i32 *value_number_count) {
+    unsigned int local_sections_count = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+
+    unsigned int total_locals = 0;
+    fori (j, 0, (int) local_sections_count) {
+        unsigned int local_count = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+        wasm_valkind_t valtype = parse_valtype(ctx);
+
+        total_locals += local_count;
+    }
+
+    // Set up a lot of stuff...
+
+    i32 param_count  = ctx->module->functypes.data[code_idx]->type.func.params.size;
+    i32 result_count = ctx->module->functypes.data[code_idx]->type.func.results.size;
+
+    debug_info_builder_begin_func(&ctx->debug_builder, func_idx);
+
+    ctx->builder = ovm_code_builder_new(ctx->program, &ctx->debug_builder, param_count, result_count, total_locals);
+    ctx->builder.func_table_arr_idx = ctx->func_table_arr_idx;
+
+    ovm_code_builder_push_label_target(&ctx->builder, label_kind_func);
+    parse_expression(ctx);
+    ovm_code_builder_add_return(&ctx->builder);
+
+    *start_instr = ctx->builder.start_instr;
+    *value_number_count = ctx->builder.highest_value_number + 1;
+
+    ovm_code_builder_free(&ctx->builder);
+    debug_info_builder_end_func(&ctx->debug_builder);
+}
+
+//
+// The translate_func of a program whose functions are translated lazily.
+// This runs with the program's translate_mutex held.
+static bool translate_lazy_func(void *userdata, i32 func_idx, i32 *start_instr, i32 *value_number_count) {
+    wasm_module_t *module = userdata;
+
+    i32 code_idx = func_idx - module->lazy_func_base;
+    if (code_idx < 0 || code_idx >= (i32) module->functypes.size) return false;
+
+    build_context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.binary  = module->lazy_code;
+    ctx.offset  = module->lazy_body_offsets[code_idx];
+    ctx.module  = module;
+    ctx.program = module->program;
+    ctx.store   = module->store->engine->store;
+    ctx.func_table_arr_idx = module->func_table_arr_idx;
+
+    debug_info_builder_init(&ctx.debug_builder, &module->debug_info);
+
+    translate_function_body(&ctx, code_idx, func_idx, start_instr, value_number_count);
+    return true;
+}
+
 static void parse_code_section(build_context *ctx) {
     unsigned int section_size = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+    unsigned int end_of_section = ctx->offset + section_size;
     unsigned int code_count = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
     assert(ctx->module->functypes.size == code_count);
 
@@ -921,40 +1265,44 @@ static void parse_code_section(build_context *ctx) {
     // HACK HACK HACK THIS IS SUCH A BAD WAY OF DOING THIS
     ctx->module->memory_init_idx = bh_arr_length(ctx->program->funcs) + code_count;
 
-    fori (i, 0, (int) code_count) {
-        unsigned int code_size = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
-        unsigned int local_sections_count = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+    if (ctx->lazy) {
+        //
+        // Only find where each body starts. The section is copied, because
+        // the module binary does not have to outlive the module.
+        ctx->module->lazy_func_base = bh_arr_length(ctx->program->funcs);
+        ctx->module->func_table_arr_idx = ctx->func_table_arr_idx;
+        ctx->module->lazy_body_offsets = malloc(sizeof(unsigned int) * code_count);
 
-        unsigned int total_locals = 0;
-        fori (j, 0, (int) local_sections_count) {
-            unsigned int local_count = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
-            wasm_valkind_t valtype = parse_valtype(ctx);
+        unsigned int section_start = ctx->offset;
+        wasm_byte_vec_new(&ctx->module->lazy_code, end_of_section - section_start, &ctx->binary.data[section_start]);
 
-            total_locals += local_count;
-        }
+        fori (i, 0, (int) code_count) {
+            unsigned int code_size = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
+            ctx->module->lazy_body_offsets[i] = ctx->offset - section_start;
+            ctx->offset += code_size;
 
-        // Set up a lot of stuff...
+            i32 param_count = ctx->module->functypes.data[i]->type.func.params.size;
 
-        i32 func_idx = bh_arr_length(ctx->program->funcs);
-        i32 param_count  = ctx->module->functypes.data[i]->type.func.params.size;
-        i32 result_count = ctx->module->functypes.data[i]->type.func.results.size;
+            char *func_name = bh_aprintf(bh_heap_allocator(), "wasm_loaded_%d", bh_arr_length(ctx->program->funcs));
+            ovm_program_register_lazy_func(ctx->program, func_name, param_count);
+        }
 
-        debug_info_builder_begin_func(&ctx->debug_builder, func_idx);
+        goto register_memory_init;
+    }
 
-        ctx->builder = ovm_code_builder_new(ctx->program, &ctx->debug_builder, param_count, result_count, total_locals);
-        ctx->builder.func_table_arr_idx = ctx->func_table_arr_idx;
+    fori (i, 0, (int) code_count) {
+        unsigned int code_size = uleb128_to_uint((u8 *)ctx->binary.data, (i32 *)&ctx->offset);
 
-        ovm_code_builder_push_label_target(&ctx->builder, label_kind_func);
-        parse_expression(ctx);
-        ovm_code_builder_add_return(&ctx->builder);
+        i32 func_idx = bh_arr_length(ctx->program->funcs);
+        i32 start_instr, value_number_count;
+        translate_function_body(ctx, i, func_idx, &start_instr, &value_number_count);
 
         char *func_name = bh_aprintf(bh_heap_allocator(), "wasm_loaded_%d", func_idx);
-        ovm_program_register_func(ctx->program, func_name, ctx->builder.start_instr, ctx->builder.param_count, ctx->builder.highest_value_number + 1);
-
-        ovm_code_builder_free(&ctx->builder);
-        debug_info_builder_end_func(&ctx->debug_builder);
+        i32 param_count = ctx->module->functypes.data[i]->type.func.params.size;
+        ovm_program_register_func(ctx->program, func_name, start_instr, param_count, value_number_count);
     }
 
+  register_memory_init:
     ovm_program_register_external_func(ctx->program, "__internal_wasm_memory_init", 4, ctx->module->memory_init_external_idx);
 }
 
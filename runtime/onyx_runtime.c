@@ -22,11 +22,15 @@
     #include <poll.h>
     #include <termios.h>
     #include <sys/ioctl.h>
+    #include <sys/uio.h>
+    #include <sys/mman.h>
     #include <unistd.h>
 #endif
 
 #if defined(_BH_LINUX)
     #include <linux/futex.h>
+    #include <sys/epoll.h>
+    #include <linux/io_uring.h>
 #endif
 
 #if defined(_BH_DARWIN)
@@ -42,6 +46,7 @@
 #include "src/ort_os.h"
 #include "src/ort_cptr.h"
 #include "src/ort_tty.h"
+#include "src/ort_uring.h"
 
 #if defined(_BH_LINUX) || defined(_BH_DARWIN)
 #include "src/ort_net_linux.h"
@@ -62,11 +67,31 @@ ONYX_LIBRARY {
     ONYX_FUNC(__file_tell)
     ONYX_FUNC(__file_read)
     ONYX_FUNC(__file_write)
+    ONYX_FUNC(__file_pread)
+    ONYX_FUNC(__file_pwrite)
+    ONYX_FUNC(__file_readv)
+    ONYX_FUNC(__file_writev)
     ONYX_FUNC(__file_flush)
     ONYX_FUNC(__file_size)
+    ONYX_FUNC(__file_mmap)
+    ONYX_FUNC(__file_munmap)
+    ONYX_FUNC(__file_madvise)
+    ONYX_FUNC(__file_msync)
+    ONYX_FUNC(__file_page_size)
     ONYX_FUNC(__file_get_standard)
     ONYX_FUNC(__file_rename)
     ONYX_FUNC(__poll)
+    ONYX_FUNC(__poller_create)
+    ONYX_FUNC(__poller_close)
+    ONYX_FUNC(__poller_add)
+    ONYX_FUNC(__poller_modify)
+    ONYX_FUNC(__poller_remove)
+    ONYX_FUNC(__poller_wait)
+
+    ONYX_FUNC(__uring_create)
+    ONYX_FUNC(__uring_destroy)
+    ONYX_FUNC(__uring_submit)
+    ONYX_FUNC(__uring_wait)
 
     ONYX_FUNC(__dir_open)
     ONYX_FUNC(__dir_read)
@@ -10,29 +10,24 @@ ONYX_DEF(__cptr_make, (WASM_I32), (WASM_I64)) {
     return NULL;
 }
 
-ONYX_DEF(__cptr_read, (WASM_I64, WASM_I32, WASM_I32), ()) {
-    memcpy(ONYX_PTR(params->data[1].of.i32), (void *) params->data[0].of.i64, params->data[2].of.i32);
-    return NULL;
+ONYX_DEF_DIRECT(__cptr_read, (WASM_I64, WASM_I32, WASM_I32), ()) {
+    memcpy(ONYX_DIRECT_PTR(params[1].i32), (void *) params[0].i64, params[2].i32);
 }
 
-ONYX_DEF(__cptr_read_u8, (WASM_I64), (WASM_I32)) {
-    results->data[0] = WASM_I32_VAL(*(u8 *) params->data[0].of.i64);
-    return NULL;
+ONYX_DEF_DIRECT(__cptr_read_u8, (WASM_I64), (WASM_I32)) {
+    results[0].i32 = *(u8 *) params[0].i64;
 }
 
-ONYX_DEF(__cptr_read_u16, (WASM_I64), (WASM_I32)) {
-    results->data[0] = WASM_I32_VAL(*(u16 *) params->data[0].of.i64);
-    return NULL;
+ONYX_DEF_DIRECT(__cptr_read_u16, (WASM_I64), (WASM_I32)) {
+    results[0].i32 = *(u16 *) params[0].i64;
 }
 
-ONYX_DEF(__cptr_read_u32, (WASM_I64), (WASM_I32)) {
-    results->data[0] = WASM_I32_VAL(*(u32 *) params->data[0].of.i64);
-    return NULL;
+ONYX_DEF_DIRECT(__cptr_read_u32, (WASM_I64), (WASM_I32)) {
+    results[0].i32 = *(u32 *) params[0].i64;
 }
 
-ONYX_DEF(__cptr_read_u64, (WASM_I64), (WASM_I64)) {
-    results->data[0] = WASM_I64_VAL(*(u64 *) params->data[0].of.i64);
-    return NULL;
+ONYX_DEF_DIRECT(__cptr_read_u64, (WASM_I64), (WASM_I64)) {
+    results[0].i64 = *(u64 *) params[0].i64;
 }
 
 ONYX_DEF(__cptr_extract_str, (WASM_I64, WASM_I32, WASM_I32), (WASM_I32)) {
@@ -26,6 +26,7 @@ ONYX_DEF(__file_open_impl, (WASM_I32, WASM_I32, WASM_I32, WASM_I32), (WASM_I32))
         case 1: bh_mode = BH_FILE_MODE_READ; break;
         case 2: bh_mode = BH_FILE_MODE_WRITE; break;
         case 3: bh_mode = BH_FILE_MODE_APPEND; break;
+        case 4: bh_mode = BH_FILE_MODE_READ | BH_FILE_MODE_RW; break;
     }
 
     bh_file file;
@@ -99,10 +100,10 @@ ONYX_DEF(__file_remove, (WASM_I32, WASM_I32), (WASM_I32)) {
     return NULL;
 }
 
-ONYX_DEF(__file_seek, (WASM_I64, WASM_I32, WASM_I32), (WASM_I32)) {
-    i64 fd = params->data[0].of.i64;
-    i32 offset = params->data[1].of.i32;
-    i32 whence = params->data[2].of.i32;
+ONYX_DEF_DIRECT(__file_seek, (WASM_I64, WASM_I32, WASM_I32), (WASM_I32)) {
+    i64 fd = params[0].i64;
+    i32 offset = params[1].i32;
+    i32 whence = params[2].i32;
 
     bh_file file = { (bh_file_descriptor) fd };
     bh_file_whence bh_whence;
@@ -113,65 +114,318 @@ ONYX_DEF(__file_seek, (WASM_I64, WASM_I32, WASM_I32), (WASM_I32)) {
     }
 
     i64 new_offset = bh_file_seek(&file, offset, whence);
-    results->data[0] = WASM_I32_VAL((i32) new_offset);
-    return NULL;
+    results[0].i32 = (i32) new_offset;
 }
 
-ONYX_DEF(__file_tell, (WASM_I64), (WASM_I32)) {
-    i64 fd = params->data[0].of.i64;
+ONYX_DEF_DIRECT(__file_tell, (WASM_I64), (WASM_I32)) {
+    i64 fd = params[0].i64;
     bh_file file = { (bh_file_descriptor) fd };
-    results->data[0] = WASM_I32_VAL(bh_file_tell(&file));
-    return NULL;
+    results[0].i32 = bh_file_tell(&file);
 }
 
-ONYX_DEF(__file_read, (WASM_I64, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
-    i64 fd = params->data[0].of.i64;
+//
+// Sequential reads and writes are a single read() or write(), which moves
+// the file's position. The positional variants use pread() and pwrite(), and
+// do not move it. Like read(), all of these can transfer fewer bytes than
+// asked for. On failure, they return io.Error.EOF, as they always have.
+//
+// On Windows, the positional variants do move the file's position.
+//
+
+#define ORT_MAX_IOVECS 64
+
+static b32 ort_file_read(i64 fd, void *buffer, i64 size, i64 offset, i64 *transferred) {
+    #if defined(_BH_LINUX) || defined(_BH_DARWIN)
+    isize res = offset < 0 ? read(fd, buffer, size) : pread(fd, buffer, size, offset);
+    if (res < 0) return 0;
+
+    *transferred = res;
+    return 1;
+    #endif
+
+    #ifdef _BH_WINDOWS
+    OVERLAPPED overlapped = {0};
+    overlapped.Offset     = (DWORD) offset;
+    overlapped.OffsetHigh = (DWORD) (offset >> 32);
+
+    DWORD res = 0;
+    BOOL success = ReadFile((HANDLE) fd, buffer, (DWORD) size, &res, offset < 0 ? NULL : &overlapped);
+    *transferred = res;
+    return success;
+    #endif
+}
+
+static b32 ort_file_write(i64 fd, void *buffer, i64 size, i64 offset, i64 *transferred) {
+    #if defined(_BH_LINUX) || defined(_BH_DARWIN)
+    isize res = offset < 0 ? write(fd, buffer, size) : pwrite(fd, buffer, size, offset);
+    if (res < 0) return 0;
+
+    *transferred = res;
+    return 1;
+    #endif
+
+    #ifdef _BH_WINDOWS
+    OVERLAPPED overlapped = {0};
+    overlapped.Offset     = (DWORD) offset;
+    overlapped.OffsetHigh = (DWORD) (offset >> 32);
+
+    DWORD res = 0;
+    BOOL success = WriteFile((HANDLE) fd, buffer, (DWORD) size, &res, offset < 0 ? NULL : &overlapped);
+    *transferred = res;
+    return success;
+    #endif
+}
+
+//
+// `slices` points to an Onyx `[] [] u8`, which is stored as pairs of 32-bit
+// pointers and lengths. At most ORT_MAX_IOVECS buffers are used per call.
+static b32 ort_file_vectored(i64 fd, u32 *slices, i32 count, b32 writing, char *memory_base, i64 *transferred) {
+    count = bh_min(count, ORT_MAX_IOVECS);
+
+    #if defined(_BH_LINUX) || defined(_BH_DARWIN)
+    struct iovec iov[ORT_MAX_IOVECS];
+    fori (i, 0, count) {
+        iov[i].iov_base = memory_base + slices[2 * i];
+        iov[i].iov_len  = slices[2 * i + 1];
+    }
+
+    isize res = writing ? writev(fd, iov, count) : readv(fd, iov, count);
+    if (res < 0) return 0;
+
+    *transferred = res;
+    return 1;
+    #endif
+
+    #ifdef _BH_WINDOWS
+    *transferred = 0;
+    fori (i, 0, count) {
+        i64 n = 0;
+        void *buffer = memory_base + slices[2 * i];
+        b32 success = writing
+            ? ort_file_write(fd, buffer, slices[2 * i + 1], -1, &n)
+            : ort_file_read (fd, buffer, slices[2 * i + 1], -1, &n);
+
+        if (!success) return *transferred > 0;
+
+        *transferred += n;
+        if (n < slices[2 * i + 1]) break;
+    }
+
+    return 1;
+    #endif
+}
+
+ONYX_DEF_DIRECT(__file_read, (WASM_I64, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
+    i64 bytes_read = 0;
+    b32 success = ort_file_read(params[0].i64, ONYX_DIRECT_PTR(params[1].i32), params[2].i32, -1, &bytes_read);
+
+    if (params[3].i32) *(u64 *) ONYX_DIRECT_PTR(params[3].i32) = bytes_read;
+    results[0].i32 = success ? 0 : 2;
+}
+
+ONYX_DEF_DIRECT(__file_write, (WASM_I64, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
+    i64 bytes_wrote = 0;
+    b32 success = ort_file_write(params[0].i64, ONYX_DIRECT_PTR(params[1].i32), params[2].i32, -1, &bytes_wrote);
+
+    if (params[3].i32) *(u64 *) ONYX_DIRECT_PTR(params[3].i32) = bytes_wrote;
+    results[0].i32 = success ? 0 : 2;
+}
+
+ONYX_DEF_DIRECT(__file_pread, (WASM_I64, WASM_I32, WASM_I32, WASM_I64, WASM_I32), (WASM_I32)) {
+    i64 bytes_read = 0;
+    b32 success = ort_file_read(params[0].i64, ONYX_DIRECT_PTR(params[1].i32), params[2].i32, params[3].i64, &bytes_read);
+
+    if (params[4].i32) *(u64 *) ONYX_DIRECT_PTR(params[4].i32) = bytes_read;
+    results[0].i32 = success ? 0 : 2;
+}
+
+ONYX_DEF_DIRECT(__file_pwrite, (WASM_I64, WASM_I32, WASM_I32, WASM_I64, WASM_I32), (WASM_I32)) {
+    i64 bytes_wrote = 0;
+    b32 success = ort_file_write(params[0].i64, ONYX_DIRECT_PTR(params[1].i32), params[2].i32, params[3].i64, &bytes_wrote);
+
+    if (params[4].i32) *(u64 *) ONYX_DIRECT_PTR(params[4].i32) = bytes_wrote;
+    results[0].i32 = success ? 0 : 2;
+}
+
+ONYX_DEF_DIRECT(__file_readv, (WASM_I64, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
+    i64 bytes_read = 0;
+    b32 success = ort_file_vectored(params[0].i64, ONYX_DIRECT_PTR(params[1].i32), params[2].i32, 0, onyx_memory_base, &bytes_read);
+
+    if (params[3].i32) *(u64 *) ONYX_DIRECT_PTR(params[3].i32) = bytes_read;
+    results[0].i32 = success ? 0 : 2;
+}
+
+ONYX_DEF_DIRECT(__file_writev, (WASM_I64, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
+    i64 bytes_wrote = 0;
+    b32 success = ort_file_vectored(params[0].i64, ONYX_DIRECT_PTR(params[1].i32), params[2].i32, 1, onyx_memory_base, &bytes_wrote);
+
+    if (params[3].i32) *(u64 *) ONYX_DIRECT_PTR(params[3].i32) = bytes_wrote;
+    results[0].i32 = success ? 0 : 2;
+}
+
+ONYX_DEF_DIRECT(__file_flush, (WASM_I64), (WASM_I32)) {
+    i64 fd = params[0].i64;
+    bh_file file = { (bh_file_descriptor) fd };
+    bh_file_flush(&file);
+    results[0].i32 = 0;
+}
+
+ONYX_DEF_DIRECT(__file_size, (WASM_I64), (WASM_I64)) {
+    i64 fd = params[0].i64;
     bh_file file = { (bh_file_descriptor) fd };
+    results[0].i64 = bh_file_size(&file);
+}
+
+//
+// Memory-mapped files. A file is mapped over a window of linear memory that
+// the caller has already reserved (the core library takes it from the heap),
+// replacing the pages that were there. Unmapping puts zeroed anonymous pages
+// back, so the window can be freed and reused like any other memory. The
+// window and the file offset must be page-aligned.
+//
+// This relies on linear memory never moving while a mapping exists. OVMwasm
+// tries to reserve the full 4 GiB a 32-bit memory can address when the engine
+// is created, and never moves it after that. If it had to settle for less,
+// growing the memory can move it, so nothing is mapped. Wasmer manages its
+// own memory, so nothing is mapped there either.
+//
+// Not supported on Windows.
+//
 
-    i32 curr_pos = bh_file_tell(&file);
-    b32 success = bh_file_read_at(&file,
-            bh_file_tell(&file),
-            ONYX_PTR(params->data[1].of.i32),
-            params->data[2].of.i32,
-            (i64 *) ONYX_PTR(params->data[3].of.i32));
+#define ORT_MMAP_READ_ONLY     0
+#define ORT_MMAP_COPY_ON_WRITE 1
+#define ORT_MMAP_SHARED        2
 
-    bh_file_seek_to(&file, curr_pos + *(i32 *) ONYX_PTR(params->data[3].of.i32));
+static i64 ort_page_size() {
+    #if defined(_BH_LINUX) || defined(_BH_DARWIN)
+    return sysconf(_SC_PAGESIZE);
+    #endif
+
+    #ifdef _BH_WINDOWS
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+    #endif
+}
+
+// Whether linear memory stays at the same address for the rest of the run.
+// That takes a runtime that never moves it, and the whole 4GiB already
+// reserved, so growing it never needs to remap.
+static b32 ort_memory_never_moves() {
+    if (!runtime->wasm_memory_fixed) return 0;
+
+    return runtime->wasm_memory_data_size(runtime->wasm_memory) >= (1ll << 32);
+}
+
+static b32 ort_mmap_window_valid(i64 addr, i64 length) {
+    if (!ort_memory_never_moves()) return 0;
+
+    i64 memory_size = runtime->wasm_memory_data_size(runtime->wasm_memory);
+    if (addr <= 0 || length <= 0) return 0;
+    if (addr % ort_page_size() != 0) return 0;
+    if (addr + length > memory_size) return 0;
+    return 1;
+}
+
+#if defined(_BH_LINUX) || defined(_BH_DARWIN)
+static b32 ort_mmap_restore(void *addr, i64 length) {
+    void *res = mmap(addr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    return res != MAP_FAILED;
+}
+#endif
+
+ONYX_DEF(__file_mmap, (WASM_I64, WASM_I32, WASM_I32, WASM_I64, WASM_I32), (WASM_I32)) {
+    i64 fd     = params->data[0].of.i64;
+    u32 addr   = params->data[1].of.i32;
+    u32 length = params->data[2].of.i32;
+    i64 offset = params->data[3].of.i64;
+    i32 mode   = params->data[4].of.i32;
 
     results->data[0] = WASM_I32_VAL(0);
-    if (!success) results->data[0] = WASM_I32_VAL(2);
+
+    #if defined(_BH_LINUX) || defined(_BH_DARWIN)
+    if (!ort_mmap_window_valid(addr, length)) return NULL;
+    if (offset < 0 || offset % ort_page_size() != 0) return NULL;
+
+    int prot, flags;
+    switch (mode) {
+        case ORT_MMAP_READ_ONLY:     prot = PROT_READ;              flags = MAP_PRIVATE; break;
+        case ORT_MMAP_COPY_ON_WRITE: prot = PROT_READ | PROT_WRITE; flags = MAP_PRIVATE; break;
+        case ORT_MMAP_SHARED:        prot = PROT_READ | PROT_WRITE; flags = MAP_SHARED;  break;
+        default: return NULL;
+    }
+
+    void *window = ONYX_PTR(addr);
+    if (mmap(window, length, prot, flags | MAP_FIXED, fd, offset) == MAP_FAILED) {
+        // A failed MAP_FIXED mapping is allowed to have unmapped the window.
+        ort_mmap_restore(window, length);
+        return NULL;
+    }
+
+    results->data[0] = WASM_I32_VAL(1);
+    #endif
+
     return NULL;
 }
 
-ONYX_DEF(__file_write, (WASM_I64, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
-    i64 fd = params->data[0].of.i64;
-    bh_file file = { (bh_file_descriptor) fd };
+ONYX_DEF(__file_munmap, (WASM_I32, WASM_I32), (WASM_I32)) {
+    u32 addr   = params->data[0].of.i32;
+    u32 length = params->data[1].of.i32;
+
+    results->data[0] = WASM_I32_VAL(0);
 
-    i32 curr_pos = bh_file_tell(&file);
-    b32 success = bh_file_write_at(&file,
-            bh_file_tell(&file),
-            ONYX_PTR(params->data[1].of.i32),
-            params->data[2].of.i32,
-            (i64 *) ONYX_PTR(params->data[3].of.i32));
+    #if defined(_BH_LINUX) || defined(_BH_DARWIN)
+    if (!ort_mmap_window_valid(addr, length)) return NULL;
 
-    bh_file_seek_to(&file, curr_pos + *(i32 *) ONYX_PTR(params->data[3].of.i32));
+    results->data[0] = WASM_I32_VAL(ort_mmap_restore(ONYX_PTR(addr), length));
+    #endif
+
+    return NULL;
+}
+
+ONYX_DEF(__file_madvise, (WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
+    u32 addr   = params->data[0].of.i32;
+    u32 length = params->data[1].of.i32;
+    i32 advice = params->data[2].of.i32;
 
     results->data[0] = WASM_I32_VAL(0);
-    if (!success) results->data[0] = WASM_I32_VAL(2);
+
+    #if defined(_BH_LINUX) || defined(_BH_DARWIN)
+    if (!ort_mmap_window_valid(addr, length)) return NULL;
+
+    int hint;
+    switch (advice) {
+        case 0: hint = MADV_NORMAL;     break;
+        case 1: hint = MADV_SEQUENTIAL; break;
+        case 2: hint = MADV_RANDOM;     break;
+        case 3: hint = MADV_WILLNEED;   break;
+        case 4: hint = MADV_DONTNEED;   break;
+        default: return NULL;
+    }
+
+    results->data[0] = WASM_I32_VAL(madvise(ONYX_PTR(addr), length, hint) == 0);
+    #endif
+
     return NULL;
 }
 
-ONYX_DEF(__file_flush, (WASM_I64), (WASM_I32)) {
-    i64 fd = params->data[0].of.i64;
-    bh_file file = { (bh_file_descriptor) fd };
-    bh_file_flush(&file);
+ONYX_DEF(__file_msync, (WASM_I32, WASM_I32), (WASM_I32)) {
+    u32 addr   = params->data[0].of.i32;
+    u32 length = params->data[1].of.i32;
+
     results->data[0] = WASM_I32_VAL(0);
+
+    #if defined(_BH_LINUX) || defined(_BH_DARWIN)
+    if (!ort_mmap_window_valid(addr, length)) return NULL;
+
+    results->data[0] = WASM_I32_VAL(msync(ONYX_PTR(addr), length, MS_SYNC) == 0);
+    #endif
+
     return NULL;
 }
 
-ONYX_DEF(__file_size, (WASM_I64), (WASM_I32)) {
-    i64 fd = params->data[0].of.i64;
-    bh_file file = { (bh_file_descriptor) fd };
-    results->data[0] = WASM_I32_VAL(bh_file_size(&file));
+ONYX_DEF(__file_page_size, (), (WASM_I32)) {
+    results->data[0] = WASM_I32_VAL(ort_page_size());
     return NULL;
 }
 
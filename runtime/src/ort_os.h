@@ -37,20 +37,18 @@ ONYX_DEF(__exit, (WASM_I32), ()) {
     return NULL;
 }
 
-ONYX_DEF(__sleep, (WASM_I32), ()) {
+ONYX_DEF_DIRECT(__sleep, (WASM_I32), ()) {
     #if defined(_BH_LINUX) || defined(_BH_DARWIN)
-    usleep(params->data[0].of.i32 * 1000);
+    usleep(params[0].i32 * 1000);
     #endif
 
     #ifdef _BH_WINDOWS
-    Sleep(params->data[0].of.i32);
+    Sleep(params[0].i32);
     #endif
-    return NULL;
 }
 
-ONYX_DEF(__time, (), (WASM_I64)) {
-    results->data[0] = WASM_I64_VAL(bh_time_curr());
-    return NULL;
+ONYX_DEF_DIRECT(__time, (), (WASM_I64)) {
+    results[0].i64 = bh_time_curr();
 }
 
 // ([] PollDescription, timeout: i32) -> void
@@ -99,6 +97,116 @@ ONYX_DEF(__poll, (WASM_I32, WASM_I32, WASM_I32), ()) {
     return NULL;
 }
 
+//
+// A persistent readiness poller, backed by epoll. Unlike __poll, descriptors
+// are registered once, each with a 64-bit value that is handed back when the
+// descriptor is ready, so a wait costs as much as the number of ready
+// descriptors, not the number registered. Only available on Linux; elsewhere
+// __poller_create returns -1, and callers should fall back to __poll.
+//
+// Interest flags:  0x1 read, 0x2 write, 0x4 edge-triggered, 0x8 one-shot.
+// Readiness flags: 0x1 readable, 0x2 writable, 0x4 closed.
+//
+// PollerEvent :: struct { data: u64; readiness: u32; }
+//
+
+#define ORT_MAX_POLLER_EVENTS 1024
+
+#ifdef _BH_LINUX
+static u32 ort_poller_interest_to_epoll(i32 interest) {
+    u32 events = 0;
+    if (interest & 0x1) events |= EPOLLIN;
+    if (interest & 0x2) events |= EPOLLOUT;
+    if (interest & 0x4) events |= EPOLLET;
+    if (interest & 0x8) events |= EPOLLONESHOT;
+    return events;
+}
+
+static b32 ort_poller_ctl(i32 poller, i32 op, i32 fd, i32 interest, u64 data) {
+    struct epoll_event ev;
+    ev.events   = ort_poller_interest_to_epoll(interest);
+    ev.data.u64 = data;
+    return epoll_ctl(poller, op, fd, &ev) == 0;
+}
+#endif
+
+ONYX_DEF(__poller_create, (), (WASM_I32)) {
+    #ifdef _BH_LINUX
+    results->data[0] = WASM_I32_VAL(epoll_create1(EPOLL_CLOEXEC));
+    #else
+    results->data[0] = WASM_I32_VAL(-1);
+    #endif
+
+    return NULL;
+}
+
+ONYX_DEF(__poller_close, (WASM_I32), ()) {
+    #ifdef _BH_LINUX
+    close(params->data[0].of.i32);
+    #endif
+
+    return NULL;
+}
+
+// (poller: i32, fd: i32, interest: i32, data: u64) -> bool
+ONYX_DEF_DIRECT(__poller_add, (WASM_I32, WASM_I32, WASM_I32, WASM_I64), (WASM_I32)) {
+    #ifdef _BH_LINUX
+    results[0].i32 = ort_poller_ctl(params[0].i32, EPOLL_CTL_ADD, params[1].i32, params[2].i32, params[3].u64);
+    #else
+    results[0].i32 = 0;
+    #endif
+}
+
+// (poller: i32, fd: i32, interest: i32, data: u64) -> bool
+ONYX_DEF_DIRECT(__poller_modify, (WASM_I32, WASM_I32, WASM_I32, WASM_I64), (WASM_I32)) {
+    #ifdef _BH_LINUX
+    results[0].i32 = ort_poller_ctl(params[0].i32, EPOLL_CTL_MOD, params[1].i32, params[2].i32, params[3].u64);
+    #else
+    results[0].i32 = 0;
+    #endif
+}
+
+// (poller: i32, fd: i32) -> bool
+ONYX_DEF_DIRECT(__poller_remove, (WASM_I32, WASM_I32), (WASM_I32)) {
+    #ifdef _BH_LINUX
+    results[0].i32 = ort_poller_ctl(params[0].i32, EPOLL_CTL_DEL, params[1].i32, 0, 0);
+    #else
+    results[0].i32 = 0;
+    #endif
+}
+
+// (poller: i32, events: [] PollerEvent, timeout: i32) -> i32
+//
+// Returns the number of events written, or -1 on error. Being interrupted by
+// a signal counts as a wait with no events.
+ONYX_DEF_DIRECT(__poller_wait, (WASM_I32, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
+    #ifdef _BH_LINUX
+    i32 count = bh_min(params[2].i32, ORT_MAX_POLLER_EVENTS);
+    struct epoll_event evs[ORT_MAX_POLLER_EVENTS];
+
+    int res = epoll_wait(params[0].i32, evs, count, params[3].i32);
+    if (res < 0) {
+        results[0].i32 = errno == EINTR ? 0 : -1;
+        return;
+    }
+
+    u8 *out = ONYX_DIRECT_PTR(params[1].i32);
+    fori (i, 0, res) {
+        u32 readiness = 0;
+        if (evs[i].events & EPOLLIN)  readiness |= 0x1;
+        if (evs[i].events & EPOLLOUT) readiness |= 0x2;
+        if (evs[i].events & (EPOLLHUP | EPOLLERR)) readiness |= 0x4;
+
+        *(u64 *) (out + 16 * i)     = evs[i].data.u64;
+        *(u32 *) (out + 16 * i + 8) = readiness;
+    }
+
+    results[0].i32 = res;
+    #else
+    results[0].i32 = -1;
+    #endif
+}
+
 
 ONYX_DEF(__lookup_env, (WASM_I32, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
 
@@ -130,84 +238,106 @@ ONYX_DEF(__lookup_env, (WASM_I32, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
 }
 
 
-ONYX_DEF(__random_get, (WASM_PTR, WASM_I32), ()) {
+ONYX_DEF_DIRECT(__random_get, (WASM_PTR, WASM_I32), ()) {
     #if defined(_BH_LINUX)
-    getrandom(ONYX_PTR(params->data[0].of.i32), params->data[1].of.i32, 0);
+    getrandom(ONYX_DIRECT_PTR(params[0].i32), params[1].i32, 0);
     #endif
 
     #if defined(_BH_DARWIN)
-    SecRandomCopyBytes(NULL, params->data[1].of.i32, ONYX_PTR(params->data[0].of.i32));
+    SecRandomCopyBytes(NULL, params[1].i32, ONYX_DIRECT_PTR(params[0].i32));
     #endif
 
     #ifdef _BH_WINDOWS
     BCRYPT_ALG_HANDLE alg;
     BCryptOpenAlgorithmProvider(&alg, L"SHA256", NULL, 0);
-    BCryptGenRandom(alg, ONYX_PTR(params->data[0].of.i32), params->data[1].of.i32, 0);
+    BCryptGenRandom(alg, ONYX_DIRECT_PTR(params[0].i32), params[1].i32, 0);
     BCryptCloseAlgorithmProvider(alg, 0);
     #endif
-
-    return NULL;
 }
 
 
-ONYX_DEF(__futex_wait, (WASM_PTR, WASM_I32, WASM_I32), (WASM_I32)) {
-    int *addr = ONYX_PTR(params->data[0].of.i32);
+// Mutex, Semaphore and thread joining all wait here, so these are direct, which
+// lets OVM call them without going through wasm_val_t.
+//
+// mutex_unlock wakes on every unlock, even when nobody is waiting. So waiters
+// are counted in buckets hashed by address, and a wake only makes the system
+// call when its bucket has waiters. A waiter is counted before the kernel
+// compares the value, and a waker stores the value before it reads the count,
+// so a wake is only skipped when the waiter will see the new value and not
+// sleep. Collisions only cost an extra system call.
+#if defined(_BH_LINUX)
+#define ORT_FUTEX_BUCKETS 256
+static i32 ort_futex_waiters[ORT_FUTEX_BUCKETS];
+
+static i32 *ort_futex_bucket(int *addr) {
+    return &ort_futex_waiters[((u64) addr >> 2) % ORT_FUTEX_BUCKETS];
+}
+#endif
+
+ONYX_DEF_DIRECT(__futex_wait, (WASM_PTR, WASM_I32, WASM_I32), (WASM_I32)) {
+    int *addr = ONYX_DIRECT_PTR(params[0].i32);
+    i32 expected = params[1].i32;
+    i32 timeout  = params[2].i32;
 
     #if defined(_BH_LINUX)
     struct timespec delay;
 
     struct timespec *t = NULL;
-    if (params->data[2].of.i32 >= 0) {
-        delay.tv_sec  = params->data[2].of.i32 / 1000;
-        delay.tv_nsec = params->data[2].of.i32 * 1000000;
+    if (timeout >= 0) {
+        delay.tv_sec  = timeout / 1000;
+        delay.tv_nsec = (timeout % 1000) * 1000000;
         t = &delay;
     }
 
-    int res = syscall(SYS_futex, addr, FUTEX_WAIT, params->data[1].of.i32, t, NULL, 0);
+    i32 *waiters = ort_futex_bucket(addr);
+    __atomic_fetch_add(waiters, 1, __ATOMIC_SEQ_CST);
+    int res = syscall(SYS_futex, addr, FUTEX_WAIT, expected, t, NULL, 0);
+    __atomic_fetch_sub(waiters, 1, __ATOMIC_SEQ_CST);
 
     if (res == 0) {
-        if (*addr == params->data[1].of.i32) results->data[0] = WASM_I32_VAL(0);
-        else                                 results->data[0] = WASM_I32_VAL(1);
+        if (*addr == expected) results[0].i32 = 0;
+        else                   results[0].i32 = 1;
     }
     if (res == -1) {
-        if (errno == EAGAIN) results->data[0] = WASM_I32_VAL(2);
-        else                 results->data[0] = WASM_I32_VAL(1);
+        if (errno == EAGAIN) results[0].i32 = 2;
+        else                 results[0].i32 = 1;
     }
     #endif
 
     #ifdef _BH_WINDOWS
-    results->data[0] = WASM_I32_VAL(WaitOnAddress(addr, &params->data[1].of.i32, 4, params->data[2].of.i32));
+    results[0].i32 = WaitOnAddress(addr, &expected, 4, timeout);
     #endif
 
     #ifdef _BH_DARWIN
-    results->data[0] = WASM_I32_VAL(0);
+    results[0].i32 = 0;
     #endif
-
-    return NULL;
 }
 
-ONYX_DEF(__futex_wake, (WASM_PTR, WASM_I32), (WASM_I32)) {
-    int *addr = ONYX_PTR(params->data[0].of.i32);
+ONYX_DEF_DIRECT(__futex_wake, (WASM_PTR, WASM_I32), (WASM_I32)) {
+    int *addr = ONYX_DIRECT_PTR(params[0].i32);
+    i32 maximum = params[1].i32;
 
     #if defined(_BH_LINUX)
-    int res = syscall(SYS_futex, addr, FUTEX_WAKE, params->data[1].of.i32, NULL, NULL, 0);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(ort_futex_bucket(addr), __ATOMIC_SEQ_CST) == 0) {
+        results[0].i32 = 0;
+        return;
+    }
 
-    results->data[0] = WASM_I32_VAL(res);
+    results[0].i32 = syscall(SYS_futex, addr, FUTEX_WAKE, maximum, NULL, NULL, 0);
     #endif
 
     #ifdef _BH_WINDOWS
-    for (int i=0; i<params->data[1].of.i32; i++) {
+    for (int i=0; i<maximum; i++) {
         WakeByAddressSingle(addr);
     }
 
-    results->data[0] = WASM_I32_VAL(params->data[1].of.i32);
+    results[0].i32 = maximum;
     #endif
 
     #ifdef _BH_DARWIN
-    results->data[0] = WASM_I32_VAL(params->data[1].of.i32);
+    results[0].i32 = maximum;
     #endif
-
-    return NULL;
 }
 
 
@@ -0,0 +1,285 @@
+
+//
+// Asynchronous I/O with io_uring
+//
+// A ring takes batches of reads and writes on files and sockets, and hands
+// back their results as they complete. The kernel fills buffers in linear
+// memory while the program keeps running, so rings are only made when linear
+// memory can never move (see ort_memory_never_moves). The rings are driven
+// with raw system calls, so liburing is not needed.
+//
+// Only available on Linux. Everywhere else, on kernels where io_uring is
+// missing, disabled, or lacks one of the operations below, and on runtimes
+// that can move linear memory when it grows, __uring_create returns 0, and
+// the core library does the operations synchronously instead.
+//
+// Operation  :: struct { user_data: u64; handle: i64; offset: i64; buffer: [] u8; kind: u32; }
+// Completion :: struct { user_data: u64; result: i32; }
+//
+// Kinds: 0 read, 1 write, 2 recv, 3 send. An offset of -1 uses (and moves) the
+// file's position. A result is the number of bytes transferred, or a negative
+// errno. A ring must only be used by one thread at a time.
+//
+
+#define ORT_URING_OP_SIZE         40
+#define ORT_URING_COMPLETION_SIZE 16
+
+#ifdef _BH_LINUX
+
+typedef struct ort_uring {
+    int fd;
+
+    u32 *sq_head, *sq_tail, *sq_mask, *sq_array;
+    u32 sq_entries;
+    struct io_uring_sqe *sqes;
+
+    u32 *cq_head, *cq_tail, *cq_mask;
+    u32 cq_entries;
+    struct io_uring_cqe *cqes;
+
+    void  *sq_ring;
+    u64    sq_ring_size;
+    void  *cq_ring;
+    u64    cq_ring_size;
+    u64    sqes_size;
+
+    // Submitted, but not yet reaped. This is kept below cq_entries so the
+    // completion queue can never overflow.
+    u32 in_flight;
+} ort_uring;
+
+static void ort_uring_free(ort_uring *ring) {
+    if (ring->sqes)    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+    free(ring);
+}
+
+// Kernels before 5.6 have no probe, and no recv or send either.
+static b32 ort_uring_supports_operations(int fd) {
+    static const u8 needed[] = { IORING_OP_READ, IORING_OP_WRITE, IORING_OP_RECV, IORING_OP_SEND };
+
+    u32 probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_size);
+    if (!probe) return 0;
+
+    b32 supported = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) >= 0;
+    fori (i, 0, (i32) (sizeof(needed) / sizeof(needed[0]))) {
+        if (!supported) break;
+
+        u8 op = needed[i];
+        supported = op < probe->ops_len && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    free(probe);
+    return supported;
+}
+
+static ort_uring *ort_uring_create(u32 entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    int fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0) return NULL;
+
+    if (!ort_uring_supports_operations(fd)) {
+        close(fd);
+        return NULL;
+    }
+
+    ort_uring *ring = calloc(1, sizeof(*ring));
+    if (!ring) {
+        close(fd);
+        return NULL;
+    }
+
+    ring->fd = fd;
+
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(u32);
+    ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sq_ring_size = bh_max(ring->sq_ring_size, ring->cq_ring_size);
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) { ring->sq_ring = NULL; goto failed; }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) { ring->cq_ring = NULL; goto failed; }
+    }
+
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) { ring->sqes = NULL; goto failed; }
+
+    u8 *sq = ring->sq_ring;
+    ring->sq_head    = (u32 *) (sq + p.sq_off.head);
+    ring->sq_tail    = (u32 *) (sq + p.sq_off.tail);
+    ring->sq_mask    = (u32 *) (sq + p.sq_off.ring_mask);
+    ring->sq_array   = (u32 *) (sq + p.sq_off.array);
+    ring->sq_entries = p.sq_entries;
+
+    u8 *cq = ring->cq_ring;
+    ring->cq_head    = (u32 *) (cq + p.cq_off.head);
+    ring->cq_tail    = (u32 *) (cq + p.cq_off.tail);
+    ring->cq_mask    = (u32 *) (cq + p.cq_off.ring_mask);
+    ring->cqes       = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+    ring->cq_entries = p.cq_entries;
+
+    return ring;
+
+  failed:
+    ort_uring_free(ring);
+    return NULL;
+}
+
+static u32 ort_uring_reap(ort_uring *ring, u8 *out, u32 count) {
+    u32 head = *ring->cq_head;
+    u32 tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    u32 reaped = 0;
+    while (head != tail && reaped < count) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        *(u64 *) (out + ORT_URING_COMPLETION_SIZE * reaped)     = cqe->user_data;
+        *(i32 *) (out + ORT_URING_COMPLETION_SIZE * reaped + 8) = cqe->res;
+
+        head++;
+        reaped++;
+    }
+
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    ring->in_flight -= reaped;
+    return reaped;
+}
+
+#endif
+
+ONYX_DEF(__uring_create, (WASM_I32), (WASM_I64)) {
+    results->data[0] = WASM_I64_VAL(0);
+
+    #ifdef _BH_LINUX
+    if (!ort_memory_never_moves()) return NULL;
+
+    ort_uring *ring = ort_uring_create(params->data[0].of.i32);
+    results->data[0] = WASM_I64_VAL((i64) ring);
+    #endif
+
+    return NULL;
+}
+
+ONYX_DEF(__uring_destroy, (WASM_I64), ()) {
+    #ifdef _BH_LINUX
+    ort_uring *ring = (ort_uring *) params->data[0].of.i64;
+    if (ring) ort_uring_free(ring);
+    #endif
+
+    return NULL;
+}
+
+// (ring: i64, ops: [] Operation) -> i32
+//
+// Queues as many of the operations as fit, and submits them with a single
+// system call. Returns how many were taken, or -1 on error, when none were.
+// An operation of an unknown kind is an error, and nothing is taken.
+ONYX_DEF_DIRECT(__uring_submit, (WASM_I64, WASM_I32, WASM_I32), (WASM_I32)) {
+    #ifdef _BH_LINUX
+    static const u8 opcodes[] = { IORING_OP_READ, IORING_OP_WRITE, IORING_OP_RECV, IORING_OP_SEND };
+
+    ort_uring *ring = (ort_uring *) params[0].i64;
+    u8 *ops = ONYX_DIRECT_PTR(params[1].i32);
+    u32 count = params[2].i32;
+
+    u32 first = *ring->sq_tail;
+    u32 tail  = first;
+    u32 head  = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+    u32 space = ring->sq_entries - (tail - head);
+    space = bh_min(space, ring->cq_entries - ring->in_flight);
+    count = bh_min(count, space);
+
+    fori (i, 0, (i32) count) {
+        if (*(u32 *) (ops + ORT_URING_OP_SIZE * i + 32) >= sizeof(opcodes)) {
+            results[0].i32 = -1;
+            return;
+        }
+    }
+
+    fori (i, 0, (i32) count) {
+        u8 *op = ops + ORT_URING_OP_SIZE * i;
+        u32 buffer = *(u32 *) (op + 24);
+        u32 length = *(u32 *) (op + 28);
+
+        u32 index = tail & *ring->sq_mask;
+        struct io_uring_sqe *sqe = &ring->sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+
+        sqe->opcode    = opcodes[*(u32 *) (op + 32)];
+        sqe->fd        = (i32) *(i64 *) (op + 8);
+        sqe->off       = (u64) *(i64 *) (op + 16);
+        sqe->addr      = (u64) ONYX_DIRECT_PTR(buffer);
+        sqe->len       = length;
+        sqe->user_data = *(u64 *) op;
+
+        ring->sq_array[index] = index;
+        tail++;
+    }
+
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+    ring->in_flight += count;
+
+    // The kernel takes every queued entry, even ones from an earlier call
+    // that failed to enter.
+    u32 to_submit = tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (to_submit > 0) {
+        int res = syscall(__NR_io_uring_enter, ring->fd, to_submit, 0, 0, NULL, 0);
+        if (res < 0 && errno != EAGAIN && errno != EBUSY && errno != EINTR) {
+            // Take back the entries from this call that the kernel did not
+            // consume, so they do not run twice when the caller resubmits.
+            i32 consumed = (i32) (__atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) - first);
+            u32 taken = bh_min((u32) bh_max(consumed, 0), count);
+
+            __atomic_store_n(ring->sq_tail, first + taken, __ATOMIC_RELEASE);
+            ring->in_flight -= count - taken;
+
+            results[0].i32 = taken > 0 ? (i32) taken : -1;
+            return;
+        }
+    }
+
+    results[0].i32 = count;
+    #else
+    results[0].i32 = -1;
+    #endif
+}
+
+// (ring: i64, completions: [] Completion, min_complete: i32) -> i32
+//
+// Fills in finished operations, waiting until at least `min_complete` of them
+// are done (or none are left in flight). Returns how many were filled in.
+ONYX_DEF_DIRECT(__uring_wait, (WASM_I64, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
+    #ifdef _BH_LINUX
+    ort_uring *ring = (ort_uring *) params[0].i64;
+    u8 *out = ONYX_DIRECT_PTR(params[1].i32);
+    u32 count = params[2].i32;
+    u32 min_complete = bh_min((u32) params[3].i32, count);
+
+    u32 reaped = ort_uring_reap(ring, out, count);
+    while (reaped < min_complete && ring->in_flight > 0) {
+        u32 wanted = bh_min(min_complete - reaped, ring->in_flight);
+        u32 to_submit = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        int res = syscall(__NR_io_uring_enter, ring->fd, to_submit, wanted, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (res < 0 && errno != EINTR) break;
+
+        reaped += ort_uring_reap(ring, out + ORT_URING_COMPLETION_SIZE * reaped, count - reaped);
+    }
+
+    results[0].i32 = reaped;
+    #else
+    results[0].i32 = 0;
+    #endif
+}
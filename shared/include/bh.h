@@ -857,10 +857,16 @@ static const u64 bh_managed_heap_magic_number = 0x1337cafedeadbeef;
 typedef struct bh_managed_heap__link {
     struct bh_managed_heap__link *prev, *next;
     u64 magic_number;
+    isize size;
 } bh_managed_heap__link;
 
 typedef struct bh_managed_heap {
     bh_managed_heap__link *first;
+
+    // Bytes currently allocated, the most that was ever allocated at once,
+    // and the total over every allocation and resize.
+    isize live_bytes, peak_bytes, total_bytes;
+    u64 allocation_count;
 } bh_managed_heap;
 
 void bh_managed_heap_init(bh_managed_heap* mh);
@@ -1053,6 +1059,10 @@ BH_ALLOCATOR_PROC(bh_heap_allocator_proc) {
 // MANAGED HEAP ALLOCATOR IMPLEMENTATION
 void bh_managed_heap_init(bh_managed_heap* mh) {
     mh->first = NULL;
+    mh->live_bytes = 0;
+    mh->peak_bytes = 0;
+    mh->total_bytes = 0;
+    mh->allocation_count = 0;
 }
 
 void bh_managed_heap_free(bh_managed_heap* mh) {
@@ -1103,6 +1113,8 @@ BH_ALLOCATOR_PROC(bh_managed_heap_allocator_proc) {
         if (old->next) {
             old->next->prev = old->prev;
         }
+
+        mh->live_bytes -= old->size;
     }
 
     bh_managed_heap__link *newptr = bh_heap_allocator_proc(NULL, action, size + sizeof(*old), alignment, old, flags);
@@ -1110,6 +1122,7 @@ BH_ALLOCATOR_PROC(bh_managed_heap_allocator_proc) {
     if (action == bh_allocator_action_alloc || action == bh_allocator_action_resize) {
         if (newptr) {
             newptr->magic_number = bh_managed_heap_magic_number;
+            newptr->size = size;
             newptr->next = mh->first;
             newptr->prev = NULL;
 
@@ -1118,6 +1131,11 @@ BH_ALLOCATOR_PROC(bh_managed_heap_allocator_proc) {
             }
 
             mh->first = newptr;
+
+            mh->live_bytes += size;
+            mh->total_bytes += size;
+            mh->allocation_count += 1;
+            if (mh->live_bytes > mh->peak_bytes) mh->peak_bytes = mh->live_bytes;
         }
     }
 
@@ -2193,6 +2211,12 @@ b32 bh_file_watch_wait(bh_file_watch *w) {
         return 0;
     }
 
+    // Consume the pending events, so the next wait blocks until there are new ones.
+    if (FD_ISSET(w->inotify_fd, &w->fds)) {
+        char buf[4096];
+        (void) read(w->inotify_fd, buf, sizeof(buf));
+    }
+
     FD_ZERO(&w->fds);
     FD_SET(w->inotify_fd, &w->fds);
     FD_SET(w->kill_pipe[0], &w->fds);
@@ -13,6 +13,18 @@
     #define ONYX_IMPORT
 #endif
 
+//
+// Bumped whenever the layout of the structures below changes. Every library
+// exports the version of this header it was built against. Fields are only
+// ever added at the end, so the runtime still loads libraries built against
+// an older version, and refuses ones built against a newer version.
+//
+// 1: Libraries from before the version was exported.
+// 2: WasmFuncDefinition gained `direct`, for ONYX_DEF_DIRECT.
+// 3: OnyxRuntime gained wasm_memory_data_size and wasm_memory_fixed.
+//
+#define ONYX_LIBRARY_VERSION 3
+
 typedef struct OnyxRuntime {
     wasm_instance_t* wasm_instance;
     wasm_module_t* wasm_module;
@@ -44,6 +56,12 @@ typedef struct OnyxRuntime {
     void (*wasm_instance_delete)(wasm_instance_t *instance);
 
     wasm_store_t *wasm_store;
+
+    // Set when linear memory never moves once it has been given its full
+    // size, which is only the case for OVMwasm. Files can only be mapped
+    // into memory that never moves.
+    size_t (*wasm_memory_data_size)(const wasm_memory_t *wasm_memory);
+    int wasm_memory_fixed;
 } OnyxRuntime;
 
 OnyxRuntime* runtime;
@@ -53,6 +71,27 @@ typedef struct WasmValkindBuffer {
     wasm_valkind_t types[20];
 } WasmValkindBuffer;
 
+//
+// The arguments and result of a function defined with ONYX_DEF_DIRECT.
+// This has the same layout as a value in the OVM interpreter, so when
+// running on ovmwasm, the interpreter passes its own values and the base
+// of linear memory straight to the function, without converting them to
+// wasm_val_t's first. On other runtimes, the wasm_val_t's are converted.
+//
+typedef struct OnyxValue {
+    union {
+        int32_t  i32;
+        int64_t  i64;
+        uint32_t u32;
+        uint64_t u64;
+        float    f32;
+        double   f64;
+    };
+    unsigned char type;   // Owned by the runtime; do not set.
+} OnyxValue;
+
+typedef void (*OnyxDirectFunc)(OnyxValue *params, OnyxValue *results, char *memory_base);
+
 typedef struct WasmFuncDefinition {
     char* module_name;
     char* import_name;
@@ -60,6 +99,9 @@ typedef struct WasmFuncDefinition {
 
     WasmValkindBuffer *params;
     WasmValkindBuffer *results;
+
+    // Only set for functions defined with ONYX_DEF_DIRECT.
+    OnyxDirectFunc direct;
 } WasmFuncDefinition;
 
 #define STRINGIFY1(a) #a
@@ -68,10 +110,12 @@ typedef struct WasmFuncDefinition {
 #define CONCAT3(a, b, c) a ## _ ## b ## _ ## c
 #define ONYX_MODULE_NAME_GEN(m) CONCAT2(__onyx_library, m)
 #define ONYX_LINK_NAME_GEN(m) CONCAT2(onyx_library, m)
+#define ONYX_VERSION_NAME_GEN(m) CONCAT2(onyx_library_version, m)
 #define ONYX_FUNC_NAME(m, n) CONCAT3(__onyx_internal, m, n)
 #define ONYX_DEF_NAME(m, n) CONCAT3(__onyx_internal_def, m, n)
 #define ONYX_PARAM_NAME(m, n) CONCAT3(__onyx_internal_param_buffer, m, n)
 #define ONYX_RESULT_NAME(m, n) CONCAT3(__onyx_internal_result_buffer, m, n)
+#define ONYX_DIRECT_NAME(m, n) CONCAT3(__onyx_internal_direct, m, n)
 #define ONYX_IMPORT_NAME(m, n) STRINGIFY1(m) "_" #n
 
 #define NUM_VALS(...) (sizeof((wasm_valkind_t []){ 0, __VA_ARGS__ }) / sizeof(wasm_valkind_t))
@@ -85,9 +129,63 @@ typedef struct WasmFuncDefinition {
     \
     static wasm_trap_t* ONYX_FUNC_NAME(ONYX_LIBRARY_NAME, name)(const wasm_val_vec_t* params, wasm_val_vec_t* results)
 
+//
+// Used when the function is called through the standard C-API, to call a
+// function defined with ONYX_DEF_DIRECT.
+static inline wasm_trap_t* onyx_call_direct(OnyxDirectFunc func, WasmValkindBuffer *result_types, const wasm_val_vec_t* params, wasm_val_vec_t* results) {
+    OnyxValue direct_params[20];
+    OnyxValue direct_result;
+    direct_result.u64 = 0;
+
+    for (unsigned int i = 0; i < params->size && i < 20; i++) {
+        direct_params[i].u64 = 0;
+        switch (params->data[i].kind) {
+            case WASM_I32: direct_params[i].i32 = params->data[i].of.i32; break;
+            case WASM_I64: direct_params[i].i64 = params->data[i].of.i64; break;
+            case WASM_F32: direct_params[i].f32 = params->data[i].of.f32; break;
+            case WASM_F64: direct_params[i].f64 = params->data[i].of.f64; break;
+            default: break;
+        }
+    }
+
+    func(direct_params, &direct_result, runtime->wasm_memory_data(runtime->wasm_memory));
+
+    if (result_types->count > 0) {
+        switch (result_types->types[0]) {
+            case WASM_I32: results->data[0] = WASM_I32_VAL(direct_result.i32); break;
+            case WASM_I64: results->data[0] = WASM_I64_VAL(direct_result.i64); break;
+            case WASM_F32: results->data[0] = WASM_F32_VAL(direct_result.f32); break;
+            case WASM_F64: results->data[0] = WASM_F64_VAL(direct_result.f64); break;
+            default: break;
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Like ONYX_DEF, but the body receives `OnyxValue *params`, `OnyxValue *results`
+// and `char *onyx_memory_base`. Results are written as `results[0].i32 = ...`,
+// and pointers into linear memory are made with ONYX_DIRECT_PTR. The body
+// cannot return a trap.
+//
+#define ONYX_DEF_DIRECT(name, params_types, result_types) \
+    static void ONYX_DIRECT_NAME(ONYX_LIBRARY_NAME, name)(OnyxValue *params, OnyxValue *results, char *onyx_memory_base); \
+    static struct WasmValkindBuffer  ONYX_PARAM_NAME(ONYX_LIBRARY_NAME, name) = _VALS params_types; \
+    static struct WasmValkindBuffer  ONYX_RESULT_NAME(ONYX_LIBRARY_NAME, name) = _VALS result_types; \
+    static wasm_trap_t* ONYX_FUNC_NAME(ONYX_LIBRARY_NAME, name)(const wasm_val_vec_t* params, wasm_val_vec_t* results) { \
+        return onyx_call_direct(ONYX_DIRECT_NAME(ONYX_LIBRARY_NAME, name), & ONYX_RESULT_NAME(ONYX_LIBRARY_NAME, name), params, results); \
+    } \
+    static struct WasmFuncDefinition ONYX_DEF_NAME(ONYX_LIBRARY_NAME, name) = { STRINGIFY2(ONYX_LIBRARY_NAME), #name, ONYX_FUNC_NAME(ONYX_LIBRARY_NAME, name), & ONYX_PARAM_NAME(ONYX_LIBRARY_NAME, name), & ONYX_RESULT_NAME(ONYX_LIBRARY_NAME, name), ONYX_DIRECT_NAME(ONYX_LIBRARY_NAME, name) }; \
+    \
+    static void ONYX_DIRECT_NAME(ONYX_LIBRARY_NAME, name)(OnyxValue *params, OnyxValue *results, char *onyx_memory_base)
+
 #define ONYX_FUNC(name) & ONYX_DEF_NAME(ONYX_LIBRARY_NAME, name),
 #define ONYX_LIBRARY \
     extern struct WasmFuncDefinition *ONYX_MODULE_NAME_GEN(ONYX_LIBRARY_NAME)[]; \
+    ONYX_EXPORT int ONYX_VERSION_NAME_GEN(ONYX_LIBRARY_NAME)() { \
+        return ONYX_LIBRARY_VERSION; \
+    } \
     ONYX_EXPORT WasmFuncDefinition** ONYX_LINK_NAME_GEN(ONYX_LIBRARY_NAME)(OnyxRuntime* in_runtime) { \
         runtime = in_runtime; \
         return ONYX_MODULE_NAME_GEN(ONYX_LIBRARY_NAME); \
@@ -114,6 +212,9 @@ typedef struct WasmFuncDefinition {
 #define ONYX_PTR(p) ((void*) (p != 0 ? (runtime->wasm_memory_data(runtime->wasm_memory) + p) : NULL))
 #define ONYX_UNPTR(p) ((int) (p != NULL ? ((char *) p - runtime->wasm_memory_data(runtime->wasm_memory)) : 0))
 
+// Only usable in the body of an ONYX_DEF_DIRECT function.
+#define ONYX_DIRECT_PTR(p) ((void*) ((p) != 0 ? (onyx_memory_base + (p)) : NULL))
+
 
 //
 // Below are definitions that allow you to use the heap_resize and heap_free